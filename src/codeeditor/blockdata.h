@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QChar>
+#include <QTextBlock>
+#include <QTextBlockUserData>
+#include <QVector>
+
+// Facts derived from a block's text. They are recomputed only when the block
+// itself is edited, so cursor moves and painting never have to re-read it.
+class BlockData : public QTextBlockUserData {
+public:
+  // Brackets outside strings and line comments, in text order. Each entry
+  // packs the bracket's position in the block above its kind, so the list
+  // is a plain sorted integer array that lookups can binary-search.
+  QVector<quint32> brackets;
+  // Nesting depth change across the block (opens minus closes)
+  int depthDelta = 0;
+  // Lowest depth reached inside the block, relative to its start (<= 0)
+  int minDepth = 0;
+
+  // What folding needs to know about this line alone. Recomputed lazily
+  // whenever foldRevision no longer matches QTextBlock::revision().
+  enum FoldFlag : quint8 {
+    BlankLine = 0x01,
+    EndsWithOpenBrace = 0x02,
+    EndsWithCloseBrace = 0x04,
+    DeclarationLike = 0x08, // class/struct/function, or a '('
+    HasParenthesis = 0x10,
+  };
+  int foldRevision = -1;
+  quint8 foldFlags = 0;
+  int indentLevel = 0;
+  int braceDelta = 0; // '{' minus '}'
+
+  static quint32 packBracket(int position, int kind) {
+    return (quint32(position) << 3) | quint32(kind);
+  }
+  static int bracketPosition(quint32 bracket) { return int(bracket >> 3); }
+  // Kinds 0-2 are the openers "([{", 3-5 the matching closers
+  static int bracketKind(quint32 bracket) { return int(bracket & 7); }
+  static bool bracketOpens(quint32 bracket) { return bracketKind(bracket) < 3; }
+  static QChar bracketChar(quint32 bracket) {
+    return QLatin1Char("([{)]}"[bracketKind(bracket)]);
+  }
+
+  static BlockData *get(const QTextBlock &block) {
+    return static_cast<BlockData *>(block.userData());
+  }
+
+  static BlockData *ensure(QTextBlock &block) {
+    BlockData *data = get(block);
+    if (!data) {
+      data = new BlockData;
+      block.setUserData(data); // The document takes ownership
+    }
+    return data;
+  }
+};
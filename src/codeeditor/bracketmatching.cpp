@@ -1,6 +1,10 @@
 #include "bracketmatching.h"
+#include "blockdata.h"
+#include <QTextDocument>
+#include <algorithm>
 
-BracketMatcher::BracketMatcher() : bracketRoot(nullptr) {
+BracketMatcher::BracketMatcher()
+    : m_document(nullptr), m_root(-1), m_seed(0x9E3779B9u) {
   // Initialize bracket pairs
   bracketPairs['{'] = '}';
   bracketPairs['['] = ']';
@@ -21,89 +25,206 @@ BracketMatcher::BracketMatcher() : bracketRoot(nullptr) {
   };
 }
 
-BracketMatcher::~BracketMatcher() { clearBracketTree(); }
+BracketMatcher::~BracketMatcher() = default;
 
-void BracketMatcher::updateBracketTree(const QString &text) {
-  clearBracketTree();
-  bracketRoot = nullptr;
+namespace {
 
-  QVector<BracketPair> openBrackets;
-  int level = 0;
-  bool inString = false;
-  bool inComment = false;
-  QChar stringChar;
+// Quotes are paired while typing but are not nesting brackets, and '<' is
+// far more often a comparison than a template bracket, so only three bracket
+// kinds take part in the depth index. Returns the BlockData bracket kind, or
+// -1 for any other character.
+int scopeKind(QChar ch) {
+  switch (ch.unicode()) {
+  case '(':
+    return 0;
+  case '[':
+    return 1;
+  case '{':
+    return 2;
+  case ')':
+    return 3;
+  case ']':
+    return 4;
+  case '}':
+    return 5;
+  default:
+    return -1;
+  }
+}
 
-  for (int i = 0; i < text.length(); i++) {
-    QChar ch = text[i];
+int depthStep(quint32 bracket) {
+  return BlockData::bracketOpens(bracket) ? 1 : -1;
+}
 
-    // Handle line comments
-    if (ch == '/' && i + 1 < text.length() && text[i + 1] == '/') {
-      inComment = true;
-      continue;
-    }
-    if (ch == '\n') {
-      inComment = false;
-      continue;
-    }
-    if (inComment)
-      continue;
+// Returns the first bracket at or after `from` that brings the depth down to
+// `target`, given the depth just before `from`
+int findCloserForward(const BlockData *data, int from, int depth, int target) {
+  for (int i = from; i < data->brackets.size(); ++i) {
+    depth += depthStep(data->brackets[i]);
+    if (depth == target)
+      return i;
+  }
+  return -1;
+}
 
-    // Handle string literals
-    if ((ch == '"' || ch == '\'' || ch == '`') &&
-        (i == 0 || text[i - 1] != '\\')) {
-      if (!inString) {
-        inString = true;
-        stringChar = ch;
-      } else if (ch == stringChar) {
-        inString = false;
-      }
-      continue;
-    }
-    if (inString)
-      continue;
+// Returns the last bracket before `before` that raised the depth from
+// `target`, given the depth just before `before`
+int findOpenerBackward(const BlockData *data, int before, int depth,
+                       int target) {
+  for (int i = before - 1; i >= 0; --i) {
+    depth -= depthStep(data->brackets[i]);
+    if (depth == target)
+      return i;
+  }
+  return -1;
+}
 
-    // Handle brackets
-    if (isOpenBracket(ch)) {
-      openBrackets.push_back(
-          BracketPair(i, -1, level++, ch, getMatchingBracket(ch)));
-    } else if (isCloseBracket(ch) && !openBrackets.isEmpty()) {
-      // Find matching opening bracket
-      for (int j = openBrackets.size() - 1; j >= 0; j--) {
-        if (openBrackets[j].closePos == -1 && openBrackets[j].closeChar == ch) {
-          openBrackets[j].closePos = i;
-          bracketRoot = insertBracket(bracketRoot, openBrackets[j]);
-          level = j;
-          openBrackets.resize(j);
-          break;
-        }
-      }
-    }
+} // namespace
+
+void BracketMatcher::setDocument(QTextDocument *document) {
+  m_document = document;
+  rebuild();
+}
+
+void BracketMatcher::updateBlocks(int position, int charsRemoved,
+                                  int charsAdded) {
+  Q_UNUSED(charsRemoved);
+  if (!m_document)
+    return;
+
+  int blockCount = m_document->blockCount();
+  int oldBlockCount = sizeOf(m_root);
+  int end = qMin(position + charsAdded, m_document->characterCount() - 1);
+  QTextBlock first = m_document->findBlock(position);
+  QTextBlock last = m_document->findBlock(end);
+  if (!first.isValid() || !last.isValid()) {
+    rebuild();
+    return;
   }
 
-  // Mark remaining unmatched brackets as invalid
-  for (const BracketPair &pair : openBrackets) {
-    if (pair.closePos == -1) {
-      BracketPair invalidPair = pair;
-      invalidPair.isInvalid = true;
-      bracketRoot = insertBracket(bracketRoot, invalidPair);
+  // The edit replaced oldSpan blocks starting at `first` with newSpan blocks
+  int firstNumber = first.blockNumber();
+  int newSpan = last.blockNumber() - firstNumber + 1;
+  int oldSpan = newSpan - (blockCount - oldBlockCount);
+  if (oldSpan < 1 || firstNumber + oldSpan > oldBlockCount) {
+    rebuild();
+    return;
+  }
+
+  if (oldSpan == newSpan) {
+    // Typing within lines: only summaries that actually changed need their
+    // path to the root recomputed
+    QTextBlock block = first;
+    for (int i = 0; i < newSpan; ++i, block = block.next()) {
+      if (scanBlock(block))
+        setSummary(m_root, firstNumber + i, summaryOf(block));
     }
+    return;
+  }
+
+  // Lines were added or removed: cut the old blocks out of the tree and
+  // splice the rescanned ones in. The blocks after the edit are not
+  // touched; their numbers follow from the subtree sizes.
+  int before, rest, removed, after;
+  split(m_root, firstNumber, &before, &rest);
+  split(rest, oldSpan, &removed, &after);
+  freeNodes(removed);
+
+  m_newNodes.clear();
+  QTextBlock block = first;
+  for (int i = 0; i < newSpan; ++i, block = block.next()) {
+    scanBlock(block);
+    m_newNodes.append(allocateNode(summaryOf(block)));
   }
+  m_root = merge(merge(before, build(m_newNodes.constData(), newSpan)), after);
 }
 
-BracketNode *BracketMatcher::findMatchingBracket(int position) const {
-  BracketNode *current = bracketRoot;
-  while (current) {
-    if (position == current->pair.openPos ||
-        position == current->pair.closePos) {
-      return current;
+bool BracketMatcher::findMatchingBracket(int position,
+                                         BracketPair *pair) const {
+  if (!m_document)
+    return false;
+
+  QTextBlock block = m_document->findBlock(position);
+  const BlockData *data = BlockData::get(block);
+  if (!data)
+    return false;
+
+  int positionInBlock = position - block.position();
+  auto it = std::lower_bound(data->brackets.cbegin(), data->brackets.cend(),
+                             BlockData::packBracket(positionInBlock, 0));
+  if (it == data->brackets.cend() ||
+      BlockData::bracketPosition(*it) != positionInBlock)
+    return false;
+
+  int index = int(it - data->brackets.cbegin());
+  int blockNumber = block.blockNumber();
+  int depth = depthAtBlock(blockNumber);
+  for (int i = 0; i < index; ++i)
+    depth += depthStep(data->brackets[i]);
+
+  QChar ch = BlockData::bracketChar(*it);
+  if (BlockData::bracketOpens(*it)) {
+    // The pair closes where the depth first returns to its value before
+    // the opener
+    *pair = BracketPair(position, -1, qMax(depth, 0), ch,
+                        getMatchingBracket(ch));
+    const BlockData *closeData = data;
+    int closeBlockStart = block.position();
+    int found = findCloserForward(data, index + 1, depth + 1, depth);
+    if (found == -1) {
+      int blockDepth = 0;
+      int number =
+          findFirstBlock(m_root, 0, blockNumber + 1, depth, &blockDepth);
+      if (number != -1) {
+        QTextBlock closeBlock = m_document->findBlockByNumber(number);
+        closeData = BlockData::get(closeBlock);
+        closeBlockStart = closeBlock.position();
+        if (closeData)
+          found = findCloserForward(closeData, 0, blockDepth, depth);
+      }
     }
-    if (position < current->pair.openPos) {
-      current = current->left;
-    } else {
-      current = current->right;
+    if (found == -1) {
+      pair->isInvalid = true;
+      return true;
     }
+    quint32 close = closeData->brackets[found];
+    pair->closePos = closeBlockStart + BlockData::bracketPosition(close);
+    pair->closeChar = BlockData::bracketChar(close);
+    pair->isInvalid = !isMatchingPair(pair->openChar, pair->closeChar);
+    return true;
   }
-  return nullptr;
+
+  // A closer pairs with the last opener that left the depth one below the
+  // closer's
+  int target = depth - 1;
+  *pair = BracketPair(-1, position, qMax(target, 0),
+                      getMatchingBracket(ch), ch);
+  const BlockData *openData = data;
+  int openBlockStart = block.position();
+  int found = findOpenerBackward(data, index, depth, target);
+  if (found == -1) {
+    int number = findLastBlock(m_root, 0, blockNumber, target, 0);
+    if (number != -1) {
+      QTextBlock openBlock = m_document->findBlockByNumber(number);
+      openData = BlockData::get(openBlock);
+      openBlockStart = openBlock.position();
+      if (openData)
+        found = findOpenerBackward(
+            openData, openData->brackets.size(),
+            depthAtBlock(number) + openData->depthDelta, target);
+    }
+  }
+  if (found == -1) {
+    pair->openPos = position;
+    pair->closePos = -1;
+    pair->isInvalid = true;
+    return true;
+  }
+  quint32 open = openData->brackets[found];
+  pair->openPos = openBlockStart + BlockData::bracketPosition(open);
+  pair->openChar = BlockData::bracketChar(open);
+  pair->isInvalid = !isMatchingPair(pair->openChar, pair->closeChar);
+  return true;
 }
 
 QColor BracketMatcher::getBracketColor(int level) const {
@@ -112,98 +233,265 @@ QColor BracketMatcher::getBracketColor(int level) const {
   return bracketColors[level % bracketColors.size()];
 }
 
-void BracketMatcher::clearBracketTree() {
-  clearBracketTree(bracketRoot);
-  bracketRoot = nullptr;
+void BracketMatcher::rebuild() {
+  m_nodes.clear();
+  m_freeNodes.clear();
+  m_root = -1;
+  if (!m_document)
+    return;
+
+  m_nodes.reserve(m_document->blockCount());
+  m_newNodes.clear();
+  for (QTextBlock block = m_document->begin(); block.isValid();
+       block = block.next()) {
+    scanBlock(block);
+    m_newNodes.append(allocateNode(summaryOf(block)));
+  }
+  m_root = build(m_newNodes.constData(), m_newNodes.size());
 }
 
-BracketNode *BracketMatcher::insertBracket(BracketNode *node,
-                                           const BracketPair &pair) {
-  if (!node) {
-    return new BracketNode(pair);
-  }
+bool BracketMatcher::scanBlock(QTextBlock &block) {
+  m_scratch.clear();
+  const QString text = block.text();
+  bool inString = false;
+  QChar stringChar;
+  int depth = 0;
+  int minDepth = 0;
 
-  if (pair.openPos < node->pair.openPos) {
-    node->left = insertBracket(node->left, pair);
-  } else if (pair.openPos > node->pair.openPos) {
-    node->right = insertBracket(node->right, pair);
-  } else {
-    return node;
-  }
+  for (int i = 0; i < text.length(); i++) {
+    QChar ch = text[i];
 
-  node->height = 1 + qMax(getHeight(node->left), getHeight(node->right));
+    // Line comments end the scan
+    if (!inString && ch == '/' && i + 1 < text.length() && text[i + 1] == '/')
+      break;
 
-  int balance = getBalance(node);
+    // String literals
+    if ((ch == '"' || ch == '\'' || ch == '`') &&
+        (i == 0 || text[i - 1] != '\\')) {
+      if (!inString) {
+        inString = true;
+        stringChar = ch;
+      } else if (ch == stringChar) {
+        inString = false;
+      }
+      continue;
+    }
+    if (inString)
+      continue;
 
-  // Left Left Case
-  if (balance > 1 && pair.openPos < node->left->pair.openPos) {
-    return rotateRight(node);
+    int kind = scopeKind(ch);
+    if (kind < 0)
+      continue;
+    m_scratch.append(BlockData::packBracket(i, kind));
+    if (kind < 3)
+      ++depth;
+    else
+      minDepth = qMin(minDepth, --depth);
   }
 
-  // Right Right Case
-  if (balance < -1 && pair.openPos > node->right->pair.openPos) {
-    return rotateLeft(node);
+  // Most edits do not touch a bracket, so compare before storing, and copy
+  // into the block's existing buffer rather than sharing the scratch one
+  BlockData *data = BlockData::ensure(block);
+  if (data->brackets != m_scratch) {
+    data->brackets.resize(m_scratch.size());
+    std::copy(m_scratch.cbegin(), m_scratch.cend(), data->brackets.begin());
   }
+  bool summaryChanged =
+      data->depthDelta != depth || data->minDepth != minDepth;
+  data->depthDelta = depth;
+  data->minDepth = minDepth;
+  return summaryChanged;
+}
 
-  // Left Right Case
-  if (balance > 1 && pair.openPos > node->left->pair.openPos) {
-    node->left = rotateLeft(node->left);
-    return rotateRight(node);
+BracketMatcher::Summary BracketMatcher::summaryOf(const QTextBlock &block) {
+  Summary summary;
+  if (const BlockData *data = BlockData::get(block)) {
+    summary.depthDelta = data->depthDelta;
+    summary.minDepth = data->minDepth;
   }
+  return summary;
+}
 
-  // Right Left Case
-  if (balance < -1 && pair.openPos < node->right->pair.openPos) {
-    node->right = rotateRight(node->right);
-    return rotateLeft(node);
-  }
+BracketMatcher::Summary BracketMatcher::combine(const Summary &left,
+                                                const Summary &right) {
+  Summary summary;
+  summary.depthDelta = left.depthDelta + right.depthDelta;
+  summary.minDepth = qMin(left.minDepth, left.depthDelta + right.minDepth);
+  return summary;
+}
 
+int BracketMatcher::allocateNode(const Summary &summary) {
+  int node;
+  if (!m_freeNodes.isEmpty()) {
+    node = m_freeNodes.takeLast();
+  } else {
+    node = m_nodes.size();
+    m_nodes.append(Node());
+  }
+  // xorshift32; the priorities only have to look random to the edits
+  m_seed ^= m_seed << 13;
+  m_seed ^= m_seed >> 17;
+  m_seed ^= m_seed << 5;
+
+  Node &n = m_nodes[node];
+  n.block = summary;
+  n.subtree = summary;
+  n.size = 1;
+  n.priority = m_seed;
+  n.left = -1;
+  n.right = -1;
   return node;
 }
 
-int BracketMatcher::getHeight(BracketNode *node) const {
-  if (!node)
-    return 0;
-  return node->height;
+void BracketMatcher::freeNodes(int node) {
+  if (node < 0)
+    return;
+  freeNodes(m_nodes[node].left);
+  freeNodes(m_nodes[node].right);
+  m_freeNodes.append(node);
 }
 
-int BracketMatcher::getBalance(BracketNode *node) const {
-  if (!node)
-    return 0;
-  return getHeight(node->left) - getHeight(node->right);
+void BracketMatcher::pull(int node) {
+  Node &n = m_nodes[node];
+  n.size = sizeOf(n.left) + 1 + sizeOf(n.right);
+  n.subtree = combine(combine(subtreeOf(n.left), n.block), subtreeOf(n.right));
 }
 
-BracketNode *BracketMatcher::rotateLeft(BracketNode *x) {
-  BracketNode *y = x->right;
-  BracketNode *T2 = y->left;
-
-  y->left = x;
-  x->right = T2;
-
-  x->height = 1 + qMax(getHeight(x->left), getHeight(x->right));
-  y->height = 1 + qMax(getHeight(y->left), getHeight(y->right));
+void BracketMatcher::siftDown(int node) {
+  while (true) {
+    const Node &n = m_nodes[node];
+    int highest = node;
+    if (n.left >= 0 && m_nodes[n.left].priority > m_nodes[highest].priority)
+      highest = n.left;
+    if (n.right >= 0 && m_nodes[n.right].priority > m_nodes[highest].priority)
+      highest = n.right;
+    if (highest == node)
+      return;
+    std::swap(m_nodes[node].priority, m_nodes[highest].priority);
+    node = highest;
+  }
+}
 
-  return y;
+int BracketMatcher::build(const int *nodes, int count) {
+  if (count <= 0)
+    return -1;
+  int mid = count / 2;
+  int node = nodes[mid];
+  m_nodes[node].left = build(nodes, mid);
+  m_nodes[node].right = build(nodes + mid + 1, count - mid - 1);
+  pull(node);
+  siftDown(node);
+  return node;
 }
 
-BracketNode *BracketMatcher::rotateRight(BracketNode *y) {
-  BracketNode *x = y->left;
-  BracketNode *T2 = x->right;
+void BracketMatcher::split(int node, int count, int *left, int *right) {
+  if (node < 0) {
+    *left = -1;
+    *right = -1;
+    return;
+  }
+  Node &n = m_nodes[node];
+  int leftSize = sizeOf(n.left);
+  if (count <= leftSize) {
+    split(n.left, count, left, &n.left);
+    *right = node;
+  } else {
+    split(n.right, count - leftSize - 1, &n.right, right);
+    *left = node;
+  }
+  pull(node);
+}
 
-  x->right = y;
-  y->left = T2;
+int BracketMatcher::merge(int left, int right) {
+  if (left < 0)
+    return right;
+  if (right < 0)
+    return left;
+  if (m_nodes[left].priority > m_nodes[right].priority) {
+    int merged = merge(m_nodes[left].right, right);
+    m_nodes[left].right = merged;
+    pull(left);
+    return left;
+  }
+  int merged = merge(left, m_nodes[right].left);
+  m_nodes[right].left = merged;
+  pull(right);
+  return right;
+}
 
-  y->height = 1 + qMax(getHeight(y->left), getHeight(y->right));
-  x->height = 1 + qMax(getHeight(x->left), getHeight(x->right));
+void BracketMatcher::setSummary(int node, int blockNumber,
+                                const Summary &summary) {
+  if (node < 0)
+    return;
+  Node &n = m_nodes[node];
+  int leftSize = sizeOf(n.left);
+  if (blockNumber < leftSize)
+    setSummary(n.left, blockNumber, summary);
+  else if (blockNumber > leftSize)
+    setSummary(n.right, blockNumber - leftSize - 1, summary);
+  else
+    n.block = summary;
+  pull(node);
+}
 
-  return x;
+int BracketMatcher::depthAtBlock(int blockNumber) const {
+  int depth = 0;
+  int node = m_root;
+  while (node >= 0 && blockNumber > 0) {
+    const Node &n = m_nodes[node];
+    int leftSize = sizeOf(n.left);
+    if (blockNumber <= leftSize) {
+      node = n.left;
+      continue;
+    }
+    depth += subtreeOf(n.left).depthDelta + n.block.depthDelta;
+    blockNumber -= leftSize + 1;
+    node = n.right;
+  }
+  return depth;
 }
 
-void BracketMatcher::clearBracketTree(BracketNode *node) {
-  if (node) {
-    clearBracketTree(node->left);
-    clearBracketTree(node->right);
-    delete node;
+// First block at or after `from` in which the depth drops to `target`.
+// `offset` is the number of the subtree's first block, and `depth` holds
+// the depth at its start and is advanced past every block that is skipped.
+int BracketMatcher::findFirstBlock(int node, int offset, int from, int target,
+                                   int *depth) const {
+  if (node < 0)
+    return -1;
+  const Node &n = m_nodes[node];
+  if (offset + n.size <= from ||
+      (offset >= from && *depth + n.subtree.minDepth > target)) {
+    *depth += n.subtree.depthDelta;
+    return -1;
   }
+  int found = findFirstBlock(n.left, offset, from, target, depth);
+  if (found != -1)
+    return found;
+  int number = offset + sizeOf(n.left);
+  if (number >= from && *depth + n.block.minDepth <= target)
+    return number;
+  *depth += n.block.depthDelta;
+  return findFirstBlock(n.right, number + 1, from, target, depth);
+}
+
+// Last block before `before` in which the depth drops to `target`; `depth`
+// is the depth at the start of the subtree, whose first block is `offset`
+int BracketMatcher::findLastBlock(int node, int offset, int before, int target,
+                                  int depth) const {
+  if (node < 0 || offset >= before)
+    return -1;
+  const Node &n = m_nodes[node];
+  if (offset + n.size <= before && depth + n.subtree.minDepth > target)
+    return -1;
+  int number = offset + sizeOf(n.left);
+  int blockDepth = depth + subtreeOf(n.left).depthDelta;
+  int found = findLastBlock(n.right, number + 1, before, target,
+                            blockDepth + n.block.depthDelta);
+  if (found != -1)
+    return found;
+  if (number < before && blockDepth + n.block.minDepth <= target)
+    return number;
+  return findLastBlock(n.left, offset, before, target, depth);
 }
 
 bool BracketMatcher::isOpenBracket(QChar ch) const {
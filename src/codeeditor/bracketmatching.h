@@ -5,7 +5,7 @@
 #include <QMap>
 #include <QTextBlock>
 #include <QTextCursor>
-#include <qtextcursor.h>
+#include <QVector>
 
 struct BracketPair {
   int openPos;
@@ -21,25 +21,31 @@ struct BracketPair {
         closeChar(cChar), isInvalid(false) {}
 };
 
-struct BracketNode {
-  BracketPair pair;
-  BracketNode *left;
-  BracketNode *right;
-  int height;
-
-  explicit BracketNode(const BracketPair &p)
-      : pair(p), left(nullptr), right(nullptr), height(1) {}
-};
+class QTextDocument;
 
+// Matches brackets through a per-block index instead of rescanning the
+// document. Each block's brackets and its depth summary are cached in the
+// block's BlockData and recomputed only when that block is edited. A treap
+// keyed by block number holds the block summaries, each node also
+// summarising its subtree. It gives the nesting depth at any block start
+// and finds the block where a given depth is next (or last) reached, so a
+// lookup costs O(log n) plus a scan of the two blocks at either end. Lines
+// added or removed are spliced in and out in O(log n) plus the blocks
+// edited.
 class BracketMatcher {
 public:
   BracketMatcher();
   ~BracketMatcher();
 
-  void updateBracketTree(const QString &text);
-  BracketNode *findMatchingBracket(int position) const;
+  // Indexes the whole document
+  void setDocument(QTextDocument *document);
+  // Re-indexes the blocks touched by an edit, from QTextDocument::contentsChange
+  void updateBlocks(int position, int charsRemoved, int charsAdded);
+
+  // Finds the pair the bracket at `position` belongs to. Unmatched brackets
+  // and mismatched pairs are returned with isInvalid set.
+  bool findMatchingBracket(int position, BracketPair *pair) const;
   QColor getBracketColor(int level) const;
-  void clearBracketTree();
   bool isOpenBracket(QChar ch) const;
   bool isCloseBracket(QChar ch) const;
   QChar getMatchingBracket(QChar ch) const;
@@ -50,14 +56,58 @@ public:
   QString getCharBefore(const QTextCursor &cursor) const;
 
 private:
-  BracketNode *insertBracket(BracketNode *node, const BracketPair &pair);
-  int getHeight(BracketNode *node) const;
-  int getBalance(BracketNode *node) const;
-  BracketNode *rotateLeft(BracketNode *x);
-  BracketNode *rotateRight(BracketNode *y);
-  void clearBracketTree(BracketNode *node);
-
-  BracketNode *bracketRoot;
+  struct Summary {
+    int depthDelta = 0;
+    int minDepth = 0;
+  };
+
+  // A treap node. Nodes live in m_nodes and refer to each other by index,
+  // -1 for none.
+  struct Node {
+    Summary block;   // This block's own summary
+    Summary subtree; // The blocks of the subtree, in order
+    int size = 1;
+    quint32 priority = 0;
+    int left = -1;
+    int right = -1;
+  };
+
+  static Summary combine(const Summary &left, const Summary &right);
+  static Summary summaryOf(const QTextBlock &block);
+  void rebuild();
+  // Returns whether the block's depth summary changed
+  bool scanBlock(QTextBlock &block);
+
+  int allocateNode(const Summary &summary);
+  void freeNodes(int node);
+  int sizeOf(int node) const { return node < 0 ? 0 : m_nodes[node].size; }
+  Summary subtreeOf(int node) const {
+    return node < 0 ? Summary() : m_nodes[node].subtree;
+  }
+  void pull(int node);
+  // Restores the heap order below `node` by swapping priorities, which
+  // leaves the block order alone
+  void siftDown(int node);
+  // Balanced from the start, over nodes already allocated in block order
+  int build(const int *nodes, int count);
+  // Splits off the first `count` blocks
+  void split(int node, int count, int *left, int *right);
+  int merge(int left, int right);
+  void setSummary(int node, int blockNumber, const Summary &summary);
+
+  int depthAtBlock(int blockNumber) const;
+  int findFirstBlock(int node, int offset, int from, int target,
+                     int *depth) const;
+  int findLastBlock(int node, int offset, int before, int target,
+                    int depth) const;
+
+  QTextDocument *m_document;
+  QVector<Node> m_nodes;
+  QVector<int> m_freeNodes;
+  int m_root;
+  quint32 m_seed;          // For node priorities
+  QVector<int> m_newNodes; // Reused by every splice
+  QVector<quint32> m_scratch; // Reused by every block scan
   QMap<QChar, QChar> bracketPairs;
   QVector<QColor> bracketColors;
 };
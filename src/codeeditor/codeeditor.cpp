@@ -1,6 +1,8 @@
 #include "codeeditor/codeeditor.h"
+#include "codeeditor/completionmodel.h"
 #include "customtextedit.h"
 #include "highlighters/cpphighlighter.h"
+#include "lsp/lspserverpool.h"
 #include "search.h"
 #include "settings/shortcutmanager.h"
 #include <QAbstractItemView>
@@ -15,6 +17,7 @@
 #include <QJsonValue>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListView>
 #include <QMessageBox>
 #include <QPainter>
 #include <QPushButton>
@@ -28,8 +31,13 @@
 
 CodeEditor::CodeEditor(QWidget *parent)
     : DockWidgetBase(parent), m_intelligentIndent(true),
-      m_lspClient(new LSPClient(this)), m_serverInitialized(false) {
+      m_lspClient(nullptr), m_documentVersion(0), m_needsFullSync(false),
+      m_completionStart(-1), m_completionIncomplete(false),
+      m_completionReceived(false), m_textEdited(false),
+      m_applyingCompletion(false), m_hoveredFoldBlock(-1) {
   m_editor = new CustomPlainTextEdit(this);
+  DocumentSnapshot::track(m_editor->document());
+  m_decorations = new EditorDecorations(m_editor);
   m_lineNumberArea = new LineNumberArea(this);
   m_highlighter = new CppHighlighter(m_editor->document());
 
@@ -80,25 +88,27 @@ CodeEditor::CodeEditor(QWidget *parent)
   setupUI();
   setupSearchDialogs();
   setupBracketMatching();
+  m_folding.setDocument(m_editor->document());
   connect(m_editor, &QPlainTextEdit::cursorPositionChanged, this,
           &CodeEditor::cursorPositionChanged);
 
-  // Set up LSP client
-  setupLSPClient();
-
   // Set up change timer for LSP updates
   m_changeTimer = new QTimer(this);
   m_changeTimer->setSingleShot(true);
   m_changeTimer->setInterval(500); // 500ms delay
   connect(m_changeTimer, &QTimer::timeout, this,
-          &CodeEditor::handleTextChanged);
+          &CodeEditor::flushDocumentChanges);
 
   // Connect text change signals
+  connect(m_editor->document(), &QTextDocument::contentsChange, this,
+          &CodeEditor::handleContentsChange);
   connect(m_editor->document(), &QTextDocument::contentsChanged, m_changeTimer,
           QOverload<>::of(&QTimer::start));
   connect(m_editor, &QPlainTextEdit::cursorPositionChanged, this,
           &CodeEditor::handleCursorPositionChanged);
 
+  setupCompletion();
+
   // Add keyboard shortcuts for folding
   QShortcut *foldShortcut =
       new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_BracketLeft), this);
@@ -145,9 +155,7 @@ CodeEditor::CodeEditor(QWidget *parent)
 CodeEditor::~CodeEditor() {
   delete m_findDialog;
   delete m_replaceDialog;
-  if (m_lspClient) {
-    m_lspClient->stopServer();
-  }
+  closeLSPDocument();
 }
 
 void CodeEditor::setupUI() {
@@ -173,7 +181,7 @@ void CodeEditor::setupUI() {
 
 void CodeEditor::setupSearchDialogs() {
   if (!m_findDialog) {
-    m_findDialog = new SearchDialog(m_editor, this);
+    m_findDialog = new SearchDialog(m_editor, m_decorations, this);
     m_findDialog->setWindowFlags(Qt::Dialog | Qt::WindowStaysOnTopHint);
   }
 }
@@ -224,6 +232,8 @@ void CodeEditor::updateLineNumberAreaWidth(int newBlockCount) {
 }
 
 void CodeEditor::updateLineNumberArea(const QRect &rect, int dy) {
+  updateHighlightRange();
+
   if (dy)
     m_lineNumberArea->scroll(0, dy);
   else
@@ -234,6 +244,19 @@ void CodeEditor::updateLineNumberArea(const QRect &rect, int dy) {
     updateLineNumberAreaWidth(0);
 }
 
+void CodeEditor::updateHighlightRange() {
+  // Lets the highlighter format what is on screen before the rest
+  if (!m_highlighter)
+    return;
+
+  QTextBlock last =
+      m_editor
+          ->cursorForPosition(QPoint(0, m_editor->viewport()->height() - 1))
+          .block();
+  m_highlighter->setVisibleBlocks(m_editor->firstVisibleBlock().blockNumber(),
+                                  last.blockNumber());
+}
+
 void CodeEditor::resizeEvent(QResizeEvent *e) {
   DockWidgetBase::resizeEvent(e);
   QRect cr = m_editor->contentsRect();
@@ -255,7 +278,8 @@ void CodeEditor::highlightCurrentLine() {
     extraSelections.append(selection);
   }
 
-  m_editor->setExtraSelections(extraSelections);
+  m_decorations->setLayer(EditorDecorations::CurrentLineLayer,
+                          extraSelections);
 }
 
 void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
@@ -544,48 +568,38 @@ bool CodeEditor::handleAutoPair(QKeyEvent *e) {
 }
 
 void CodeEditor::setupBracketMatching() {
-  // Connect cursor position changes to bracket matching
-  connect(m_editor, &QPlainTextEdit::cursorPositionChanged, this,
-          &CodeEditor::cursorPositionChanged);
+  // The index follows edits through handleContentsChange; cursor moves are
+  // connected in the constructor
+  m_bracketMatcher.setDocument(m_editor->document());
   connect(m_editor, &QPlainTextEdit::textChanged, this,
           &CodeEditor::updateBracketMatching);
 }
 
 void CodeEditor::updateBracketMatching() {
-  QList<QTextEdit::ExtraSelection> selections = m_editor->extraSelections();
-
-  // Remove previous bracket highlights
-  selections.removeIf([](const QTextEdit::ExtraSelection &selection) {
-    return selection.format.background().color().alpha() < 255;
-  });
-
-  // Update the bracket tree
-  m_bracketMatcher.updateBracketTree(m_editor->toPlainText());
+  QList<QTextEdit::ExtraSelection> selections;
 
   // Find brackets at cursor position
   QTextCursor cursor = m_editor->textCursor();
   int position = cursor.position();
 
-  BracketNode *match = m_bracketMatcher.findMatchingBracket(position);
+  BracketPair pair;
+  bool match = m_bracketMatcher.findMatchingBracket(position, &pair);
   if (!match && position > 0) {
-    match = m_bracketMatcher.findMatchingBracket(position - 1);
+    match = m_bracketMatcher.findMatchingBracket(position - 1, &pair);
   }
 
   if (match) {
-    const BracketPair &pair = match->pair;
-    if (pair.closePos != -1) {
-      QColor color = m_bracketMatcher.getBracketColor(pair.level);
-      color.setAlpha(40);
+    QColor color = pair.isInvalid ? QColor(255, 0, 0, 40)
+                                  : m_bracketMatcher.getBracketColor(pair.level);
+    color.setAlpha(40);
 
-      selections.append(createBracketSelection(pair.openPos, color));
+    // Unmatched brackets only have openPos set; mismatched pairs mark both
+    selections.append(createBracketSelection(pair.openPos, color));
+    if (pair.closePos != -1)
       selections.append(createBracketSelection(pair.closePos, color));
-    } else if (pair.isInvalid) {
-      selections.append(
-          createBracketSelection(pair.openPos, QColor(255, 0, 0, 40)));
-    }
   }
 
-  m_editor->setExtraSelections(selections);
+  m_decorations->setLayer(EditorDecorations::BracketLayer, selections);
 }
 
 void CodeEditor::cursorPositionChanged() { updateBracketMatching(); }
@@ -600,10 +614,24 @@ bool CodeEditor::isSyntaxHighlightingEnabled() const {
   return m_highlighter && m_highlighter->isEnabled();
 }
 
-void CodeEditor::setupLSPClient() {
+void CodeEditor::setFilePath(const QString &filePath) {
+  if (filePath == m_filePath)
+    return;
+
+  closeLSPDocument();
+  m_filePath = filePath;
+  openLSPDocument();
+}
+
+void CodeEditor::openLSPDocument() {
+  if (m_filePath.isEmpty())
+    return;
+
+  m_lspClient = LSPServerPool::instance().acquire(m_filePath);
+  if (!m_lspClient)
+    return;
+
   // Connect LSP client signals
-  connect(m_lspClient, &LSPClient::initialized,
-          [this]() { m_serverInitialized = true; });
   connect(m_lspClient, &LSPClient::completionReceived, this,
           &CodeEditor::handleCompletionReceived);
   connect(m_lspClient, &LSPClient::hoverReceived, this,
@@ -614,76 +642,335 @@ void CodeEditor::setupLSPClient() {
           &CodeEditor::handleDiagnosticsReceived);
   connect(m_lspClient, &LSPClient::serverError, this,
           &CodeEditor::handleServerError);
+  connect(m_lspClient, &LSPClient::documentSyncRequired, this,
+          &CodeEditor::handleDocumentSyncRequired);
+
+  m_documentUri = m_lspClient->uriFromPath(m_filePath);
+  m_documentVersion = 1;
+  m_pendingEdits.clear();
+  m_needsFullSync = false;
+  resetSyncedLineLengths();
+  m_lspClient->didOpen(m_documentUri,
+                       LSPServerPool::languageIdForFile(m_filePath),
+                       m_documentVersion,
+                       DocumentSnapshot::of(m_editor->document()).plainText());
+}
+
+void CodeEditor::closeLSPDocument() {
+  if (!m_lspClient)
+    return;
+
+  hideCompletion();
+  m_changeTimer->stop();
+  m_pendingEdits.clear();
+  m_lspClient->didClose(m_documentUri);
+  disconnect(m_lspClient, nullptr, this, nullptr);
+  LSPServerPool::instance().release(m_lspClient);
+  m_lspClient = nullptr;
+  m_documentUri.clear();
+}
+
+void CodeEditor::resetSyncedLineLengths() {
+  QTextDocument *doc = m_editor->document();
+  m_syncedLineLengths.clear();
+  m_syncedLineLengths.reserve(doc->blockCount());
+  for (QTextBlock block = doc->firstBlock(); block.isValid();
+       block = block.next()) {
+    m_syncedLineLengths.append(block.length() - 1);
+  }
+}
+
+void CodeEditor::handleContentsChange(int position, int charsRemoved,
+                                      int charsAdded) {
+  m_bracketMatcher.updateBlocks(position, charsRemoved, charsAdded);
+
+  if (charsAdded > 0 && !m_applyingCompletion)
+    m_textEdited = true;
+
+  if (!m_lspClient || m_needsFullSync)
+    return;
+
+  QTextDocument *doc = m_editor->document();
+
+  // Some edits (e.g. the first one after setPlainText) also count the
+  // implicit final paragraph separator. It is present both before and after
+  // the edit, so drop it from both counts.
+  int overshoot = position + charsAdded - (doc->characterCount() - 1);
+  if (overshoot > 0) {
+    charsAdded -= overshoot;
+    charsRemoved -= overshoot;
+  }
+  if (charsAdded < 0 || charsRemoved < 0) {
+    m_needsFullSync = true;
+    return;
+  }
 
-  // Start clangd server
-  if (m_lspClient->startServer("clangd")) {
-    m_lspClient->initialize(workingDirectory());
+  QTextBlock startBlock = doc->findBlock(position);
+  int startLine = startBlock.blockNumber();
+  int startCharacter = position - startBlock.position();
+
+  // Text before the edit is unchanged, but the removed span has to be
+  // measured against the lines as the server last saw them
+  int endLine = startLine;
+  int endCharacter = startCharacter;
+  int remaining = charsRemoved;
+  while (endLine < m_syncedLineLengths.size() &&
+         remaining > m_syncedLineLengths[endLine] - endCharacter) {
+    remaining -= m_syncedLineLengths[endLine] - endCharacter + 1;
+    ++endLine;
+    endCharacter = 0;
   }
+  if (endLine >= m_syncedLineLengths.size()) {
+    m_needsFullSync = true;
+    return;
+  }
+  endCharacter += remaining;
+
+  QTextCursor cursor(doc);
+  cursor.setPosition(position);
+  cursor.setPosition(position + charsAdded, QTextCursor::KeepAnchor);
+  QString text = cursor.selectedText();
+  text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+  text.replace(QChar::LineSeparator, QLatin1Char('\n'));
+  text.replace(QChar::Nbsp, QLatin1Char(' '));
+
+  // Bring the synced line lengths up to date for the next edit
+  QTextBlock endBlock = doc->findBlock(position + charsAdded);
+  int oldCount = endLine - startLine + 1;
+  int newCount = endBlock.blockNumber() - startLine + 1;
+  if (newCount > oldCount) {
+    m_syncedLineLengths.insert(startLine, newCount - oldCount, 0);
+  } else if (newCount < oldCount) {
+    m_syncedLineLengths.remove(startLine, oldCount - newCount);
+  }
+  QTextBlock block = startBlock;
+  for (int i = 0; i < newCount; ++i, block = block.next()) {
+    m_syncedLineLengths[startLine + i] = block.length() - 1;
+  }
+
+  // Coalesce keystrokes so a burst of typing is sent as one edit
+  if (!m_pendingEdits.isEmpty()) {
+    PendingEdit &last = m_pendingEdits.last();
+    bool lastIsInsert = last.startLine == last.endLine &&
+                        last.startCharacter == last.endCharacter;
+    if (charsRemoved == 0 && lastIsInsert && !last.text.contains('\n') &&
+        last.startLine == startLine &&
+        last.startCharacter + last.text.length() == startCharacter) {
+      last.text += text;
+      return;
+    }
+    if (text.isEmpty() && last.text.isEmpty() && endLine == last.startLine &&
+        endCharacter == last.startCharacter) {
+      last.startLine = startLine;
+      last.startCharacter = startCharacter;
+      return;
+    }
+  }
+
+  // Past this point a single full-text update is cheaper than replaying
+  // every edit (e.g. Replace All)
+  if (m_pendingEdits.size() >= 256) {
+    m_pendingEdits.clear();
+    m_needsFullSync = true;
+    return;
+  }
+
+  m_pendingEdits.append(
+      {startLine, startCharacter, endLine, endCharacter, text});
 }
 
-void CodeEditor::handleTextChanged() {
-  if (!m_serverInitialized)
+void CodeEditor::flushDocumentChanges() {
+  m_changeTimer->stop();
+  if (!m_lspClient || (m_pendingEdits.isEmpty() && !m_needsFullSync))
     return;
 
-  QString uri =
-      m_lspClient->uriFromPath(workingDirectory() + "/" + windowTitle());
-  m_lspClient->didChange(uri, m_editor->toPlainText());
+  QJsonArray changes;
+  if (m_needsFullSync || !m_lspClient->isInitialized() ||
+      m_lspClient->syncKind() != LSPClient::SyncKind::Incremental) {
+    changes.append(QJsonObject(
+        {{"text", DocumentSnapshot::of(m_editor->document()).plainText()}}));
+    if (m_needsFullSync) {
+      resetSyncedLineLengths();
+    }
+  } else {
+    for (const PendingEdit &edit : std::as_const(m_pendingEdits)) {
+      QJsonObject range(
+          {{"start", QJsonObject({{"line", edit.startLine},
+                                  {"character", edit.startCharacter}})},
+           {"end", QJsonObject({{"line", edit.endLine},
+                                {"character", edit.endCharacter}})}});
+      changes.append(QJsonObject({{"range", range}, {"text", edit.text}}));
+    }
+  }
+
+  m_pendingEdits.clear();
+  m_needsFullSync = false;
+  m_lspClient->didChange(m_documentUri, ++m_documentVersion, changes);
+}
+
+void CodeEditor::handleDocumentSyncRequired(const QString &uri) {
+  if (uri == m_documentUri)
+    flushDocumentChanges();
 }
 
 void CodeEditor::handleCursorPositionChanged() {
-  if (!m_serverInitialized)
+  bool textEdited = m_textEdited;
+  m_textEdited = false;
+  if (!m_lspClient || m_applyingCompletion)
     return;
 
+  // The client debounces these and asks for pending edits to be synced
+  // before it sends them
   QTextCursor cursor = m_editor->textCursor();
   int line = cursor.blockNumber();
   int character = cursor.positionInBlock();
-  QString uri =
-      m_lspClient->uriFromPath(workingDirectory() + "/" + windowTitle());
 
   // Request hover information
-  m_lspClient->requestHover(uri, line, character);
+  m_lspClient->requestHover(m_documentUri, line, character);
+
+  updateCompletion(textEdited);
+}
+
+void CodeEditor::setupCompletion() {
+  m_completionModel = new CompletionModel(this);
+  m_completer = new QCompleter(m_completionModel, this);
+  m_completer->setWidget(m_editor);
+  // The model does its own fuzzy filtering; the completer only shows it
+  m_completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+  m_completer->setMaxVisibleItems(12);
+  if (QListView *list = qobject_cast<QListView *>(m_completer->popup()))
+    list->setUniformItemSizes(true);
+
+  connect(m_completer,
+          QOverload<const QModelIndex &>::of(&QCompleter::activated), this,
+          &CodeEditor::insertCompletion);
+}
+
+bool CodeEditor::isCompletionPopupVisible() const {
+  return m_completer->popup()->isVisible();
+}
+
+int CodeEditor::completionWordStart(const QTextCursor &cursor) const {
+  const QString text = cursor.block().text();
+  int start = cursor.positionInBlock();
+  while (start > 0 &&
+         (text[start - 1].isLetterOrNumber() || text[start - 1] == '_'))
+    --start;
+  return cursor.block().position() + start;
+}
+
+void CodeEditor::updateCompletion(bool textEdited) {
+  QTextCursor cursor = m_editor->textCursor();
+  int wordStart = completionWordStart(cursor);
+  if (cursor.hasSelection() || wordStart == cursor.position()) {
+    hideCompletion();
+    return;
+  }
+
+  // Same word as the items we already have: narrow them locally. Only an
+  // incomplete list or a new word needs another round trip.
+  if (wordStart == m_completionStart && !m_completionIncomplete) {
+    if (m_completionReceived)
+      filterCompletions();
+    return;
+  }
+
+  // Moving the cursor onto a word is not a reason to pop up a list
+  if (wordStart != m_completionStart && !textEdited) {
+    hideCompletion();
+    return;
+  }
 
-  // Request completion if typing
-  QString currentWord = getCurrentWord();
-  if (!currentWord.isEmpty()) {
-    m_lspClient->requestCompletion(uri, line, character);
+  if (wordStart != m_completionStart) {
+    m_completionModel->clear();
+    m_completer->popup()->hide();
+    m_completionReceived = false;
   }
+  m_completionStart = wordStart;
+  m_completionIncomplete = false;
+  m_lspClient->requestCompletion(m_documentUri, cursor.blockNumber(),
+                                 cursor.positionInBlock());
+  if (m_completionReceived)
+    filterCompletions();
 }
 
-void CodeEditor::handleCompletionReceived(const QJsonArray &completions) {
-  QStringList suggestions;
-  for (const auto &val : completions) {
-    if (val.isObject()) {
-      QJsonObject item = val.toObject();
-      suggestions << item["label"].toString();
-    }
+void CodeEditor::filterCompletions() {
+  QTextCursor cursor = m_editor->textCursor();
+  cursor.setPosition(m_completionStart, QTextCursor::KeepAnchor);
+  m_completionModel->setFilter(cursor.selectedText());
+
+  QAbstractItemView *popup = m_completer->popup();
+  int rows = m_completionModel->rowCount();
+  if (rows == 0) {
+    popup->hide();
+    return;
   }
 
-  if (suggestions.isEmpty())
+  // Size the popup from the rows it can show rather than sizeHintForColumn,
+  // which measures every row in the model
+  QFontMetrics metrics(popup->font());
+  int width = 0;
+  for (int row = 0; row < qMin(rows, m_completer->maxVisibleItems()); ++row) {
+    width = qMax(width, metrics.horizontalAdvance(
+                            m_completionModel->index(row).data().toString()));
+  }
+
+  QRect rect = m_editor->cursorRect();
+  rect.setWidth(width + 2 * metrics.averageCharWidth() +
+                popup->verticalScrollBar()->sizeHint().width());
+  m_completer->complete(rect);
+  popup->setCurrentIndex(m_completer->completionModel()->index(0, 0));
+}
+
+void CodeEditor::hideCompletion() {
+  if (m_completionStart < 0)
     return;
 
-  QCompleter *completer = new QCompleter(suggestions, this);
-  completer->setWidget(m_editor);
-  completer->setCompletionMode(QCompleter::PopupCompletion);
-  completer->setCaseSensitivity(Qt::CaseInsensitive);
-
-  connect(completer, QOverload<const QString &>::of(&QCompleter::activated),
-          [this](const QString &text) {
-            QTextCursor cursor = m_editor->textCursor();
-            QString currentWord = getCurrentWord();
-            cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor,
-                                currentWord.length());
-            cursor.insertText(text);
-          });
+  m_completer->popup()->hide();
+  m_completionModel->clear();
+  m_completionStart = -1;
+  m_completionIncomplete = false;
+  m_completionReceived = false;
+  if (m_lspClient)
+    m_lspClient->cancelRequests(m_documentUri, "textDocument/completion");
+}
+
+void CodeEditor::insertCompletion(const QModelIndex &index) {
+  if (m_completionStart < 0)
+    return;
 
-  QRect cr = m_editor->cursorRect();
-  cr.setWidth(completer->popup()->sizeHintForColumn(0) +
-              completer->popup()->verticalScrollBar()->sizeHint().width());
-  completer->complete(cr);
+  QString text = index.data(CompletionModel::InsertTextRole).toString();
+  QTextCursor cursor = m_editor->textCursor();
+  cursor.setPosition(m_completionStart, QTextCursor::KeepAnchor);
+
+  // Keep the session for this word so further typing filters locally, but
+  // don't reopen the popup for the text we just inserted
+  m_applyingCompletion = true;
+  cursor.insertText(text);
+  m_editor->setTextCursor(cursor);
+  m_applyingCompletion = false;
+  m_completer->popup()->hide();
 }
 
-void CodeEditor::handleHoverReceived(const QString &contents) {
-  if (contents.isEmpty())
+void CodeEditor::handleCompletionReceived(
+    const QString &uri, bool isIncomplete,
+    const QVector<LSPCompletionItem> &items) {
+  if (uri != m_documentUri || m_completionStart < 0)
+    return;
+
+  // The user has moved on to another word since asking
+  if (completionWordStart(m_editor->textCursor()) != m_completionStart)
+    return;
+
+  m_completionModel->setItems(items);
+  m_completionIncomplete = isIncomplete;
+  m_completionReceived = true;
+  filterCompletions();
+}
+
+void CodeEditor::handleHoverReceived(const QString &uri,
+                                     const QString &contents) {
+  if (uri != m_documentUri || contents.isEmpty())
     return;
 
   QRect rect = cursorRect();
@@ -691,51 +978,53 @@ void CodeEditor::handleHoverReceived(const QString &contents) {
   QToolTip::showText(pos, contents);
 }
 
-void CodeEditor::handleDefinitionReceived(const QString &uri, int line,
+void CodeEditor::handleDefinitionReceived(const QString &uri,
+                                          const QString &targetUri, int line,
                                           int character) {
-  emit gotoDefinitionRequested(uri, line, character);
+  if (uri != m_documentUri)
+    return;
+
+  if (targetUri == m_documentUri) {
+    goToLine(line, character);
+    return;
+  }
+  emit gotoDefinitionRequested(targetUri, line, character);
 }
 
-void CodeEditor::handleDiagnosticsReceived(const QString &uri,
-                                           const QJsonArray &diagnostics) {
-  QList<QTextEdit::ExtraSelection> selections;
+int CodeEditor::positionAt(int line, int character) const {
+  // The document keeps its blocks in a tree indexed by number and position
+  // and updates it on every edit, so this is O(log n) with no extra index.
+  // Columns map directly because the server is asked for UTF-16 offsets,
+  // which is what QString stores.
+  QTextDocument *doc = m_editor->document();
+  QTextBlock block = doc->findBlockByNumber(qMax(line, 0));
+  if (!block.isValid())
+    return doc->characterCount() - 1;
+  return block.position() + qBound(0, character, block.length() - 1);
+}
 
-  // Keep existing selections that are not diagnostic highlights
-  for (const auto &selection : m_editor->extraSelections()) {
-    if (selection.format.background().color().alpha() == 255) {
-      selections.append(selection);
-    }
-  }
+void CodeEditor::goToLine(int line, int character) {
+  QTextCursor cursor = m_editor->textCursor();
+  cursor.setPosition(positionAt(line, character));
+  m_editor->setTextCursor(cursor);
+  m_editor->centerCursor();
+}
 
-  for (const auto &val : diagnostics) {
-    if (!val.isObject())
-      continue;
-
-    QJsonObject diagnostic = val.toObject();
-    QJsonObject range = diagnostic["range"].toObject();
-    QJsonObject start = range["start"].toObject();
-    QJsonObject end = range["end"].toObject();
-    QString severity = diagnostic["severity"].toString();
-    QString message = diagnostic["message"].toString();
-
-    // Convert LSP positions to text positions
-    QTextCursor cursor(m_editor->document());
-
-    // Move to start position
-    cursor.movePosition(QTextCursor::Start);
-    cursor.movePosition(QTextCursor::Down, QTextCursor::MoveAnchor,
-                        start["line"].toInt());
-    cursor.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor,
-                        start["character"].toInt());
-    int startPos = cursor.position();
-
-    // Move to end position
-    cursor.movePosition(QTextCursor::Start);
-    cursor.movePosition(QTextCursor::Down, QTextCursor::MoveAnchor,
-                        end["line"].toInt());
-    cursor.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor,
-                        end["character"].toInt());
-    int endPos = cursor.position();
+void CodeEditor::reloadText(const QString &text) {
+  QTextDocument *document = m_editor->document();
+  SearchEngine::applyMinimalEdit(document, text);
+  document->setModified(false);
+}
+
+void CodeEditor::handleDiagnosticsReceived(
+    const QString &uri, const QVector<LSPDiagnostic> &diagnostics) {
+  if (uri != m_documentUri)
+    return;
+
+  QList<QTextEdit::ExtraSelection> selections;
+  for (const LSPDiagnostic &diagnostic : diagnostics) {
+    int startPos = positionAt(diagnostic.startLine, diagnostic.startCharacter);
+    int endPos = positionAt(diagnostic.endLine, diagnostic.endCharacter);
 
     // Create selection
     QTextEdit::ExtraSelection selection;
@@ -745,13 +1034,13 @@ void CodeEditor::handleDiagnosticsReceived(const QString &uri,
 
     // Set format based on severity
     QColor underlineColor;
-    if (severity == "1") {                // Error
+    if (diagnostic.severity == 1) {       // Error
       underlineColor = QColor("#FF0000"); // Red
-    } else if (severity == "2") {         // Warning
-      underlineColor = QColor("#FFA500"); // Orange
-    } else if (severity == "3") {         // Information
-      underlineColor = QColor("#2196F3"); // Blue
-    } else if (severity == "4") {         // Hint
+    } else if (diagnostic.severity == 2) { // Warning
+      underlineColor = QColor("#FFA500");  // Orange
+    } else if (diagnostic.severity == 3) { // Information
+      underlineColor = QColor("#2196F3");  // Blue
+    } else if (diagnostic.severity == 4) { // Hint
       underlineColor = QColor("#4CAF50"); // Green
     } else {
       underlineColor = QColor("#FF0000"); // Default to red
@@ -761,12 +1050,12 @@ void CodeEditor::handleDiagnosticsReceived(const QString &uri,
     QTextCharFormat format;
     format.setUnderlineColor(underlineColor);
     format.setUnderlineStyle(QTextCharFormat::WaveUnderline);
-    format.setToolTip(message); // Show diagnostic message on hover
+    format.setToolTip(diagnostic.message); // Show diagnostic message on hover
 
     selection.format = format;
     selections.append(selection);
   }
-  m_editor->setExtraSelections(selections);
+  m_decorations->setLayer(EditorDecorations::DiagnosticLayer, selections);
 }
 
 void CodeEditor::handleServerError(const QString &message) {
@@ -785,28 +1074,24 @@ QPair<int, int> CodeEditor::getCursorPosition() const {
 }
 
 void CodeEditor::requestDefinition() {
-  if (!m_serverInitialized)
+  if (!m_lspClient)
     return;
 
   QTextCursor cursor = m_editor->textCursor();
   int line = cursor.blockNumber();
   int character = cursor.positionInBlock();
-  QString uri =
-      m_lspClient->uriFromPath(workingDirectory() + "/" + windowTitle());
 
-  m_lspClient->requestDefinition(uri, line, character);
+  m_lspClient->requestDefinition(m_documentUri, line, character);
 }
 
 void CodeEditor::requestHover(const QTextCursor &cursor) {
-  if (!m_serverInitialized)
+  if (!m_lspClient)
     return;
 
   int line = cursor.blockNumber();
   int character = cursor.positionInBlock();
-  QString uri =
-      m_lspClient->uriFromPath(workingDirectory() + "/" + windowTitle());
 
-  m_lspClient->requestHover(uri, line, character);
+  m_lspClient->requestHover(m_documentUri, line, character);
 }
 
 QString CodeEditor::getWordUnderCursor(const QTextCursor &cursor) const {
@@ -816,22 +1101,18 @@ QString CodeEditor::getWordUnderCursor(const QTextCursor &cursor) const {
 }
 
 void CodeEditor::toggleFold(const QTextBlock &blockToFold) {
-  m_folding.toggleFold(blockToFold);
-  updateVisibleBlocks();
-  m_editor->viewport()->update();
-  m_lineNumberArea->update();
+  if (m_folding.toggleFold(blockToFold))
+    updateVisibleBlocks();
 }
 
 void CodeEditor::foldAll() {
-  m_folding.foldAll(m_editor->document());
-  updateVisibleBlocks();
-  viewport()->update();
+  if (m_folding.foldAll())
+    updateVisibleBlocks();
 }
 
 void CodeEditor::unfoldAll() {
-  m_folding.unfoldAll();
-  updateVisibleBlocks();
-  viewport()->update();
+  if (m_folding.unfoldAll())
+    updateVisibleBlocks();
 }
 
 bool CodeEditor::isFoldable(const QTextBlock &block) const {
@@ -843,7 +1124,8 @@ bool CodeEditor::isFolded(const QTextBlock &block) const {
 }
 
 void CodeEditor::setFolded(const QTextBlock &block, bool folded) {
-  m_folding.setFolded(block, folded);
+  if (m_folding.setFolded(block, folded))
+    updateVisibleBlocks();
 }
 
 int CodeEditor::findFoldingEndBlock(const QTextBlock &startBlock) const {
@@ -855,13 +1137,8 @@ bool CodeEditor::isBlockVisible(const QTextBlock &block) const {
 }
 
 void CodeEditor::updateVisibleBlocks() {
-  QTextBlock block = document()->firstBlock();
-  while (block.isValid()) {
-    block.setVisible(isBlockVisible(block));
-    block = block.next();
-  }
-
-  // Update line number area and viewport
+  // CodeFolding has already flipped the visibility of the affected blocks;
+  // update line number area and viewport
   m_editor->viewport()->update();
   m_lineNumberArea->update();
   updateLineNumberAreaWidth(0);
@@ -879,7 +1156,7 @@ void CodeEditor::paintFoldingMarkers(QPainter &painter, const QTextBlock &block,
                                      const QRectF &rect) {
   m_folding.paintFoldingMarkers(
       painter, block, rect, isFolded(block),
-      m_hoveredFoldMarkers.value(block.blockNumber(), false),
+      block.blockNumber() == m_hoveredFoldBlock,
       lineNumberAreaWidth());
 }
 
@@ -896,47 +1173,18 @@ bool CodeEditor::isFoldMarkerUnderMouse(const QPoint &pos,
 
 void CodeEditor::mouseMoveEvent(QMouseEvent *event) {
   QPoint pos = event->pos();
-  bool needsUpdate = false;
 
   // Clear previous hover states if mouse is outside the folding marker area
-  if (pos.x() > lineNumberAreaWidth()) {
-    if (!m_hoveredFoldMarkers.isEmpty()) {
-      m_hoveredFoldMarkers.clear();
-      m_lineNumberArea->update();
-    }
-    DockWidgetBase::mouseMoveEvent(event);
-    return;
+  int hovered = -1;
+  if (pos.x() <= lineNumberAreaWidth()) {
+    // Only the block under the mouse can have its marker hovered
+    QTextBlock block = blockAtPosition(pos.y());
+    if (block.isValid() && isFoldMarkerUnderMouse(pos, block))
+      hovered = block.blockNumber();
   }
 
-  // Update hover states for visible blocks
-  QTextBlock block = m_editor->firstVisibleBlock();
-  while (block.isValid()) {
-    int blockNumber = block.blockNumber();
-    bool wasHovered = m_hoveredFoldMarkers.value(blockNumber, false);
-    bool isHovered = isFoldMarkerUnderMouse(pos, block);
-
-    if (wasHovered != isHovered) {
-      if (isHovered) {
-        m_hoveredFoldMarkers[blockNumber] = true;
-      } else {
-        m_hoveredFoldMarkers.remove(blockNumber);
-      }
-      needsUpdate = true;
-    }
-
-    block = block.next();
-    if (!block.isVisible())
-      continue;
-
-    // Stop if we're past the visible area
-    int bottom = m_editor->blockBoundingGeometry(block)
-                     .translated(m_editor->contentOffset())
-                     .bottom();
-    if (bottom > m_editor->viewport()->height())
-      break;
-  }
-
-  if (needsUpdate) {
+  if (hovered != m_hoveredFoldBlock) {
+    m_hoveredFoldBlock = hovered;
     m_lineNumberArea->update();
   }
 
@@ -945,8 +1193,8 @@ void CodeEditor::mouseMoveEvent(QMouseEvent *event) {
 
 void CodeEditor::leaveEvent(QEvent *event) {
   // Clear all hover states when mouse leaves the widget
-  if (!m_hoveredFoldMarkers.isEmpty()) {
-    m_hoveredFoldMarkers.clear();
+  if (m_hoveredFoldBlock != -1) {
+    m_hoveredFoldBlock = -1;
     m_lineNumberArea->update();
   }
   DockWidgetBase::leaveEvent(event);
@@ -961,26 +1209,17 @@ void CodeEditor::handleUnfoldShortcut() {
 }
 
 QTextBlock CodeEditor::blockAtPosition(int y) const {
-  QTextBlock block = m_editor->firstVisibleBlock();
-  int top = m_editor->blockBoundingGeometry(block)
-                .translated(m_editor->contentOffset())
-                .top();
-  int bottom = top + m_editor->blockBoundingRect(block).height();
-
-  do {
-    if (block.isValid() && top <= y && y <= bottom) {
-      return block;
-    }
-
-    block = block.next();
-    if (!block.isValid())
-      break;
-
-    top = bottom;
-    bottom = top + m_editor->blockBoundingRect(block).height();
-  } while (block.isValid() && top <= y);
-
-  return QTextBlock();
+  // Let the document layout find the line instead of walking the visible
+  // blocks, then reject points above or below the text
+  QTextBlock block = m_editor->cursorForPosition(QPoint(0, y)).block();
+  if (!block.isValid())
+    return QTextBlock();
+
+  QRectF rect = m_editor->blockBoundingGeometry(block).translated(
+      m_editor->contentOffset());
+  if (y < rect.top() || y > rect.bottom())
+    return QTextBlock();
+  return block;
 }
 
 QTextEdit::ExtraSelection
@@ -1,6 +1,8 @@
 #pragma once
 #include "../highlighters/basehighlighter.h"
 #include "codeeditor/bracketmatching.h"
+#include "codeeditor/decorations.h"
+#include "codeeditor/documentsnapshot.h"
 #include "codeeditor/folding.h"
 #include "codeeditor/quotematching.h"
 #include "customtextedit.h"
@@ -19,6 +21,8 @@ class QLineEdit;
 class QCheckBox;
 class QPushButton;
 class SearchDialog;
+class QCompleter;
+class CompletionModel;
 
 class CodeEditor : public DockWidgetBase {
   Q_OBJECT
@@ -37,15 +41,35 @@ public:
   }
   QString workingDirectory() const { return m_workingDirectory; }
 
+  // Associates the editor with a file on disk and opens it on the shared
+  // language server for its workspace
+  void setFilePath(const QString &filePath);
+  QString filePath() const { return m_filePath; }
+
+  bool isCompletionPopupVisible() const;
+
+  // Document offset of a zero-based line and UTF-16 column, clamped to the
+  // text; the form LSP positions arrive in
+  int positionAt(int line, int character) const;
+  void goToLine(int line, int character = 0);
+
   // Editor specific methods
   void setPlainText(const QString &text) { m_editor->setPlainText(text); }
-  QString toPlainText() const { return m_editor->toPlainText(); }
+  QString toPlainText() const {
+    return DocumentSnapshot::of(m_editor->document()).plainText();
+  }
+  // Replaces the text with a newer copy from disk as one undoable edit of
+  // only the span that differs, so the cursor and scroll position stay put,
+  // and marks the document unmodified
+  void reloadText(const QString &text);
   void undo() { m_editor->undo(); }
   void redo() { m_editor->redo(); }
   void cut() { m_editor->cut(); }
   void copy() { m_editor->copy(); }
   void paste() { m_editor->paste(); }
   QTextDocument *document() const { return m_editor->document(); }
+  // Extra selections, one layer per feature
+  EditorDecorations *decorations() const { return m_decorations; }
   void setLineWrapMode(QPlainTextEdit::LineWrapMode mode) {
     m_editor->setLineWrapMode(mode);
   }
@@ -107,13 +131,16 @@ private slots:
   void toggleLineComment();
   void updateBracketMatching();
   void cursorPositionChanged();
-  void handleCompletionReceived(const QJsonArray &completions);
-  void handleHoverReceived(const QString &contents);
-  void handleDefinitionReceived(const QString &uri, int line, int character);
+  void handleCompletionReceived(const QString &uri, bool isIncomplete,
+                                const QVector<LSPCompletionItem> &items);
+  void handleHoverReceived(const QString &uri, const QString &contents);
+  void handleDefinitionReceived(const QString &uri, const QString &targetUri,
+                                int line, int character);
   void handleDiagnosticsReceived(const QString &uri,
-                                 const QJsonArray &diagnostics);
+                                 const QVector<LSPDiagnostic> &diagnostics);
   void handleServerError(const QString &message);
-  void handleTextChanged();
+  void handleDocumentSyncRequired(const QString &uri);
+  void handleContentsChange(int position, int charsRemoved, int charsAdded);
   void handleCursorPositionChanged();
   void handleFoldShortcut();
   void handleUnfoldShortcut();
@@ -130,19 +157,55 @@ private:
   QDialog *m_replaceDialog;
   BracketMatcher m_bracketMatcher;
   QuoteMatcher m_quoteMatcher;
+  EditorDecorations *m_decorations;
   CodeFolding m_folding;
 
   // LSP
-  LSPClient *m_lspClient;
+  QString m_filePath;
+  QString m_documentUri;
+  LSPClient *m_lspClient; // Shared, owned by LSPServerPool
   QTimer *m_changeTimer;
-  bool m_serverInitialized;
+
+  // Edits not yet sent to the server, as LSP ranges in the coordinates of
+  // the document state that precedes each edit
+  struct PendingEdit {
+    int startLine;
+    int startCharacter;
+    int endLine;
+    int endCharacter;
+    QString text;
+  };
+  QVector<PendingEdit> m_pendingEdits;
+  QVector<int> m_syncedLineLengths; // Line lengths as last seen by the server
+  int m_documentVersion;
+  bool m_needsFullSync;
+
+  // Completion session: one popup per editor, refilled from the server only
+  // when the word being completed changes or the last list was incomplete
+  QCompleter *m_completer;
+  CompletionModel *m_completionModel;
+  int m_completionStart; // Position of the word being completed, or -1
+  bool m_completionIncomplete;
+  bool m_completionReceived;
+  bool m_textEdited;         // Text was typed since the last cursor move
+  bool m_applyingCompletion; // Inserting an accepted item
 
   // Private methods
   void setupUI();
   void setupEditor();
   void setupSearchDialogs();
   void setupBracketMatching();
-  void setupLSPClient();
+  void openLSPDocument();
+  void closeLSPDocument();
+  void flushDocumentChanges();
+  void updateHighlightRange();
+  void setupCompletion();
+  int completionWordStart(const QTextCursor &cursor) const;
+  void updateCompletion(bool textEdited);
+  void filterCompletions();
+  void hideCompletion();
+  void insertCompletion(const QModelIndex &index);
+  void resetSyncedLineLengths();
   QString getIndentString() const;
   int getIndentLevel(const QString &text) const;
   void updateTabWidth();
@@ -157,8 +220,7 @@ private:
   QWidget *viewport() const { return m_editor->viewport(); }
 
   // Code folding members
-  QMap<int, bool>
-      m_hoveredFoldMarkers; // Tracks which fold markers are being hovered
+  int m_hoveredFoldBlock; // Block whose fold marker is hovered, or -1
   void updateFoldingRanges();
   void paintFoldingMarkers(QPainter &painter, const QTextBlock &block,
                            const QRectF &rect);
@@ -0,0 +1,160 @@
+#include "completionmodel.h"
+#include <algorithm>
+
+namespace {
+
+inline ushort foldCase(QChar ch) {
+  ushort u = ch.unicode();
+  if (u < 128)
+    return (u >= 'A' && u <= 'Z') ? u + ('a' - 'A') : u;
+  return ch.toCaseFolded().unicode();
+}
+
+inline bool isWordStart(QStringView text, qsizetype i) {
+  if (i == 0)
+    return true;
+  QChar prev = text[i - 1];
+  QChar ch = text[i];
+  if (!prev.isLetterOrNumber())
+    return true;
+  return prev.isLower() && ch.isUpper();
+}
+
+} // namespace
+
+CompletionModel::CompletionModel(QObject *parent)
+    : QAbstractListModel(parent) {}
+
+void CompletionModel::setItems(const QVector<LSPCompletionItem> &items) {
+  beginResetModel();
+  m_items = items;
+  m_masks.resize(m_items.size());
+  m_visible.resize(m_items.size());
+  for (int i = 0; i < m_items.size(); ++i) {
+    m_masks[i] = charMask(m_items[i].filterText);
+    m_visible[i] = i;
+  }
+  m_filter.clear();
+  endResetModel();
+}
+
+void CompletionModel::clear() {
+  beginResetModel();
+  m_items.clear();
+  m_masks.clear();
+  m_visible.clear();
+  m_filter.clear();
+  endResetModel();
+}
+
+void CompletionModel::setFilter(const QString &prefix) {
+  if (prefix == m_filter)
+    return;
+
+  // Anything matching the longer prefix also matched the shorter one, so
+  // while the user keeps typing only the survivors need to be rescored
+  QVector<int> candidates;
+  if (!m_filter.isEmpty() && prefix.startsWith(m_filter, Qt::CaseInsensitive)) {
+    candidates = m_visible;
+  } else {
+    candidates.resize(m_items.size());
+    for (int i = 0; i < m_items.size(); ++i)
+      candidates[i] = i;
+  }
+
+  QVector<QPair<int, int>> scored; // (-score, index)
+  scored.reserve(candidates.size());
+  quint64 mask = charMask(prefix);
+  for (int index : std::as_const(candidates)) {
+    // Cheap rejection before the character-by-character match
+    if ((m_masks[index] & mask) != mask)
+      continue;
+    int score = fuzzyScore(prefix, m_items[index].filterText);
+    if (score >= 0)
+      scored.append(qMakePair(-score, index));
+  }
+
+  // Equal scores keep the server's order
+  std::sort(scored.begin(), scored.end());
+
+  beginResetModel();
+  m_visible.resize(scored.size());
+  for (int i = 0; i < scored.size(); ++i)
+    m_visible[i] = scored[i].second;
+  m_filter = prefix;
+  endResetModel();
+}
+
+int CompletionModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : m_visible.size();
+}
+
+QVariant CompletionModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= m_visible.size())
+    return QVariant();
+
+  const LSPCompletionItem &item = m_items[m_visible[index.row()]];
+  switch (role) {
+  case Qt::DisplayRole:
+  case Qt::EditRole:
+    return item.label;
+  case Qt::ToolTipRole:
+    return item.detail;
+  case InsertTextRole:
+    return item.insertText;
+  default:
+    return QVariant();
+  }
+}
+
+int CompletionModel::fuzzyScore(QStringView pattern, QStringView candidate) {
+  if (pattern.isEmpty())
+    return 0;
+  if (pattern.size() > candidate.size())
+    return -1;
+
+  int score = 0;
+  qsizetype p = 0;
+  qsizetype last = -2;
+  for (qsizetype i = 0; i < candidate.size() && p < pattern.size(); ++i) {
+    QChar ch = candidate[i];
+    QChar wanted = pattern[p];
+    if (ch != wanted && foldCase(ch) != foldCase(wanted))
+      continue;
+
+    int bonus = 1;
+    if (ch == wanted)
+      bonus += 1; // Same case
+    if (i == 0)
+      bonus += 8;
+    else if (isWordStart(candidate, i))
+      bonus += 4;
+    if (i == last + 1)
+      bonus += 3; // Continues the previous match
+    score += bonus;
+    last = i;
+    ++p;
+  }
+
+  if (p < pattern.size())
+    return -1;
+
+  // Among otherwise equal matches prefer the shorter name
+  return score * 16 - qMin<qsizetype>(candidate.size() - pattern.size(), 15);
+}
+
+quint64 CompletionModel::charMask(QStringView text) {
+  quint64 mask = 0;
+  for (QChar ch : text) {
+    ushort u = foldCase(ch);
+    if (u >= 'a' && u <= 'z')
+      mask |= quint64(1) << (u - 'a');
+    else if (u >= '0' && u <= '9')
+      mask |= quint64(1) << (26 + u - '0');
+    else if (u == '_')
+      mask |= quint64(1) << 36;
+    else
+      mask |= quint64(1) << (37 + u % 27);
+  }
+  return mask;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "lsp/lsptypes.h"
+#include <QAbstractListModel>
+#include <QStringView>
+#include <QVector>
+
+// Flat model behind the editor's completion popup. It keeps the items of the
+// last textDocument/completion response and narrows them locally as the user
+// keeps typing, so the server is only asked again when the word changes or
+// the response was marked incomplete.
+class CompletionModel : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  enum Roles { InsertTextRole = Qt::UserRole + 1 };
+
+  explicit CompletionModel(QObject *parent = nullptr);
+
+  void setItems(const QVector<LSPCompletionItem> &items);
+  void clear();
+  // Shows the items matching `prefix`, best match first
+  void setFilter(const QString &prefix);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+
+  // Returns -1 if `pattern` is not a case-insensitive subsequence of
+  // `candidate`, otherwise a score that favours prefix, word-start and
+  // consecutive matches
+  static int fuzzyScore(QStringView pattern, QStringView candidate);
+
+private:
+  static quint64 charMask(QStringView text);
+
+  QVector<LSPCompletionItem> m_items;
+  QVector<quint64> m_masks; // Characters present in each item's filter text
+  QVector<int> m_visible;   // Indices into m_items in display order
+  QString m_filter;
+};
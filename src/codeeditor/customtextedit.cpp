@@ -21,6 +21,22 @@ void CustomPlainTextEdit::keyPressEvent(QKeyEvent *e) {
         return;
     }
 
+    // Keys the completion popup acts on itself; QCompleter forwards them
+    // here as well, so they must not also edit the text
+    if (editor->isCompletionPopupVisible()) {
+        switch (e->key()) {
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+        case Qt::Key_Tab:
+        case Qt::Key_Backtab:
+        case Qt::Key_Escape:
+            e->ignore();
+            return;
+        default:
+            break;
+        }
+    }
+
     // Handle Home key
     if (e->key() == Qt::Key_Home && !(e->modifiers() & Qt::ControlModifier)) {
         QTextCursor cursor = textCursor();
@@ -0,0 +1,113 @@
+#include "decorations.h"
+#include <QPlainTextEdit>
+#include <QTextBlock>
+#include <algorithm>
+
+static bool startsBefore(const QTextEdit::ExtraSelection &a,
+                         const QTextEdit::ExtraSelection &b) {
+  return a.cursor.selectionStart() < b.cursor.selectionStart();
+}
+
+EditorDecorations::EditorDecorations(QPlainTextEdit *editor)
+    : QObject(editor), m_editor(editor), m_windowStart(0), m_windowEnd(-1),
+      m_movingWindow(false) {
+  // Fires on scrolls, resizes and edits; anything that stays inside the
+  // current window is a cheap no-op
+  connect(m_editor, &QPlainTextEdit::updateRequest, this, [this]() {
+    if (!updateWindow())
+      return;
+    m_movingWindow = true;
+    emit windowChanged(m_windowStart, m_windowEnd);
+    m_movingWindow = false;
+    flush();
+  });
+}
+
+void EditorDecorations::setLayer(Layer layer,
+                                 QList<QTextEdit::ExtraSelection> selections) {
+  LayerData &data = m_layers[layer];
+  if (!std::is_sorted(selections.cbegin(), selections.cend(), startsBefore))
+    std::stable_sort(selections.begin(), selections.end(), startsBefore);
+
+  data.maxLength = 0;
+  for (const QTextEdit::ExtraSelection &selection : selections) {
+    data.maxLength =
+        qMax(data.maxLength, selection.cursor.selectionEnd() -
+                                 selection.cursor.selectionStart());
+  }
+  data.selections = std::move(selections);
+  data.dirty = true;
+
+  if (m_movingWindow)
+    return;
+  if (updateWindow()) {
+    m_movingWindow = true;
+    emit windowChanged(m_windowStart, m_windowEnd);
+    m_movingWindow = false;
+  }
+  flush();
+}
+
+void EditorDecorations::clearLayer(Layer layer) {
+  if (m_layers[layer].selections.isEmpty())
+    return;
+  setLayer(layer, {});
+}
+
+const QList<QTextEdit::ExtraSelection> &
+EditorDecorations::selections(Layer layer) const {
+  return m_layers[layer].selections;
+}
+
+// Moves the window when the visible text is no longer inside it. Returns
+// whether it moved, in which case every layer has to be clipped again.
+bool EditorDecorations::updateWindow() {
+  QTextBlock first = m_editor->firstVisibleBlock();
+  QTextBlock last =
+      m_editor
+          ->cursorForPosition(QPoint(0, m_editor->viewport()->height() - 1))
+          .block();
+  if (!first.isValid() || !last.isValid())
+    return false;
+
+  int visibleStart = first.position();
+  int visibleEnd = last.position() + last.length();
+  if (visibleStart >= m_windowStart && visibleEnd <= m_windowEnd)
+    return false;
+
+  int screen = visibleEnd - visibleStart;
+  m_windowStart = qMax(0, visibleStart - screen);
+  m_windowEnd = visibleEnd + screen;
+  for (LayerData &layer : m_layers)
+    layer.dirty = true;
+  return true;
+}
+
+void EditorDecorations::clip(LayerData &layer) {
+  layer.visible.clear();
+  layer.dirty = false;
+
+  // Nothing starting before windowStart - maxLength can reach the window
+  auto it = std::lower_bound(
+      layer.selections.cbegin(), layer.selections.cend(),
+      m_windowStart - layer.maxLength,
+      [](const QTextEdit::ExtraSelection &selection, int position) {
+        return selection.cursor.selectionStart() < position;
+      });
+  for (; it != layer.selections.cend(); ++it) {
+    if (it->cursor.selectionStart() > m_windowEnd)
+      break;
+    if (it->cursor.selectionEnd() >= m_windowStart)
+      layer.visible.append(*it);
+  }
+}
+
+void EditorDecorations::flush() {
+  QList<QTextEdit::ExtraSelection> all;
+  for (LayerData &layer : m_layers) {
+    if (layer.dirty)
+      clip(layer);
+    all.append(layer.visible);
+  }
+  m_editor->setExtraSelections(all);
+}
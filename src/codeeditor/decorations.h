@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QTextEdit>
+
+class QPlainTextEdit;
+
+// Owns the editor's extra selections, split into independent layers. Each
+// feature replaces only its own layer and never sees the others. The editor
+// is handed the union of the layers clipped to a window around the viewport,
+// so thousands of search or diagnostic marks cost nothing while off screen,
+// and a cursor move only rebuilds the small layers that follow the cursor.
+class EditorDecorations : public QObject {
+  Q_OBJECT
+
+public:
+  // Layers are painted in this order, later ones on top
+  enum Layer {
+    CurrentLineLayer,
+    SearchLayer,
+    OccurrenceLayer, // Other uses of the symbol under the cursor
+    DiagnosticLayer,
+    BracketLayer,
+    LayerCount
+  };
+
+  explicit EditorDecorations(QPlainTextEdit *editor);
+
+  void setLayer(Layer layer, QList<QTextEdit::ExtraSelection> selections);
+  void clearLayer(Layer layer);
+  const QList<QTextEdit::ExtraSelection> &selections(Layer layer) const;
+
+  // Document range currently handed to the editor. Producers with too many
+  // marks to keep as cursors can fill their layer with just this range and
+  // refill it on windowChanged.
+  int windowStart() const { return m_windowStart; }
+  int windowEnd() const { return m_windowEnd; }
+
+signals:
+  // Emitted before the editor is updated; layers set from a connected slot
+  // are flushed together with the move
+  void windowChanged(int start, int end);
+
+private:
+  struct LayerData {
+    QList<QTextEdit::ExtraSelection> selections; // Sorted by start
+    QList<QTextEdit::ExtraSelection> visible;    // Those inside the window
+    int maxLength = 0; // Longest selection, bounds the backward search
+    bool dirty = false;
+  };
+
+  bool updateWindow();
+  void clip(LayerData &layer);
+  void flush();
+
+  QPlainTextEdit *m_editor;
+  LayerData m_layers[LayerCount];
+  // Document range whose decorations are handed to the editor: the visible
+  // text plus a screen above and below, so short scrolls change nothing
+  int m_windowStart;
+  int m_windowEnd;
+  bool m_movingWindow;
+};
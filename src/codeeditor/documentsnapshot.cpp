@@ -0,0 +1,92 @@
+#include "documentsnapshot.h"
+#include <QMutex>
+#include <QObject>
+#include <QTextDocument>
+
+struct DocumentSnapshot::Data {
+  quint64 version = 0;
+  QString rawText;
+
+  QMutex plainTextLock;
+  QString plainText;
+  bool hasPlainText = false;
+};
+
+// Lives as a child of the document and holds its current snapshot until the
+// next edit
+class DocumentSnapshot::Cache : public QObject {
+public:
+  explicit Cache(QTextDocument *document) : QObject(document) {
+    setObjectName(QStringLiteral("DocumentSnapshotCache"));
+    connect(document, &QTextDocument::contentsChange, this, [this]() {
+      ++version;
+      current.reset();
+    });
+  }
+
+  static Cache *find(QTextDocument *document) {
+    return static_cast<Cache *>(document->findChild<QObject *>(
+        QStringLiteral("DocumentSnapshotCache"), Qt::FindDirectChildrenOnly));
+  }
+
+  quint64 version = 0;
+  QSharedPointer<Data> current;
+};
+
+void DocumentSnapshot::track(QTextDocument *document) {
+  if (document && !Cache::find(document))
+    new Cache(document);
+}
+
+DocumentSnapshot DocumentSnapshot::of(QTextDocument *document) {
+  DocumentSnapshot snapshot;
+  if (!document)
+    return snapshot;
+
+  Cache *cache = Cache::find(document);
+  if (!cache)
+    cache = new Cache(document);
+  if (!cache->current) {
+    cache->current = QSharedPointer<Data>::create();
+    cache->current->version = cache->version;
+    cache->current->rawText = document->toRawText();
+  }
+  snapshot.d = cache->current;
+  return snapshot;
+}
+
+quint64 DocumentSnapshot::version() const { return d ? d->version : 0; }
+
+const QString &DocumentSnapshot::rawText() const {
+  static const QString empty;
+  return d ? d->rawText : empty;
+}
+
+QString DocumentSnapshot::plainText() const {
+  if (!d)
+    return QString();
+
+  QMutexLocker locker(&d->plainTextLock);
+  if (!d->hasPlainText) {
+    // The same substitutions QTextDocument::toPlainText() makes
+    QString text = d->rawText;
+    for (QChar &ch : text) {
+      switch (ch.unicode()) {
+      case 0xfdd0: // QTextBeginningOfFrame
+      case 0xfdd1: // QTextEndOfFrame
+      case QChar::ParagraphSeparator:
+      case QChar::LineSeparator:
+        ch = QLatin1Char('\n');
+        break;
+      case QChar::Nbsp:
+        ch = QLatin1Char(' ');
+        break;
+      default:
+        break;
+      }
+    }
+    d->plainText = text;
+    d->hasPlainText = true;
+  }
+  return d->plainText;
+}
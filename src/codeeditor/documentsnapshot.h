@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QSharedPointer>
+#include <QString>
+
+class QTextDocument;
+
+// An immutable copy of a document's text, tagged with the edit it reflects.
+// Copies share one buffer and may be handed to other threads. A document's
+// snapshot is built at most once per edit, when first asked for, so the
+// highlighter, search and LSP sync share one copy of the text instead of
+// each materializing their own.
+class DocumentSnapshot {
+public:
+  DocumentSnapshot() = default;
+
+  // Starts following the document's edits. Call it before anything else
+  // connects to QTextDocument::contentsChange, so that handlers of an edit
+  // never see the snapshot from before it.
+  static void track(QTextDocument *document);
+  // The snapshot of the document's current contents
+  static DocumentSnapshot of(QTextDocument *document);
+
+  bool isNull() const { return !d; }
+  // Increases with every edit to the document
+  quint64 version() const;
+  // As QTextDocument::toRawText(): blocks end in U+2029, so offsets are
+  // document positions and lines correspond to blocks
+  const QString &rawText() const;
+  // As QTextDocument::toPlainText(), with the same length as rawText().
+  // Converted once per snapshot, on first use.
+  QString plainText() const;
+
+private:
+  struct Data;
+  class Cache;
+
+  QSharedPointer<Data> d;
+};
@@ -1,33 +1,48 @@
 #include "folding.h"
+#include "blockdata.h"
+#include <QTextDocument>
+#include <algorithm>
 #include <qpainter.h>
 
-CodeFolding::CodeFolding() {}
+CodeFolding::CodeFolding() : m_document(nullptr) {}
 
 CodeFolding::~CodeFolding() {}
 
+void CodeFolding::setDocument(QTextDocument *document) {
+  m_document = document;
+  m_folds.clear();
+  m_maxEnd.clear();
+}
+
+static bool hasFlag(const BlockData *facts, BlockData::FoldFlag flag) {
+  return facts->foldFlags & flag;
+}
+
 bool CodeFolding::isFoldable(const QTextBlock &block) const {
   if (!block.isValid())
     return false;
 
-  QString text = block.text().trimmed();
-  if (text.isEmpty())
+  // Only cached flags are read here: this runs for every visible line on
+  // each gutter paint
+  const BlockData *facts = lineFacts(block);
+  if (hasFlag(facts, BlockData::BlankLine))
     return false;
 
   // Case 1: Block ends with an opening brace
-  if (text.endsWith('{'))
+  if (hasFlag(facts, BlockData::EndsWithOpenBrace))
     return true;
 
   // Case 2: Function or class declaration that might span multiple lines
-  if (text.startsWith("class ") || text.startsWith("struct ") ||
-      text.contains("function") || text.contains("(")) {
+  if (hasFlag(facts, BlockData::DeclarationLike)) {
     // Check if any following block has an opening brace
     QTextBlock nextBlock = block.next();
     int maxLines = 3; // Look ahead maximum 3 lines
     while (nextBlock.isValid() && maxLines > 0) {
-      QString nextText = nextBlock.text().trimmed();
-      if (nextText.endsWith('{'))
+      const BlockData *next = lineFacts(nextBlock);
+      if (hasFlag(next, BlockData::EndsWithOpenBrace))
         return true;
-      if (!nextText.isEmpty() && !nextText.contains("("))
+      if (!hasFlag(next, BlockData::BlankLine) &&
+          !hasFlag(next, BlockData::HasParenthesis))
         break;
       nextBlock = nextBlock.next();
       maxLines--;
@@ -35,137 +50,268 @@ bool CodeFolding::isFoldable(const QTextBlock &block) const {
   }
 
   // Case 3: Indentation-based folding
-  int currentIndent = getIndentLevel(block.text());
-  if (currentIndent == 0)
+  if (facts->indentLevel == 0)
     return false; // Don't fold non-indented blocks
 
   QTextBlock nextBlock = block.next();
-  while (nextBlock.isValid() && nextBlock.text().trimmed().isEmpty()) {
+  while (nextBlock.isValid() &&
+         hasFlag(lineFacts(nextBlock), BlockData::BlankLine)) {
     nextBlock = nextBlock.next();
   }
 
   if (!nextBlock.isValid())
     return false;
 
-  int nextIndent = getIndentLevel(nextBlock.text());
-  return nextIndent > currentIndent;
+  return lineFacts(nextBlock)->indentLevel > facts->indentLevel;
 }
 
 bool CodeFolding::isFolded(const QTextBlock &block) const {
-  return m_foldedBlocks.value(block.blockNumber(), false);
+  return foldIndex(block) != -1;
 }
 
-void CodeFolding::setFolded(const QTextBlock &block, bool folded) {
-  if (!isFoldable(block))
-    return;
+bool CodeFolding::setFolded(const QTextBlock &block, bool folded) {
+  if (!m_document || !block.isValid())
+    return false;
 
-  int blockNum = block.blockNumber();
+  int index = foldIndex(block);
+  int first = block.blockNumber() + 1;
+  int last;
   if (folded) {
-    m_foldedBlocks[blockNum] = true;
-    // Find and store the end of the folding range
-    int endBlockNum = findFoldingEndBlock(block);
-    if (endBlockNum > blockNum) {
-      m_foldingRanges[blockNum] = endBlockNum;
-    }
+    if (index != -1 || !isFoldable(block))
+      return false;
+    last = findFoldingEndBlock(block);
+    if (last < first)
+      return false;
+    Fold fold;
+    fold.start = QTextCursor(block);
+    fold.end = QTextCursor(m_document->findBlockByNumber(last));
+    m_folds.insert(firstFoldAtOrAfter(block), fold);
   } else {
-    m_foldedBlocks.remove(blockNum);
-    m_foldingRanges.remove(blockNum);
+    if (index == -1)
+      return false;
+    last = m_folds[index].end.blockNumber();
+    m_folds.remove(index);
   }
+
+  rebuildMaxEnd();
+  updateVisibility(first, last);
+  return true;
 }
 
-void CodeFolding::toggleFold(const QTextBlock &block) {
+bool CodeFolding::toggleFold(const QTextBlock &block) {
   if (!block.isValid())
-    return;
+    return false;
 
+  // A fold can always be opened again, even if its text has since changed
+  if (isFolded(block))
+    return setFolded(block, false);
+  if (!isFoldable(block))
+    return false;
+
+  // If this block is part of a function/class declaration spanning multiple
+  // lines, find the block with the opening brace
   QTextBlock blockToFold = block;
-  if (isFoldable(blockToFold)) {
-    bool shouldFold = !isFolded(blockToFold);
-
-    // If this block is part of a function/class declaration spanning multiple
-    // lines, find the block with the opening brace
-    if (!blockToFold.text().trimmed().endsWith('{')) {
-      QTextBlock searchBlock = blockToFold;
-      int maxLines = 3;
-      while (searchBlock.isValid() && maxLines > 0) {
-        QString text = searchBlock.text().trimmed();
-        if (text.endsWith('{')) {
-          blockToFold = searchBlock;
-          break;
-        }
-        searchBlock = searchBlock.next();
-        maxLines--;
+  if (!hasFlag(lineFacts(blockToFold), BlockData::EndsWithOpenBrace)) {
+    QTextBlock searchBlock = blockToFold;
+    int maxLines = 3;
+    while (searchBlock.isValid() && maxLines > 0) {
+      if (hasFlag(lineFacts(searchBlock), BlockData::EndsWithOpenBrace)) {
+        blockToFold = searchBlock;
+        break;
       }
+      searchBlock = searchBlock.next();
+      maxLines--;
     }
-
-    setFolded(blockToFold, shouldFold);
   }
+
+  return setFolded(blockToFold, !isFolded(blockToFold));
 }
 
-void CodeFolding::foldAll(QTextDocument *doc) {
-  if (!doc)
-    return;
+bool CodeFolding::foldAll() {
+  if (!m_document)
+    return false;
 
-  QTextBlock block = doc->firstBlock();
-  while (block.isValid()) {
-    if (isFoldable(block)) {
-      setFolded(block, true);
+  // Existing folds are kept; both lists are in document order, so they merge
+  // in a single pass
+  QVector<Fold> folds;
+  int index = 0;
+  int number = 0;
+  for (QTextBlock block = m_document->firstBlock(); block.isValid();
+       block = block.next(), ++number) {
+    int blockEnd = block.position() + block.length();
+    bool folded = false;
+    while (index < m_folds.size() &&
+           m_folds[index].start.position() < blockEnd) {
+      if (!folded)
+        folds.append(m_folds[index]);
+      folded = true;
+      ++index;
+    }
+    if (folded || !isFoldable(block))
+      continue;
+
+    int end = findFoldingEndBlock(block);
+    if (end > number) {
+      Fold fold;
+      fold.start = QTextCursor(block);
+      fold.end = QTextCursor(m_document->findBlockByNumber(end));
+      folds.append(fold);
     }
-    block = block.next();
   }
+
+  bool changed = folds.size() != m_folds.size();
+  m_folds.swap(folds);
+  rebuildMaxEnd();
+  updateVisibility(0, m_document->blockCount() - 1);
+  return changed;
 }
 
-void CodeFolding::unfoldAll() {
-  m_foldedBlocks.clear();
-  m_foldingRanges.clear();
+bool CodeFolding::unfoldAll() {
+  if (!m_document || m_folds.isEmpty())
+    return false;
+
+  m_folds.clear();
+  m_maxEnd.clear();
+  updateVisibility(0, m_document->blockCount() - 1);
+  return true;
 }
 
 bool CodeFolding::isBlockVisible(const QTextBlock &block) const {
   if (!block.isValid())
     return false;
 
-  // Check if any parent blocks are folded
-  QTextBlock current = block.previous();
-  int currentBlockNum = block.blockNumber();
+  return hiddenUntil(firstFoldAtOrAfter(block)) < block.blockNumber();
+}
+
+void CodeFolding::updateVisibility(int first, int last) {
+  if (!m_document)
+    return;
+  first = qMax(first, 0);
+  last = qMin(last, m_document->blockCount() - 1);
+  if (first > last)
+    return;
 
-  while (current.isValid()) {
-    int parentBlockNum = current.blockNumber();
-    if (m_foldedBlocks.value(parentBlockNum, false)) {
-      int foldEnd = m_foldingRanges.value(parentBlockNum, -1);
-      if (currentBlockNum <= foldEnd) {
-        return false;
-      }
+  QTextBlock block = m_document->findBlockByNumber(first);
+  int index = firstFoldAtOrAfter(block);
+  int hidden = hiddenUntil(index);
+  int dirtyStart = -1;
+  int dirtyEnd = -1;
+
+  for (int number = first; block.isValid() && number <= last;
+       block = block.next(), ++number) {
+    bool visible = number > hidden;
+    int blockEnd = block.position() + block.length();
+    if (block.isVisible() != visible) {
+      block.setVisible(visible);
+      if (dirtyStart == -1)
+        dirtyStart = block.position();
+      dirtyEnd = blockEnd;
+    }
+
+    // Folds headed by this block hide the blocks after it
+    while (index < m_folds.size() &&
+           m_folds[index].start.position() < blockEnd) {
+      hidden = qMax(hidden, m_folds[index].end.blockNumber());
+      ++index;
     }
-    current = current.previous();
   }
 
-  return true;
+  // Only the blocks whose visibility flipped need a new layout
+  if (dirtyStart != -1)
+    m_document->markContentsDirty(dirtyStart, dirtyEnd - dirtyStart);
+}
+
+const BlockData *CodeFolding::lineFacts(const QTextBlock &block) const {
+  QTextBlock target = block;
+  BlockData *data = BlockData::ensure(target);
+  if (data->foldRevision == block.revision())
+    return data;
+
+  const QString line = block.text();
+  const QString text = line.trimmed();
+  bool hasParenthesis = text.contains('(');
+  quint8 flags = 0;
+  if (text.isEmpty())
+    flags |= BlockData::BlankLine;
+  if (text.endsWith('{'))
+    flags |= BlockData::EndsWithOpenBrace;
+  if (text.endsWith('}'))
+    flags |= BlockData::EndsWithCloseBrace;
+  if (hasParenthesis)
+    flags |= BlockData::HasParenthesis;
+  if (text.startsWith("class ") || text.startsWith("struct ") ||
+      text.contains("function") || hasParenthesis)
+    flags |= BlockData::DeclarationLike;
+
+  data->foldFlags = flags;
+  data->indentLevel = getIndentLevel(line);
+  data->braceDelta = int(text.count('{') - text.count('}'));
+  data->foldRevision = block.revision();
+  return data;
+}
+
+int CodeFolding::firstFoldAtOrAfter(const QTextBlock &block) const {
+  auto it = std::lower_bound(
+      m_folds.cbegin(), m_folds.cend(), block.position(),
+      [](const Fold &fold, int position) {
+        return fold.start.position() < position;
+      });
+  return int(it - m_folds.cbegin());
+}
+
+int CodeFolding::foldIndex(const QTextBlock &block) const {
+  if (!block.isValid())
+    return -1;
+
+  int index = firstFoldAtOrAfter(block);
+  if (index < m_folds.size() &&
+      m_folds[index].start.position() < block.position() + block.length())
+    return index;
+  return -1;
+}
+
+// Last block hidden by the first `foldCount` folds, or -1
+int CodeFolding::hiddenUntil(int foldCount) const {
+  if (foldCount <= 0)
+    return -1;
+  return m_folds[m_maxEnd[foldCount - 1]].end.blockNumber();
+}
+
+void CodeFolding::rebuildMaxEnd() {
+  m_maxEnd.resize(m_folds.size());
+  int furthest = -1;
+  for (int i = 0; i < m_folds.size(); ++i) {
+    if (furthest == -1 ||
+        m_folds[i].end.position() > m_folds[furthest].end.position())
+      furthest = i;
+    m_maxEnd[i] = furthest;
+  }
 }
 
 int CodeFolding::findFoldingEndBlock(const QTextBlock &startBlock) const {
   if (!startBlock.isValid())
     return -1;
 
-  QString startText = startBlock.text().trimmed();
-  int startIndent = getIndentLevel(startBlock.text());
+  const BlockData *start = lineFacts(startBlock);
+  int startIndent = start->indentLevel;
 
   // Case 1: Block starts with a brace
-  bool hasBrace = startText.endsWith('{');
+  bool hasBrace = hasFlag(start, BlockData::EndsWithOpenBrace);
   int braceCount = hasBrace ? 1 : 0;
 
   // Case 2: Function/class declaration that might span multiple lines
-  if (!hasBrace &&
-      (startText.startsWith("class ") || startText.startsWith("struct ") ||
-       startText.contains("function") || startText.contains("("))) {
+  if (!hasBrace && hasFlag(start, BlockData::DeclarationLike)) {
     QTextBlock nextBlock = startBlock.next();
     int maxLines = 3;
     while (nextBlock.isValid() && maxLines > 0) {
-      QString nextText = nextBlock.text().trimmed();
-      if (nextText.endsWith('{')) {
+      const BlockData *next = lineFacts(nextBlock);
+      if (hasFlag(next, BlockData::EndsWithOpenBrace)) {
         hasBrace = true;
         braceCount = 1;
         break;
       }
-      if (!nextText.isEmpty() && !nextText.contains("("))
+      if (!hasFlag(next, BlockData::BlankLine) &&
+          !hasFlag(next, BlockData::HasParenthesis))
         break;
       nextBlock = nextBlock.next();
       maxLines--;
@@ -176,24 +322,25 @@ int CodeFolding::findFoldingEndBlock(const QTextBlock &startBlock) const {
   bool foundContent = false; // Track if we've found any non-empty content
 
   while (block.isValid()) {
-    QString text = block.text().trimmed();
-    if (text.isEmpty()) {
+    const BlockData *facts = lineFacts(block);
+    if (hasFlag(facts, BlockData::BlankLine)) {
       block = block.next();
       continue;
     }
 
     foundContent = true;
-    int indent = getIndentLevel(block.text());
+    int indent = facts->indentLevel;
 
     if (hasBrace) {
       // Count braces in the line
-      braceCount += text.count('{') - text.count('}');
+      braceCount += facts->braceDelta;
       if (braceCount == 0) {
         return block.blockNumber();
       }
       // If we find a closing brace at the same indent level, it's probably the
       // end
-      if (braceCount > 0 && indent == startIndent && text.endsWith('}')) {
+      if (braceCount > 0 && indent == startIndent &&
+          hasFlag(facts, BlockData::EndsWithCloseBrace)) {
         return block.blockNumber();
       }
     } else {
@@ -1,20 +1,35 @@
 #pragma once
 
-#include <QMap>
 #include <QTextBlock>
+#include <QTextCursor>
+#include <QVector>
 
+class BlockData;
+
+// Keeps the folded regions of one document and the visibility of the blocks
+// they hide. Folds are anchored with QTextCursors, so they follow edits
+// instead of going stale with block numbers. They are kept sorted by start,
+// together with a running maximum of their ends: because edits never reorder
+// cursors, whether a block lies inside any fold is a binary search, and
+// (un)folding re-evaluates visibility in one sweep over the affected blocks.
 class CodeFolding {
 public:
   CodeFolding();
   ~CodeFolding();
 
+  void setDocument(QTextDocument *document);
+
   bool isFoldable(const QTextBlock &block) const;
   bool isFolded(const QTextBlock &block) const;
-  void setFolded(const QTextBlock &block, bool folded);
-  void toggleFold(const QTextBlock &block);
-  void foldAll(QTextDocument *doc);
-  void unfoldAll();
+  // These update block visibility themselves and return whether anything
+  // changed; the caller only has to repaint
+  bool setFolded(const QTextBlock &block, bool folded);
+  bool toggleFold(const QTextBlock &block);
+  bool foldAll();
+  bool unfoldAll();
   bool isBlockVisible(const QTextBlock &block) const;
+  // Recomputes visibility for blocks [first, last] in one pass
+  void updateVisibility(int first, int last);
   int findFoldingEndBlock(const QTextBlock &startBlock) const;
   int getIndentLevel(const QString &text) const;
   void paintFoldingMarkers(QPainter &painter, const QTextBlock &block,
@@ -25,6 +40,19 @@ public:
                               int lineNumberAreaWidth) const;
 
 private:
-  QMap<int, bool> m_foldedBlocks;
-  QMap<int, int> m_foldingRanges;
+  struct Fold {
+    QTextCursor start; // In the header block, which stays visible
+    QTextCursor end;   // In the last hidden block
+  };
+
+  // Cached per-line facts, refreshed if the block changed since
+  const BlockData *lineFacts(const QTextBlock &block) const;
+  int firstFoldAtOrAfter(const QTextBlock &block) const;
+  int foldIndex(const QTextBlock &block) const;
+  int hiddenUntil(int foldCount) const;
+  void rebuildMaxEnd();
+
+  QTextDocument *m_document;
+  QVector<Fold> m_folds; // Sorted by start
+  QVector<int> m_maxEnd; // m_maxEnd[i]: fold in [0, i] that reaches furthest
 };
@@ -1,4 +1,6 @@
 #include "search.h"
+#include "decorations.h"
+#include "documentsnapshot.h"
 #include <QLineEdit>
 #include <QCheckBox>
 #include <QPushButton>
@@ -9,9 +11,12 @@
 #include <QRegularExpression>
 #include <QTextCursor>
 
-SearchDialog::SearchDialog(QPlainTextEdit *editor, QWidget *parent)
-    : QDialog(parent), m_editor(editor), m_searchFlags(QTextDocument::FindFlags()), m_lastSearchText("") {
+SearchDialog::SearchDialog(QPlainTextEdit *editor,
+                           EditorDecorations *decorations, QWidget *parent)
+    : QDialog(parent), m_editor(editor), m_decorations(decorations),
+      m_searchFlags(QTextDocument::FindFlags()), m_lastSearchText("") {
     setWindowTitle(tr("Find"));
+    m_engine = new SearchEngine(m_editor->document(), this);
     
     // Create find layout
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
@@ -20,6 +25,8 @@ SearchDialog::SearchDialog(QPlainTextEdit *editor, QWidget *parent)
     m_findLineEdit = new QLineEdit(this);
     findInputLayout->addWidget(new QLabel(tr("Find:")));
     findInputLayout->addWidget(m_findLineEdit);
+    m_matchCountLabel = new QLabel(this);
+    findInputLayout->addWidget(m_matchCountLabel);
     mainLayout->addLayout(findInputLayout);
 
     // Create options layout
@@ -67,6 +74,18 @@ SearchDialog::SearchDialog(QPlainTextEdit *editor, QWidget *parent)
     connect(m_replaceButton, &QPushButton::clicked, this, &SearchDialog::replace);
     connect(m_replaceAllButton, &QPushButton::clicked, this, &SearchDialog::replaceAll);
     connect(m_findLineEdit, &QLineEdit::textChanged, this, &SearchDialog::updateSearchHighlight);
+    connect(m_caseSensitiveCheckBox, &QCheckBox::toggled, this, &SearchDialog::updateSearchHighlight);
+    connect(m_wholeWordsCheckBox, &QCheckBox::toggled, this, &SearchDialog::updateSearchHighlight);
+    connect(m_regexCheckBox, &QCheckBox::toggled, this, &SearchDialog::updateSearchHighlight);
+
+    // Only the matches around the viewport become selections; the rest stay
+    // plain offsets in the engine's index
+    connect(m_engine, &SearchEngine::resultsChanged, this, [this]() {
+        updateVisibleHighlights();
+        updateMatchCount();
+    });
+    connect(m_decorations, &EditorDecorations::windowChanged, this,
+            &SearchDialog::updateVisibleHighlights);
 }
 
 SearchDialog::~SearchDialog() {
@@ -139,24 +158,81 @@ void SearchDialog::replace() {
 }
 
 void SearchDialog::replaceAll() {
-    QTextCursor cursor = m_editor->textCursor();
-    cursor.movePosition(QTextCursor::Start);
-    m_editor->setTextCursor(cursor);
+    QString searchText = m_findLineEdit->text();
+    if (searchText.isEmpty()) {
+        return;
+    }
+
+    QTextDocument::FindFlags flags = QTextDocument::FindFlags();
+    if (m_caseSensitiveCheckBox->isChecked()) {
+        flags |= QTextDocument::FindCaseSensitively;
+    }
+    if (m_wholeWordsCheckBox->isChecked()) {
+        flags |= QTextDocument::FindWholeWords;
+    }
+    SearchEngine::Query query = makeQuery(searchText, flags);
+    if (query.regex) {
+        QRegularExpression regex(searchText);
+        if (!regex.isValid()) {
+            QMessageBox::warning(
+                this, tr("Invalid Regular Expression"),
+                tr("The regular expression is invalid: %1").arg(regex.errorString()));
+            return;
+        }
+    }
+    m_lastSearchText = searchText;
+    m_searchFlags = flags;
 
+    // The new text is built in one pass over the snapshot, then only the
+    // span between the first and last change is swapped in
+    QTextDocument *document = m_editor->document();
+    const QString oldText = DocumentSnapshot::of(document).plainText();
     int count = 0;
-    while (findText(m_lastSearchText, m_searchFlags)) {
-        cursor = m_editor->textCursor();
-        cursor.insertText(m_replaceLineEdit->text());
-        count++;
+    const QString newText = SearchEngine::replaceAll(
+        oldText, query, m_replaceLineEdit->text(), &count);
+    if (count > 0) {
+        SearchEngine::applyMinimalEdit(document, newText);
     }
 
     QMessageBox::information(this, tr("Replace All"),
                            tr("Replaced %1 occurrence(s).").arg(count));
 }
 
+SearchEngine::Query SearchDialog::makeQuery(const QString &text,
+                                            QTextDocument::FindFlags flags) const {
+    SearchEngine::Query query;
+    query.pattern = text;
+    query.caseSensitive = flags.testFlag(QTextDocument::FindCaseSensitively);
+    query.regex = m_regexCheckBox->isChecked();
+    // Whole words never applied to regular expressions
+    query.wholeWords =
+        !query.regex && flags.testFlag(QTextDocument::FindWholeWords);
+    return query;
+}
+
 bool SearchDialog::findText(const QString &text, QTextDocument::FindFlags flags) {
+    // The index of the highlighted query answers with a binary search; it
+    // is only bypassed while a re-run after an edit is pending
+    if (m_engine->isUpToDate() && m_engine->query() == makeQuery(text, flags)) {
+        QTextCursor cursor = m_editor->textCursor();
+        int index = (flags & QTextDocument::FindBackward)
+                        ? m_engine->previousMatch(cursor.selectionStart())
+                        : m_engine->nextMatch(cursor.selectionEnd());
+        if (index < 0) {
+            return false;
+        }
+
+        const SearchEngine::Match &match = m_engine->match(index);
+        cursor.setPosition(match.start);
+        cursor.setPosition(match.start + match.length, QTextCursor::KeepAnchor);
+        m_editor->setTextCursor(cursor);
+        return true;
+    }
+
     if (m_regexCheckBox->isChecked()) {
-        QRegularExpression regex(text);
+        // Same options as the index, so '^' and '$' match at every line
+        // whether or not the index is current
+        QRegularExpression regex = SearchEngine::makeRegex(makeQuery(text, flags));
         if (!regex.isValid()) {
             QMessageBox::warning(
                 this, tr("Invalid Regular Expression"),
@@ -164,13 +240,8 @@ bool SearchDialog::findText(const QString &text, QTextDocument::FindFlags flags)
             return false;
         }
 
-        QRegularExpression::PatternOptions options;
-        if (!(flags & QTextDocument::FindCaseSensitively)) {
-            options |= QRegularExpression::CaseInsensitiveOption;
-        }
-        regex.setPatternOptions(options);
-
-        QString documentText = m_editor->toPlainText();
+        QString documentText =
+            DocumentSnapshot::of(m_editor->document()).plainText();
         QTextCursor cursor = m_editor->textCursor();
         int searchFrom = cursor.position();
 
@@ -203,21 +274,6 @@ bool SearchDialog::findText(const QString &text, QTextDocument::FindFlags flags)
 }
 
 void SearchDialog::updateSearchHighlight() {
-    clearSearchHighlights();
-
-    QString searchText = m_findLineEdit->text();
-    if (searchText.isEmpty()) {
-        return;
-    }
-
-    QTextCharFormat format;
-    format.setBackground(QColor(255, 255, 0, 100)); // Light yellow highlight
-
-    QTextCursor cursor = m_editor->textCursor();
-    int originalPosition = cursor.position();
-    cursor.movePosition(QTextCursor::Start);
-    m_editor->setTextCursor(cursor);
-
     QTextDocument::FindFlags flags = QTextDocument::FindFlags();
     if (m_caseSensitiveCheckBox->isChecked()) {
         flags |= QTextDocument::FindCaseSensitively;
@@ -226,60 +282,57 @@ void SearchDialog::updateSearchHighlight() {
         flags |= QTextDocument::FindWholeWords;
     }
 
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    // Supersedes the scan for the previous keystroke, if still running
+    m_engine->setQuery(makeQuery(m_findLineEdit->text(), flags));
+}
 
-    if (m_regexCheckBox->isChecked()) {
-        QRegularExpression regex(searchText);
-        if (!regex.isValid()) {
-            return;
-        }
+void SearchDialog::updateVisibleHighlights() {
+    if (m_engine->matchCount() == 0) {
+        clearSearchHighlights();
+        return;
+    }
 
-        QRegularExpression::PatternOptions options =
-            QRegularExpression::NoPatternOption;
-        if (!(flags & QTextDocument::FindCaseSensitively)) {
-            options |= QRegularExpression::CaseInsensitiveOption;
-        }
-        regex.setPatternOptions(options);
+    QTextCharFormat format;
+    format.setBackground(QColor(255, 255, 0, 100)); // Light yellow highlight
 
-        QString documentText = m_editor->toPlainText();
-        QRegularExpressionMatchIterator it = regex.globalMatch(documentText);
+    int first = 0;
+    int last = 0;
+    m_engine->matchesIn(m_decorations->windowStart(),
+                        m_decorations->windowEnd(), &first, &last);
+
+    QTextDocument *document = m_editor->document();
+    QList<QTextEdit::ExtraSelection> extraSelections;
+    extraSelections.reserve(last - first);
+    for (int i = first; i < last; ++i) {
+        const SearchEngine::Match &match = m_engine->match(i);
+        QTextEdit::ExtraSelection selection;
+        selection.format = format;
+        selection.cursor = QTextCursor(document);
+        selection.cursor.setPosition(match.start);
+        selection.cursor.setPosition(match.start + match.length,
+                                     QTextCursor::KeepAnchor);
+        extraSelections.append(selection);
+    }
 
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            QTextCursor matchCursor = m_editor->textCursor();
-            matchCursor.setPosition(match.capturedStart());
-            matchCursor.setPosition(match.capturedEnd(), QTextCursor::KeepAnchor);
+    m_decorations->setLayer(EditorDecorations::SearchLayer, extraSelections);
+}
 
-            QTextEdit::ExtraSelection selection;
-            selection.format = format;
-            selection.cursor = matchCursor;
-            extraSelections.append(selection);
-        }
+void SearchDialog::updateMatchCount() {
+    // While a re-run after an edit is pending the count is that of the
+    // previous results, less the matches the edit touched
+    QString error = m_engine->errorString();
+    if (m_findLineEdit->text().isEmpty()) {
+        m_matchCountLabel->clear();
+    } else if (!error.isEmpty()) {
+        m_matchCountLabel->setText(tr("Invalid pattern"));
+    } else if (m_engine->matchCount() == 0) {
+        m_matchCountLabel->setText(tr("No matches"));
     } else {
-        // Store original flags to restore after highlighting
-        QTextDocument::FindFlags originalFlags = m_searchFlags;
-        m_searchFlags = flags; // Use current flags for highlighting
-
-        while (m_editor->find(searchText, flags)) {
-            QTextEdit::ExtraSelection selection;
-            selection.format = format;
-            selection.cursor = m_editor->textCursor();
-            extraSelections.append(selection);
-        }
-
-        m_searchFlags = originalFlags; // Restore original flags
+        m_matchCountLabel->setText(tr("%n match(es)", "", m_engine->matchCount()));
     }
-
-    // Restore original cursor position
-    cursor.setPosition(originalPosition);
-    m_editor->setTextCursor(cursor);
-    m_editor->setExtraSelections(extraSelections);
+    m_matchCountLabel->setToolTip(error);
 }
 
 void SearchDialog::clearSearchHighlights() {
-    QList<QTextEdit::ExtraSelection> selections = m_editor->extraSelections();
-    selections.removeIf([](const QTextEdit::ExtraSelection &selection) {
-        return selection.format.background() == QColor(255, 255, 0, 100);
-    });
-    m_editor->setExtraSelections(selections);
-} 
\ No newline at end of file
+    m_decorations->clearLayer(EditorDecorations::SearchLayer);
+}
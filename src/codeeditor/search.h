@@ -1,18 +1,22 @@
 #pragma once
 
+#include "searchengine.h"
 #include <QDialog>
 #include <QPlainTextEdit>
 #include <QTextDocument>
 
+class EditorDecorations;
 class QLineEdit;
 class QCheckBox;
+class QLabel;
 class QPushButton;
 
 class SearchDialog : public QDialog {
   Q_OBJECT
 
 public:
-  explicit SearchDialog(QPlainTextEdit *editor, QWidget *parent = nullptr);
+  SearchDialog(QPlainTextEdit *editor, EditorDecorations *decorations,
+               QWidget *parent = nullptr);
   ~SearchDialog();
   void showFind();
   void showReplace();
@@ -29,12 +33,17 @@ private slots:
   void replace();
   void replaceAll();
   void updateSearchHighlight();
+  void updateVisibleHighlights();
+  void updateMatchCount();
   void clearSearchHighlights();
 
 private:
   bool findText(const QString &text, QTextDocument::FindFlags flags);
+  SearchEngine::Query makeQuery(const QString &text,
+                                QTextDocument::FindFlags flags) const;
 
   QPlainTextEdit *m_editor;
+  EditorDecorations *m_decorations;
   QLineEdit *m_findLineEdit;
   QLineEdit *m_replaceLineEdit;
   QCheckBox *m_caseSensitiveCheckBox;
@@ -44,6 +53,8 @@ private:
   QPushButton *m_findPrevButton;
   QPushButton *m_replaceButton;
   QPushButton *m_replaceAllButton;
+  QLabel *m_matchCountLabel;
+  SearchEngine *m_engine;
 
   QString m_lastSearchText;
   QTextDocument::FindFlags m_searchFlags;
@@ -0,0 +1,348 @@
+#include "searchengine.h"
+#include "documentsnapshot.h"
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+// Edits re-run the query once typing pauses for this long
+constexpr int kEditDelayMs = 150;
+// How many matches the worker finds between checks for cancellation
+constexpr int kCancelCheckInterval = 256;
+
+// Same rule as QTextDocument::FindWholeWords
+bool isWholeWord(QStringView text, qsizetype start, qsizetype length) {
+  qsizetype end = start + length;
+  return (start == 0 || !text[start - 1].isLetterOrNumber()) &&
+         (end == text.size() || !text[end].isLetterOrNumber());
+}
+} // namespace
+
+SearchEngine::SearchEngine(QTextDocument *document, QObject *parent)
+    : QObject(parent), m_document(document), m_stale(false), m_generation(0),
+      m_longestMatch(0) {
+  m_pool.setMaxThreadCount(1);
+
+  m_editTimer = new QTimer(this);
+  m_editTimer->setSingleShot(true);
+  m_editTimer->setInterval(kEditDelayMs);
+  connect(m_editTimer, &QTimer::timeout, this, &SearchEngine::restart);
+
+  connect(m_document, &QTextDocument::contentsChange, this,
+          [this](int position, int charsRemoved, int charsAdded) {
+            if (m_query.pattern.isEmpty())
+              return;
+
+            // Keep the index usable until the re-run lands: matches the edit
+            // touched are dropped and the ones after it shift
+            int editEnd = position + charsRemoved;
+            int delta = charsAdded - charsRemoved;
+            auto out = m_matches.begin();
+            for (auto it = m_matches.begin(); it != m_matches.end(); ++it) {
+              if (it->start + it->length <= position) {
+                *out++ = *it;
+              } else if (it->start >= editEnd) {
+                *out++ = Match{it->start + delta, it->length};
+              }
+            }
+            m_matches.erase(out, m_matches.end());
+
+            cancel();
+            m_stale = true;
+            m_editTimer->start();
+            emit resultsChanged();
+          });
+}
+
+SearchEngine::~SearchEngine() {
+  cancel();
+  m_pool.waitForDone();
+}
+
+void SearchEngine::setQuery(const Query &query) {
+  if (query == m_query && !m_stale)
+    return;
+  m_query = query;
+  restart();
+}
+
+void SearchEngine::cancel() {
+  if (m_job) {
+    m_job->cancelled = true;
+    m_job.reset();
+  }
+  ++m_generation;
+}
+
+void SearchEngine::restart() {
+  cancel();
+  m_editTimer->stop();
+  m_errorString.clear();
+
+  if (m_query.pattern.isEmpty()) {
+    m_matches.clear();
+    m_longestMatch = 0;
+    m_stale = false;
+    emit resultsChanged();
+    return;
+  }
+
+  if (m_query.regex) {
+    QRegularExpression regex = makeRegex(m_query);
+    if (!regex.isValid()) {
+      m_errorString = regex.errorString();
+      m_matches.clear();
+      m_longestMatch = 0;
+      m_stale = false;
+      emit resultsChanged();
+      return;
+    }
+  }
+
+  m_stale = true;
+  auto job = std::make_shared<Job>();
+  m_job = job;
+
+  const int generation = m_generation;
+  const Query query = m_query;
+  const DocumentSnapshot snapshot = DocumentSnapshot::of(m_document);
+  SearchEngine *receiver = this;
+
+  m_pool.start([=]() {
+    // Plain text, so that '\n' ends lines for the regex as it did when
+    // matching on the GUI thread
+    const QString text = snapshot.plainText();
+    QVector<Match> matches = findAll(text, query, &job->cancelled);
+    if (job->cancelled.load(std::memory_order_relaxed))
+      return;
+
+    QMetaObject::invokeMethod(
+        receiver,
+        [receiver, generation, matches = std::move(matches)]() mutable {
+          receiver->receive(generation, std::move(matches));
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+QRegularExpression SearchEngine::makeRegex(const Query &query) {
+  // '^' and '$' anchor at every line, as in an editor, not just at the
+  // ends of the whole text
+  QRegularExpression::PatternOptions options =
+      QRegularExpression::MultilineOption;
+  if (!query.caseSensitive)
+    options |= QRegularExpression::CaseInsensitiveOption;
+  return QRegularExpression(query.pattern, options);
+}
+
+SearchEngine::Matcher::Matcher(const Query &query)
+    : m_query(query),
+      m_literal(query.regex ? QString() : query.pattern,
+                query.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive) {
+  if (m_query.regex) {
+    m_regex = makeRegex(m_query);
+    // Compiles the pattern with the JIT up front
+    m_regex.optimize();
+  }
+}
+
+QVector<SearchEngine::Match>
+SearchEngine::Matcher::findAll(const QString &text,
+                               const std::atomic<bool> *cancel) const {
+  QVector<Match> matches;
+  if (m_query.pattern.isEmpty())
+    return matches;
+
+  int sinceCheck = 0;
+  auto cancelled = [&]() {
+    if (!cancel || ++sinceCheck < kCancelCheckInterval)
+      return false;
+    sinceCheck = 0;
+    return cancel->load(std::memory_order_relaxed);
+  };
+
+  if (m_query.regex) {
+    QRegularExpressionMatchIterator it = m_regex.globalMatch(text);
+    while (it.hasNext()) {
+      QRegularExpressionMatch match = it.next();
+      // Empty matches can be neither highlighted nor selected
+      if (match.capturedLength() > 0) {
+        matches.append(
+            Match{int(match.capturedStart()), int(match.capturedLength())});
+      }
+      if (cancelled())
+        break;
+    }
+  } else {
+    // Boyer-Moore skip table over the pattern, built once per Matcher
+    QStringView view(text);
+    const qsizetype length = m_query.pattern.size();
+    qsizetype from = 0;
+    while ((from = m_literal.indexIn(view, from)) >= 0) {
+      if (m_query.wholeWords && !isWholeWord(view, from, length)) {
+        ++from;
+      } else {
+        matches.append(Match{int(from), int(length)});
+        from += length;
+      }
+      if (cancelled())
+        break;
+    }
+  }
+  return matches;
+}
+
+QVector<SearchEngine::Match>
+SearchEngine::findAll(const QString &text, const Query &query,
+                      const std::atomic<bool> *cancel) {
+  return Matcher(query).findAll(text, cancel);
+}
+
+QString SearchEngine::replaceAll(const QString &text, const Query &query,
+                                 const QString &replacement, int *count) {
+  QString result;
+  int replaced = 0;
+  qsizetype copied = 0;
+
+  if (query.regex) {
+    // Iterated directly rather than through findAll() for the captures;
+    // empty matches count here, so "^" can prefix every line
+    QRegularExpression regex = makeRegex(query);
+    regex.optimize();
+    QRegularExpressionMatchIterator it = regex.globalMatch(text);
+    while (it.hasNext()) {
+      QRegularExpressionMatch match = it.next();
+      if (replaced == 0)
+        result.reserve(text.size());
+      result.append(
+          QStringView(text).mid(copied, match.capturedStart() - copied));
+      result.append(expandReplacement(match, replacement));
+      copied = match.capturedEnd();
+      ++replaced;
+    }
+  } else {
+    const QVector<Match> matches = findAll(text, query);
+    if (!matches.isEmpty()) {
+      result.reserve(text.size() + matches.size() * (replacement.size() -
+                                                     query.pattern.size()));
+    }
+    for (const Match &match : matches) {
+      result.append(QStringView(text).mid(copied, match.start - copied));
+      result.append(replacement);
+      copied = match.start + match.length;
+    }
+    replaced = matches.size();
+  }
+
+  if (count)
+    *count = replaced;
+  if (replaced == 0)
+    return text;
+  result.append(QStringView(text).mid(copied));
+  return result;
+}
+
+void SearchEngine::applyMinimalEdit(QTextDocument *document,
+                                    const QString &text) {
+  const QString oldText = DocumentSnapshot::of(document).plainText();
+  if (text == oldText)
+    return;
+  qsizetype prefix = 0;
+  const qsizetype maxPrefix = qMin(oldText.size(), text.size());
+  while (prefix < maxPrefix && oldText[prefix] == text[prefix])
+    ++prefix;
+  qsizetype suffix = 0;
+  const qsizetype maxSuffix = maxPrefix - prefix;
+  while (suffix < maxSuffix && oldText[oldText.size() - 1 - suffix] ==
+                                   text[text.size() - 1 - suffix])
+    ++suffix;
+
+  QTextCursor cursor(document);
+  cursor.beginEditBlock();
+  cursor.setPosition(int(prefix));
+  cursor.setPosition(int(oldText.size() - suffix), QTextCursor::KeepAnchor);
+  cursor.insertText(text.mid(prefix, text.size() - suffix - prefix));
+  cursor.endEditBlock();
+}
+
+QString SearchEngine::expandReplacement(const QRegularExpressionMatch &match,
+                                        const QString &replacement) {
+  // $1 and \1 insert a capture group, $0 and \0 the whole match; $$ and \\
+  // are a literal $ and backslash. Two digits are taken when that group
+  // exists, so $10 means group 10 only in a pattern with ten groups.
+  QString result;
+  const int groupCount = match.regularExpression().captureCount();
+
+  for (qsizetype i = 0; i < replacement.size(); ++i) {
+    QChar ch = replacement[i];
+    if ((ch != QLatin1Char('$') && ch != QLatin1Char('\\')) ||
+        i + 1 == replacement.size()) {
+      result.append(ch);
+      continue;
+    }
+
+    QChar next = replacement[i + 1];
+    if (next == ch) {
+      result.append(ch);
+      ++i;
+    } else if (next.isDigit()) {
+      int group = next.digitValue();
+      ++i;
+      if (i + 1 < replacement.size() && replacement[i + 1].isDigit()) {
+        int twoDigits = group * 10 + replacement[i + 1].digitValue();
+        if (twoDigits <= groupCount) {
+          group = twoDigits;
+          ++i;
+        }
+      }
+      result.append(match.capturedView(group));
+    } else {
+      result.append(ch);
+    }
+  }
+  return result;
+}
+
+void SearchEngine::receive(int generation, QVector<Match> matches) {
+  // An edit or a newer query got in first
+  if (generation != m_generation)
+    return;
+
+  m_job.reset();
+  m_matches = std::move(matches);
+  m_longestMatch = 0;
+  for (const Match &match : m_matches)
+    m_longestMatch = qMax(m_longestMatch, match.length);
+  m_stale = false;
+  emit resultsChanged();
+}
+
+int SearchEngine::nextMatch(int position) const {
+  auto it = std::lower_bound(
+      m_matches.cbegin(), m_matches.cend(), position,
+      [](const Match &match, int position) { return match.start < position; });
+  return it == m_matches.cend() ? -1 : int(it - m_matches.cbegin());
+}
+
+int SearchEngine::previousMatch(int position) const {
+  auto it = std::lower_bound(
+      m_matches.cbegin(), m_matches.cend(), position,
+      [](const Match &match, int position) { return match.start < position; });
+  return it == m_matches.cbegin() ? -1 : int(it - m_matches.cbegin()) - 1;
+}
+
+void SearchEngine::matchesIn(int start, int end, int *first, int *last) const {
+  // Matches never overlap, but one starting up to m_longestMatch before
+  // `start` can still reach into the range
+  auto begin = std::lower_bound(
+      m_matches.cbegin(), m_matches.cend(), start - m_longestMatch,
+      [](const Match &match, int position) { return match.start < position; });
+  while (begin != m_matches.cend() && begin->start + begin->length <= start)
+    ++begin;
+  auto finish = std::lower_bound(
+      begin, m_matches.cend(), end,
+      [](const Match &match, int position) { return match.start < position; });
+  *first = int(begin - m_matches.cbegin());
+  *last = int(finish - m_matches.cbegin());
+}
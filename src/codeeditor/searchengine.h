@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringMatcher>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class QTextDocument;
+class QTimer;
+
+// Finds every occurrence of a query in a document without blocking the GUI.
+// Each query scans a DocumentSnapshot on a worker thread, a literal with
+// QStringMatcher and a regular expression with a JIT-compiled
+// QRegularExpression. The result is a position-sorted match index, so
+// next/previous are binary searches and callers can ask for just the
+// matches inside a range, such as the viewport. A new query or an edit
+// cancels the scan in flight; after edits the query is re-run once typing
+// pauses.
+class SearchEngine : public QObject {
+  Q_OBJECT
+
+public:
+  struct Query {
+    QString pattern;
+    bool caseSensitive = false;
+    bool wholeWords = false; // Literal queries only
+    bool regex = false;
+
+    bool operator==(const Query &other) const {
+      return pattern == other.pattern &&
+             caseSensitive == other.caseSensitive &&
+             wholeWords == other.wholeWords && regex == other.regex;
+    }
+    bool operator!=(const Query &other) const { return !(*this == other); }
+  };
+
+  struct Match {
+    int start;
+    int length;
+  };
+
+  // A query compiled once for scanning many texts. Not to be shared
+  // between threads; give each its own.
+  class Matcher {
+  public:
+    explicit Matcher(const Query &query);
+    // Every non-empty match in `text`, in order. Stops early once
+    // `cancel` is set.
+    QVector<Match> findAll(const QString &text,
+                           const std::atomic<bool> *cancel = nullptr) const;
+
+  private:
+    Query m_query;
+    QStringMatcher m_literal;
+    QRegularExpression m_regex;
+  };
+
+  explicit SearchEngine(QTextDocument *document, QObject *parent = nullptr);
+  ~SearchEngine();
+
+  // An empty pattern clears the results
+  void setQuery(const Query &query);
+  const Query &query() const { return m_query; }
+  // Results reflect the current query and the document as it is now
+  bool isUpToDate() const { return !m_stale; }
+  QString errorString() const { return m_errorString; }
+
+  int matchCount() const { return m_matches.size(); }
+  const Match &match(int index) const { return m_matches[index]; }
+  // First match starting at or after `position`, or -1
+  int nextMatch(int position) const;
+  // Last match starting before `position`, or -1
+  int previousMatch(int position) const;
+  // Index range [first, last) of the matches overlapping [start, end)
+  void matchesIn(int start, int end, int *first, int *last) const;
+
+  // Matcher(query).findAll(text, cancel)
+  static QVector<Match> findAll(const QString &text, const Query &query,
+                                const std::atomic<bool> *cancel = nullptr);
+  // `text` with every match of `query` replaced in one pass. For regular
+  // expressions the replacement may refer to captures as $1 or \1.
+  static QString replaceAll(const QString &text, const Query &query,
+                            const QString &replacement, int *count);
+  // Turns `document` into `text` by replacing only the span between the
+  // first and last difference, as one edit and one undo step, so the
+  // cursor, blocks and highlighting outside it are left alone
+  static void applyMinimalEdit(QTextDocument *document, const QString &text);
+  // The expression a regex query compiles to, with the options every
+  // search path must share
+  static QRegularExpression makeRegex(const Query &query);
+
+signals:
+  void resultsChanged();
+
+private:
+  struct Job {
+    std::atomic<bool> cancelled{false};
+  };
+
+  static QString expandReplacement(const QRegularExpressionMatch &match,
+                                   const QString &replacement);
+
+  void restart();
+  void cancel();
+  void receive(int generation, QVector<Match> matches);
+
+  QTextDocument *m_document;
+  Query m_query;
+  QVector<Match> m_matches;
+  QString m_errorString;
+  bool m_stale;
+  int m_generation;
+  int m_longestMatch; // Bounds the backward search in matchesIn
+  std::shared_ptr<Job> m_job;
+  QTimer *m_editTimer;
+  QThreadPool m_pool;
+};
@@ -0,0 +1,316 @@
+#include "basehighlighter.h"
+#include "codeeditor/documentsnapshot.h"
+#include <QElapsedTimer>
+#include <QTextDocument>
+#include <QTimer>
+
+namespace {
+
+// Edits that touch more blocks than this (loading a file, Replace All) are
+// not highlighted synchronously beyond the visible blocks; neither is the
+// downstream ripple of a small edit once it runs past this many blocks.
+const int kSyncBlockLimit = 200;
+
+const int kChunkSize = 1000;    // Lines per result batch sent by the worker
+const int kApplySliceMs = 8;    // GUI time spent applying results per tick
+const int kRestartDelayMs = 250; // Lets a burst of typing settle first
+
+} // namespace
+
+BaseHighlighter::BaseHighlighter(QTextDocument *parent)
+    : QObject(parent), m_document(parent), m_enabled(true), m_blockCount(0),
+      m_dirtyFrom(0), m_visibleFirst(0), m_visibleLast(-1), m_visibleStale(true),
+      m_generation(0), m_chunkOffset(0) {
+    m_pool.setMaxThreadCount(1);
+
+    m_visibleTimer = new QTimer(this);
+    m_visibleTimer->setSingleShot(true);
+    m_visibleTimer->setInterval(0);
+    connect(m_visibleTimer, &QTimer::timeout, this, &BaseHighlighter::highlightVisibleBlocks);
+
+    m_restartTimer = new QTimer(this);
+    m_restartTimer->setSingleShot(true);
+    m_restartTimer->setInterval(kRestartDelayMs);
+    connect(m_restartTimer, &QTimer::timeout, this, &BaseHighlighter::startBackgroundPass);
+
+    m_applyTimer = new QTimer(this);
+    m_applyTimer->setInterval(0);
+    connect(m_applyTimer, &QTimer::timeout, this, &BaseHighlighter::applyPendingResults);
+
+    if (m_document) {
+        m_blockCount = m_document->blockCount();
+        connect(m_document, &QTextDocument::contentsChange, this,
+                &BaseHighlighter::handleContentsChange);
+        // lineFunction() is virtual, so the first pass has to wait until
+        // the subclass is fully constructed
+        QTimer::singleShot(0, this, &BaseHighlighter::rehighlight);
+    }
+}
+
+BaseHighlighter::~BaseHighlighter() {
+    // The worker posts its results to this object
+    cancelBackgroundPass();
+    m_pool.waitForDone();
+}
+
+void BaseHighlighter::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    rehighlight();
+}
+
+void BaseHighlighter::rehighlight() {
+    if (!m_document) return;
+
+    cancelBackgroundPass();
+    m_blockCount = m_document->blockCount();
+
+    if (!m_enabled) {
+        for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next()) {
+            applyFormats(block, FormatRanges());
+            block.setUserState(-1);
+        }
+        m_dirtyFrom = m_blockCount;
+        return;
+    }
+
+    m_dirtyFrom = 0;
+    m_visibleStale = true;
+    highlightVisibleBlocks();
+    startBackgroundPass();
+}
+
+void BaseHighlighter::setVisibleBlocks(int first, int last) {
+    if (first == m_visibleFirst && last == m_visibleLast && !m_visibleStale) {
+        return;
+    }
+    m_visibleFirst = first;
+    m_visibleLast = last;
+    m_visibleStale = true;
+
+    // Called while the view is laying itself out; don't touch block layouts
+    // from inside that
+    m_visibleTimer->start();
+}
+
+void BaseHighlighter::highlightVisibleBlocks() {
+    m_visibleStale = false;
+    if (!m_enabled || m_dirtyFrom > m_visibleLast) return;
+
+    // Blocks below m_dirtyFrom are already final. The rest get a provisional
+    // pass that starts from whatever state the block above has now; the
+    // background pass corrects them if that state turns out to be wrong.
+    int first = qMax(m_visibleFirst, m_dirtyFrom);
+    QTextBlock block = m_document->findBlockByNumber(first);
+    int state = stateBefore(block);
+    for (int number = first; number <= m_visibleLast && block.isValid(); ++number) {
+        state = highlightBlock(block, state);
+        block = block.next();
+    }
+}
+
+void BaseHighlighter::handleContentsChange(int position, int charsRemoved, int charsAdded) {
+    Q_UNUSED(charsRemoved);
+
+    int blockCount = m_document->blockCount();
+    int delta = blockCount - m_blockCount;
+    m_blockCount = blockCount;
+    if (!m_enabled) return;
+
+    QTextBlock first = m_document->findBlock(position);
+    if (!first.isValid()) return;
+    QTextBlock last = m_document->findBlock(position + charsAdded);
+    if (!last.isValid()) last = m_document->lastBlock();
+
+    int firstNumber = first.blockNumber();
+    int lastNumber = last.blockNumber();
+
+    // Blocks after the edit keep their highlighting, but move by the number
+    // of blocks inserted or removed
+    int dirtyFrom = m_dirtyFrom;
+    if (dirtyFrom > firstNumber) {
+        dirtyFrom = qMax(lastNumber + 1, dirtyFrom + delta);
+    }
+
+    bool bulk = lastNumber - firstNumber >= kSyncBlockLimit;
+    if (bulk) {
+        dirtyFrom = qMin(dirtyFrom, firstNumber);
+    } else {
+        // Re-highlight the edited blocks, then carry on only while the state
+        // at the end of each block differs from what it was before
+        QTextBlock block = first;
+        int state = stateBefore(block);
+        for (int number = firstNumber; block.isValid() && number < dirtyFrom; ++number) {
+            int previous = block.userState();
+            state = highlightBlock(block, state);
+            if (number >= lastNumber && state == previous) break;
+            if (number - lastNumber >= kSyncBlockLimit) {
+                dirtyFrom = number + 1;
+                break;
+            }
+            block = block.next();
+        }
+
+        // Edits past the final region are still shown right away
+        if (firstNumber >= dirtyFrom) {
+            QTextBlock edited = first;
+            int editedState = stateBefore(edited);
+            for (int number = firstNumber; number <= lastNumber && edited.isValid(); ++number) {
+                editedState = highlightBlock(edited, editedState);
+                edited = edited.next();
+            }
+        }
+    }
+
+    m_dirtyFrom = dirtyFrom;
+    m_visibleStale = true;
+    m_visibleTimer->start();
+
+    // Whatever the worker is tokenizing no longer matches the text
+    cancelBackgroundPass();
+    if (m_dirtyFrom < m_blockCount) {
+        m_restartTimer->start(bulk ? 0 : kRestartDelayMs);
+    }
+}
+
+void BaseHighlighter::startBackgroundPass() {
+    cancelBackgroundPass();
+    if (!m_enabled || m_dirtyFrom >= m_blockCount) return;
+
+    auto job = std::make_shared<Job>();
+    m_job = job;
+
+    const int generation = m_generation;
+    const int firstBlock = m_dirtyFrom;
+    const int initialState = stateBefore(m_document->findBlockByNumber(firstBlock));
+    const int lineCount = m_blockCount - firstBlock;
+    // Raw text keeps block boundaries (U+2029) distinct from line breaks
+    // inside a block (U+2028), so lines map one-to-one onto blocks. The
+    // snapshot is shared with the document's other readers and keeps the
+    // text alive for the worker.
+    const DocumentSnapshot snapshot = DocumentSnapshot::of(m_document);
+    const LineFunction highlight = highlightFunction();
+    BaseHighlighter *receiver = this;
+
+    m_pool.start([=]() {
+        auto post = [receiver](Chunk chunk) {
+            QMetaObject::invokeMethod(
+                receiver, [receiver, chunk = std::move(chunk)]() mutable {
+                    receiver->receiveChunk(std::move(chunk));
+                },
+                Qt::QueuedConnection);
+        };
+
+        const QChar separator = QChar::ParagraphSeparator;
+        QStringView view(snapshot.rawText());
+        qsizetype pos = 0;
+        for (int skipped = 0; skipped < firstBlock && pos >= 0; ++skipped) {
+            pos = view.indexOf(separator, pos);
+            if (pos >= 0) ++pos;
+        }
+        if (pos < 0) return;
+
+        Chunk chunk{generation, firstBlock, {}};
+        chunk.lines.reserve(qMin(kChunkSize, lineCount));
+        int state = initialState;
+        for (int line = 0; line < lineCount; ++line) {
+            if (job->cancelled.load(std::memory_order_relaxed)) return;
+
+            qsizetype end = view.indexOf(separator, pos);
+            bool lastLine = end < 0;
+            if (lastLine) end = view.size();
+
+            LineResult result;
+            state = highlight(view.mid(pos, end - pos), state, &result.formats);
+            result.state = state;
+            chunk.lines.append(std::move(result));
+
+            if (lastLine) break;
+            pos = end + 1;
+
+            if (chunk.lines.size() == kChunkSize) {
+                int next = chunk.firstBlock + kChunkSize;
+                post(std::move(chunk));
+                chunk = Chunk{generation, next, {}};
+                chunk.lines.reserve(kChunkSize);
+            }
+        }
+        post(std::move(chunk));
+    });
+}
+
+void BaseHighlighter::receiveChunk(Chunk chunk) {
+    if (chunk.generation != m_generation) return;
+
+    m_pendingChunks.append(std::move(chunk));
+    if (!m_applyTimer->isActive()) {
+        m_applyTimer->start();
+    }
+}
+
+void BaseHighlighter::applyPendingResults() {
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    while (!m_pendingChunks.isEmpty()) {
+        const Chunk &chunk = m_pendingChunks.first();
+        QTextBlock block = m_document->findBlockByNumber(chunk.firstBlock + m_chunkOffset);
+
+        while (m_chunkOffset < chunk.lines.size() && block.isValid()) {
+            const LineResult &result = chunk.lines[m_chunkOffset];
+            applyFormats(block, result.formats);
+            block.setUserState(result.state);
+            block = block.next();
+            ++m_chunkOffset;
+            m_dirtyFrom = chunk.firstBlock + m_chunkOffset;
+
+            if ((m_chunkOffset & 63) == 0 && elapsed.elapsed() >= kApplySliceMs) {
+                return;
+            }
+        }
+
+        m_pendingChunks.removeFirst();
+        m_chunkOffset = 0;
+    }
+
+    m_applyTimer->stop();
+}
+
+void BaseHighlighter::cancelBackgroundPass() {
+    if (m_job) {
+        m_job->cancelled = true;
+        m_job.reset();
+    }
+    ++m_generation;
+    m_pendingChunks.clear();
+    m_chunkOffset = 0;
+    m_applyTimer->stop();
+    m_restartTimer->stop();
+}
+
+const BaseHighlighter::LineFunction &BaseHighlighter::highlightFunction() {
+    if (!m_lineFunction) {
+        m_lineFunction = lineFunction();
+    }
+    return m_lineFunction;
+}
+
+int BaseHighlighter::highlightBlock(QTextBlock block, int state) {
+    FormatRanges formats;
+    int next = highlightFunction()(block.text(), state, &formats);
+    applyFormats(block, formats);
+    block.setUserState(next);
+    return next;
+}
+
+void BaseHighlighter::applyFormats(QTextBlock block, const FormatRanges &formats) {
+    QTextLayout *layout = block.layout();
+    if (!layout || layout->formats() == formats) return;
+
+    layout->setFormats(formats);
+    m_document->markContentsDirty(block.position(), block.length());
+}
+
+int BaseHighlighter::stateBefore(const QTextBlock &block) {
+    QTextBlock previous = block.previous();
+    return previous.isValid() ? previous.userState() : -1;
+}
@@ -1,33 +1,104 @@
 #pragma once
-#include <QSyntaxHighlighter>
+#include <QObject>
 #include <QString>
+#include <QStringView>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
 
-class BaseHighlighter : public QSyntaxHighlighter {
+class QTextDocument;
+class QTimer;
+
+// Highlights a QTextDocument without ever formatting the whole document on
+// the GUI thread:
+//  - edited blocks and the blocks on screen are highlighted synchronously,
+//  - everything else is tokenized on a worker thread from a text snapshot,
+//  - the worker's results are applied from the event loop in short slices.
+// Each block's end-of-line state lives in QTextBlock::userState(); an edit
+// only carries on to the following blocks while that state keeps changing.
+class BaseHighlighter : public QObject {
     Q_OBJECT
 
 public:
-    explicit BaseHighlighter(QTextDocument *parent = nullptr) 
-        : QSyntaxHighlighter(parent), m_enabled(true) {}
-    virtual ~BaseHighlighter() = default;
+    explicit BaseHighlighter(QTextDocument *parent = nullptr);
+    virtual ~BaseHighlighter();
 
     virtual QString name() const = 0;
     virtual QString description() const = 0;
     virtual QString filePattern() const = 0;
 
+    QTextDocument *document() const { return m_document; }
+
     bool isEnabled() const { return m_enabled; }
-    void setEnabled(bool enabled) { 
-        m_enabled = enabled;
-        rehighlight();
-    }
+    void setEnabled(bool enabled);
+
+    void rehighlight();
+
+    // Blocks currently on screen, highlighted ahead of the background pass
+    void setVisibleBlocks(int first, int last);
 
 protected:
-    void highlightBlock(const QString &text) override {
-        if (!m_enabled) return;
-        doHighlightBlock(text);
-    }
+    using FormatRanges = QVector<QTextLayout::FormatRange>;
+
+    // Highlights one line that starts in `state` (the value returned for the
+    // previous line, -1 for the first line) and returns the state the next
+    // line starts in.
+    using LineFunction = std::function<int(QStringView text, int state, FormatRanges *formats)>;
+
+    // The returned function is also run on worker threads and may outlive
+    // the highlighter, so it must capture everything it uses by value.
+    virtual LineFunction lineFunction() const = 0;
 
-    virtual void doHighlightBlock(const QString &text) = 0;
+private slots:
+    void handleContentsChange(int position, int charsRemoved, int charsAdded);
+    void highlightVisibleBlocks();
+    void startBackgroundPass();
+    void applyPendingResults();
 
 private:
+    struct LineResult {
+        FormatRanges formats;
+        int state;
+    };
+
+    struct Chunk {
+        int generation;
+        int firstBlock;
+        QVector<LineResult> lines;
+    };
+
+    struct Job {
+        std::atomic<bool> cancelled{false};
+    };
+
+    const LineFunction &highlightFunction();
+    int highlightBlock(QTextBlock block, int state);
+    void applyFormats(QTextBlock block, const FormatRanges &formats);
+    void cancelBackgroundPass();
+    void receiveChunk(Chunk chunk);
+    static int stateBefore(const QTextBlock &block);
+
+    QTextDocument *m_document;
     bool m_enabled;
-}; 
\ No newline at end of file
+    LineFunction m_lineFunction;
+
+    int m_blockCount;
+    int m_dirtyFrom;   // Blocks from here on are not final yet
+    int m_visibleFirst;
+    int m_visibleLast;
+    bool m_visibleStale;
+
+    // Background pass; results from an older generation are discarded
+    int m_generation;
+    std::shared_ptr<Job> m_job;
+    QVector<Chunk> m_pendingChunks;
+    int m_chunkOffset; // Next line to apply within the first pending chunk
+    QThreadPool m_pool;
+    QTimer *m_visibleTimer;
+    QTimer *m_restartTimer;
+    QTimer *m_applyTimer;
+};
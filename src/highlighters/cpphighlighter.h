@@ -1,7 +1,8 @@
 #pragma once
 #include "basehighlighter.h"
-#include <QRegularExpression>
+#include "cpplexer.h"
 #include <QTextCharFormat>
+#include <QVector>
 
 class CppHighlighter : public BaseHighlighter {
     Q_OBJECT
@@ -14,28 +15,20 @@ public:
     QString filePattern() const override { return "*.cpp;*.h;*.hpp;*.c;*.cc;*.cxx"; }
 
 protected:
-    void doHighlightBlock(const QString &text) override;
+    LineFunction lineFunction() const override;
 
 private:
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-    QVector<HighlightingRule> highlightingRules;
-
-    QRegularExpression commentStartExpression;
-    QRegularExpression commentEndExpression;
-
     QTextCharFormat keywordFormat;
     QTextCharFormat classFormat;
     QTextCharFormat singleLineCommentFormat;
-    QTextCharFormat multiLineCommentFormat;
     QTextCharFormat quotationFormat;
     QTextCharFormat functionFormat;
     QTextCharFormat preprocessorFormat;
     QTextCharFormat numberFormat;
     QTextCharFormat operatorFormat;
 
+    // Indexed by CppLexer::TokenKind
+    QVector<QTextCharFormat> m_tokenFormats;
+
     void setupFormats();
-    void setupRules();
-}; 
\ No newline at end of file
+};
\ No newline at end of file
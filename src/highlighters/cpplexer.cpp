@@ -0,0 +1,351 @@
+#include "cpplexer.h"
+#include <QLatin1String>
+
+namespace {
+
+enum CharClass : quint8 {
+    IdentStart = 1,
+    IdentChar = 2,
+    Digit = 4,
+    OperatorChar = 8,
+    Space = 16
+};
+
+struct CharTable {
+    quint8 flags[128] = {};
+
+    constexpr CharTable() {
+        for (int c = 'a'; c <= 'z'; ++c) flags[c] = IdentStart | IdentChar;
+        for (int c = 'A'; c <= 'Z'; ++c) flags[c] = IdentStart | IdentChar;
+        for (int c = '0'; c <= '9'; ++c) flags[c] = IdentChar | Digit;
+        flags[int('_')] = IdentStart | IdentChar;
+        const char operators[] = "!%&*+-/:<=>?^|~";
+        for (int k = 0; operators[k]; ++k) flags[int(operators[k])] = OperatorChar;
+        flags[int(' ')] = flags[int('\t')] = flags[int('\r')] = flags[int('\n')] = Space;
+        flags[int('\f')] = flags[int('\v')] = Space;
+    }
+};
+
+constexpr CharTable kChars;
+
+inline quint8 charClass(QChar ch) {
+    char16_t c = ch.unicode();
+    if (c < 128) return kChars.flags[c];
+    if (ch.isLetter()) return IdentStart | IdentChar;
+    return ch.isSpace() ? Space : 0;
+}
+
+// Keywords sorted alphabetically; kKeywordSlots is a collision-free table
+// for keywordSlot() below, generated offline for exactly this list
+const char *const kKeywords[] = {
+    "alignas", "alignof", "asm", "auto", "bool", "break", "case", "catch",
+    "char", "char16_t", "char32_t", "char8_t", "class", "co_await",
+    "co_return", "co_yield", "concept", "const", "const_cast", "consteval",
+    "constexpr", "constinit", "continue", "decltype", "default", "delete",
+    "do", "double", "dynamic_cast", "else", "emit", "enum", "explicit",
+    "export", "extern", "false", "final", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+    "nullptr", "operator", "override", "private", "protected", "public",
+    "register", "reinterpret_cast", "requires", "return", "short", "signals",
+    "signed", "sizeof", "slots", "static", "static_assert", "static_cast",
+    "struct", "switch", "template", "this", "thread_local", "throw", "true",
+    "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+    "virtual", "void", "volatile", "wchar_t", "while",
+};
+
+const qint8 kKeywordSlots[372] = {
+     34,  -1,  -1,  -1,  26,  -1,  -1,  -1,  85,  47,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  59,
+     -1,  83,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  67,  -1,  -1,  -1,  -1,  -1,  -1,  66,
+     80,  -1,  -1,  -1,  -1,  65,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  68,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  56,  -1,  -1,  -1,  40,  -1,  15,  -1,  -1,  -1,  -1,  -1,
+      8,  84,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   6,  -1,   1,  -1,  -1,
+     -1,  -1,   0,  27,  -1,  22,  25,  39,  -1,  -1,  -1,  -1,   9,  -1,  10,  -1,  12,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  29,  20,  -1,  -1,  -1,  -1,  23,  72,  -1,  -1,  -1,
+     38,  -1,  35,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  16,  17,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  18,  -1,  24,  -1,
+     11,  -1,  -1,  -1,  -1,  -1,  30,  -1,  74,  -1,  13,  -1,  21,  42,  -1,  -1,   7,  -1,
+     -1,  41,  -1,  -1,  33,  -1,  -1,  28,  32,  -1,  -1,  71,  -1,  -1,  37,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  58,  -1,  -1,  -1,  -1,
+     -1,  81,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  54,  -1,  -1,  43,  -1,  -1,  -1,  45,  -1,
+     -1,   5,  -1,  -1,  -1,  78,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  53,  49,  -1,  -1,  -1,  -1,  -1,   4,
+     -1,  -1,  50,  44,  -1,  46,  -1,  -1,  64,  -1,  -1,  -1,   2,  -1,  51,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  52,  -1,  -1,  61,  -1,  -1,  -1,  -1,
+     -1,  76,  -1,  -1,  -1,  -1,  -1,  -1,  19,  -1,  -1,  48,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  82,  -1,  36,  79,  55,  -1,  -1,  -1,  -1,  -1,  -1,
+     73,  -1,  -1,  -1,   3,  -1,  -1,  31,  62,  -1,  -1,  69,  57,  77,  -1,  14,  -1,  -1,
+     63,  -1,  -1,  -1,  70,  -1,  -1,  -1,  -1,  60,  75,  -1,
+};
+
+inline int keywordSlot(qsizetype length, char16_t first, char16_t middle, char16_t last) {
+    return int((length * 5 + first * 15 + last * 29 + middle) % 372);
+}
+
+const int kStateMask = 0xFF;
+const int kMaxRawDelimiter = 16;
+
+// Stored in the block state of a line that ends inside a raw string, so the
+// closing )delimiter" can be recognised on a later line
+int delimiterHash(QStringView delimiter) {
+    quint32 hash = 2166136261u;
+    for (QChar ch : delimiter) {
+        hash ^= ch.unicode();
+        hash *= 16777619u;
+    }
+    return int(hash & 0x3FFFFF);
+}
+
+bool isRawDelimiterChar(QChar ch) {
+    char16_t c = ch.unicode();
+    return c > ' ' && c < 127 && c != '(' && c != ')' && c != '\\' && c != '"';
+}
+
+int findBlockCommentEnd(QStringView text, int from) {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+    for (int i = from; i + 1 < length; ++i) {
+        if (data[i] == QLatin1Char('*') && data[i + 1] == QLatin1Char('/')) {
+            return i + 2;
+        }
+    }
+    return -1;
+}
+
+int findRawStringEnd(QStringView text, int from, int hash) {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+    for (int i = from; i < length; ++i) {
+        if (data[i] != QLatin1Char(')')) continue;
+
+        int end = i + 1;
+        while (end < length && end - i - 1 < kMaxRawDelimiter && isRawDelimiterChar(data[end])) {
+            ++end;
+        }
+        if (end < length && data[end] == QLatin1Char('"') &&
+            delimiterHash(text.mid(i + 1, end - i - 1)) == hash) {
+            return end + 1;
+        }
+    }
+    return -1;
+}
+
+// Returns the end of a quoted literal whose opening quote is at `quote`
+int skipQuoted(QStringView text, int quote) {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+    const QChar delimiter = data[quote];
+    int i = quote + 1;
+    while (i < length) {
+        if (data[i] == QLatin1Char('\\')) {
+            i += 2;
+        } else if (data[i++] == delimiter) {
+            break;
+        }
+    }
+    return qMin(i, length);
+}
+
+int skipNumber(QStringView text, int from) {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+    int i = from;
+    while (i < length) {
+        char16_t c = data[i].unicode();
+        if ((c == '+' || c == '-') && i > from) {
+            // Only as the sign of an exponent
+            char16_t prev = data[i - 1].unicode() | 0x20;
+            if (prev != 'e' && prev != 'p') break;
+        } else if (!(charClass(data[i]) & IdentChar) && c != '.' && c != '\'') {
+            break;
+        }
+        ++i;
+    }
+    return i;
+}
+
+bool isStringPrefix(QStringView word) {
+    return word == QLatin1String("L") || word == QLatin1String("u") ||
+           word == QLatin1String("U") || word == QLatin1String("u8") ||
+           word == QLatin1String("R") || word == QLatin1String("LR") ||
+           word == QLatin1String("uR") || word == QLatin1String("UR") ||
+           word == QLatin1String("u8R");
+}
+
+} // namespace
+
+bool CppLexer::isKeyword(QStringView word) {
+    const qsizetype length = word.size();
+    if (length < 2 || length > 16) return false;
+
+    char16_t first = word.front().unicode();
+    char16_t middle = word[length / 2].unicode();
+    char16_t last = word.back().unicode();
+    if (first >= 128 || middle >= 128 || last >= 128) return false;
+
+    int slot = kKeywordSlots[keywordSlot(length, first, middle, last)];
+    return slot >= 0 && word == QLatin1String(kKeywords[slot]);
+}
+
+int CppLexer::tokenize(QStringView text, int state, QVector<Token> *tokens) {
+    const QChar *data = text.data();
+    const int length = int(text.size());
+
+    auto add = [tokens](int start, int size, TokenKind kind) {
+        tokens->append(Token{start, size, kind});
+    };
+
+    int i = 0;
+    if (state > 0 && (state & kStateMask) == InBlockComment) {
+        int end = findBlockCommentEnd(text, 0);
+        if (end < 0) {
+            add(0, length, TokenKind::Comment);
+            return InBlockComment;
+        }
+        add(0, end, TokenKind::Comment);
+        i = end;
+    } else if (state > 0 && (state & kStateMask) == InRawString) {
+        int end = findRawStringEnd(text, 0, state >> 8);
+        if (end < 0) {
+            add(0, length, TokenKind::String);
+            return state;
+        }
+        add(0, end, TokenKind::String);
+        i = end;
+    }
+
+    // A '#' is a directive only when nothing but whitespace precedes it
+    bool atLineStart = (i == 0);
+
+    while (i < length) {
+        const QChar ch = data[i];
+        const char16_t c = ch.unicode();
+        const quint8 cls = charClass(ch);
+
+        if (cls & Space) {
+            ++i;
+            continue;
+        }
+
+        if (c == '#' && atLineStart) {
+            int start = i++;
+            while (i < length && (charClass(data[i]) & Space)) ++i;
+            int nameStart = i;
+            while (i < length && (charClass(data[i]) & IdentChar)) ++i;
+            add(start, i - start, TokenKind::Preprocessor);
+
+            QStringView name = text.mid(nameStart, i - nameStart);
+            if (name == QLatin1String("include") || name == QLatin1String("include_next") ||
+                name == QLatin1String("import")) {
+                while (i < length && (charClass(data[i]) & Space)) ++i;
+                if (i < length && data[i] == QLatin1Char('<')) {
+                    int end = text.indexOf(QLatin1Char('>'), i);
+                    end = end < 0 ? length : end + 1;
+                    add(i, end - i, TokenKind::String);
+                    i = end;
+                }
+            }
+            atLineStart = false;
+            continue;
+        }
+        atLineStart = false;
+
+        if (c == '/' && i + 1 < length) {
+            const QChar next = data[i + 1];
+            if (next == QLatin1Char('/')) {
+                add(i, length - i, TokenKind::Comment);
+                return Normal;
+            }
+            if (next == QLatin1Char('*')) {
+                int end = findBlockCommentEnd(text, i + 2);
+                if (end < 0) {
+                    add(i, length - i, TokenKind::Comment);
+                    return InBlockComment;
+                }
+                add(i, end - i, TokenKind::Comment);
+                i = end;
+                continue;
+            }
+        }
+
+        if ((cls & Digit) ||
+            (c == '.' && i + 1 < length && (charClass(data[i + 1]) & Digit))) {
+            int end = skipNumber(text, i);
+            add(i, end - i, TokenKind::Number);
+            i = end;
+            continue;
+        }
+
+        if (cls & IdentStart) {
+            int start = i;
+            while (i < length && (charClass(data[i]) & IdentChar)) ++i;
+            QStringView word = text.mid(start, i - start);
+
+            // Encoding prefixes and raw strings: u8"...", L'x', R"tag(...)tag"
+            if (i < length && (data[i] == QLatin1Char('"') || data[i] == QLatin1Char('\'')) &&
+                isStringPrefix(word)) {
+                if (data[i] == QLatin1Char('"') && word.back() == QLatin1Char('R')) {
+                    int open = i + 1;
+                    while (open < length && open - i - 1 < kMaxRawDelimiter &&
+                           isRawDelimiterChar(data[open])) {
+                        ++open;
+                    }
+                    if (open < length && data[open] == QLatin1Char('(')) {
+                        int hash = delimiterHash(text.mid(i + 1, open - i - 1));
+                        int end = findRawStringEnd(text, open + 1, hash);
+                        if (end < 0) {
+                            add(start, length - start, TokenKind::String);
+                            return (hash << 8) | InRawString;
+                        }
+                        add(start, end - start, TokenKind::String);
+                        i = end;
+                        continue;
+                    }
+                }
+                int end = skipQuoted(text, i);
+                add(start, end - start, TokenKind::String);
+                i = end;
+                continue;
+            }
+
+            if (isKeyword(word)) {
+                add(start, i - start, TokenKind::Keyword);
+            } else if (i < length && data[i] == QLatin1Char('(')) {
+                add(start, i - start, TokenKind::Function);
+            } else {
+                // Names followed by ':' or '{' (class heads, labels, scopes)
+                int next = i;
+                while (next < length && (charClass(data[next]) & Space)) ++next;
+                if (next < length &&
+                    (data[next] == QLatin1Char(':') || data[next] == QLatin1Char('{'))) {
+                    add(start, i - start, TokenKind::Class);
+                }
+            }
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            int end = skipQuoted(text, i);
+            add(i, end - i, TokenKind::String);
+            i = end;
+            continue;
+        }
+
+        if (cls & OperatorChar) {
+            int start = i;
+            while (i < length && (charClass(data[i]) & OperatorChar)) {
+                // Leave a following comment to the next iteration
+                if (i > start && data[i] == QLatin1Char('/') && i + 1 < length &&
+                    (data[i + 1] == QLatin1Char('/') || data[i + 1] == QLatin1Char('*'))) {
+                    break;
+                }
+                ++i;
+            }
+            add(start, i - start, TokenKind::Operator);
+            continue;
+        }
+
+        ++i;
+    }
+
+    return Normal;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <QStringView>
+#include <QVector>
+
+// Hand-written C/C++ tokenizer used by CppHighlighter. A line is scanned
+// once from left to right; the only state carried from one line to the next
+// is the block state returned by tokenize(), which records an unterminated
+// block comment or raw string literal.
+class CppLexer {
+public:
+    enum class TokenKind : quint8 {
+        Keyword,
+        Class,
+        Function,
+        Preprocessor,
+        Number,
+        String,
+        Operator,
+        Comment
+    };
+
+    struct Token {
+        int start;
+        int length;
+        TokenKind kind;
+    };
+
+    // Block states; a raw string also stores a hash of its delimiter in the
+    // upper bits
+    enum State { Normal = 0, InBlockComment = 1, InRawString = 2 };
+
+    // Appends the tokens of `text` to `tokens` and returns the state the
+    // next line starts in. `state` is the value returned for the previous
+    // line (negative values are treated as Normal).
+    static int tokenize(QStringView text, int state, QVector<Token> *tokens);
+
+    static bool isKeyword(QStringView word);
+};
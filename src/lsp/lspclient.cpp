@@ -1,12 +1,46 @@
 #include "lspclient.h"
-#include <QJsonDocument>
+#include "lsptransport.h"
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QThread>
+#include <QTimer>
 #include <QUrl>
 #include <QDir>
 
+namespace {
+
+// Quiet period before a scheduled request is sent. Hover follows the cursor
+// and only matters once it settles; completion has to keep up with typing.
+int debounceInterval(const QString &method) {
+    if (method == "textDocument/hover") return 250;
+    if (method == "textDocument/completion") return 75;
+    return 0;
+}
+
+const qint64 kRequestTimeout = 10000;
+// How long a server gets to answer shutdown before it is sent exit anyway
+const int kShutdownTimeout = 2000;
+
+QString requestKey(const QString &method, const QString &uri) {
+    return method + QLatin1Char('\n') + uri;
+}
+
+} // namespace
+
 LSPClient::LSPClient(QObject *parent)
-    : QObject(parent), m_server(nullptr), m_initialized(false), m_nextId(1) {
+    : QObject(parent), m_ioThread(nullptr), m_transport(nullptr), m_running(false),
+      m_initialized(false), m_syncKind(SyncKind::Full), m_shutdown(Shutdown::None),
+      m_shutdownId(-1),
+      m_positionEncoding("utf-16"), m_nextId(1) {
+    m_clock.start();
+
+    m_scheduleTimer = new QTimer(this);
+    m_scheduleTimer->setSingleShot(true);
+    connect(m_scheduleTimer, &QTimer::timeout, this, &LSPClient::dispatchScheduledRequests);
+
+    m_timeoutTimer = new QTimer(this);
+    m_timeoutTimer->setInterval(1000);
+    connect(m_timeoutTimer, &QTimer::timeout, this, &LSPClient::expireRequests);
 }
 
 LSPClient::~LSPClient() {
@@ -14,34 +48,116 @@ LSPClient::~LSPClient() {
 }
 
 bool LSPClient::startServer(const QString &command) {
-    if (m_server) {
+    if (m_transport) {
         return false;
     }
 
-    m_server = new QProcess(this);
-    connect(m_server, &QProcess::readyReadStandardOutput, this, &LSPClient::handleServerOutput);
-    connect(m_server, &QProcess::readyReadStandardError, this, &LSPClient::handleServerError);
-    connect(m_server, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, &LSPClient::handleServerFinished);
-
-    m_server->start(command);
-    return m_server->waitForStarted();
+    m_ioThread = new QThread(this);
+    m_ioThread->setObjectName("LSP I/O");
+    m_transport = new LSPTransport;
+    m_transport->moveToThread(m_ioThread);
+    connect(m_ioThread, &QThread::finished, m_transport, &QObject::deleteLater);
+
+    connect(m_transport, &LSPTransport::initializeResult, this, &LSPClient::handleInitializeResult);
+    connect(m_transport, &LSPTransport::completionResult, this, &LSPClient::handleCompletionResult);
+    connect(m_transport, &LSPTransport::hoverResult, this, &LSPClient::handleHoverResult);
+    connect(m_transport, &LSPTransport::definitionResult, this, &LSPClient::handleDefinitionResult);
+    connect(m_transport, &LSPTransport::responseReceived, this, &LSPClient::handleResponse);
+    connect(m_transport, &LSPTransport::requestFailed, this, &LSPClient::handleRequestFailed);
+    connect(m_transport, &LSPTransport::diagnosticsPublished, this, &LSPClient::diagnosticsReceived);
+    connect(m_transport, &LSPTransport::errorOccurred, this, &LSPClient::serverError);
+    connect(m_transport, &LSPTransport::finished, this, &LSPClient::handleServerFinished);
+
+    m_ioThread->start();
+
+    LSPTransport *transport = m_transport;
+    QMetaObject::invokeMethod(
+        m_transport, [transport, command]() { return transport->start(command); },
+        Qt::BlockingQueuedConnection, &m_running);
+    return m_running;
 }
 
 void LSPClient::stopServer() {
-    if (m_server) {
-        m_server->terminate();
-        if (!m_server->waitForFinished(3000)) {
-            m_server->kill();
+    if (m_transport) {
+        if (m_initialized && m_running && m_shutdown != Shutdown::ExitSent) {
+            // Ask the server to exit cleanly; the transport falls back to
+            // signals if it does not
+            if (m_shutdown == Shutdown::None) {
+                sendRequest("shutdown", QJsonObject());
+            }
+            sendNotification("exit", QJsonObject());
         }
-        delete m_server;
-        m_server = nullptr;
+
+        LSPTransport *transport = m_transport;
+        QMetaObject::invokeMethod(
+            m_transport, [transport]() { transport->stop(); },
+            Qt::BlockingQueuedConnection);
+    }
+    closeTransport();
+}
+
+void LSPClient::shutdownServer() {
+    if (!m_transport) {
+        emit serverStopped();
+        return;
+    }
+    if (m_shutdown != Shutdown::None) {
+        return;
+    }
+
+    m_shutdown = Shutdown::Requested;
+    m_scheduleTimer->stop();
+    m_scheduledRequests.clear();
+    if (!m_initialized || !m_running) {
+        // Nothing to shut down before the handshake; exit is still allowed
+        exitServer();
+        return;
+    }
+    m_shutdownId = sendRequest("shutdown", QJsonObject());
+    QTimer::singleShot(kShutdownTimeout, this, &LSPClient::exitServer);
+}
+
+void LSPClient::exitServer() {
+    // On the shutdown response, or once the server has had long enough
+    if (!m_transport || m_shutdown != Shutdown::Requested) {
+        return;
+    }
+    m_shutdown = Shutdown::ExitSent;
+    if (m_running) {
+        sendNotification("exit", QJsonObject());
+    }
+
+    LSPTransport *transport = m_transport;
+    QMetaObject::invokeMethod(
+        m_transport, [transport]() { transport->finish(); }, Qt::QueuedConnection);
+}
+
+void LSPClient::closeTransport() {
+    if (m_transport) {
+        m_transport->disconnect(this);
+        m_ioThread->quit();
+        m_ioThread->wait();
+        delete m_ioThread;
+        m_ioThread = nullptr;
+        m_transport = nullptr;
     }
+    m_scheduleTimer->stop();
+    m_timeoutTimer->stop();
+    m_running = false;
     m_initialized = false;
+    m_syncKind = SyncKind::Full;
+    m_shutdown = Shutdown::None;
+    m_shutdownId = -1;
+    m_pendingRequests.clear();
+    m_scheduledRequests.clear();
+    m_activeRequests.clear();
+    m_queuedMessages.clear();
+    m_openDocuments.clear();
+    m_documentVersions.clear();
 }
 
 bool LSPClient::isServerRunning() const {
-    return m_server && m_server->state() == QProcess::Running;
+    return m_running;
 }
 
 void LSPClient::initialize(const QString &rootPath) {
@@ -49,10 +165,20 @@ void LSPClient::initialize(const QString &rootPath) {
     params["processId"] = QJsonValue::Null;
     params["rootUri"] = uriFromPath(rootPath);
     params["capabilities"] = QJsonObject({
+        // QString is UTF-16, so that is the only encoding whose columns
+        // map onto document offsets without rescanning the line
+        {"general", QJsonObject({
+            {"positionEncodings", QJsonArray({"utf-16"})}
+        })},
         {"textDocument", QJsonObject({
+            {"synchronization", QJsonObject({
+                {"dynamicRegistration", false}
+            })},
             {"completion", QJsonObject({
                 {"completionItem", QJsonObject({
-                    {"snippetSupport", true}
+                    // Inserted items are plain text; the editor has no
+                    // snippet placeholders to expand
+                    {"snippetSupport", false}
                 })}
             })},
             {"hover", QJsonObject({
@@ -65,32 +191,46 @@ void LSPClient::initialize(const QString &rootPath) {
     sendRequest("initialize", params);
 }
 
-void LSPClient::didOpen(const QString &uri, const QString &languageId, const QString &text) {
+void LSPClient::didOpen(const QString &uri, const QString &languageId, int version,
+                        const QString &text) {
+    m_openDocuments.insert(uri);
+    m_documentVersions.insert(uri, version);
+
     QJsonObject params;
     params["textDocument"] = QJsonObject({
         {"uri", uri},
         {"languageId", languageId},
-        {"version", 1},
+        {"version", version},
         {"text", text}
     });
 
     sendNotification("textDocument/didOpen", params);
 }
 
-void LSPClient::didChange(const QString &uri, const QString &text) {
+void LSPClient::didChange(const QString &uri, int version,
+                          const QJsonArray &contentChanges) {
+    m_documentVersions.insert(uri, version);
+    if (m_syncKind == SyncKind::None) {
+        return;
+    }
+
     QJsonObject params;
     params["textDocument"] = QJsonObject({
         {"uri", uri},
-        {"version", 1}
-    });
-    params["contentChanges"] = QJsonArray({
-        QJsonObject({{"text", text}})
+        {"version", version}
     });
+    params["contentChanges"] = contentChanges;
 
     sendNotification("textDocument/didChange", params);
 }
 
 void LSPClient::didClose(const QString &uri) {
+    if (!m_openDocuments.remove(uri)) {
+        return;
+    }
+    cancelRequests(uri);
+    m_documentVersions.remove(uri);
+
     QJsonObject params;
     params["textDocument"] = QJsonObject({
         {"uri", uri}
@@ -107,7 +247,7 @@ void LSPClient::requestCompletion(const QString &uri, int line, int character) {
         {"character", character}
     });
 
-    sendRequest("textDocument/completion", params);
+    scheduleRequest("textDocument/completion", uri, params);
 }
 
 void LSPClient::requestHover(const QString &uri, int line, int character) {
@@ -118,7 +258,7 @@ void LSPClient::requestHover(const QString &uri, int line, int character) {
         {"character", character}
     });
 
-    sendRequest("textDocument/hover", params);
+    scheduleRequest("textDocument/hover", uri, params);
 }
 
 void LSPClient::requestDefinition(const QString &uri, int line, int character) {
@@ -129,106 +269,197 @@ void LSPClient::requestDefinition(const QString &uri, int line, int character) {
         {"character", character}
     });
 
-    sendRequest("textDocument/definition", params);
+    scheduleRequest("textDocument/definition", uri, params);
 }
 
-void LSPClient::handleServerOutput() {
-    m_buffer.append(m_server->readAllStandardOutput());
+void LSPClient::cancelRequests(const QString &uri, const QString &method) {
+    for (auto it = m_scheduledRequests.begin(); it != m_scheduledRequests.end();) {
+        if (it.value().uri == uri && (method.isEmpty() || it.value().method == method)) {
+            it = m_scheduledRequests.erase(it);
+        } else {
+            ++it;
+        }
+    }
 
-    while (!m_buffer.isEmpty()) {
-        // Look for the Content-Length header
-        int headerEnd = m_buffer.indexOf("\r\n\r\n");
-        if (headerEnd == -1) {
-            // Header not complete yet
-            return;
+    QList<int> ids;
+    for (auto it = m_activeRequests.cbegin(); it != m_activeRequests.cend(); ++it) {
+        const PendingRequest request = m_pendingRequests.value(it.value());
+        if (request.uri == uri && (method.isEmpty() || request.method == method)) {
+            ids.append(it.value());
         }
+    }
+    for (int id : std::as_const(ids)) {
+        cancelRequest(id);
+    }
+}
+
+void LSPClient::scheduleRequest(const QString &method, const QString &uri,
+                                const QJsonObject &params) {
+    if (!m_transport) {
+        return;
+    }
 
-        // Parse the Content-Length header
-        QByteArray header = m_buffer.left(headerEnd);
-        int contentLength = -1;
-        QList<QByteArray> headers = header.split('\n');
-        for (const QByteArray &h : headers) {
-            if (h.startsWith("Content-Length: ")) {
-                contentLength = h.mid(16).trimmed().toInt();
-                break;
+    // Whatever the server is still computing for this document refers to a
+    // cursor position that has been left behind
+    QString key = requestKey(method, uri);
+    auto active = m_activeRequests.constFind(key);
+    if (active != m_activeRequests.cend()) {
+        cancelRequest(active.value());
+    }
+
+    // A newer request replaces one still waiting for its debounce to expire;
+    // restarting the wait means a held-down arrow key sends nothing until
+    // the cursor stops
+    ScheduledRequest &request = m_scheduledRequests[key];
+    request.method = method;
+    request.uri = uri;
+    request.params = params;
+    request.dueTime = m_clock.elapsed() + debounceInterval(method);
+
+    if (!m_scheduleTimer->isActive() ||
+        m_scheduleTimer->remainingTime() > debounceInterval(method)) {
+        m_scheduleTimer->start(debounceInterval(method));
+    }
+}
+
+void LSPClient::dispatchScheduledRequests() {
+    qint64 now = m_clock.elapsed();
+    QList<ScheduledRequest> due;
+    qint64 nextDue = -1;
+
+    for (auto it = m_scheduledRequests.begin(); it != m_scheduledRequests.end();) {
+        if (it.value().dueTime <= now) {
+            due.append(it.value());
+            it = m_scheduledRequests.erase(it);
+        } else {
+            if (nextDue < 0 || it.value().dueTime < nextDue) {
+                nextDue = it.value().dueTime;
             }
+            ++it;
         }
+    }
 
-        if (contentLength == -1) {
-            // Invalid header, clear buffer and return
-            m_buffer.clear();
+    for (const ScheduledRequest &request : std::as_const(due)) {
+        // Positions in the request refer to the editor's current text
+        emit documentSyncRequired(request.uri);
+        if (!m_transport) {
             return;
         }
+        m_activeRequests.insert(requestKey(request.method, request.uri),
+                                sendRequest(request.method, request.params, request.uri));
+    }
 
-        // Check if we have the complete message
-        int messageStart = headerEnd + 4; // Skip \r\n\r\n
-        int totalLength = messageStart + contentLength;
-        if (m_buffer.size() < totalLength) {
-            // Message not complete yet
-            return;
-        }
+    if (nextDue >= 0) {
+        m_scheduleTimer->start(qMax<qint64>(0, nextDue - m_clock.elapsed()));
+    }
+}
 
-        // Extract and process the message
-        QByteArray message = m_buffer.mid(messageStart, contentLength);
-        processMessage(message);
+void LSPClient::cancelRequest(int id) {
+    auto it = m_pendingRequests.find(id);
+    if (it == m_pendingRequests.end()) {
+        return;
+    }
+    QString key = requestKey(it.value().method, it.value().uri);
+    if (m_activeRequests.value(key) == id) {
+        m_activeRequests.remove(key);
+    }
+    m_pendingRequests.erase(it);
 
-        // Remove processed message from buffer
-        m_buffer.remove(0, totalLength);
+    // Still waiting for the handshake: the server has never seen it
+    for (int i = 0; i < m_queuedMessages.size(); ++i) {
+        const QJsonObject &message = m_queuedMessages.at(i);
+        if (message.contains("method") && message.value("id").toInt(-1) == id) {
+            m_queuedMessages.removeAt(i);
+            return;
+        }
     }
+
+    sendNotification("$/cancelRequest", QJsonObject({{"id", id}}));
 }
 
-void LSPClient::processMessage(const QByteArray &message) {
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(message, &error);
-    if (error.error != QJsonParseError::NoError) {
-        emit serverError(tr("Failed to parse JSON message: %1").arg(error.errorString()));
-        return;
+void LSPClient::expireRequests() {
+    qint64 now = m_clock.elapsed();
+    QList<int> expired;
+    bool waiting = false;
+
+    for (auto it = m_pendingRequests.cbegin(); it != m_pendingRequests.cend(); ++it) {
+        if (it.value().deadline < 0) {
+            continue;
+        }
+        if (it.value().deadline <= now) {
+            expired.append(it.key());
+        } else {
+            waiting = true;
+        }
     }
 
-    if (!doc.isObject()) {
-        emit serverError(tr("Invalid message format: not a JSON object"));
-        return;
+    for (int id : std::as_const(expired)) {
+        QString method = m_pendingRequests.value(id).method;
+        cancelRequest(id);
+        emit serverError(tr("%1 timed out").arg(method));
     }
 
-    QJsonObject obj = doc.object();
-    if (obj.contains("id")) {
-        handleResponse(obj);
-    } else if (obj.contains("method")) {
-        handleNotification(obj);
-    } else if (obj.contains("error")) {
-        emit serverError(obj["error"].toObject()["message"].toString());
+    if (!waiting) {
+        m_timeoutTimer->stop();
     }
 }
 
-void LSPClient::handleServerError() {
-    QString error = m_server->readAllStandardError();
-    emit serverError(error);
+bool LSPClient::takeCurrentRequest(int id, PendingRequest *request) {
+    auto it = m_pendingRequests.find(id);
+    if (it == m_pendingRequests.end()) {
+        // Cancelled, superseded or timed out
+        return false;
+    }
+    *request = it.value();
+    m_pendingRequests.erase(it);
+
+    QString key = requestKey(request->method, request->uri);
+    if (m_activeRequests.value(key) == id) {
+        m_activeRequests.remove(key);
+    }
+
+    // The document was edited while the server worked on it, so positions
+    // in the result no longer line up with the text. Completion lists are
+    // the exception: the editor keeps narrowing them as the user types and
+    // discards them itself once the word they belong to is left.
+    return request->uri.isEmpty() || request->method == "textDocument/completion" ||
+           m_documentVersions.value(request->uri, -1) == request->version;
 }
 
 void LSPClient::handleServerFinished(int exitCode, QProcess::ExitStatus exitStatus) {
-    if (exitStatus == QProcess::CrashExit || exitCode != 0) {
+    if (m_shutdown == Shutdown::None && (exitStatus == QProcess::CrashExit || exitCode != 0)) {
         emit serverError(tr("Language server crashed or exited with error code %1").arg(exitCode));
     }
-    m_initialized = false;
+
+    // Nothing queued or in flight will be answered now. The process is
+    // already gone, so the I/O thread has nothing left to wait for.
+    closeTransport();
+    emit serverStopped();
 }
 
-void LSPClient::sendRequest(const QString &method, const QJsonObject &params) {
+int LSPClient::sendRequest(const QString &method, const QJsonObject &params,
+                           const QString &uri) {
+    int id = m_nextId++;
     QJsonObject request;
     request["jsonrpc"] = "2.0";
-    request["id"] = m_nextId;
+    request["id"] = id;
     request["method"] = method;
     request["params"] = params;
 
-    m_pendingRequests[m_nextId] = method;
-    m_nextId++;
+    PendingRequest pending;
+    pending.method = method;
+    pending.uri = uri;
+    pending.version = m_documentVersions.value(uri);
+    if (!uri.isEmpty()) {
+        pending.deadline = m_clock.elapsed() + kRequestTimeout;
+        if (!m_timeoutTimer->isActive()) {
+            m_timeoutTimer->start();
+        }
+    }
+    m_pendingRequests.insert(id, pending);
 
-    QJsonDocument doc(request);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    QString message = QString("Content-Length: %1\r\n\r\n%2")
-                         .arg(data.length())
-                         .arg(QString::fromUtf8(data));
-    
-    m_server->write(message.toUtf8());
+    sendMessage(request, method != "initialize");
+    return id;
 }
 
 void LSPClient::sendNotification(const QString &method, const QJsonObject &params) {
@@ -237,54 +468,104 @@ void LSPClient::sendNotification(const QString &method, const QJsonObject &param
     notification["method"] = method;
     notification["params"] = params;
 
-    QJsonDocument doc(notification);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    QString message = QString("Content-Length: %1\r\n\r\n%2")
-                         .arg(data.length())
-                         .arg(QString::fromUtf8(data));
-    
-    m_server->write(message.toUtf8());
+    sendMessage(notification, method != "initialized" && method != "exit");
 }
 
-void LSPClient::handleResponse(const QJsonObject &response) {
-    if (!response.contains("id") || !response.contains("result")) {
-        emit serverError("Invalid response format from LSP server");
+void LSPClient::sendMessage(const QJsonObject &message, bool queueUntilInitialized) {
+    if (!m_transport) {
         return;
     }
-    
-    int id = response["id"].toInt();
-    QString method = m_pendingRequests.take(id);
-    if (method.isEmpty()) {
-        emit serverError("Received response for unknown request");
+
+    // Editors sharing this server may open documents while the initialize
+    // handshake is still in flight; hold their traffic until it completes
+    if (queueUntilInitialized && !m_initialized) {
+        m_queuedMessages.append(message);
         return;
     }
 
-    if (method == "initialize") {
-        m_initialized = true;
-        emit initialized();
-    } else if (method == "textDocument/completion") {
-        QJsonArray completions = response["result"].toObject()["items"].toArray();
-        emit completionReceived(completions);
-    } else if (method == "textDocument/hover") {
-        QString contents = response["result"].toObject()["contents"].toString();
-        emit hoverReceived(contents);
-    } else if (method == "textDocument/definition") {
-        QJsonObject location = response["result"].toArray().first().toObject();
-        QString uri = location["uri"].toString();
-        QJsonObject range = location["range"].toObject();
-        QJsonObject start = range["start"].toObject();
-        emit definitionReceived(uri, start["line"].toInt(), start["character"].toInt());
-    }
-}
-
-void LSPClient::handleNotification(const QJsonObject &notification) {
-    QString method = notification["method"].toString();
-    if (method == "textDocument/publishDiagnostics") {
-        QJsonObject params = notification["params"].toObject();
-        QString uri = params["uri"].toString();
-        QJsonArray diagnostics = params["diagnostics"].toArray();
-        emit diagnosticsReceived(uri, diagnostics);
+    postMessage(message);
+}
+
+void LSPClient::postMessage(const QJsonObject &message) {
+    // Serialisation happens on the I/O thread; QJsonObject is implicitly
+    // shared, so handing it over does not copy the document text
+    LSPTransport *transport = m_transport;
+    QMetaObject::invokeMethod(
+        m_transport, [transport, message]() { transport->send(message); },
+        Qt::QueuedConnection);
+}
+
+void LSPClient::handleInitializeResult(int id, const QJsonObject &capabilities) {
+    m_pendingRequests.remove(id);
+
+    // textDocumentSync is either a bare TextDocumentSyncKind or an options
+    // object; servers that omit it do not want edits at all
+    QJsonValue sync = capabilities["textDocumentSync"];
+    if (sync.isObject()) {
+        sync = sync.toObject()["change"];
+    }
+    m_syncKind = static_cast<SyncKind>(qBound(0, sync.toInt(0), 2));
+
+    // Absent means UTF-16; anything else would shift every column on lines
+    // with non-BMP characters, so say so rather than misplace silently
+    m_positionEncoding = capabilities.value("positionEncoding").toString("utf-16");
+    if (m_positionEncoding != "utf-16") {
+        emit serverError(tr("Server chose unsupported position encoding %1")
+                             .arg(m_positionEncoding));
+    }
+
+    m_initialized = true;
+    sendNotification("initialized", QJsonObject());
+    for (const QJsonObject &message : std::as_const(m_queuedMessages)) {
+        postMessage(message);
+    }
+    m_queuedMessages.clear();
+    emit initialized();
+}
+
+void LSPClient::handleCompletionResult(int id, bool isIncomplete,
+                                       const QVector<LSPCompletionItem> &items) {
+    PendingRequest request;
+    if (takeCurrentRequest(id, &request)) {
+        emit completionReceived(request.uri, isIncomplete, items);
+    }
+}
+
+void LSPClient::handleHoverResult(int id, const QString &contents) {
+    PendingRequest request;
+    if (takeCurrentRequest(id, &request)) {
+        emit hoverReceived(request.uri, contents);
+    }
+}
+
+void LSPClient::handleDefinitionResult(int id, const QString &uri, int line,
+                                       int character) {
+    PendingRequest request;
+    if (takeCurrentRequest(id, &request)) {
+        emit definitionReceived(request.uri, uri, line, character);
+    }
+}
+
+void LSPClient::handleResponse(int id) {
+    PendingRequest request;
+    takeCurrentRequest(id, &request);
+    if (id == m_shutdownId) {
+        exitServer();
+    }
+}
+
+void LSPClient::handleRequestFailed(int id, const QString &message) {
+    // Requests we cancelled come back as errors too; those are expected
+    if (!m_pendingRequests.contains(id)) {
+        return;
+    }
+    PendingRequest request;
+    takeCurrentRequest(id, &request);
+    if (id == m_shutdownId) {
+        exitServer();
+        return;
     }
+    emit serverError(tr("%1 failed: %2").arg(request.method, message));
 }
 
 QString LSPClient::uriFromPath(const QString &path) const {
@@ -1,54 +1,144 @@
 #pragma once
+#include "lsptypes.h"
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QProcess>
 #include <QJsonObject>
+#include <QList>
 #include <QMap>
+#include <QSet>
 
+class LSPTransport;
+class QThread;
+class QTimer;
+
+// Talks to one language server. The process, message framing and JSON
+// decoding live on a dedicated I/O thread (see LSPTransport); this object
+// stays on the GUI thread, tracks requests and routes typed results to the
+// editors that asked for them.
+//
+// Hover, completion and definition requests are scheduled rather than sent
+// immediately: each method is debounced per document, a new request
+// supersedes (and cancels) the previous one for the same document, results
+// computed against an older document version are dropped, and requests the
+// server never answers are evicted after a timeout.
 class LSPClient : public QObject {
     Q_OBJECT
 
 public:
+    // How the server wants document edits delivered, from the
+    // textDocumentSync capability returned by initialize
+    enum class SyncKind { None = 0, Full = 1, Incremental = 2 };
+
     explicit LSPClient(QObject *parent = nullptr);
     ~LSPClient();
 
     bool startServer(const QString &command);
+    // Blocks until the server has exited; for application shutdown
     void stopServer();
+    // Asks the server to shut down and returns at once. serverStopped is
+    // emitted when the process has exited.
+    void shutdownServer();
     bool isServerRunning() const;
+    bool isInitialized() const { return m_initialized; }
+    SyncKind syncKind() const { return m_syncKind; }
+    // Unit of the character offsets in positions, from initialize
+    QString positionEncoding() const { return m_positionEncoding; }
 
     // LSP methods
     void initialize(const QString &rootPath);
-    void didOpen(const QString &uri, const QString &languageId, const QString &text);
-    void didChange(const QString &uri, const QString &text);
+    void didOpen(const QString &uri, const QString &languageId, int version,
+                 const QString &text);
+    void didChange(const QString &uri, int version,
+                   const QJsonArray &contentChanges);
     void didClose(const QString &uri);
     void requestCompletion(const QString &uri, int line, int character);
     void requestHover(const QString &uri, int line, int character);
     void requestDefinition(const QString &uri, int line, int character);
+    // Drops scheduled and in-flight requests for the document; an empty
+    // method cancels every kind
+    void cancelRequests(const QString &uri, const QString &method = QString());
     QString uriFromPath(const QString &path) const;
 
 signals:
+    // A server is shared by every editor in its workspace, so each signal
+    // carries the URI of the document the message belongs to
     void initialized();
-    void completionReceived(const QJsonArray &completions);
-    void hoverReceived(const QString &contents);
-    void definitionReceived(const QString &uri, int line, int character);
-    void diagnosticsReceived(const QString &uri, const QJsonArray &diagnostics);
+    // Emitted just before a scheduled request for the document is sent so
+    // its editor can push any edits it has not synced yet
+    void documentSyncRequired(const QString &uri);
+    void completionReceived(const QString &uri, bool isIncomplete,
+                            const QVector<LSPCompletionItem> &items);
+    void hoverReceived(const QString &uri, const QString &contents);
+    void definitionReceived(const QString &uri, const QString &targetUri,
+                            int line, int character);
+    void diagnosticsReceived(const QString &uri,
+                             const QVector<LSPDiagnostic> &diagnostics);
     void serverError(const QString &message);
+    // The server process has gone, asked to or not, and the client will not
+    // talk to it again
+    void serverStopped();
 
 private slots:
-    void handleServerOutput();
-    void handleServerError();
+    void handleInitializeResult(int id, const QJsonObject &capabilities);
+    void handleCompletionResult(int id, bool isIncomplete,
+                                const QVector<LSPCompletionItem> &items);
+    void handleHoverResult(int id, const QString &contents);
+    void handleDefinitionResult(int id, const QString &uri, int line, int character);
+    void handleResponse(int id);
+    void handleRequestFailed(int id, const QString &message);
     void handleServerFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void dispatchScheduledRequests();
+    void expireRequests();
 
 private:
-    QProcess *m_server;
+    struct PendingRequest {
+        QString method;
+        QString uri;
+        int version = 0;      // Document version the request was made against
+        qint64 deadline = -1; // Against m_clock; -1 never expires
+    };
+
+    struct ScheduledRequest {
+        QString method;
+        QString uri;
+        QJsonObject params;
+        qint64 dueTime = 0;
+    };
+
+    enum class Shutdown { None, Requested, ExitSent };
+
+    QThread *m_ioThread;
+    LSPTransport *m_transport; // Lives on m_ioThread
+    bool m_running;
     bool m_initialized;
+    SyncKind m_syncKind;
+    Shutdown m_shutdown;
+    int m_shutdownId; // Id of the shutdown request, once sent
+    QString m_positionEncoding;
     int m_nextId;
-    QMap<int, QString> m_pendingRequests;
-    QByteArray m_buffer; // Buffer for incomplete messages
+    QMap<int, PendingRequest> m_pendingRequests;
+    QSet<QString> m_openDocuments;
+    QList<QJsonObject> m_queuedMessages; // Sent once initialize completes
+    QHash<QString, int> m_documentVersions;
+    // Both keyed by method and URI; at most one of each is live per document
+    QHash<QString, ScheduledRequest> m_scheduledRequests;
+    QHash<QString, int> m_activeRequests;
+    QElapsedTimer m_clock;
+    QTimer *m_scheduleTimer;
+    QTimer *m_timeoutTimer;
 
-    void sendRequest(const QString &method, const QJsonObject &params);
+    int sendRequest(const QString &method, const QJsonObject &params,
+                    const QString &uri = QString());
     void sendNotification(const QString &method, const QJsonObject &params);
-    void handleResponse(const QJsonObject &response);
-    void handleNotification(const QJsonObject &notification);
-    void processMessage(const QByteArray &message);
+    void sendMessage(const QJsonObject &message, bool queueUntilInitialized);
+    void exitServer();
+    void closeTransport();
+    void postMessage(const QJsonObject &message);
+    void scheduleRequest(const QString &method, const QString &uri,
+                         const QJsonObject &params);
+    void cancelRequest(int id);
+    bool takeCurrentRequest(int id, PendingRequest *request);
     QString pathFromUri(const QString &uri) const;
 }; 
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "lspframer.h"
+#include <cstring>
+
+namespace {
+const char kContentLength[] = "content-length:";
+const qsizetype kContentLengthSize = sizeof(kContentLength) - 1;
+const qsizetype kMinimumCapacity = 64 * 1024;
+// Larger bodies are taken as a corrupt header rather than buffered
+const qsizetype kMaximumContentLength = 256 * 1024 * 1024;
+}
+
+char *LSPFramer::reserve(qsizetype size) {
+    if (m_head == m_tail) {
+        // Everything has been consumed; start over without moving anything
+        m_head = m_tail = m_scanned = 0;
+    } else if (m_head > 0 &&
+               (m_head >= m_buffer.size() / 2 || m_tail + size > m_buffer.size())) {
+        // Slide the unconsumed bytes to the front. This only happens once
+        // the dead prefix is at least as large as what is moved, so each
+        // byte is copied a bounded number of times.
+        qsizetype live = m_tail - m_head;
+        std::memmove(m_buffer.data(), m_buffer.constData() + m_head, live);
+        m_scanned -= m_head;
+        m_tail = live;
+        m_head = 0;
+    }
+
+    if (m_tail + size > m_buffer.size()) {
+        m_buffer.resize(qMax(qMax(m_tail + size, m_buffer.size() * 2), kMinimumCapacity));
+    }
+    return m_buffer.data() + m_tail;
+}
+
+void LSPFramer::commit(qsizetype size) {
+    m_tail += size;
+}
+
+LSPFramer::Result LSPFramer::next(QByteArray *payload) {
+    if (m_bodyOffset < 0) {
+        qsizetype headerEnd = findHeaderEnd();
+        if (headerEnd < 0) {
+            return Result::NeedMoreData;
+        }
+
+        qsizetype contentLength = parseContentLength(headerEnd);
+        if (contentLength < 0) {
+            // Drop the broken header and try to resynchronise on the next one
+            m_head = m_scanned = headerEnd + 4;
+            return Result::Malformed;
+        }
+        m_bodyOffset = headerEnd + 4 - m_head;
+        m_contentLength = contentLength;
+    }
+
+    qsizetype bodyStart = m_head + m_bodyOffset;
+    if (m_tail - bodyStart < m_contentLength) {
+        return Result::NeedMoreData;
+    }
+
+    *payload = QByteArray::fromRawData(m_buffer.constData() + bodyStart, m_contentLength);
+    m_head = m_scanned = bodyStart + m_contentLength;
+    m_bodyOffset = -1;
+    m_contentLength = -1;
+    return Result::Message;
+}
+
+void LSPFramer::clear() {
+    m_buffer.clear();
+    m_head = m_tail = m_scanned = 0;
+    m_bodyOffset = -1;
+    m_contentLength = -1;
+}
+
+qsizetype LSPFramer::findHeaderEnd() {
+    const char *data = m_buffer.constData();
+
+    // Back up three bytes in case the terminator straddles two reads
+    qsizetype pos = qMax(m_head, m_scanned - 3);
+    while (pos + 4 <= m_tail) {
+        const void *cr = std::memchr(data + pos, '\r', m_tail - pos - 3);
+        if (!cr) {
+            break;
+        }
+        pos = static_cast<const char *>(cr) - data;
+        if (std::memcmp(data + pos, "\r\n\r\n", 4) == 0) {
+            return pos;
+        }
+        ++pos;
+    }
+
+    m_scanned = m_tail;
+    return -1;
+}
+
+qsizetype LSPFramer::parseContentLength(qsizetype headerEnd) const {
+    const char *data = m_buffer.constData();
+    qsizetype lineStart = m_head;
+
+    while (lineStart < headerEnd) {
+        const void *lf = std::memchr(data + lineStart, '\n', headerEnd - lineStart);
+        qsizetype lineEnd = lf ? static_cast<const char *>(lf) - data : headerEnd;
+
+        if (lineEnd - lineStart > kContentLengthSize &&
+            qstrnicmp(data + lineStart, kContentLength, kContentLengthSize) == 0) {
+            qsizetype pos = lineStart + kContentLengthSize;
+            while (pos < lineEnd && data[pos] == ' ') {
+                ++pos;
+            }
+
+            qsizetype length = 0;
+            bool hasDigits = false;
+            while (pos < lineEnd && data[pos] >= '0' && data[pos] <= '9') {
+                const int digit = data[pos] - '0';
+                // Checked before it grows, so it cannot overflow either
+                if (length > (kMaximumContentLength - digit) / 10) {
+                    return -1;
+                }
+                length = length * 10 + digit;
+                hasDigits = true;
+                ++pos;
+            }
+            return hasDigits ? length : -1;
+        }
+
+        lineStart = lineEnd + 1;
+    }
+
+    return -1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <QByteArray>
+
+// Splits the server's output stream into JSON-RPC payloads.
+//
+// Bytes are read straight into a single growable buffer. Headers are parsed
+// where they lie, the header terminator search resumes where the previous
+// one stopped, and consumed bytes are only reclaimed when the read position
+// passes the middle of the buffer, so framing cost stays linear in the
+// amount of data received however it is chunked.
+class LSPFramer {
+public:
+    enum class Result { NeedMoreData, Message, Malformed };
+
+    // Returns a pointer to at least `size` writable bytes at the end of the
+    // buffer; call commit() with the number of bytes actually written.
+    char *reserve(qsizetype size);
+    void commit(qsizetype size);
+
+    // Extracts the next complete message. The payload refers to the
+    // framer's own storage and stays valid until the next reserve().
+    Result next(QByteArray *payload);
+
+    void clear();
+
+private:
+    qsizetype findHeaderEnd();
+    qsizetype parseContentLength(qsizetype headerEnd) const;
+
+    QByteArray m_buffer;
+    qsizetype m_head = 0;     // First unconsumed byte
+    qsizetype m_tail = 0;     // End of received data
+    qsizetype m_scanned = 0;  // Header search has covered [m_head, m_scanned)
+    qsizetype m_bodyOffset = -1; // Body start relative to m_head, once known
+    qsizetype m_contentLength = -1;
+};
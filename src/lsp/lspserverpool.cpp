@@ -0,0 +1,139 @@
+#include "lspserverpool.h"
+#include "lspclient.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+
+LSPServerPool &LSPServerPool::instance() {
+    // Owned by the application object rather than held in a function
+    // static, so it never outlives Qt
+    static LSPServerPool *instance =
+        new LSPServerPool(QCoreApplication::instance());
+    return *instance;
+}
+
+LSPServerPool::LSPServerPool(QObject *parent)
+    : QObject(parent), m_stopped(false) {
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this,
+            &LSPServerPool::stopAll);
+}
+
+LSPServerPool::~LSPServerPool() {
+    // The clients are children, so they go with the pool; their servers
+    // were stopped on aboutToQuit
+}
+
+void LSPServerPool::stopAll() {
+    // Editors still hold their clients and release them as the windows
+    // close, so the clients stay alive with no server behind them. That
+    // includes released clients whose servers are still shutting down.
+    m_stopped = true;
+    const QList<LSPClient *> clients = findChildren<LSPClient *>(Qt::FindDirectChildrenOnly);
+    for (LSPClient *client : clients) {
+        client->stopServer();
+    }
+}
+
+void LSPServerPool::evict(LSPClient *client) {
+    // Released clients are already gone from m_servers
+    for (auto it = m_servers.begin(); it != m_servers.end(); ++it) {
+        if (it.value().client != client) continue;
+
+        m_evicted.insert(client, it.value().refCount);
+        m_servers.erase(it);
+        return;
+    }
+}
+
+LSPClient *LSPServerPool::acquire(const QString &filePath) {
+    QString languageId = languageIdForFile(filePath);
+    QString command = serverCommand(languageId);
+    if (command.isEmpty() || m_stopped) {
+        return nullptr;
+    }
+
+    QString rootPath = workspaceRootForFile(filePath);
+    QString key = command + QLatin1Char('\n') + rootPath;
+
+    auto it = m_servers.find(key);
+    if (it != m_servers.end()) {
+        it.value().refCount++;
+        return it.value().client;
+    }
+
+    LSPClient *client = new LSPClient(this);
+    if (!client->startServer(command)) {
+        delete client;
+        return nullptr;
+    }
+    client->initialize(rootPath);
+    connect(client, &LSPClient::serverStopped, this, [this, client]() { evict(client); });
+
+    ServerEntry entry;
+    entry.client = client;
+    entry.refCount = 1;
+    m_servers.insert(key, entry);
+    return client;
+}
+
+void LSPServerPool::release(LSPClient *client) {
+    if (!client) return;
+
+    auto evicted = m_evicted.find(client);
+    if (evicted != m_evicted.end()) {
+        if (--evicted.value() <= 0) {
+            m_evicted.erase(evicted);
+            client->deleteLater();
+        }
+        return;
+    }
+
+    for (auto it = m_servers.begin(); it != m_servers.end(); ++it) {
+        if (it.value().client != client) continue;
+
+        if (--it.value().refCount <= 0) {
+            m_servers.erase(it);
+            // Closing the last editor must not wait on the server; the
+            // client goes once its process has exited
+            connect(client, &LSPClient::serverStopped, client, &QObject::deleteLater);
+            client->shutdownServer();
+        }
+        return;
+    }
+}
+
+QString LSPServerPool::languageIdForFile(const QString &filePath) {
+    static const QHash<QString, QString> languageIds = {
+        {"c", "c"},
+        {"cpp", "cpp"}, {"cc", "cpp"}, {"cxx", "cpp"}, {"c++", "cpp"},
+        {"h", "cpp"}, {"hpp", "cpp"}, {"hh", "cpp"}, {"hxx", "cpp"},
+        {"inl", "cpp"}, {"ipp", "cpp"}, {"tpp", "cpp"},
+        {"m", "objective-c"}, {"mm", "objective-cpp"}
+    };
+    return languageIds.value(QFileInfo(filePath).suffix().toLower());
+}
+
+QString LSPServerPool::workspaceRootForFile(const QString &filePath) {
+    QDir dir = QFileInfo(filePath).absoluteDir();
+    const QDir fileDir = dir;
+
+    // Walk up to the nearest directory that looks like a project root, the
+    // same markers clangd uses to locate its compilation database
+    while (true) {
+        if (dir.exists("compile_commands.json") || dir.exists(".clangd") ||
+            dir.exists(".git")) {
+            return dir.absolutePath();
+        }
+        if (!dir.cdUp()) break;
+    }
+
+    return fileDir.absolutePath();
+}
+
+QString LSPServerPool::serverCommand(const QString &languageId) const {
+    if (languageId == "c" || languageId == "cpp" ||
+        languageId == "objective-c" || languageId == "objective-cpp") {
+        return "clangd";
+    }
+    return QString();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+class LSPClient;
+
+// Owns the language server processes for the whole application. Editors do
+// not start servers themselves; they acquire the client that serves their
+// document's workspace and language, and release it when the document is
+// closed. A server is shut down in the background once its last document
+// has been released, and every server is stopped when the application is
+// about to quit. A server that exits on its own is dropped from the pool so
+// the next document in its workspace starts a new one.
+// The pool belongs to the application object, so instance() must not be
+// called before it exists.
+class LSPServerPool : public QObject {
+    Q_OBJECT
+
+public:
+    static LSPServerPool &instance();
+
+    // Returns the shared client for the file, starting the server on first
+    // use, or nullptr if no language server handles this kind of file.
+    LSPClient *acquire(const QString &filePath);
+    void release(LSPClient *client);
+
+    static QString languageIdForFile(const QString &filePath);
+    static QString workspaceRootForFile(const QString &filePath);
+
+private:
+    explicit LSPServerPool(QObject *parent = nullptr);
+    ~LSPServerPool();
+    LSPServerPool(const LSPServerPool &) = delete;
+    LSPServerPool &operator=(const LSPServerPool &) = delete;
+
+    struct ServerEntry {
+        LSPClient *client = nullptr;
+        int refCount = 0;
+    };
+
+    QString serverCommand(const QString &languageId) const;
+    void stopAll();
+    void evict(LSPClient *client);
+
+    // Keyed by server command and workspace root; languages served by the
+    // same server binary (C and C++ for clangd) share one process.
+    QHash<QString, ServerEntry> m_servers;
+    // Clients whose server exited on its own, with the number of editors
+    // still holding them
+    QHash<LSPClient *, int> m_evicted;
+    // Set on aboutToQuit; no servers are started after it
+    bool m_stopped;
+};
@@ -0,0 +1,257 @@
+#include "lsptransport.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+
+namespace {
+
+QString hoverText(const QJsonValue &contents) {
+    // MarkupContent, a bare MarkedString, or a list of MarkedStrings
+    if (contents.isString()) {
+        return contents.toString();
+    }
+    if (contents.isObject()) {
+        return contents.toObject()["value"].toString();
+    }
+    if (contents.isArray()) {
+        QStringList parts;
+        for (const QJsonValue &part : contents.toArray()) {
+            QString text = hoverText(part);
+            if (!text.isEmpty()) {
+                parts << text;
+            }
+        }
+        return parts.join("\n\n");
+    }
+    return QString();
+}
+
+} // namespace
+
+LSPTransport::LSPTransport(QObject *parent)
+    : QObject(parent), m_process(nullptr) {
+}
+
+LSPTransport::~LSPTransport() {
+    stop();
+}
+
+bool LSPTransport::start(const QString &command) {
+    if (m_process) {
+        return false;
+    }
+
+    m_process = new QProcess(this);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &LSPTransport::readServerOutput);
+    connect(m_process, &QProcess::readyReadStandardError, this, &LSPTransport::readServerError);
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &LSPTransport::finished);
+
+    m_process->start(command);
+    return m_process->waitForStarted();
+}
+
+void LSPTransport::send(const QJsonObject &message) {
+    if (!m_process) {
+        return;
+    }
+
+    if (message.contains("id") && message.contains("method")) {
+        m_requestMethods.insert(message["id"].toInt(), message["method"].toString());
+    }
+    write(message);
+}
+
+void LSPTransport::stop() {
+    if (m_process) {
+        if (m_process->state() == QProcess::Running) {
+            m_process->waitForBytesWritten(1000);
+            m_process->closeWriteChannel();
+            if (!m_process->waitForFinished(1000)) {
+                m_process->terminate();
+                if (!m_process->waitForFinished(2000)) {
+                    m_process->kill();
+                    m_process->waitForFinished(1000);
+                }
+            }
+        }
+        m_process->disconnect(this);
+        delete m_process;
+        m_process = nullptr;
+    }
+    m_framer.clear();
+    m_requestMethods.clear();
+}
+
+void LSPTransport::finish() {
+    if (!m_process || m_process->state() != QProcess::Running) {
+        return;
+    }
+
+    // Same grace periods as stop(); the timers die with the process
+    m_process->closeWriteChannel();
+    QTimer::singleShot(1000, m_process, &QProcess::terminate);
+    QTimer::singleShot(3000, m_process, &QProcess::kill);
+}
+
+void LSPTransport::readServerOutput() {
+    // Read straight into the framer's buffer rather than through an
+    // intermediate QByteArray per chunk
+    qint64 available = m_process->bytesAvailable();
+    while (available > 0) {
+        char *data = m_framer.reserve(available);
+        qint64 read = m_process->read(data, available);
+        if (read <= 0) {
+            break;
+        }
+        m_framer.commit(read);
+        available = m_process->bytesAvailable();
+    }
+
+    QByteArray payload;
+    while (true) {
+        LSPFramer::Result result = m_framer.next(&payload);
+        if (result == LSPFramer::Result::NeedMoreData) {
+            break;
+        }
+        if (result == LSPFramer::Result::Malformed) {
+            emit errorOccurred(tr("Invalid message header from language server"));
+            continue;
+        }
+        dispatchMessage(payload);
+    }
+}
+
+void LSPTransport::readServerError() {
+    emit errorOccurred(QString::fromUtf8(m_process->readAllStandardError()));
+}
+
+void LSPTransport::dispatchMessage(const QByteArray &payload) {
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(payload, &error);
+    if (error.error != QJsonParseError::NoError) {
+        emit errorOccurred(tr("Failed to parse JSON message: %1").arg(error.errorString()));
+        return;
+    }
+
+    if (!doc.isObject()) {
+        emit errorOccurred(tr("Invalid message format: not a JSON object"));
+        return;
+    }
+
+    QJsonObject obj = doc.object();
+    bool hasId = obj.contains("id");
+    bool hasMethod = obj.contains("method");
+
+    if (hasId && hasMethod) {
+        // A request from the server (progress tokens, configuration). None
+        // of them need an answer beyond an acknowledgement, but the server
+        // may block until it gets one.
+        write(QJsonObject({
+            {"jsonrpc", "2.0"},
+            {"id", obj.value("id")},
+            {"result", QJsonValue::Null}
+        }));
+    } else if (hasId) {
+        int id = obj["id"].toInt();
+        QString method = m_requestMethods.take(id);
+        if (obj.contains("error")) {
+            emit requestFailed(id, obj["error"].toObject()["message"].toString());
+        } else {
+            decodeResponse(id, method, obj["result"]);
+        }
+    } else if (hasMethod) {
+        decodeNotification(obj["method"].toString(), obj["params"].toObject());
+    }
+}
+
+void LSPTransport::decodeResponse(int id, const QString &method, const QJsonValue &result) {
+    if (method == "initialize") {
+        emit initializeResult(id, result.toObject()["capabilities"].toObject());
+    } else if (method == "textDocument/completion") {
+        // Either a CompletionList or a bare array of items
+        bool isIncomplete = false;
+        QJsonArray array;
+        if (result.isArray()) {
+            array = result.toArray();
+        } else {
+            QJsonObject list = result.toObject();
+            isIncomplete = list["isIncomplete"].toBool();
+            array = list["items"].toArray();
+        }
+
+        QVector<LSPCompletionItem> items;
+        items.reserve(array.size());
+        for (const QJsonValue &val : array) {
+            QJsonObject obj = val.toObject();
+            LSPCompletionItem item;
+            item.label = obj["label"].toString();
+            item.detail = obj["detail"].toString();
+            item.kind = obj["kind"].toInt();
+            item.filterText = obj["filterText"].toString(item.label);
+            if (obj.contains("textEdit")) {
+                item.insertText = obj["textEdit"].toObject()["newText"].toString();
+            } else {
+                item.insertText = obj["insertText"].toString(item.label);
+            }
+            items.append(item);
+        }
+        emit completionResult(id, isIncomplete, items);
+    } else if (method == "textDocument/hover") {
+        emit hoverResult(id, hoverText(result.toObject()["contents"]));
+    } else if (method == "textDocument/definition") {
+        // Location, Location[] or LocationLink[]
+        QJsonObject location = result.isArray() ? result.toArray().at(0).toObject()
+                                                : result.toObject();
+        QString uri = location["uri"].toString();
+        QJsonObject range = location["range"].toObject();
+        if (location.contains("targetUri")) {
+            uri = location["targetUri"].toString();
+            range = location["targetSelectionRange"].toObject();
+        }
+
+        if (uri.isEmpty()) {
+            emit responseReceived(id);
+            return;
+        }
+        QJsonObject start = range["start"].toObject();
+        emit definitionResult(id, uri, start["line"].toInt(), start["character"].toInt());
+    } else {
+        emit responseReceived(id);
+    }
+}
+
+void LSPTransport::decodeNotification(const QString &method, const QJsonObject &params) {
+    if (method != "textDocument/publishDiagnostics") {
+        return;
+    }
+
+    QJsonArray array = params["diagnostics"].toArray();
+    QVector<LSPDiagnostic> diagnostics;
+    diagnostics.reserve(array.size());
+    for (const QJsonValue &val : array) {
+        QJsonObject obj = val.toObject();
+        QJsonObject range = obj["range"].toObject();
+        QJsonObject start = range["start"].toObject();
+        QJsonObject end = range["end"].toObject();
+
+        LSPDiagnostic diagnostic;
+        diagnostic.startLine = start["line"].toInt();
+        diagnostic.startCharacter = start["character"].toInt();
+        diagnostic.endLine = end["line"].toInt();
+        diagnostic.endCharacter = end["character"].toInt();
+        diagnostic.severity = obj["severity"].toInt(1);
+        diagnostic.message = obj["message"].toString();
+        diagnostics.append(diagnostic);
+    }
+    emit diagnosticsPublished(params["uri"].toString(), diagnostics);
+}
+
+void LSPTransport::write(const QJsonObject &message) {
+    QByteArray data = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    QByteArray frame;
+    frame.reserve(data.size() + 32);
+    frame.append("Content-Length: ").append(QByteArray::number(data.size()));
+    frame.append("\r\n\r\n").append(data);
+    m_process->write(frame);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "lspframer.h"
+#include "lsptypes.h"
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QProcess>
+
+// Runs on the LSP I/O thread. Owns the server process, serialises outgoing
+// messages, frames and parses incoming ones, and turns responses into typed
+// results before anything reaches the GUI thread. All slots must be invoked
+// through queued connections from other threads.
+class LSPTransport : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LSPTransport(QObject *parent = nullptr);
+    ~LSPTransport();
+
+public slots:
+    bool start(const QString &command);
+    void send(const QJsonObject &message);
+    // Waits for the server to exit, escalating to terminate and kill if it
+    // does not; blocks the I/O thread, so only for application shutdown
+    void stop();
+    // The same without blocking: closes the server's input and returns;
+    // finished is emitted once the process is gone
+    void finish();
+
+signals:
+    void initializeResult(int id, const QJsonObject &capabilities);
+    void completionResult(int id, bool isIncomplete,
+                          const QVector<LSPCompletionItem> &items);
+    void hoverResult(int id, const QString &contents);
+    void definitionResult(int id, const QString &uri, int line, int character);
+    // Responses without a typed payload, including empty results
+    void responseReceived(int id);
+    void requestFailed(int id, const QString &message);
+    void diagnosticsPublished(const QString &uri,
+                              const QVector<LSPDiagnostic> &diagnostics);
+    void errorOccurred(const QString &message);
+    void finished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private slots:
+    void readServerOutput();
+    void readServerError();
+
+private:
+    void dispatchMessage(const QByteArray &payload);
+    void decodeResponse(int id, const QString &method, const QJsonValue &result);
+    void decodeNotification(const QString &method, const QJsonObject &params);
+    void write(const QJsonObject &message);
+
+    QProcess *m_process;
+    LSPFramer m_framer;
+    QHash<int, QString> m_requestMethods; // Outstanding request id -> method
+};
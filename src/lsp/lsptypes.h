@@ -0,0 +1,27 @@
+#pragma once
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+// Results are decoded from JSON on the LSP I/O thread and delivered to the
+// GUI thread in these ready-to-use forms
+
+struct LSPCompletionItem {
+    QString label;
+    QString insertText;
+    QString filterText;
+    QString detail;
+    int kind = 0;
+};
+
+struct LSPDiagnostic {
+    int startLine = 0;
+    int startCharacter = 0;
+    int endLine = 0;
+    int endCharacter = 0;
+    int severity = 1; // 1 = Error, 2 = Warning, 3 = Information, 4 = Hint
+    QString message;
+};
+
+Q_DECLARE_METATYPE(LSPCompletionItem)
+Q_DECLARE_METATYPE(LSPDiagnostic)
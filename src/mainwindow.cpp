@@ -4,6 +4,7 @@
 #include "settings/sessionsettings.h"
 #include "settings/shortcutmanager.h"
 #include "views/browser/browserview.h"
+#include "views/project/ignorerules.h"
 #include <QApplication>
 #include <QCloseEvent>
 #include <QContextMenuEvent>
@@ -17,6 +18,7 @@
 #include <QMessageBox>
 #include <QPushButton>
 #include <QScreen>
+#include <QSet>
 #include <QSettings>
 #include <QShortcut>
 #include <QSplitter>
@@ -32,6 +34,12 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   editorTabs = new QTabWidget(this);
   contentView = new ContentView(this);
   terminal = new Terminal(this);
+  findInFilesView = new FindInFilesView(this);
+  projectWatcher = new ProjectWatcher(this);
+  searchIndex = new TrigramIndex(this);
+  findInFilesView->setIndex(searchIndex);
+  pathIndex = new PathIndex(this);
+  quickOpenDialog = new QuickOpenDialog(pathIndex, this);
   welcomeView = new WelcomeView(this);
   dockManager = new DockManager(this);
 
@@ -96,6 +104,21 @@ void MainWindow::setupUI() {
           &MainWindow::handleDirectoryChanged);
   connect(projectTree, &ProjectTree::rootDirectoryChanged, this,
           &MainWindow::handleRootDirectoryChanged);
+  connect(projectWatcher, &ProjectWatcher::changed, this,
+          &MainWindow::handleFileSystemChanges);
+  connect(quickOpenDialog, &QuickOpenDialog::fileSelected, this,
+          &MainWindow::handleFileSelected);
+
+  // Open a Find in Files hit at its position
+  connect(findInFilesView, &FindInFilesView::matchActivated, this,
+          [this](const QString &filePath, int line, int column) {
+            handleFileSelected(filePath);
+            CodeEditor *editor = currentEditor();
+            if (editor && editor->filePath() == filePath) {
+              editor->goToLine(line, column);
+              editor->setFocus();
+            }
+          });
 
   // Connect dock manager signals
   connect(dockManager, &DockManager::layoutChanged, this,
@@ -117,6 +140,9 @@ void MainWindow::createDockWidgets() {
                                  contentView, tr("Content View"));
   QDockWidget *terminalDock = dockManager->addDockWidget(
       DockManager::DockWidgetType::Terminal, terminal, tr("Terminal"));
+  QDockWidget *findDock = dockManager->addDockWidget(
+      DockManager::DockWidgetType::FindInFiles, findInFilesView,
+      tr("Find in Files"));
 
   // Set terminal dock properties
   terminalDock->setFeatures(QDockWidget::DockWidgetClosable |
@@ -131,6 +157,7 @@ void MainWindow::createDockWidgets() {
   editorDock->hide();
   contentDock->hide();
   terminalDock->hide();
+  findDock->hide();
 
   // Create default layout
   dockManager->resetLayout();
@@ -153,6 +180,13 @@ void MainWindow::createMenus() {
                                tr("Open existing file"));
   connect(openAction, &QAction::triggered, this, &MainWindow::openFile);
 
+  QAction *goToFileAction = fileMenu->addAction(tr("&Go to File..."));
+  shortcutMgr.registerShortcut("file.goToFile", QKeySequence("Ctrl+P"),
+                               goToFileAction,
+                               tr("Open a project file by fuzzy name"));
+  connect(goToFileAction, &QAction::triggered, this,
+          &MainWindow::showQuickOpen);
+
   QAction *openFolderAction = fileMenu->addAction(tr("Open &Folder..."));
   shortcutMgr.registerShortcut("file.openFolder",
                                QKeySequence("Ctrl+K, Ctrl+O"), openFolderAction,
@@ -246,6 +280,13 @@ void MainWindow::createMenus() {
     }
   });
 
+  QAction *findInFilesAction = editMenu->addAction(tr("Find in F&iles..."));
+  shortcutMgr.registerShortcut("edit.findInFiles", QKeySequence("Ctrl+Shift+F"),
+                               findInFilesAction,
+                               tr("Search all files in the project"));
+  connect(findInFilesAction, &QAction::triggered, this,
+          &MainWindow::showFindInFiles);
+
   QAction *replaceAction = editMenu->addAction(tr("&Replace..."));
   shortcutMgr.registerShortcut("edit.replace", QKeySequence::Replace,
                                replaceAction, tr("Replace text in document"));
@@ -631,7 +672,7 @@ void MainWindow::handleFileSelected(const QString &filePath) {
   for (int i = 0; i < editorTabs->count(); ++i) {
     if (CodeEditor *editor =
             qobject_cast<CodeEditor *>(editorTabs->widget(i))) {
-      if (editor->property("filePath").toString() == filePath) {
+      if (editor->filePath() == filePath) {
         editorTabs->setCurrentIndex(i);
         dockManager->setDockVisible(DockManager::DockWidgetType::Editor, true);
         return;
@@ -647,9 +688,62 @@ void MainWindow::handleDirectoryChanged(const QString &path) {
 
 void MainWindow::handleRootDirectoryChanged(const QString &path) {
   projectPath = path;
+  findInFilesView->setRootPath(path);
+  projectWatcher->setRootPath(path);
+  searchIndex->setRootPath(path);
+  pathIndex->setRootPath(path);
   updateWindowTitle();
 }
 
+void MainWindow::handleFileSystemChanges(const QStringList &paths,
+                                         bool overflowed) {
+  projectTree->handleFileSystemChanges(paths, overflowed);
+
+  if (overflowed) {
+    searchIndex->refresh();
+    pathIndex->invalidate(projectPath);
+  } else {
+    bool rulesChanged = false;
+    for (const QString &path : paths) {
+      searchIndex->invalidate(path);
+      pathIndex->invalidate(path);
+      rulesChanged = rulesChanged || IgnoreService::isRulesFile(path);
+    }
+    // Files the index left out may be searchable now, and the reverse
+    if (rulesChanged) {
+      searchIndex->refresh();
+    }
+  }
+
+  // Editors without local edits follow the file on disk; the others keep
+  // their text and say so
+  const QSet<QString> changed(paths.cbegin(), paths.cend());
+  for (int i = 0; i < editorTabs->count(); ++i) {
+    CodeEditor *editor = qobject_cast<CodeEditor *>(editorTabs->widget(i));
+    if (!editor || editor->filePath().isEmpty() ||
+        (!overflowed && !changed.contains(editor->filePath()))) {
+      continue;
+    }
+    QFile file(editor->filePath());
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+      continue;
+    }
+    QTextStream in(&file);
+    const QString text = in.readAll();
+    // Our own saves come back through here too
+    if (text == editor->toPlainText()) {
+      continue;
+    }
+    if (editor->document()->isModified()) {
+      statusBar()->showMessage(tr("%1 changed on disk; keeping your edits")
+                                   .arg(QFileInfo(file).fileName()),
+                               3000);
+      continue;
+    }
+    editor->reloadText(text);
+  }
+}
+
 void MainWindow::updateWindowTitle() {
   QString title = tr("Modern C++ IDE");
   if (!projectPath.isEmpty()) {
@@ -665,7 +759,7 @@ CodeEditor *MainWindow::currentEditor() {
 
 QString MainWindow::currentFilePath() {
   if (CodeEditor *editor = currentEditor()) {
-    return editor->property("filePath").toString();
+    return editor->filePath();
   }
   return QString();
 }
@@ -702,7 +796,7 @@ void MainWindow::loadFile(const QString &filePath) {
   for (int i = 0; i < editorTabs->count(); ++i) {
     if (CodeEditor *editor =
             qobject_cast<CodeEditor *>(editorTabs->widget(i))) {
-      if (editor->property("filePath").toString() == filePath) {
+      if (editor->filePath() == filePath) {
         editorTabs->setCurrentIndex(i);
         return;
       }
@@ -730,11 +824,11 @@ void MainWindow::loadFile(const QString &filePath) {
 
   // Create new editor tab without dock
   CodeEditor *editor = new CodeEditor(this);
-  editor->setProperty("filePath", filePath);
   editor->setWorkingDirectory(QFileInfo(filePath).absolutePath());
 
   QTextStream in(&file);
   editor->setPlainText(in.readAll());
+  editor->setFilePath(filePath);
 
   QString fileName = QFileInfo(filePath).fileName();
   editorTabs->addTab(editor, fileName);
@@ -773,7 +867,9 @@ bool MainWindow::saveFile(const QString &filePath) {
 
   QTextStream out(&file);
   out << editor->toPlainText();
-  editor->setProperty("filePath", filePath);
+  editor->document()->setModified(false);
+  editor->setFilePath(filePath);
+  searchIndex->invalidate(QFileInfo(filePath).absoluteFilePath());
 
   QFileInfo info(filePath);
   editorTabs->setTabText(editorTabs->currentIndex(), info.fileName());
@@ -919,7 +1015,7 @@ void MainWindow::saveSessionState() {
   for (int i = 0; i < editorTabs->count(); ++i) {
     if (CodeEditor *editor =
             qobject_cast<CodeEditor *>(editorTabs->widget(i))) {
-      QString filePath = editor->property("filePath").toString();
+      QString filePath = editor->filePath();
       if (!filePath.isEmpty()) {
         openedFiles << filePath;
       }
@@ -1047,6 +1143,11 @@ void MainWindow::closeFolder() {
 
   // Hide project tree
   dockManager->setDockVisible(DockManager::DockWidgetType::ProjectTree, false);
+  dockManager->setDockVisible(DockManager::DockWidgetType::FindInFiles, false);
+  findInFilesView->setRootPath(QString());
+  projectWatcher->setRootPath(QString());
+  searchIndex->setRootPath(QString());
+  pathIndex->setRootPath(QString());
 
   // Update window title
   setWindowTitle("ohao IDE");
@@ -1110,6 +1211,23 @@ void MainWindow::focusContentView() {
   }
 }
 
+void MainWindow::showQuickOpen() {
+  if (projectPath.isEmpty()) {
+    statusBar()->showMessage(tr("Open a folder to go to its files"), 2000);
+    return;
+  }
+  quickOpenDialog->popup();
+}
+
+void MainWindow::showFindInFiles() {
+  if (QDockWidget *dock = dockManager->getDockWidget(
+          DockManager::DockWidgetType::FindInFiles)) {
+    dock->show();
+    dock->raise();
+  }
+  findInFilesView->activate();
+}
+
 void MainWindow::handleCtrlW() {
   // Handle close based on what's focused
   if (!currentFocusWidget)
@@ -4,6 +4,11 @@
 #include "views/dockmanager.h"
 #include "views/dockwidgetbase.h"
 #include "views/project/projecttree.h"
+#include "views/project/projectwatcher.h"
+#include "views/search/findinfilesview.h"
+#include "views/search/pathindex.h"
+#include "views/search/quickopendialog.h"
+#include "views/search/trigramindex.h"
 #include "views/terminal/terminalwidget.h"
 #include "views/welcome/welcomeview.h"
 #include <QInputDialog>
@@ -25,6 +30,8 @@ public slots:
   void focusProjectTree();
   void focusTerminal();
   void focusContentView();
+  void showFindInFiles();
+  void showQuickOpen();
   void handleCtrlW();
   void handleCtrlN();
   void showShortcutsHelp();
@@ -40,6 +47,7 @@ private slots:
   void handleFileSelected(const QString &filePath);
   void handleDirectoryChanged(const QString &path);
   void handleRootDirectoryChanged(const QString &path);
+  void handleFileSystemChanges(const QStringList &paths, bool overflowed);
   void handleLayoutChanged();
   void handleDockVisibilityChanged(DockManager::DockWidgetType type,
                                    bool visible);
@@ -82,6 +90,11 @@ private:
   ContentView *contentView;
   WelcomeView *welcomeView;
   Terminal *terminal;
+  FindInFilesView *findInFilesView;
+  ProjectWatcher *projectWatcher;
+  TrigramIndex *searchIndex;
+  PathIndex *pathIndex;
+  QuickOpenDialog *quickOpenDialog;
   DockManager *dockManager;
   QString projectPath;
   QStringList recentProjects;
@@ -15,14 +15,16 @@ SessionSettings::SessionSettings(QObject *parent) : QObject(parent) {
   ensureConfigDirectory();
 }
 
+QString SessionSettings::configDirectory() const {
+  return QDir::currentPath() + "/.ohao-ide";
+}
+
 QString SessionSettings::getSessionFilePath() const {
-  QString configPath = QDir::currentPath() + "/.ohao-ide";
-  return configPath + "/session.json";
+  return configDirectory() + "/session.json";
 }
 
 void SessionSettings::ensureConfigDirectory() const {
-  QString configPath = QDir::currentPath() + "/.ohao-ide";
-  QDir dir(configPath);
+  QDir dir(configDirectory());
   if (!dir.exists()) {
     dir.mkpath(".");
   }
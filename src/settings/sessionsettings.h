@@ -27,6 +27,10 @@ public:
                    QMap<QString, WindowState> &windowStates,
                    QByteArray &mainWindowGeometry, QByteArray &mainWindowState);
 
+  // The .ohao-ide directory holding the session and other per-workspace
+  // state such as the search index
+  QString configDirectory() const;
+
 private:
   explicit SessionSettings(QObject *parent = nullptr);
   // Delete copy constructor and assignment operator
@@ -112,6 +112,10 @@ void DockManager::resetLayout()
     if (QDockWidget *terminalDock = getDockWidget(DockWidgetType::Terminal)) {
         mainWindow->addDockWidget(Qt::BottomDockWidgetArea, terminalDock);
     }
+
+    if (QDockWidget *findDock = getDockWidget(DockWidgetType::FindInFiles)) {
+        mainWindow->addDockWidget(Qt::BottomDockWidgetArea, findDock);
+    }
 }
 
 QList<QDockWidget*> DockManager::getDockWidgets() const
@@ -212,6 +216,7 @@ QString DockManager::getDockTypeName(DockWidgetType type) const
         case DockWidgetType::Editor:       return "Editor";
         case DockWidgetType::ContentView:  return "ContentView";
         case DockWidgetType::Terminal:     return "Terminal";
+        case DockWidgetType::FindInFiles:  return "FindInFiles";
         default:                           return "Unknown";
     }
 }
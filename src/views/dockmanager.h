@@ -12,7 +12,13 @@ class DockManager : public QObject {
 public:
   enum class DockArea { Left, Right, Top, Bottom, Center, Floating };
 
-  enum class DockWidgetType { ProjectTree, Editor, ContentView, Terminal };
+  enum class DockWidgetType {
+    ProjectTree,
+    Editor,
+    ContentView,
+    Terminal,
+    FindInFiles
+  };
 
   explicit DockManager(QMainWindow *mainWindow);
 
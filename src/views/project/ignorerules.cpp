@@ -0,0 +1,315 @@
+#include "ignorerules.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <utility>
+
+namespace {
+// Translates a gitignore-style glob. '*' and '?' stay within one path
+// segment, "**" crosses segments and "[...]" is a character class.
+QString globToRegex(QStringView glob) {
+    QString rx;
+    for (qsizetype i = 0; i < glob.size(); ++i) {
+        QChar ch = glob[i];
+        if (ch == QLatin1Char('*')) {
+            if (i + 1 < glob.size() && glob[i + 1] == QLatin1Char('*')) {
+                if (i + 2 < glob.size() && glob[i + 2] == QLatin1Char('/')) {
+                    rx += QLatin1String("(?:.*/)?");
+                    i += 2;
+                } else {
+                    rx += QLatin1String(".*");
+                    ++i;
+                }
+            } else {
+                rx += QLatin1String("[^/]*");
+            }
+        } else if (ch == QLatin1Char('?')) {
+            rx += QLatin1String("[^/]");
+        } else if (ch == QLatin1Char('[')) {
+            qsizetype close = glob.indexOf(QLatin1Char(']'), i + 2);
+            if (close < 0) {
+                rx += QLatin1String("\\[");
+                continue;
+            }
+            QStringView set = glob.mid(i + 1, close - i - 1);
+            rx += QLatin1Char('[');
+            if (set.startsWith(QLatin1Char('!'))) {
+                rx += QLatin1Char('^');
+                set = set.mid(1);
+            }
+            for (QChar member : set) {
+                if (member == QLatin1Char('\\') || member == QLatin1Char('^') ||
+                    member == QLatin1Char('[')) {
+                    rx += QLatin1Char('\\');
+                }
+                rx += member;
+            }
+            rx += QLatin1Char(']');
+            i = close;
+        } else if (ch == QLatin1Char('\\') && i + 1 < glob.size()) {
+            rx += QRegularExpression::escape(glob.mid(++i, 1).toString());
+        } else {
+            rx += QRegularExpression::escape(QString(ch));
+        }
+    }
+    return rx;
+}
+
+QRegularExpression compileAlternatives(const QStringList &patterns) {
+    QRegularExpression regex(QRegularExpression::anchoredPattern(
+        QLatin1String("(?:") + patterns.join(QLatin1String(")|(?:")) + QLatin1Char(')')));
+    regex.optimize();
+    return regex;
+}
+
+QStringList readPatterns(const QString &path) {
+    QStringList patterns;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return patterns;
+    }
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        while (line.endsWith(QLatin1Char('\n')) || line.endsWith(QLatin1Char('\r')) ||
+               (line.endsWith(QLatin1Char(' ')) && !line.endsWith(QLatin1String("\\ ")))) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#'))) {
+            continue;
+        }
+        patterns.append(line);
+    }
+    return patterns;
+}
+} // namespace
+
+// The rules of one file, which apply below the directory it is in
+struct IgnoreRules::Layer {
+    struct Rule {
+        QRegularExpression regex;
+        bool negated = false;
+        bool directoryOnly = false;
+    };
+
+    // Relative to the root, empty or ending in '/'
+    QString base;
+    // Every rule, and the rules that also apply to files, as one
+    // expression each over paths relative to `base`
+    QRegularExpression directories;
+    QRegularExpression files;
+    bool hasFileRules = false;
+    // Only kept when a negation makes the order of the rules matter
+    QVector<Rule> rules;
+    bool hasNegation = false;
+};
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::fromPatterns(const QStringList &patterns) {
+    auto rules = std::make_shared<IgnoreRules>();
+    rules->append(QString(), patterns);
+    return rules;
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::builtIn() {
+    static const std::shared_ptr<const IgnoreRules> rules =
+        fromPatterns({".git/", ".hg/", ".svn/", ".ohao-ide/"});
+    return rules;
+}
+
+void IgnoreRules::append(const QString &base, const QStringList &patterns) {
+    auto layer = std::make_shared<Layer>();
+    layer->base = base;
+    QStringList all;
+    QStringList forFiles;
+    for (QString glob : patterns) {
+        glob = glob.trimmed();
+        Layer::Rule rule;
+        if (glob.startsWith(QLatin1Char('!'))) {
+            rule.negated = true;
+            glob.remove(0, 1);
+        }
+        if (glob.endsWith(QLatin1Char('/'))) {
+            rule.directoryOnly = true;
+            glob.chop(1);
+        }
+        if (glob.isEmpty()) {
+            continue;
+        }
+        // Without a '/' the pattern may match at any depth
+        const bool anchored = glob.contains(QLatin1Char('/'));
+        if (glob.startsWith(QLatin1Char('/'))) {
+            glob.remove(0, 1);
+        }
+        QString rx = globToRegex(glob);
+        if (!anchored) {
+            rx.prepend(QLatin1String("(?:.*/)?"));
+        }
+
+        rule.regex.setPattern(QRegularExpression::anchoredPattern(rx));
+        if (!rule.regex.isValid()) {
+            // One bad pattern would spoil the whole expression
+            continue;
+        }
+        all.append(rx);
+        if (!rule.directoryOnly) {
+            forFiles.append(rx);
+        }
+        layer->hasNegation = layer->hasNegation || rule.negated;
+        layer->rules.append(rule);
+    }
+    if (all.isEmpty()) {
+        return;
+    }
+
+    layer->directories = compileAlternatives(all);
+    layer->hasFileRules = !forFiles.isEmpty();
+    if (layer->hasFileRules) {
+        layer->files = compileAlternatives(forFiles);
+    }
+    if (layer->hasNegation) {
+        for (Layer::Rule &rule : layer->rules) {
+            rule.regex.optimize();
+        }
+    } else {
+        layer->rules.clear();
+    }
+    m_layers.append(layer);
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::enter(const QString &directory,
+                                                      const QString &relativeDirectory) const {
+    QStringList files;
+    if (relativeDirectory.isEmpty()) {
+        files.append(directory + QLatin1String("/.git/info/exclude"));
+    }
+    // .ignore comes last, so it overrides .gitignore as ripgrep's does
+    files.append(directory + QLatin1String("/.gitignore"));
+    files.append(directory + QLatin1String("/.ignore"));
+
+    const QString base =
+        relativeDirectory.isEmpty() ? QString() : relativeDirectory + QLatin1Char('/');
+    std::shared_ptr<IgnoreRules> entered;
+    for (const QString &file : std::as_const(files)) {
+        const QStringList patterns = readPatterns(file);
+        if (patterns.isEmpty()) {
+            continue;
+        }
+        if (!entered) {
+            entered = std::make_shared<IgnoreRules>(*this);
+        }
+        entered->append(base, patterns);
+    }
+    if (!entered) {
+        return shared_from_this();
+    }
+    return entered;
+}
+
+bool IgnoreRules::matches(const QString &relativePath, bool isDir) const {
+    for (auto it = m_layers.crbegin(); it != m_layers.crend(); ++it) {
+        const Layer &layer = **it;
+        if (!isDir && !layer.hasFileRules) {
+            continue;
+        }
+        if (!relativePath.startsWith(layer.base)) {
+            continue;
+        }
+        const QString local = relativePath.mid(layer.base.size());
+        const QRegularExpression &any = isDir ? layer.directories : layer.files;
+        if (!any.match(local).hasMatch()) {
+            continue;
+        }
+        if (!layer.hasNegation) {
+            return true;
+        }
+        for (auto rule = layer.rules.crbegin(); rule != layer.rules.crend(); ++rule) {
+            if ((!rule->directoryOnly || isDir) && rule->regex.match(local).hasMatch()) {
+                return !rule->negated;
+            }
+        }
+    }
+    return false;
+}
+
+IgnoreService &IgnoreService::instance() {
+    static IgnoreService instance;
+    return instance;
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreService::rulesFor(const QString &root,
+                                                           const QString &directory) {
+    if (directory != root && !directory.startsWith(root + QLatin1Char('/'))) {
+        return IgnoreRules::builtIn();
+    }
+    QMutexLocker locker(&m_mutex);
+    return stateFor(root, directory).rules;
+}
+
+bool IgnoreService::isIgnored(const QString &root, const QString &path, bool isDir) {
+    if (!path.startsWith(root + QLatin1Char('/'))) {
+        return false;
+    }
+    const QString directory = path.left(path.lastIndexOf(QLatin1Char('/')));
+    QMutexLocker locker(&m_mutex);
+    const DirectoryState state = stateFor(root, directory);
+    return state.ignored || state.rules->matches(path.mid(root.size() + 1), isDir);
+}
+
+bool IgnoreService::isRulesFile(const QString &path) {
+    return path.endsWith(QLatin1String("/.gitignore")) ||
+           path.endsWith(QLatin1String("/.ignore")) ||
+           path.endsWith(QLatin1String("/.git/info/exclude"));
+}
+
+void IgnoreService::invalidate(const QString &root, const QString &path) {
+    QMutexLocker locker(&m_mutex);
+    if (path == root) {
+        m_cache.remove(root);
+        return;
+    }
+    auto cache = m_cache.find(root);
+    if (cache == m_cache.end()) {
+        return;
+    }
+
+    QString directory = path;
+    if (path.endsWith(QLatin1String("/.git/info/exclude"))) {
+        directory = root;
+    } else if (isRulesFile(path)) {
+        directory = path.left(path.lastIndexOf(QLatin1Char('/')));
+    }
+    if (!cache->contains(directory)) {
+        // Directories are cached after their parents, so none below it is
+        return;
+    }
+    const QString prefix = directory + QLatin1Char('/');
+    for (auto it = cache->begin(); it != cache->end();) {
+        if (it.key() == directory || it.key().startsWith(prefix)) {
+            it = cache->erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+IgnoreService::DirectoryState IgnoreService::stateFor(const QString &root,
+                                                      const QString &directory) {
+    auto cached = m_cache[root].constFind(directory);
+    if (cached != m_cache[root].constEnd()) {
+        return *cached;
+    }
+
+    DirectoryState state;
+    if (directory.size() <= root.size()) {
+        state.rules = IgnoreRules::builtIn()->enter(root, QString());
+    } else {
+        const DirectoryState parent =
+            stateFor(root, directory.left(directory.lastIndexOf(QLatin1Char('/'))));
+        const QString relative = directory.mid(root.size() + 1);
+        state.ignored = parent.ignored || parent.rules->matches(relative, true);
+        // Nothing below an ignored directory can be brought back, so its
+        // own ignore files are never read
+        state.rules = state.ignored ? parent.rules : parent.rules->enter(directory, relative);
+    }
+    m_cache[root].insert(directory, state);
+    return state;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+
+// Compiled gitignore-style rules, as they apply inside one directory: the
+// rules of every .gitignore and .ignore from the root down to it, deepest
+// last. Each file's patterns are joined into a single regular expression,
+// so an entry is tested once per file of rules rather than once per
+// pattern; the patterns are only tried one by one, newest first, when that
+// expression matches and the file has '!' negations to honour.
+//
+// Rules are immutable and shared: a directory without ignore files of its
+// own uses its parent's. Matching is safe from any thread.
+class IgnoreRules : public std::enable_shared_from_this<IgnoreRules> {
+public:
+  // Patterns matched against paths relative to the root, as search's
+  // include and exclude globs are. Without a '/' a pattern matches the
+  // last component at any depth.
+  static std::shared_ptr<const IgnoreRules> fromPatterns(const QStringList &patterns);
+  // Version control metadata and the IDE's own directory
+  static std::shared_ptr<const IgnoreRules> builtIn();
+
+  // The rules in effect inside `directory`, whose path relative to the root
+  // is `relativeDirectory`: these plus its .gitignore and .ignore, and for
+  // the root, .git/info/exclude
+  std::shared_ptr<const IgnoreRules> enter(const QString &directory,
+                                           const QString &relativeDirectory) const;
+
+  bool isEmpty() const { return m_layers.isEmpty(); }
+  // Whether an entry of the directory these rules are for is ignored. Later
+  // rules override earlier ones, and deeper files override shallower.
+  bool matches(const QString &relativePath, bool isDir) const;
+
+private:
+  struct Layer;
+
+  void append(const QString &base, const QStringList &patterns);
+
+  QVector<std::shared_ptr<const Layer>> m_layers;
+};
+
+// The ignore rules of open projects, compiled once per directory and shared
+// by the project tree, the watcher, search and the indexers. A directory
+// that is ignored is pruned as a whole: nothing below it is ever consulted,
+// so neither are the ignore files it holds.
+class IgnoreService {
+public:
+  static IgnoreService &instance();
+
+  // The rules for the entries of `directory`, under the project at `root`
+  std::shared_ptr<const IgnoreRules> rulesFor(const QString &root, const QString &directory);
+  // Whether `path` under `root`, or a directory above it, is ignored
+  bool isIgnored(const QString &root, const QString &path, bool isDir);
+  // Whether `path` is a file whose contents are ignore rules
+  static bool isRulesFile(const QString &path);
+  // Drops what was compiled from `path` once it changed; every cached
+  // directory of the project when `path` is the root
+  void invalidate(const QString &root, const QString &path);
+
+  IgnoreService(const IgnoreService &) = delete;
+  IgnoreService &operator=(const IgnoreService &) = delete;
+
+private:
+  IgnoreService() = default;
+
+  struct DirectoryState {
+    std::shared_ptr<const IgnoreRules> rules;
+    // The directory itself, or one above it, is ignored
+    bool ignored = false;
+  };
+
+  // Callers hold m_mutex
+  DirectoryState stateFor(const QString &root, const QString &directory);
+
+  QMutex m_mutex;
+  // Per project root, per absolute directory path
+  QHash<QString, QHash<QString, DirectoryState>> m_cache;
+};
@@ -0,0 +1,559 @@
+#include "projectmodel.h"
+#include "ignorerules.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMimeData>
+#include <QUrl>
+#include <algorithm>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include <cstddef>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Folders first, then by name ignoring case; the order of every child list
+bool lessThan(bool aIsDir, const QString &a, bool bIsDir, const QString &b) {
+    if (aIsDir != bIsDir) {
+        return aIsDir;
+    }
+    const int order = a.compare(b, Qt::CaseInsensitive);
+    if (order != 0) {
+        return order < 0;
+    }
+    return a < b;
+}
+
+#ifdef Q_OS_LINUX
+// The fixed part of a struct linux_dirent64, which glibc does not declare
+struct DirentHeader {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+};
+constexpr size_t kDirentNameOffset = offsetof(DirentHeader, d_type) + 1;
+#endif
+} // namespace
+
+struct ProjectModel::Node {
+    // The root holds its absolute path
+    QString name;
+    Node *parent = nullptr;
+    // Always in lessThan order, so a node's row is found by binary search
+    QVector<Node *> children;
+    bool isDir = false;
+    bool loaded = false;
+
+    ~Node() { qDeleteAll(children); }
+
+    int rowOf(bool childIsDir, const QString &childName) const {
+        auto it = std::lower_bound(children.cbegin(), children.cend(), childName,
+                                   [childIsDir](const Node *node, const QString &name) {
+                                       return lessThan(node->isDir, node->name, childIsDir, name);
+                                   });
+        if (it == children.cend() || (*it)->isDir != childIsDir || (*it)->name != childName) {
+            return -1;
+        }
+        return int(it - children.cbegin());
+    }
+};
+
+ProjectModel::ProjectModel(QObject *parent)
+    : QAbstractItemModel(parent), m_root(nullptr), m_generation(0) {
+    m_pool.setMaxThreadCount(2);
+}
+
+ProjectModel::~ProjectModel() {
+    ++m_generation;
+    m_pool.waitForDone();
+    delete m_root;
+}
+
+QVector<ProjectModel::Entry> ProjectModel::listDirectory(const QString &root,
+                                                        const QString &path) {
+    const std::shared_ptr<const IgnoreRules> ignore =
+        IgnoreService::instance().rulesFor(root, path);
+    const QString relativeDirectory =
+        path.size() > root.size() ? path.mid(root.size() + 1) + QLatin1Char('/') : QString();
+    QVector<Entry> entries;
+#ifdef Q_OS_LINUX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        // Each call returns as many entries as fit in the buffer, where
+        // readdir() would make one call per entry on some systems
+        alignas(8) char buffer[64 * 1024];
+        for (;;) {
+            const long length = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (long offset = 0; offset < length;) {
+                DirentHeader header;
+                std::memcpy(&header, buffer + offset, sizeof(header));
+                const char *name = buffer + offset + kDirentNameOffset;
+                offset += header.d_reclen;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                bool isDir = header.d_type == DT_DIR;
+                if (header.d_type == DT_UNKNOWN || header.d_type == DT_LNK) {
+                    // A symlink shows as what it points to
+                    struct statx info;
+                    isDir = ::statx(fd, name, AT_NO_AUTOMOUNT, STATX_TYPE, &info) == 0 &&
+                            S_ISDIR(info.stx_mode);
+                }
+                entries.append(Entry{QFile::decodeName(name), isDir});
+            }
+        }
+        ::close(fd);
+    }
+#else
+    const QFileInfoList infos = QDir(path).entryInfoList(
+        QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    entries.reserve(infos.size());
+    for (const QFileInfo &info : infos) {
+        entries.append(Entry{info.fileName(), info.isDir()});
+    }
+#endif
+    // Ignored entries are not shown, so nothing below them is ever listed
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](const Entry &entry) {
+                                     return ignore->matches(relativeDirectory + entry.name,
+                                                            entry.isDir);
+                                 }),
+                  entries.end());
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return lessThan(a.isDir, a.name, b.isDir, b.name);
+    });
+    return entries;
+}
+
+void ProjectModel::setRootPath(const QString &path) {
+    const QString root = path.isEmpty() ? QString() : QDir(path).absolutePath();
+
+    beginResetModel();
+    ++m_generation;
+    delete m_root;
+    m_root = nullptr;
+    m_listing.clear();
+    m_relist.clear();
+    if (!root.isEmpty()) {
+        m_root = new Node;
+        m_root->name = root;
+        m_root->isDir = true;
+    }
+    endResetModel();
+
+    if (m_root) {
+        requestListing(root);
+    }
+}
+
+QString ProjectModel::rootPath() const {
+    return m_root ? m_root->name : QString();
+}
+
+ProjectModel::Node *ProjectModel::nodeAt(const QModelIndex &index) const {
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : m_root;
+}
+
+ProjectModel::Node *ProjectModel::nodeForPath(const QString &path) const {
+    if (!m_root) {
+        return nullptr;
+    }
+    if (path == m_root->name) {
+        return m_root;
+    }
+    if (!path.startsWith(m_root->name + QLatin1Char('/'))) {
+        return nullptr;
+    }
+
+    const QStringList names =
+        path.mid(m_root->name.size() + 1).split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    Node *node = m_root;
+    for (int i = 0; i < names.size(); ++i) {
+        int row = node->rowOf(true, names[i]);
+        if (row < 0 && i == names.size() - 1) {
+            row = node->rowOf(false, names[i]);
+        }
+        if (row < 0) {
+            return nullptr;
+        }
+        node = node->children[row];
+    }
+    return node;
+}
+
+QModelIndex ProjectModel::indexOf(Node *node) const {
+    if (!node || node == m_root) {
+        return QModelIndex();
+    }
+    return createIndex(node->parent->rowOf(node->isDir, node->name), 0, node);
+}
+
+QString ProjectModel::pathOf(const Node *node) const {
+    QStringList names;
+    for (; node && node != m_root; node = node->parent) {
+        names.prepend(node->name);
+    }
+    names.prepend(m_root->name);
+    return names.join(QLatin1Char('/'));
+}
+
+QString ProjectModel::filePath(const QModelIndex &index) const {
+    Node *node = nodeAt(index);
+    return node ? pathOf(node) : QString();
+}
+
+bool ProjectModel::isDir(const QModelIndex &index) const {
+    Node *node = nodeAt(index);
+    return node && node->isDir;
+}
+
+QModelIndex ProjectModel::index(const QString &path) const {
+    return indexOf(nodeForPath(path));
+}
+
+void ProjectModel::refresh(const QStringList &paths, bool everything) {
+    if (!m_root) {
+        return;
+    }
+
+    QSet<QString> directories;
+    if (everything) {
+        QVector<Node *> stack{m_root};
+        while (!stack.isEmpty()) {
+            Node *node = stack.takeLast();
+            if (!node->loaded) {
+                continue;
+            }
+            directories.insert(pathOf(node));
+            for (Node *child : std::as_const(node->children)) {
+                if (child->isDir) {
+                    stack.append(child);
+                }
+            }
+        }
+    } else {
+        for (const QString &path : paths) {
+            // A change shows in the directory holding it, and in the
+            // directory itself when it is one we have listed
+            const Node *parent = nodeForPath(path.left(path.lastIndexOf(QLatin1Char('/'))));
+            if (parent && parent->loaded) {
+                directories.insert(pathOf(parent));
+            }
+            const Node *node = nodeForPath(path);
+            if (node && node->isDir && node->loaded) {
+                directories.insert(path);
+            }
+            if (IgnoreService::isRulesFile(path) && parent) {
+                // What the rules hide may have changed anywhere below
+                QVector<const Node *> stack{parent};
+                while (!stack.isEmpty()) {
+                    const Node *below = stack.takeLast();
+                    for (const Node *child : std::as_const(below->children)) {
+                        if (child->isDir && child->loaded) {
+                            directories.insert(pathOf(child));
+                            stack.append(child);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (const QString &directory : std::as_const(directories)) {
+        requestListing(directory);
+    }
+}
+
+void ProjectModel::requestListing(const QString &path) {
+    if (m_listing.contains(path)) {
+        m_relist.insert(path);
+        return;
+    }
+    m_listing.insert(path);
+
+    const int generation = m_generation;
+    const QString root = m_root->name;
+    ProjectModel *receiver = this;
+    m_pool.start([=]() {
+        QVector<Entry> entries = listDirectory(root, path);
+        QMetaObject::invokeMethod(
+            receiver,
+            [=]() { receiver->receive(generation, path, entries); },
+            Qt::QueuedConnection);
+    });
+}
+
+void ProjectModel::receive(int generation, const QString &path, QVector<Entry> entries) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_listing.remove(path);
+
+    Node *directory = nodeForPath(path);
+    if (directory && directory->isDir) {
+        applyListing(directory, entries);
+        emit directoryLoaded(path);
+    }
+    if (m_relist.remove(path)) {
+        requestListing(path);
+    }
+}
+
+void ProjectModel::applyListing(Node *directory, const QVector<Entry> &entries) {
+    const QModelIndex parentIndex = indexOf(directory);
+    QVector<Node *> &children = directory->children;
+    auto makeNode = [directory](const Entry &entry) {
+        Node *node = new Node;
+        node->name = entry.name;
+        node->isDir = entry.isDir;
+        node->parent = directory;
+        return node;
+    };
+
+    if (!directory->loaded) {
+        directory->loaded = true;
+        if (entries.isEmpty()) {
+            // Drops the expand arrow shown while the contents were unknown
+            if (parentIndex.isValid()) {
+                emit dataChanged(parentIndex, parentIndex);
+            }
+            return;
+        }
+        beginInsertRows(parentIndex, 0, int(entries.size()) - 1);
+        children.reserve(entries.size());
+        for (const Entry &entry : entries) {
+            children.append(makeNode(entry));
+        }
+        endInsertRows();
+        return;
+    }
+
+    // Both lists are in the same order, so one merge finds the children
+    // that are gone...
+    QVector<bool> keep(children.size(), false);
+    for (qsizetype i = 0, j = 0; i < children.size() && j < entries.size();) {
+        const Node *child = children[i];
+        const Entry &entry = entries[j];
+        if (lessThan(child->isDir, child->name, entry.isDir, entry.name)) {
+            ++i;
+        } else if (lessThan(entry.isDir, entry.name, child->isDir, child->name)) {
+            ++j;
+        } else {
+            keep[i++] = true;
+            ++j;
+        }
+    }
+    for (qsizetype last = children.size() - 1; last >= 0;) {
+        if (keep[last]) {
+            --last;
+            continue;
+        }
+        qsizetype first = last;
+        while (first > 0 && !keep[first - 1]) {
+            --first;
+        }
+        beginRemoveRows(parentIndex, int(first), int(last));
+        qDeleteAll(children.begin() + first, children.begin() + last + 1);
+        children.remove(first, last - first + 1);
+        endRemoveRows();
+        last = first - 1;
+    }
+
+    // ...and a second one the entries that are new, inserted in runs
+    auto sameAs = [&children](qsizetype row, const Entry &entry) {
+        return row < children.size() && children[row]->isDir == entry.isDir &&
+               children[row]->name == entry.name;
+    };
+    qsizetype row = 0;
+    for (qsizetype j = 0; j < entries.size();) {
+        if (sameAs(row, entries[j])) {
+            ++row;
+            ++j;
+            continue;
+        }
+        const qsizetype start = j;
+        while (j < entries.size() && !sameAs(row, entries[j])) {
+            ++j;
+        }
+        const qsizetype count = j - start;
+        beginInsertRows(parentIndex, int(row), int(row + count) - 1);
+        children.insert(row, count, nullptr);
+        for (qsizetype k = 0; k < count; ++k) {
+            children[row + k] = makeNode(entries[start + k]);
+        }
+        endInsertRows();
+        row += count;
+    }
+}
+
+QModelIndex ProjectModel::index(int row, int column, const QModelIndex &parent) const {
+    Node *node = nodeAt(parent);
+    if (!node || column != 0 || row < 0 || row >= node->children.size()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, node->children[row]);
+}
+
+QModelIndex ProjectModel::parent(const QModelIndex &child) const {
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    return indexOf(static_cast<Node *>(child.internalPointer())->parent);
+}
+
+int ProjectModel::rowCount(const QModelIndex &parent) const {
+    Node *node = nodeAt(parent);
+    if (!node || parent.column() > 0) {
+        return 0;
+    }
+    return int(node->children.size());
+}
+
+int ProjectModel::columnCount(const QModelIndex &) const {
+    return 1;
+}
+
+bool ProjectModel::hasChildren(const QModelIndex &parent) const {
+    Node *node = nodeAt(parent);
+    return node && node->isDir && (!node->loaded || !node->children.isEmpty());
+}
+
+bool ProjectModel::canFetchMore(const QModelIndex &parent) const {
+    Node *node = nodeAt(parent);
+    return node && node->isDir && !node->loaded;
+}
+
+void ProjectModel::fetchMore(const QModelIndex &parent) {
+    Node *node = nodeAt(parent);
+    if (!node || !node->isDir || node->loaded) {
+        return;
+    }
+    // The view asks again on every layout until the listing lands
+    const QString path = pathOf(node);
+    if (!m_listing.contains(path)) {
+        requestListing(path);
+    }
+}
+
+QVariant ProjectModel::data(const QModelIndex &index, int role) const {
+    Node *node = index.isValid() ? nodeAt(index) : nullptr;
+    if (!node) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return node->name;
+    case Qt::DecorationRole:
+        // The generic icons; a per-file lookup would stat every row
+        return m_iconProvider.icon(node->isDir ? QFileIconProvider::Folder
+                                               : QFileIconProvider::File);
+    case FilePathRole:
+        return pathOf(node);
+    default:
+        return QVariant();
+    }
+}
+
+bool ProjectModel::setData(const QModelIndex &index, const QVariant &value, int role) {
+    Node *node = index.isValid() ? nodeAt(index) : nullptr;
+    const QString newName = value.toString();
+    if (!node || role != Qt::EditRole || newName.isEmpty() || newName == node->name ||
+        newName.contains(QLatin1Char('/'))) {
+        return false;
+    }
+
+    const QString parentPath = pathOf(node->parent);
+    if (!QDir(parentPath).rename(node->name, newName)) {
+        return false;
+    }
+    // The row moves to its new place once the directory is listed again
+    requestListing(parentPath);
+    return true;
+}
+
+Qt::ItemFlags ProjectModel::flags(const QModelIndex &index) const {
+    if (!index.isValid()) {
+        return Qt::ItemIsDropEnabled;
+    }
+    Qt::ItemFlags flags =
+        Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled;
+    if (nodeAt(index)->isDir) {
+        flags |= Qt::ItemIsDropEnabled;
+    }
+    return flags;
+}
+
+QStringList ProjectModel::mimeTypes() const {
+    return {QStringLiteral("text/uri-list")};
+}
+
+QMimeData *ProjectModel::mimeData(const QModelIndexList &indexes) const {
+    QList<QUrl> urls;
+    for (const QModelIndex &index : indexes) {
+        if (index.column() == 0) {
+            urls.append(QUrl::fromLocalFile(filePath(index)));
+        }
+    }
+    QMimeData *data = new QMimeData;
+    data->setUrls(urls);
+    return data;
+}
+
+bool ProjectModel::dropMimeData(const QMimeData *data, Qt::DropAction action, int, int,
+                                const QModelIndex &parent) {
+    Node *target = nodeAt(parent);
+    if (!target || !data->hasUrls()) {
+        return false;
+    }
+    if (!target->isDir) {
+        target = target->parent;
+    }
+    const QString targetPath = pathOf(target);
+
+    bool changed = false;
+    QSet<QString> sourceDirectories;
+    const QList<QUrl> urls = data->urls();
+    for (const QUrl &url : urls) {
+        const QFileInfo source(url.toLocalFile());
+        const QString destination = targetPath + QLatin1Char('/') + source.fileName();
+        if (!source.exists() || source.absoluteFilePath() == destination) {
+            continue;
+        }
+        if (action == Qt::MoveAction) {
+            if (QFile::rename(source.absoluteFilePath(), destination)) {
+                sourceDirectories.insert(source.absolutePath());
+                changed = true;
+            }
+        } else if (action == Qt::CopyAction && source.isFile()) {
+            changed |= QFile::copy(source.absoluteFilePath(), destination);
+        }
+    }
+
+    if (changed) {
+        requestListing(targetPath);
+        for (const QString &directory : std::as_const(sourceDirectories)) {
+            if (const Node *node = nodeForPath(directory); node && node->loaded) {
+                requestListing(directory);
+            }
+        }
+    }
+    return changed;
+}
+
+Qt::DropActions ProjectModel::supportedDropActions() const {
+    return Qt::MoveAction | Qt::CopyAction;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <QAbstractItemModel>
+#include <QFileIconProvider>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+// The files under a project root as a lazily loaded tree. Directories are
+// listed on worker threads (with getdents64 on Linux) and sorted there,
+// folders first, so the GUI thread only ever inserts ready rows. Changes
+// re-list the affected directories and merge the result in as row
+// inserts and removals; nodes that survive keep their children, so
+// expansion and selection are untouched. Entries the IgnoreService ignores
+// are left out.
+class ProjectModel : public QAbstractItemModel {
+  Q_OBJECT
+
+public:
+  enum Role { FilePathRole = Qt::UserRole + 1 };
+
+  explicit ProjectModel(QObject *parent = nullptr);
+  ~ProjectModel();
+
+  // Shows the contents of `path`; an empty path clears the model
+  void setRootPath(const QString &path);
+  QString rootPath() const;
+
+  QString filePath(const QModelIndex &index) const;
+  bool isDir(const QModelIndex &index) const;
+  // The index of a path whose directory has been loaded, or an invalid one
+  QModelIndex index(const QString &path) const;
+
+  // Re-lists the loaded directories a batch of changed paths touches, or
+  // every loaded directory when events were lost
+  void refresh(const QStringList &paths, bool everything = false);
+
+  QModelIndex index(int row, int column,
+                    const QModelIndex &parent = QModelIndex()) const override;
+  QModelIndex parent(const QModelIndex &child) const override;
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+  bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+  bool canFetchMore(const QModelIndex &parent) const override;
+  void fetchMore(const QModelIndex &parent) override;
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+  bool setData(const QModelIndex &index, const QVariant &value,
+               int role = Qt::EditRole) override;
+  Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+  QStringList mimeTypes() const override;
+  QMimeData *mimeData(const QModelIndexList &indexes) const override;
+  bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row,
+                    int column, const QModelIndex &parent) override;
+  Qt::DropActions supportedDropActions() const override;
+
+signals:
+  // A directory's listing was applied, the first time or after a change
+  void directoryLoaded(const QString &path);
+
+private:
+  struct Node;
+  struct Entry {
+    QString name;
+    bool isDir;
+  };
+
+  // Runs on a worker thread; leaves out what the project ignores
+  static QVector<Entry> listDirectory(const QString &root, const QString &path);
+
+  Node *nodeAt(const QModelIndex &index) const;
+  Node *nodeForPath(const QString &path) const;
+  QModelIndex indexOf(Node *node) const;
+  QString pathOf(const Node *node) const;
+  void requestListing(const QString &path);
+  void receive(int generation, const QString &path, QVector<Entry> entries);
+  void applyListing(Node *directory, const QVector<Entry> &entries);
+
+  Node *m_root;
+  int m_generation;
+  // Directories being listed, and those to list again once that is done
+  QSet<QString> m_listing;
+  QSet<QString> m_relist;
+  QFileIconProvider m_iconProvider;
+  QThreadPool m_pool;
+};
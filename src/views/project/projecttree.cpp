@@ -11,17 +11,12 @@
 #include <QUrl>
 #include <qshortcut.h>
 #include <QMouseEvent>
-#include <QTimer>
-#include <QDirIterator>
 
 
 ProjectTree::ProjectTree(QWidget *parent) : QTreeView(parent) {
-    setupFileSystemModel();
+    setupModel();
     setupTreeView();
     setupContextMenus();
-    setupFileWatcher();
-    model->setRootPath("");
-    setRootIndex(model->index(""));
     // Add F2 shortcut for rename
     QShortcut *renameShortcut = new QShortcut(QKeySequence(Qt::Key_F2), this);
     connect(renameShortcut, &QShortcut::activated, this, &ProjectTree::renameItem);
@@ -31,29 +26,19 @@ ProjectTree::ProjectTree(QWidget *parent) : QTreeView(parent) {
     setSelectionBehavior(QAbstractItemView::SelectRows);
 }
 
-void ProjectTree::setupFileSystemModel() {
-    model = new QFileSystemModel(this);
-
-    // Set filters to show all files and directories
-    model->setFilter(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
-
-    // Set name filters but don't hide the filtered ones (just gray them out)
-    model->setNameFilterDisables(false);
-    model->setNameFilters(getDefaultFilters());
-    model->setReadOnly(false);  // Make sure the model is editable
-
+void ProjectTree::setupModel() {
+    model = new ProjectModel(this);
+    connect(model, &ProjectModel::directoryLoaded, this, &ProjectTree::handleDirectoryLoaded);
     setModel(model);
 }
 
 void ProjectTree::setupTreeView() {
-    // Hide the size, type, and date columns
-    hideColumn(1); // Size
-    hideColumn(2); // Type
-    hideColumn(3); // Date Modified
+    // Lets the view lay out only the visible rows of large directories
+    setUniformRowHeights(true);
 
-    // Set header properties
+    // Set header properties; sizing the column to its contents would
+    // measure every row
     header()->setStretchLastSection(true);
-    header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
     header()->hide(); // Hide header like VSCode
 
     // Enable selection
@@ -138,14 +123,8 @@ void ProjectTree::setRootPath(const QString &path) {
     }
 
     currentRootPath = path;
-    QModelIndex index = model->setRootPath(path);
-    setRootIndex(index);
-
-    // Set up file system watching for the new root path
-    watchDirectory(path);
-
-    // Expand the root item
-    expand(index);
+    pendingEditPath.clear();
+    model->setRootPath(path);
 
     emit rootDirectoryChanged(path);
     emit directoryChanged(path);
@@ -229,9 +208,7 @@ void ProjectTree::createNewFile() {
         QFile file(filePath);
         if (file.open(QIODevice::WriteOnly)) {
             file.close();
-            QModelIndex newIndex = model->index(filePath);
-            setCurrentIndex(newIndex);
-            edit(newIndex);
+            editWhenListed(filePath);
         }
     }
 }
@@ -251,9 +228,7 @@ void ProjectTree::createNewFolder() {
     if (ok && !folderName.isEmpty()) {
         QDir dir(parentPath);
         if (dir.mkdir(folderName)) {
-            QModelIndex newIndex = model->index(dir.filePath(folderName));
-            setCurrentIndex(newIndex);
-            edit(newIndex);
+            editWhenListed(dir.filePath(folderName));
         }
     }
 }
@@ -277,6 +252,7 @@ void ProjectTree::deleteItem() {
         } else {
             QFile::remove(path);
         }
+        model->refresh({path});
     }
 }
 
@@ -316,113 +292,27 @@ void ProjectTree::copyRelativePath() {
     clipboard->setText(relativePath);
 }
 
-QStringList ProjectTree::getDefaultFilters() const {
-    return QStringList{
-        // Show all files without extension
-        "*",
-
-        // C/C++ files
-        "*.c", "*.cpp", "*.cxx", "*.cc",
-        "*.h", "*.hpp", "*.hxx", "*.hh",
-        "*.inl", "*.inc",
-
-        // Build files
-        "CMakeLists.txt", "*.cmake",
-        "Makefile*", "makefile*", "*.mk",
-        "*.pro", "*.pri",
-
-        // Common script files without extension
-        "configure", "README", "LICENSE", "Dockerfile",
-        "Makefile", "makefile",
-
-        // Web development
-        "*.html", "*.css", "*.js", "*.ts",
-        "*.jsx", "*.tsx", "*.vue",
-
-        // Python
-        "*.py", "*.pyw", "*.pyx",
-
-        // Documentation
-        "*.md", "*.txt", "*.rst",
-        "*.pdf", "*.doc", "*.docx",
-
-        // Data files
-        "*.json", "*.xml", "*.yaml", "*.yml",
-        "*.csv", "*.ini", "*.conf",
-        "*.env", ".env*", "*.lock",
-
-        // Images
-        "*.png", "*.jpg", "*.jpeg", "*.gif",
-        "*.bmp", "*.svg", "*.ico",
-
-        // Shell scripts
-        "*.sh", "*.bash", "*.zsh",
-        "*.bat", "*.cmd", "*.ps1",
-
-        // Version control
-        ".gitignore", ".gitattributes", ".gitmodules",
-        ".hgignore", ".svnignore",
-
-        // Hidden configuration files
-        ".*",
-        
-        // Generic binary files
-        "*.bin", "*.exe", "*.dll", "*.so", "*.dylib",
-        "*.out", "*.app"
-    };
-}
-
-void ProjectTree::setupFileWatcher() {
-    fsWatcher = new QFileSystemWatcher(this);
-    connect(fsWatcher, &QFileSystemWatcher::directoryChanged,
-            this, &ProjectTree::handleDirectoryChange);
-    connect(fsWatcher, &QFileSystemWatcher::fileChanged,
-            this, &ProjectTree::handleFileChange);
-}
-
-void ProjectTree::watchDirectory(const QString &path) {
-    if (path.isEmpty()) return;
-    
-    QStringList currentDirs = fsWatcher->directories();
-    QStringList currentFiles = fsWatcher->files();
-    
-    // Remove paths that are no longer needed
-    QStringList dirsToRemove;
-    for (const QString &dir : currentDirs) {
-        if (!dir.startsWith(path)) {
-            dirsToRemove << dir;
-        }
-    }
-    
-    if (!dirsToRemove.isEmpty())
-        fsWatcher->removePaths(dirsToRemove);
-        
-    // Add new path if not already watched
-    if (!currentDirs.contains(path))
-        fsWatcher->addPath(path);
-        
-    // Watch subdirectories
-    QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-    while (it.hasNext()) {
-        QString subDir = it.next();
-        if (!currentDirs.contains(subDir))
-            fsWatcher->addPath(subDir);
-    }
+void ProjectTree::handleFileSystemChanges(const QStringList &paths, bool overflowed) {
+    model->refresh(paths, overflowed);
 }
 
-void ProjectTree::handleDirectoryChange(const QString &path) {
-    // Use a small delay to batch multiple rapid changes
-    QTimer::singleShot(100, this, &ProjectTree::refreshCurrentDirectory);
+void ProjectTree::refreshCurrentDirectory() {
+    model->refresh(QStringList(), true);
 }
 
-void ProjectTree::handleFileChange(const QString &path) {
-    // Handle file changes if needed
-    refreshCurrentDirectory();
+void ProjectTree::editWhenListed(const QString &path) {
+    pendingEditPath = QDir(path).absolutePath();
+    model->refresh({pendingEditPath});
 }
 
-void ProjectTree::refreshCurrentDirectory() {
-    if (!currentRootPath.isEmpty()) {
-        model->setRootPath(QString()); // Force refresh
-        model->setRootPath(currentRootPath);
+void ProjectTree::handleDirectoryLoaded(const QString &path) {
+    if (pendingEditPath.isEmpty() || !pendingEditPath.startsWith(path + '/')) {
+        return;
+    }
+    QModelIndex index = model->index(pendingEditPath);
+    if (index.isValid()) {
+        pendingEditPath.clear();
+        setCurrentIndex(index);
+        edit(index);
     }
 }
@@ -1,9 +1,8 @@
 #pragma once
+#include "views/project/projectmodel.h"
 #include <QTreeView>
-#include <QFileSystemModel>
 #include <QMenu>
 #include <QStringList>
-#include <QFileSystemWatcher>
 
 class ProjectTree : public QTreeView {
     Q_OBJECT
@@ -13,6 +12,8 @@ public:
     void setRootPath(const QString &path);
     QString getRootPath() const { return currentRootPath; }
     void openFolder(const QString &path = QString());
+    // Applies a batch of changes reported by the ProjectWatcher
+    void handleFileSystemChanges(const QStringList &paths, bool overflowed);
 
 signals:
     void fileSelected(const QString &filePath);
@@ -35,24 +36,22 @@ private slots:
     void openContainingFolder();
     void copyFilePath();
     void copyRelativePath();
-    void handleDirectoryChange(const QString &path);
-    void handleFileChange(const QString &path);
     void refreshCurrentDirectory();
+    void handleDirectoryLoaded(const QString &path);
 
 private:
-    QFileSystemModel *model;
+    ProjectModel *model;
     QMenu *contextMenu;
     QMenu *fileContextMenu;
     QMenu *folderContextMenu;
     QString currentRootPath;
-    QFileSystemWatcher *fsWatcher;
+    // A file or folder just created, selected for renaming once it shows up
+    QString pendingEditPath;
 
-    void setupFileSystemModel();
+    void setupModel();
     void setupTreeView();
     void setupContextMenus();
-    void setupFileWatcher();
-    QStringList getDefaultFilters() const;
     QString getRelativePath(const QString &absolutePath) const;
     void createContextMenuActions(QMenu *menu, bool isFile);
-    void watchDirectory(const QString &path);
+    void editWhenListed(const QString &path);
 };
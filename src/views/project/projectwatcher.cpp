@@ -0,0 +1,334 @@
+#include "projectwatcher.h"
+#include "ignorerules.h"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// A batch is delivered once no change has arrived for this long...
+constexpr int kQuietPeriodMs = 100;
+// ...or once its first change is this old, whichever comes first
+constexpr int kMaxBatchDelayMs = 1000;
+} // namespace
+
+class ProjectWatcher::Worker : public QObject {
+public:
+    explicit Worker(ProjectWatcher *owner);
+    ~Worker();
+
+    void setRootPath(const QString &path, int generation);
+
+private:
+    void stop();
+    // Watches `path` and its subdirectories, skipping ignored ones
+    void addTree(const QString &path);
+    bool addDirectory(const QString &path);
+    void record(const QString &path);
+    void flush();
+#ifdef Q_OS_LINUX
+    void readEvents();
+    void removeTree(const QString &path);
+#endif
+
+    ProjectWatcher *m_owner;
+    QString m_rootPath;
+    int m_generation;
+
+    QSet<QString> m_pending;
+    bool m_overflowed;
+    QTimer *m_batchTimer;
+    QElapsedTimer m_batchAge;
+
+#ifdef Q_OS_LINUX
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    // Watch descriptor to directory path
+    QHash<int, QString> m_directories;
+    bool m_limitReached;
+#endif
+    // Used where inotify is not
+    QFileSystemWatcher *m_watcher;
+    QSet<QString> m_watched;
+};
+
+ProjectWatcher::Worker::Worker(ProjectWatcher *owner)
+    : m_owner(owner), m_generation(0), m_overflowed(false),
+#ifdef Q_OS_LINUX
+      m_fd(-1), m_notifier(nullptr), m_limitReached(false),
+#endif
+      m_watcher(nullptr) {
+    m_batchTimer = new QTimer(this);
+    m_batchTimer->setSingleShot(true);
+    m_batchTimer->setInterval(kQuietPeriodMs);
+    connect(m_batchTimer, &QTimer::timeout, this, [this]() { flush(); });
+}
+
+ProjectWatcher::Worker::~Worker() {
+    stop();
+}
+
+void ProjectWatcher::Worker::stop() {
+    m_batchTimer->stop();
+    m_pending.clear();
+    m_overflowed = false;
+#ifdef Q_OS_LINUX
+    delete m_notifier;
+    m_notifier = nullptr;
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_directories.clear();
+    m_limitReached = false;
+#endif
+    delete m_watcher;
+    m_watcher = nullptr;
+    m_watched.clear();
+}
+
+void ProjectWatcher::Worker::setRootPath(const QString &path, int generation) {
+    stop();
+    m_rootPath = path;
+    m_generation = generation;
+    if (path.isEmpty()) {
+        return;
+    }
+
+    bool useInotify = false;
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, [this]() { readEvents(); });
+        useInotify = true;
+    } else {
+        qWarning() << "inotify unavailable, falling back to QFileSystemWatcher:"
+                   << strerror(errno);
+    }
+#endif
+    if (!useInotify) {
+        m_watcher = new QFileSystemWatcher(this);
+        connect(m_watcher, &QFileSystemWatcher::directoryChanged, this,
+                [this](const QString &directory) {
+                    // New subdirectories need watches of their own, and
+                    // may hold ignore files
+                    IgnoreService::instance().invalidate(m_rootPath, directory);
+                    if (QFileInfo::exists(directory)) {
+                        addTree(directory);
+                    } else {
+                        m_watched.remove(directory);
+                    }
+                    record(directory);
+                });
+    }
+
+    // Ignore files may have changed while nothing was watching
+    IgnoreService::instance().invalidate(path, path);
+    addTree(path);
+}
+
+void ProjectWatcher::Worker::addTree(const QString &path) {
+    QStringList stack{path};
+    while (!stack.isEmpty()) {
+        const QString directory = stack.takeLast();
+        if (!addDirectory(directory)) {
+            continue;
+        }
+        const std::shared_ptr<const IgnoreRules> ignore =
+            IgnoreService::instance().rulesFor(m_rootPath, directory);
+        const QString relativeDirectory = directory.mid(m_rootPath.size() + 1);
+        const QFileInfoList children =
+            QDir(directory).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden);
+        for (const QFileInfo &child : children) {
+            const QString relative = relativeDirectory.isEmpty()
+                                         ? child.fileName()
+                                         : relativeDirectory + QLatin1Char('/') + child.fileName();
+            if (!child.isSymLink() && !ignore->matches(relative, true)) {
+                stack.append(child.filePath());
+            }
+        }
+    }
+}
+
+bool ProjectWatcher::Worker::addDirectory(const QString &path) {
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        const int wd = inotify_add_watch(
+            m_fd, QFile::encodeName(path).constData(),
+            IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+        if (wd < 0) {
+            if (errno == ENOSPC && !m_limitReached) {
+                m_limitReached = true;
+                qWarning() << "Out of inotify watches; raise fs.inotify.max_user_watches."
+                           << "Changes below" << path << "and later directories are not seen.";
+            }
+            return false;
+        }
+        m_directories.insert(wd, path);
+        return true;
+    }
+#endif
+    if (m_watched.contains(path)) {
+        // Already watched; its subdirectories may not be
+        return true;
+    }
+    if (!m_watcher->addPath(path)) {
+        return false;
+    }
+    m_watched.insert(path);
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+void ProjectWatcher::Worker::readEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        const ssize_t length = ::read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            // EAGAIN once drained
+            break;
+        }
+        for (const char *p = buffer; p < buffer + length;) {
+            const auto *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                m_overflowed = true;
+                IgnoreService::instance().invalidate(m_rootPath, m_rootPath);
+                record(m_rootPath);
+                continue;
+            }
+            auto it = m_directories.constFind(event->wd);
+            if (it == m_directories.constEnd()) {
+                continue;
+            }
+            const QString directory = *it;
+            if (event->mask & IN_IGNORED) {
+                m_directories.remove(event->wd);
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                record(directory);
+                continue;
+            }
+
+            const QString name = event->len > 0 ? QFile::decodeName(event->name) : QString();
+            const QString path = name.isEmpty() ? directory : directory + QLatin1Char('/') + name;
+            const bool isDir = event->mask & IN_ISDIR;
+            if (isDir && (event->mask & IN_MOVED_FROM)) {
+                // The watches below keep following the inodes, under names
+                // that no longer exist; MOVED_TO re-adds them if they stay
+                // in the tree
+                removeTree(path);
+            }
+            if (isDir || IgnoreService::isRulesFile(path)) {
+                // Compiled rules go stale before the batch goes out: a
+                // moved-in tree brings its own ignore files, and an edited
+                // one may bring back directories that then need watches
+                IgnoreService::instance().invalidate(m_rootPath, path);
+                if (!isDir) {
+                    addTree(directory);
+                }
+            }
+            if (IgnoreService::instance().isIgnored(m_rootPath, path, isDir)) {
+                continue;
+            }
+            if (isDir && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                addTree(path);
+            }
+            record(path);
+        }
+    }
+}
+#endif
+
+#ifdef Q_OS_LINUX
+void ProjectWatcher::Worker::removeTree(const QString &path) {
+    const QString prefix = path + QLatin1Char('/');
+    for (auto it = m_directories.begin(); it != m_directories.end();) {
+        if (*it == path || it->startsWith(prefix)) {
+            inotify_rm_watch(m_fd, it.key());
+            it = m_directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+#endif
+
+void ProjectWatcher::Worker::record(const QString &path) {
+    if (m_pending.isEmpty()) {
+        m_batchAge.start();
+    }
+    m_pending.insert(path);
+    if (m_batchAge.elapsed() >= kMaxBatchDelayMs) {
+        flush();
+    } else {
+        m_batchTimer->start();
+    }
+}
+
+void ProjectWatcher::Worker::flush() {
+    m_batchTimer->stop();
+    if (m_pending.isEmpty() && !m_overflowed) {
+        return;
+    }
+
+    QStringList paths(m_pending.cbegin(), m_pending.cend());
+    std::sort(paths.begin(), paths.end());
+    const bool overflowed = m_overflowed;
+    const int generation = m_generation;
+    m_pending.clear();
+    m_overflowed = false;
+
+    ProjectWatcher *owner = m_owner;
+    QMetaObject::invokeMethod(
+        owner, [=]() { owner->receive(generation, paths, overflowed); },
+        Qt::QueuedConnection);
+}
+
+ProjectWatcher::ProjectWatcher(QObject *parent)
+    : QObject(parent), m_generation(0) {
+    m_worker = new Worker(this);
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.setObjectName("ProjectWatcher");
+    m_thread.start();
+}
+
+ProjectWatcher::~ProjectWatcher() {
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void ProjectWatcher::setRootPath(const QString &path) {
+    const QString root = path.isEmpty() ? QString() : QDir(path).absolutePath();
+    const int generation = ++m_generation;
+    Worker *worker = m_worker;
+    // Setting up the watches walks the whole tree, so it runs over there
+    QMetaObject::invokeMethod(
+        worker, [=]() { worker->setRootPath(root, generation); },
+        Qt::QueuedConnection);
+}
+
+void ProjectWatcher::receive(int generation, const QStringList &paths, bool overflowed) {
+    if (generation != m_generation) {
+        return;
+    }
+    emit changed(paths, overflowed);
+}
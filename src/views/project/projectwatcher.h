@@ -0,0 +1,41 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+// Watches a project tree for changes from a thread of its own. On Linux a
+// single inotify instance covers every directory; elsewhere, or when
+// inotify is unavailable, a QFileSystemWatcher living on the same thread
+// does. Directories the IgnoreService ignores, such as .git and whatever
+// .gitignore lists, are not watched, and changes inside ignored paths are
+// dropped.
+//
+// Changes are coalesced: paths are collected until the tree has been quiet
+// for a moment (or a second has passed) and then delivered as one batch,
+// so a git checkout arrives as a handful of batches rather than thousands
+// of signals.
+class ProjectWatcher : public QObject {
+  Q_OBJECT
+
+public:
+  explicit ProjectWatcher(QObject *parent = nullptr);
+  ~ProjectWatcher();
+
+  // Watches `path` and everything below it; an empty path stops watching
+  void setRootPath(const QString &path);
+
+signals:
+  // Absolute paths of the files and directories that changed, each once.
+  // `overflowed` means events were lost and the whole tree may be stale.
+  void changed(const QStringList &paths, bool overflowed);
+
+private:
+  class Worker;
+
+  void receive(int generation, const QStringList &paths, bool overflowed);
+
+  int m_generation;
+  QThread m_thread;
+  Worker *m_worker;
+};
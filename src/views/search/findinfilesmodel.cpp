@@ -0,0 +1,101 @@
+#include "findinfilesmodel.h"
+#include <QDir>
+
+FindInFilesModel::FindInFilesModel(QObject *parent)
+    : QAbstractItemModel(parent), m_hitCount(0) {
+}
+
+void FindInFilesModel::setRootPath(const QString &path) {
+    m_rootPath = path;
+}
+
+void FindInFilesModel::clear() {
+    beginResetModel();
+    m_files.clear();
+    m_hitCount = 0;
+    endResetModel();
+}
+
+void FindInFilesModel::appendResults(const QVector<ProjectSearchFileResult> &results) {
+    if (results.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_files.size(), m_files.size() + results.size() - 1);
+    for (const ProjectSearchFileResult &result : results) {
+        m_hitCount += result.hits.size();
+        m_files.append(result);
+    }
+    endInsertRows();
+}
+
+QModelIndex FindInFilesModel::index(int row, int column, const QModelIndex &parent) const {
+    if (column != 0 || row < 0) {
+        return QModelIndex();
+    }
+    if (!parent.isValid()) {
+        return row < m_files.size() ? createIndex(row, 0, quintptr(0)) : QModelIndex();
+    }
+    if (!isFile(parent) || row >= m_files[parent.row()].hits.size()) {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, quintptr(parent.row() + 1));
+}
+
+QModelIndex FindInFilesModel::parent(const QModelIndex &child) const {
+    if (!child.isValid() || isFile(child)) {
+        return QModelIndex();
+    }
+    return createIndex(int(child.internalId() - 1), 0, quintptr(0));
+}
+
+int FindInFilesModel::rowCount(const QModelIndex &parent) const {
+    if (!parent.isValid()) {
+        return m_files.size();
+    }
+    return isFile(parent) ? m_files[parent.row()].hits.size() : 0;
+}
+
+int FindInFilesModel::columnCount(const QModelIndex &) const {
+    return 1;
+}
+
+QVariant FindInFilesModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    if (isFile(index)) {
+        const ProjectSearchFileResult &file = m_files[index.row()];
+        switch (role) {
+        case Qt::DisplayRole: {
+            QString path = m_rootPath.isEmpty()
+                               ? file.path
+                               : QDir(m_rootPath).relativeFilePath(file.path);
+            return tr("%1 (%2)").arg(path).arg(file.hits.size());
+        }
+        case Qt::ToolTipRole:
+        case PathRole:
+            return file.path;
+        default:
+            return QVariant();
+        }
+    }
+
+    const ProjectSearchFileResult &file = m_files[int(index.internalId() - 1)];
+    const ProjectSearchHit &hit = file.hits[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return QStringLiteral("%1: %2").arg(hit.line + 1).arg(hit.lineText.trimmed());
+    case PathRole:
+        return file.path;
+    case LineRole:
+        return hit.line;
+    case ColumnRole:
+        return hit.column;
+    case LengthRole:
+        return hit.length;
+    default:
+        return QVariant();
+    }
+}
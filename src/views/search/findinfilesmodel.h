@@ -0,0 +1,43 @@
+#pragma once
+#include "views/search/projectsearch.h"
+#include <QAbstractItemModel>
+#include <QVector>
+
+// Find in Files results grouped by file: files are the top-level rows and
+// their hits the children. Results are appended as the search streams
+// them in; the view only asks for the rows it shows, so a large result
+// set costs no more to display than a small one.
+class FindInFilesModel : public QAbstractItemModel {
+  Q_OBJECT
+
+public:
+  enum Role { PathRole = Qt::UserRole + 1, LineRole, ColumnRole, LengthRole };
+
+  explicit FindInFilesModel(QObject *parent = nullptr);
+
+  // Paths are shown relative to this directory
+  void setRootPath(const QString &path);
+  void clear();
+  void appendResults(const QVector<ProjectSearchFileResult> &results);
+
+  int fileCount() const { return m_files.size(); }
+  int hitCount() const { return m_hitCount; }
+
+  QModelIndex index(int row, int column,
+                    const QModelIndex &parent = QModelIndex()) const override;
+  QModelIndex parent(const QModelIndex &child) const override;
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+
+private:
+  // A hit's internal id is its file's row plus one; files use zero
+  static bool isFile(const QModelIndex &index) {
+    return index.internalId() == 0;
+  }
+
+  QString m_rootPath;
+  QVector<ProjectSearchFileResult> m_files;
+  int m_hitCount;
+};
@@ -0,0 +1,175 @@
+#include "findinfilesview.h"
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QRegularExpression>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+FindInFilesView::FindInFilesView(QWidget *parent) : QWidget(parent), m_index(nullptr) {
+    m_search = new ProjectSearch(this);
+    m_model = new FindInFilesModel(this);
+
+    setupUI();
+
+    connect(m_queryEdit, &QLineEdit::returnPressed, this, &FindInFilesView::startSearch);
+    connect(m_includeEdit, &QLineEdit::returnPressed, this, &FindInFilesView::startSearch);
+    connect(m_excludeEdit, &QLineEdit::returnPressed, this, &FindInFilesView::startSearch);
+    connect(m_searchButton, &QPushButton::clicked, this, &FindInFilesView::startSearch);
+    connect(m_stopButton, &QPushButton::clicked, this, &FindInFilesView::stopSearch);
+    connect(m_search, &ProjectSearch::resultsFound, this, &FindInFilesView::handleResults);
+    connect(m_search, &ProjectSearch::finished, this, &FindInFilesView::handleFinished);
+    connect(m_resultView, &QTreeView::activated, this, &FindInFilesView::handleActivated);
+}
+
+void FindInFilesView::setupUI() {
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->setSpacing(4);
+
+    QHBoxLayout *queryLayout = new QHBoxLayout;
+    m_queryEdit = new QLineEdit(this);
+    m_queryEdit->setPlaceholderText(tr("Search"));
+    m_searchButton = new QPushButton(tr("Search"), this);
+    m_stopButton = new QPushButton(tr("Stop"), this);
+    m_stopButton->setEnabled(false);
+    queryLayout->addWidget(m_queryEdit);
+    queryLayout->addWidget(m_searchButton);
+    queryLayout->addWidget(m_stopButton);
+    layout->addLayout(queryLayout);
+
+    QHBoxLayout *optionsLayout = new QHBoxLayout;
+    m_caseSensitiveCheckBox = new QCheckBox(tr("Case Sensitive"), this);
+    m_wholeWordsCheckBox = new QCheckBox(tr("Whole Words"), this);
+    m_regexCheckBox = new QCheckBox(tr("Regular Expression"), this);
+    m_gitIgnoreCheckBox = new QCheckBox(tr("Use .gitignore"), this);
+    m_gitIgnoreCheckBox->setChecked(true);
+    optionsLayout->addWidget(m_caseSensitiveCheckBox);
+    optionsLayout->addWidget(m_wholeWordsCheckBox);
+    optionsLayout->addWidget(m_regexCheckBox);
+    optionsLayout->addWidget(m_gitIgnoreCheckBox);
+    optionsLayout->addStretch();
+    layout->addLayout(optionsLayout);
+
+    m_includeEdit = new QLineEdit(this);
+    m_includeEdit->setPlaceholderText(tr("Files to include (e.g. *.cpp, src/**)"));
+    layout->addWidget(m_includeEdit);
+
+    m_excludeEdit = new QLineEdit(this);
+    m_excludeEdit->setPlaceholderText(tr("Files to exclude (e.g. build/, *.min.js)"));
+    layout->addWidget(m_excludeEdit);
+
+    m_statusLabel = new QLabel(this);
+    layout->addWidget(m_statusLabel);
+
+    m_resultView = new QTreeView(this);
+    m_resultView->setModel(m_model);
+    m_resultView->setHeaderHidden(true);
+    // Lets the view lay out only the visible rows
+    m_resultView->setUniformRowHeights(true);
+    m_resultView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    layout->addWidget(m_resultView);
+}
+
+void FindInFilesView::setRootPath(const QString &path) {
+    if (path == m_rootPath) {
+        return;
+    }
+    stopSearch();
+    m_rootPath = path;
+    m_model->setRootPath(path);
+    m_model->clear();
+    m_statusLabel->clear();
+}
+
+void FindInFilesView::setIndex(TrigramIndex *index) {
+    m_index = index;
+}
+
+void FindInFilesView::activate() {
+    m_queryEdit->setFocus();
+    m_queryEdit->selectAll();
+}
+
+void FindInFilesView::startSearch() {
+    SearchEngine::Query query;
+    query.pattern = m_queryEdit->text();
+    query.caseSensitive = m_caseSensitiveCheckBox->isChecked();
+    query.regex = m_regexCheckBox->isChecked();
+    query.wholeWords = !query.regex && m_wholeWordsCheckBox->isChecked();
+
+    m_model->clear();
+    if (query.pattern.isEmpty()) {
+        stopSearch();
+        m_statusLabel->clear();
+        return;
+    }
+    if (m_rootPath.isEmpty()) {
+        m_statusLabel->setText(tr("Open a folder to search in it."));
+        return;
+    }
+    if (query.regex) {
+        QRegularExpression regex(query.pattern);
+        if (!regex.isValid()) {
+            m_statusLabel->setText(tr("Invalid regular expression: %1").arg(regex.errorString()));
+            return;
+        }
+    }
+
+    ProjectSearch::Options options;
+    options.rootPath = m_rootPath;
+    options.query = query;
+    options.filters.includeGlobs = m_includeEdit->text();
+    options.filters.excludeGlobs = m_excludeEdit->text();
+    options.filters.respectGitIgnore = m_gitIgnoreCheckBox->isChecked();
+    // The index leaves out ignored files, so it only serves searches that do
+    if (m_index && m_index->isReady() && options.filters.respectGitIgnore) {
+        options.index = m_index->lookup();
+    }
+
+    m_search->start(options);
+    m_stopButton->setEnabled(true);
+    m_statusLabel->setText(tr("Searching..."));
+}
+
+void FindInFilesView::stopSearch() {
+    // Reports through handleFinished when a search was running
+    m_search->cancel();
+}
+
+void FindInFilesView::handleResults(const QVector<ProjectSearchFileResult> &results) {
+    m_model->appendResults(results);
+    updateStatus();
+}
+
+void FindInFilesView::handleFinished(int filesSearched, bool cancelled) {
+    m_stopButton->setEnabled(false);
+    QString summary = m_model->hitCount() == 0
+                          ? tr("No results")
+                          : tr("%1 result(s) in %2 file(s)")
+                                .arg(m_model->hitCount())
+                                .arg(m_model->fileCount());
+    m_statusLabel->setText(cancelled ? tr("%1 (stopped after %2 files)").arg(summary).arg(filesSearched)
+                                     : tr("%1, %2 files searched").arg(summary).arg(filesSearched));
+}
+
+void FindInFilesView::updateStatus() {
+    m_statusLabel->setText(tr("Searching... %1 result(s) in %2 file(s)")
+                               .arg(m_model->hitCount())
+                               .arg(m_model->fileCount()));
+}
+
+void FindInFilesView::handleActivated(const QModelIndex &index) {
+    if (!index.parent().isValid()) {
+        // A file row opens it at its first hit
+        if (m_model->rowCount(index) > 0) {
+            handleActivated(m_model->index(0, 0, index));
+        }
+        return;
+    }
+    emit matchActivated(index.data(FindInFilesModel::PathRole).toString(),
+                        index.data(FindInFilesModel::LineRole).toInt(),
+                        index.data(FindInFilesModel::ColumnRole).toInt());
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "views/search/findinfilesmodel.h"
+#include "views/search/projectsearch.h"
+#include <QWidget>
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QTreeView;
+
+// The Find in Files panel: query and filter inputs over a streaming
+// result tree. Activating a hit asks for the file to be opened there.
+class FindInFilesView : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit FindInFilesView(QWidget *parent = nullptr);
+
+  void setRootPath(const QString &path);
+  // Narrows searches with `index` while it is ready; it must cover the same
+  // root
+  void setIndex(TrigramIndex *index);
+  // Focuses the query, ready to type
+  void activate();
+
+signals:
+  void matchActivated(const QString &filePath, int line, int column);
+
+private slots:
+  void startSearch();
+  void stopSearch();
+  void handleResults(const QVector<ProjectSearchFileResult> &results);
+  void handleFinished(int filesSearched, bool cancelled);
+  void handleActivated(const QModelIndex &index);
+
+private:
+  void setupUI();
+  void updateStatus();
+
+  QString m_rootPath;
+  ProjectSearch *m_search;
+  TrigramIndex *m_index;
+  FindInFilesModel *m_model;
+
+  QLineEdit *m_queryEdit;
+  QCheckBox *m_caseSensitiveCheckBox;
+  QCheckBox *m_wholeWordsCheckBox;
+  QCheckBox *m_regexCheckBox;
+  QLineEdit *m_includeEdit;
+  QLineEdit *m_excludeEdit;
+  QCheckBox *m_gitIgnoreCheckBox;
+  QPushButton *m_searchButton;
+  QPushButton *m_stopButton;
+  QLabel *m_statusLabel;
+  QTreeView *m_resultView;
+};
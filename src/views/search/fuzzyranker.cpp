@@ -0,0 +1,187 @@
+#include "fuzzyranker.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr int kMatchScore = 16;
+constexpr int kSegmentStartBonus = 14;
+constexpr int kWordStartBonus = 10;
+constexpr int kConsecutiveBonus = 6;
+constexpr int kMaxGapPenalty = 10;
+constexpr int kFileNameBonus = 40;
+
+// A path as the directory followed by the file name, without joining them
+struct PathView {
+    QStringView text[2];
+    QStringView folded[2];
+    int split;
+    int size;
+
+    QChar at(int i) const { return i < split ? text[0][i] : text[1][i - split]; }
+    QChar foldedAt(int i) const { return i < split ? folded[0][i] : folded[1][i - split]; }
+};
+
+bool isSeparator(QChar ch) {
+    return ch == QLatin1Char('/') || ch == QLatin1Char('_') || ch == QLatin1Char('-') ||
+           ch == QLatin1Char('.') || ch == QLatin1Char(' ');
+}
+
+// Scores `query` against path[from, size), or returns -1 if it is not a
+// subsequence there. The span is first narrowed to the shortest one ending
+// at the earliest full match, then scored left to right.
+int scoreIn(const PathView &path, int from, const QString &query) {
+    const int n = query.size();
+    const QChar *q = query.constData();
+
+    int j = 0;
+    int end = -1;
+    for (int i = from; i < path.size; ++i) {
+        if (path.foldedAt(i) == q[j] && ++j == n) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) {
+        return -1;
+    }
+
+    int start = end;
+    for (int i = end, k = n - 1; i >= from; --i) {
+        if (path.foldedAt(i) == q[k] && --k < 0) {
+            start = i;
+            break;
+        }
+    }
+
+    int score = 0;
+    int last = -1;
+    int run = 0;
+    for (int i = start, k = 0; i <= end && k < n; ++i) {
+        if (path.foldedAt(i) != q[k]) {
+            continue;
+        }
+        score += kMatchScore;
+        if (i == 0 || path.at(i - 1) == QLatin1Char('/') || i == path.split) {
+            score += kSegmentStartBonus;
+        } else if (isSeparator(path.at(i - 1)) ||
+                   (path.at(i - 1).isLower() && path.at(i).isUpper())) {
+            score += kWordStartBonus;
+        }
+        if (last >= 0 && last == i - 1) {
+            ++run;
+            score += kConsecutiveBonus * run;
+        } else {
+            run = 0;
+            if (last >= 0) {
+                score -= qMin(kMaxGapPenalty, 2 + (i - last - 1));
+            }
+        }
+        last = i;
+        ++k;
+    }
+    return score;
+}
+
+int scorePath(const PathList &paths, int file, const QString &query) {
+    PathView path;
+    path.text[0] = paths.directory(file);
+    path.text[1] = paths.fileName(file);
+    path.folded[0] = paths.foldedDirectory(file);
+    path.folded[1] = paths.foldedFileName(file);
+    path.split = int(path.text[0].size());
+    path.size = path.split + int(path.text[1].size());
+
+    // A query found in the file name alone beats one spread over the path
+    int score = scoreIn(path, path.split, query);
+    if (score >= 0) {
+        return score + kFileNameBonus;
+    }
+    return scoreIn(path, 0, query);
+}
+} // namespace
+
+void FuzzyRanker::setPaths(std::shared_ptr<const PathList> paths) {
+    m_paths = std::move(paths);
+    m_lastQuery.clear();
+    m_lastMatches.clear();
+    m_haveLastMatches = false;
+}
+
+int FuzzyRanker::matchCount() const {
+    if (m_haveLastMatches) {
+        return m_lastMatches.size();
+    }
+    return m_paths ? m_paths->fileCount() : 0;
+}
+
+QVector<FuzzyRanker::Result> FuzzyRanker::rank(const QString &query, int limit) {
+    QVector<Result> results;
+    if (!m_paths) {
+        return results;
+    }
+    const PathList &paths = *m_paths;
+
+    QString folded;
+    folded.reserve(query.size());
+    for (QChar ch : query) {
+        if (!ch.isSpace()) {
+            folded.append(ch.toLower());
+        }
+    }
+
+    if (folded.isEmpty()) {
+        m_haveLastMatches = false;
+        for (int i = 0; i < qMin(limit, paths.fileCount()); ++i) {
+            results.append(Result{i, 0});
+        }
+        return results;
+    }
+
+    quint64 queryMask = 0;
+    for (QChar ch : folded) {
+        queryMask |= PathList::charMask(ch);
+    }
+
+    QVector<int> matches;
+    auto consider = [&](int file) {
+        if ((paths.mask(file) & queryMask) != queryMask) {
+            return;
+        }
+        const int score = scorePath(paths, file, folded);
+        if (score >= 0) {
+            matches.append(file);
+            results.append(Result{file, score});
+        }
+    };
+
+    // Whatever matches the longer query matched the shorter one too
+    if (m_haveLastMatches && folded.startsWith(m_lastQuery)) {
+        for (int file : std::as_const(m_lastMatches)) {
+            consider(file);
+        }
+    } else {
+        for (int file = 0; file < paths.fileCount(); ++file) {
+            consider(file);
+        }
+    }
+    m_lastQuery = folded;
+    m_lastMatches.swap(matches);
+    m_haveLastMatches = true;
+
+    // Equal scores favour the shorter path
+    auto better = [&paths](const Result &a, const Result &b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        const qsizetype aLength = paths.directory(a.file).size() + paths.fileName(a.file).size();
+        const qsizetype bLength = paths.directory(b.file).size() + paths.fileName(b.file).size();
+        if (aLength != bLength) {
+            return aLength < bLength;
+        }
+        return a.file < b.file;
+    };
+    const int count = qMin(limit, int(results.size()));
+    std::partial_sort(results.begin(), results.begin() + count, results.end(), better);
+    results.resize(count);
+    return results;
+}
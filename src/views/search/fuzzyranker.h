@@ -0,0 +1,37 @@
+#pragma once
+#include "views/search/pathindex.h"
+#include <QString>
+#include <QVector>
+#include <memory>
+
+// Ranks the files of a PathList against a fuzzy query, as typed into a
+// quick-open box. The query's characters must appear in order in the path,
+// ignoring case and spaces. Matches score higher when they fall in the
+// file name, start a path segment or word, or run together.
+//
+// Ranking is incremental: a query that extends the previous one only
+// rescores the files the previous one kept. Before scoring, a file is
+// rejected outright unless its character mask covers the query's.
+class FuzzyRanker {
+public:
+  struct Result {
+    int file;
+    int score;
+  };
+
+  void setPaths(std::shared_ptr<const PathList> paths);
+  std::shared_ptr<const PathList> paths() const { return m_paths; }
+
+  // The best `limit` files for `query`, best first. An empty query lists
+  // the first files in walk order.
+  QVector<Result> rank(const QString &query, int limit);
+  // How many files matched the last query, before the limit
+  int matchCount() const;
+
+private:
+  std::shared_ptr<const PathList> m_paths;
+  QString m_lastQuery;
+  // Files that matched m_lastQuery, every one of them
+  QVector<int> m_lastMatches;
+  bool m_haveLastMatches = false;
+};
@@ -0,0 +1,224 @@
+#include "pathindex.h"
+#include "views/project/ignorerules.h"
+#include "views/search/projectwalker.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+// Coalesces the bursts of directory events a checkout or build produces
+constexpr int kRecrawlDelayMs = 500;
+} // namespace
+
+quint64 PathList::charMask(QChar folded) {
+    const char16_t ch = folded.unicode();
+    if (ch >= 'a' && ch <= 'z') {
+        return quint64(1) << (ch - 'a');
+    }
+    if (ch >= '0' && ch <= '9') {
+        return quint64(1) << (26 + ch - '0');
+    }
+    switch (ch) {
+    case '/':
+        return quint64(1) << 36;
+    case '.':
+        return quint64(1) << 37;
+    case '_':
+        return quint64(1) << 38;
+    case '-':
+        return quint64(1) << 39;
+    default:
+        break;
+    }
+    if (ch < 0x80) {
+        return quint64(1) << (40 + ch % 23);
+    }
+    return quint64(1) << 63;
+}
+
+QStringView PathList::directory(int file) const {
+    const Span &span = m_directories[m_files[file].directory];
+    return QStringView(m_text).mid(span.offset, span.length);
+}
+
+QStringView PathList::fileName(int file) const {
+    const Span &span = m_files[file].name;
+    return QStringView(m_text).mid(span.offset, span.length);
+}
+
+QStringView PathList::foldedDirectory(int file) const {
+    const Span &span = m_directories[m_files[file].directory];
+    return QStringView(m_folded).mid(span.offset, span.length);
+}
+
+QStringView PathList::foldedFileName(int file) const {
+    const Span &span = m_files[file].name;
+    return QStringView(m_folded).mid(span.offset, span.length);
+}
+
+QString PathList::relativePath(int file) const {
+    return directory(file).toString() + fileName(file);
+}
+
+QString PathList::absolutePath(int file) const {
+    return m_rootPath + QLatin1Char('/') + relativePath(file);
+}
+
+bool PathList::contains(QStringView relativePath) const {
+    return std::binary_search(m_pathHashes.cbegin(), m_pathHashes.cend(),
+                              quint64(qHash(relativePath)));
+}
+
+PathIndex::PathIndex(QObject *parent)
+    : QObject(parent), m_generation(0),
+      m_cancelled(std::make_shared<std::atomic<bool>>(false)) {
+    m_pool.setMaxThreadCount(1);
+
+    m_crawlTimer = new QTimer(this);
+    m_crawlTimer->setSingleShot(true);
+    m_crawlTimer->setInterval(kRecrawlDelayMs);
+    connect(m_crawlTimer, &QTimer::timeout, this, &PathIndex::crawl);
+}
+
+PathIndex::~PathIndex() {
+    cancel();
+    m_pool.waitForDone();
+}
+
+void PathIndex::cancel() {
+    ++m_generation;
+    *m_cancelled = true;
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_crawlTimer->stop();
+}
+
+void PathIndex::setRootPath(const QString &path) {
+    const QString root = path.isEmpty() ? QString() : QDir(path).absolutePath();
+    if (root == m_rootPath) {
+        return;
+    }
+
+    cancel();
+    m_rootPath = root;
+    if (m_paths) {
+        m_paths.reset();
+        emit pathsChanged();
+    }
+    if (!root.isEmpty()) {
+        crawl();
+    }
+}
+
+void PathIndex::invalidate(const QString &path) {
+    if (m_rootPath.isEmpty() ||
+        (path != m_rootPath && !path.startsWith(m_rootPath + QLatin1Char('/')))) {
+        return;
+    }
+    // Edits to a file already listed leave the list as it is, unless they
+    // change what is ignored. A new file arrives as its own path, not as
+    // its directory's, and needs the crawl.
+    const QFileInfo info(path);
+    if (m_paths && info.exists() && !info.isDir() && !IgnoreService::isRulesFile(path) &&
+        m_paths->contains(QStringView(path).mid(m_rootPath.size() + 1))) {
+        return;
+    }
+    m_crawlTimer->start();
+}
+
+void PathIndex::crawl() {
+    ++m_generation;
+    *m_cancelled = true;
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+
+    const int generation = m_generation;
+    const QString root = m_rootPath;
+    const std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+    PathIndex *receiver = this;
+
+    m_pool.start([=]() {
+        const ProjectWalker walker(root, ProjectWalker::Options());
+        const int prefixLength = walker.rootPath().size() + 1;
+
+        auto paths = std::make_shared<PathList>();
+        paths->m_rootPath = walker.rootPath();
+        QHash<QString, quint32> directoryIds;
+        QString lastDirectory;
+        quint32 lastDirectoryId = 0;
+
+        auto append = [&](QStringView text) {
+            const PathList::Span span{quint32(paths->m_text.size()), quint32(text.size())};
+            paths->m_text.append(text);
+            return span;
+        };
+
+        walker.walk(
+            [&](const QFileInfo &info) {
+                const QString relative = info.filePath().mid(prefixLength);
+                const qsizetype slash = relative.lastIndexOf(QLatin1Char('/'));
+                const QStringView directory = QStringView(relative).left(slash + 1);
+
+                // The walk lists a directory's files together, so the last
+                // id is almost always the one wanted
+                if (paths->m_directories.isEmpty() || directory != lastDirectory) {
+                    lastDirectory = directory.toString();
+                    auto it = directoryIds.constFind(lastDirectory);
+                    if (it == directoryIds.constEnd()) {
+                        it = directoryIds.insert(lastDirectory, quint32(paths->m_directories.size()));
+                        paths->m_directories.append(append(directory));
+                    }
+                    lastDirectoryId = *it;
+                }
+
+                PathList::File file;
+                file.directory = lastDirectoryId;
+                file.name = append(QStringView(relative).mid(slash + 1));
+                file.mask = 0;
+                paths->m_files.append(file);
+                paths->m_pathHashes.append(quint64(qHash(relative)));
+            },
+            cancelled.get());
+        if (cancelled->load()) {
+            return;
+        }
+
+        paths->m_folded.resize(paths->m_text.size());
+        QChar *folded = paths->m_folded.data();
+        const QChar *text = paths->m_text.constData();
+        for (qsizetype i = 0; i < paths->m_text.size(); ++i) {
+            folded[i] = text[i].toLower();
+        }
+
+        QVector<quint64> directoryMasks(paths->m_directories.size(), 0);
+        for (int i = 0; i < paths->m_directories.size(); ++i) {
+            const PathList::Span &span = paths->m_directories[i];
+            for (quint32 j = 0; j < span.length; ++j) {
+                directoryMasks[i] |= PathList::charMask(folded[span.offset + j]);
+            }
+        }
+        for (PathList::File &file : paths->m_files) {
+            quint64 mask = directoryMasks[file.directory];
+            for (quint32 j = 0; j < file.name.length; ++j) {
+                mask |= PathList::charMask(folded[file.name.offset + j]);
+            }
+            file.mask = mask;
+        }
+        paths->m_text.squeeze();
+        paths->m_files.squeeze();
+        std::sort(paths->m_pathHashes.begin(), paths->m_pathHashes.end());
+
+        std::shared_ptr<const PathList> result = std::move(paths);
+        QMetaObject::invokeMethod(
+            receiver, [=]() { receiver->receive(generation, result); },
+            Qt::QueuedConnection);
+    });
+}
+
+void PathIndex::receive(int generation, std::shared_ptr<const PathList> paths) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_paths = std::move(paths);
+    emit pathsChanged();
+}
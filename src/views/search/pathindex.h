@@ -0,0 +1,93 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QStringView>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class QTimer;
+
+// The files of a project in compact form. Every directory path is stored
+// once, and every file refers to its directory by id; all the text lives
+// in one contiguous string, with a case-folded copy beside it for
+// matching. Each file also carries a 64-bit mask of the characters in its
+// path, so a query can reject most files without reading them. Immutable
+// once built, and so safe to share across threads.
+class PathList {
+public:
+  // Bit for a case-folded character: letters, digits and then a few
+  // buckets for everything else
+  static quint64 charMask(QChar folded);
+
+  QString rootPath() const { return m_rootPath; }
+  int fileCount() const { return m_files.size(); }
+
+  // Directory relative to the root with a trailing '/', or empty
+  QStringView directory(int file) const;
+  QStringView fileName(int file) const;
+  QStringView foldedDirectory(int file) const;
+  QStringView foldedFileName(int file) const;
+  quint64 mask(int file) const { return m_files[file].mask; }
+  QString relativePath(int file) const;
+  QString absolutePath(int file) const;
+  // Whether the list has a file at `relativePath`, by hash: a false
+  // positive is possible but vanishingly rare
+  bool contains(QStringView relativePath) const;
+
+private:
+  friend class PathIndex;
+
+  struct Span {
+    quint32 offset;
+    quint32 length;
+  };
+  struct File {
+    quint64 mask;
+    quint32 directory;
+    Span name;
+  };
+
+  QString m_rootPath;
+  QString m_text;
+  QString m_folded;
+  QVector<Span> m_directories;
+  QVector<File> m_files;
+  // Hashes of the relative paths, sorted
+  QVector<quint64> m_pathHashes;
+};
+
+// Crawls the project root in the background and keeps a PathList of its
+// files, respecting .gitignore. Directory changes re-crawl after a short
+// delay; the previous list is served until the new one is ready.
+class PathIndex : public QObject {
+  Q_OBJECT
+
+public:
+  explicit PathIndex(QObject *parent = nullptr);
+  ~PathIndex();
+
+  // Crawls `path`; an empty path drops the list
+  void setRootPath(const QString &path);
+  // Reports a file or directory changed on disk
+  void invalidate(const QString &path);
+
+  // Null until the first crawl is done
+  std::shared_ptr<const PathList> paths() const { return m_paths; }
+
+signals:
+  void pathsChanged();
+
+private:
+  void cancel();
+  void crawl();
+  void receive(int generation, std::shared_ptr<const PathList> paths);
+
+  QString m_rootPath;
+  std::shared_ptr<const PathList> m_paths;
+  int m_generation;
+  std::shared_ptr<std::atomic<bool>> m_cancelled;
+  QTimer *m_crawlTimer;
+  QThreadPool m_pool;
+};
@@ -0,0 +1,236 @@
+#include "projectsearch.h"
+#include <QByteArrayMatcher>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <utility>
+
+namespace {
+// The walker hands out small batches first so the first hits arrive
+// quickly, then larger ones to keep per-task overhead down
+constexpr int kFirstBatchSize = 8;
+constexpr int kMaxBatchSize = 256;
+constexpr int kMaxHitsPerFile = 1000;
+// Context kept around a hit on very long lines
+constexpr int kPreviewBefore = 60;
+constexpr int kPreviewLength = 240;
+
+// Hits in one mapped file, or none if it is binary or has no match
+QVector<ProjectSearchHit> scanFile(const QString &path,
+                                   const SearchEngine::Matcher &matcher,
+                                   const QByteArrayMatcher *prefilter,
+                                   const std::atomic<bool> &cancelled) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0 ||
+        file.size() > ProjectWalker::MaxFileSize) {
+        return {};
+    }
+
+    qint64 size = file.size();
+    const char *data = reinterpret_cast<const char *>(file.map(0, size));
+    QByteArray fallback;
+    if (!data) {
+        fallback = file.readAll();
+        data = fallback.constData();
+        size = fallback.size();
+    }
+
+    if (!ProjectWalker::isText(data, size)) {
+        return {};
+    }
+    if (prefilter && prefilter->indexIn(data, size) < 0) {
+        return {};
+    }
+
+    const QString text = QString::fromUtf8(QByteArrayView(data, size));
+    const QVector<SearchEngine::Match> matches = matcher.findAll(text, &cancelled);
+
+    QVector<ProjectSearchHit> hits;
+    QStringView view(text);
+    int line = 0;
+    qsizetype lineStart = 0;
+    qsizetype scanned = 0;
+    for (const SearchEngine::Match &match : matches) {
+        if (hits.size() == kMaxHitsPerFile) {
+            break;
+        }
+        for (; scanned < match.start; ++scanned) {
+            if (view[scanned] == QLatin1Char('\n')) {
+                ++line;
+                lineStart = scanned + 1;
+            }
+        }
+
+        qsizetype lineEnd = view.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd < 0) {
+            lineEnd = view.size();
+        }
+        if (lineEnd > lineStart && view[lineEnd - 1] == QLatin1Char('\r')) {
+            --lineEnd;
+        }
+
+        const int column = int(match.start - lineStart);
+        qsizetype previewStart = lineStart;
+        if (column > kPreviewBefore + 20) {
+            previewStart = match.start - kPreviewBefore;
+        }
+        QString preview = view.mid(previewStart,
+                                   qMin<qsizetype>(lineEnd - previewStart,
+                                                   kPreviewLength))
+                              .toString();
+        if (previewStart > lineStart) {
+            preview.prepend(QChar(0x2026));
+        }
+        hits.append(ProjectSearchHit{line, column, match.length, preview});
+    }
+    return hits;
+}
+} // namespace
+
+struct ProjectSearch::Job {
+    std::atomic<bool> cancelled{false};
+    // The walker plus every batch still queued or running; whoever brings
+    // it to zero reports completion
+    std::atomic<int> outstanding{1};
+    std::atomic<int> filesSearched{0};
+};
+
+ProjectSearch::ProjectSearch(QObject *parent)
+    : QObject(parent), m_generation(0) {
+    // One thread walks while the rest scan
+    m_pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+}
+
+ProjectSearch::~ProjectSearch() {
+    if (m_job) {
+        m_job->cancelled = true;
+        m_job.reset();
+    }
+    m_pool.waitForDone();
+}
+
+void ProjectSearch::cancel() {
+    ++m_generation;
+    if (!m_job) {
+        return;
+    }
+    m_job->cancelled = true;
+    int filesSearched = m_job->filesSearched;
+    m_job.reset();
+    emit finished(filesSearched, true);
+}
+
+void ProjectSearch::start(const Options &options) {
+    cancel();
+    if (options.query.pattern.isEmpty() || !QDir(options.rootPath).exists()) {
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    m_job = job;
+
+    const int generation = m_generation;
+    const SearchEngine::Query query = options.query;
+    const ProjectWalker walker(options.rootPath, options.filters);
+    const TrigramIndex::Lookup index = options.index;
+    ProjectSearch *receiver = this;
+    QThreadPool *pool = &m_pool;
+
+    auto finishTask = [receiver, job, generation]() {
+        if (--job->outstanding == 0) {
+            QMetaObject::invokeMethod(
+                receiver,
+                [receiver, generation, files = int(job->filesSearched)]() {
+                    receiver->complete(generation, files);
+                },
+                Qt::QueuedConnection);
+        }
+    };
+
+    auto scanBatch = [=](const QStringList &paths) {
+        // Compiled per task; regular expressions are not shared across threads
+        const SearchEngine::Matcher matcher(query);
+        std::unique_ptr<QByteArrayMatcher> prefilter;
+        if (!query.regex && query.caseSensitive) {
+            prefilter = std::make_unique<QByteArrayMatcher>(query.pattern.toUtf8());
+        }
+
+        QVector<ProjectSearchFileResult> results;
+        for (const QString &path : paths) {
+            if (job->cancelled.load(std::memory_order_relaxed)) {
+                break;
+            }
+            QVector<ProjectSearchHit> hits =
+                scanFile(path, matcher, prefilter.get(), job->cancelled);
+            ++job->filesSearched;
+            if (!hits.isEmpty()) {
+                results.append(ProjectSearchFileResult{path, std::move(hits)});
+            }
+        }
+
+        if (!results.isEmpty() && !job->cancelled.load(std::memory_order_relaxed)) {
+            QMetaObject::invokeMethod(
+                receiver,
+                [receiver, generation, results = std::move(results)]() mutable {
+                    receiver->receive(generation, std::move(results));
+                },
+                Qt::QueuedConnection);
+        }
+        finishTask();
+    };
+
+    m_pool.start([=]() {
+        QStringList batch;
+        int batchSize = kFirstBatchSize;
+        auto flush = [&]() {
+            if (batch.isEmpty()) {
+                return;
+            }
+            ++job->outstanding;
+            pool->start([scanBatch, paths = std::move(batch)]() { scanBatch(paths); });
+            batch = QStringList();
+            batchSize = qMin(batchSize * 2, kMaxBatchSize);
+        };
+
+        auto add = [&](const QString &path) {
+            batch.append(path);
+            if (batch.size() >= batchSize) {
+                flush();
+            }
+        };
+
+        // The index narrows the files to scan when the query requires some
+        // trigram; the globs still apply to what it returns
+        QStringList candidates;
+        if (index.isValid() && index.candidates(query, &candidates)) {
+            const int prefixLength = walker.rootPath().size() + 1;
+            for (const QString &path : std::as_const(candidates)) {
+                if (job->cancelled.load(std::memory_order_relaxed)) {
+                    break;
+                }
+                if (walker.acceptsFile(path.mid(prefixLength))) {
+                    add(path);
+                }
+            }
+        } else {
+            walker.walk([&](const QFileInfo &file) { add(file.filePath()); }, &job->cancelled);
+        }
+        flush();
+        finishTask();
+    });
+}
+
+void ProjectSearch::receive(int generation, QVector<ProjectSearchFileResult> results) {
+    if (generation != m_generation) {
+        return;
+    }
+    emit resultsFound(results);
+}
+
+void ProjectSearch::complete(int generation, int filesSearched) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_job.reset();
+    emit finished(filesSearched, false);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "codeeditor/searchengine.h"
+#include "views/search/projectwalker.h"
+#include "views/search/trigramindex.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+// One line containing a match. Line and column are 0-based, the column
+// in UTF-16 code units as CodeEditor::goToLine expects.
+struct ProjectSearchHit {
+  int line;
+  int column;
+  int length;
+  QString lineText;
+};
+
+struct ProjectSearchFileResult {
+  QString path;
+  QVector<ProjectSearchHit> hits;
+};
+
+// Searches every file under a root directory. One task walks the tree
+// with a ProjectWalker, or asks the trigram index for candidates when one is
+// given, and hands files out in batches to the other threads of the pool.
+// Each file is memory-mapped; binary files are skipped after a NUL check,
+// and case-sensitive literals are rejected with QByteArrayMatcher on the
+// raw bytes before any decoding. Files with hits are posted back in batches
+// as they are found, so the first results show up long before the walk is
+// done. start() and cancel() drop the search in flight.
+class ProjectSearch : public QObject {
+  Q_OBJECT
+
+public:
+  struct Options {
+    QString rootPath;
+    SearchEngine::Query query;
+    ProjectWalker::Options filters;
+    // Used when valid to skip files that cannot match
+    TrigramIndex::Lookup index;
+  };
+
+  explicit ProjectSearch(QObject *parent = nullptr);
+  ~ProjectSearch();
+
+  void start(const Options &options);
+  void cancel();
+  bool isRunning() const { return m_job != nullptr; }
+
+signals:
+  void resultsFound(const QVector<ProjectSearchFileResult> &results);
+  void finished(int filesSearched, bool cancelled);
+
+private:
+  struct Job;
+
+  void receive(int generation, QVector<ProjectSearchFileResult> results);
+  void complete(int generation, int filesSearched);
+
+  std::shared_ptr<Job> m_job;
+  int m_generation;
+  QThreadPool m_pool;
+};
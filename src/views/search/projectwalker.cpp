@@ -0,0 +1,142 @@
+#include "projectwalker.h"
+#include "views/project/ignorerules.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QVector>
+#include <cstring>
+
+namespace {
+std::shared_ptr<const IgnoreRules> compileGlobList(const QString &globs) {
+    QStringList patterns;
+    for (const QString &glob : globs.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        QString trimmed = glob.trimmed();
+        if (!trimmed.isEmpty()) {
+            patterns.append(trimmed);
+        }
+    }
+    return IgnoreRules::fromPatterns(patterns);
+}
+} // namespace
+
+bool ProjectWalker::isText(const char *data, qint64 size) {
+    return !std::memchr(data, 0, size_t(qMin<qint64>(size, 8000)));
+}
+
+struct ProjectWalker::Rules {
+    std::shared_ptr<const IgnoreRules> includes;
+    std::shared_ptr<const IgnoreRules> excludes;
+    bool respectGitIgnore = true;
+};
+
+ProjectWalker::ProjectWalker(const QString &rootPath, const Options &options)
+    : m_rootPath(QDir(rootPath).absolutePath()) {
+    auto rules = std::make_shared<Rules>();
+    rules->includes = compileGlobList(options.includeGlobs);
+    rules->excludes = compileGlobList(options.excludeGlobs);
+    rules->respectGitIgnore = options.respectGitIgnore;
+    m_rules = rules;
+}
+
+void ProjectWalker::walk(const std::function<void(const QFileInfo &file)> &visit,
+                         const std::atomic<bool> *cancelled) const {
+    walkFrom(m_rootPath, QString(), visit, cancelled);
+}
+
+void ProjectWalker::walkDirectory(const QString &directory,
+                                  const std::function<void(const QFileInfo &file)> &visit,
+                                  const std::atomic<bool> *cancelled) const {
+    const QString path = QDir(directory).absolutePath();
+    const QString relative = QDir(m_rootPath).relativeFilePath(path);
+    if (relative == QLatin1String(".")) {
+        walk(visit, cancelled);
+        return;
+    }
+    if (relative.startsWith(QLatin1String("..")) || QDir::isAbsolutePath(relative)) {
+        return;
+    }
+
+    // The walk from the root would have pruned it on the way down
+    const std::shared_ptr<const IgnoreRules> builtIn = IgnoreRules::builtIn();
+    const QStringList parts = relative.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    QString prefix;
+    for (const QString &part : parts) {
+        prefix = prefix.isEmpty() ? part : prefix + QLatin1Char('/') + part;
+        if (builtIn->matches(prefix, true) || m_rules->excludes->matches(prefix, true)) {
+            return;
+        }
+    }
+    if (m_rules->respectGitIgnore && IgnoreService::instance().isIgnored(m_rootPath, path, true)) {
+        return;
+    }
+    const QFileInfo info(path);
+    if (!info.isDir() || info.isSymLink()) {
+        return;
+    }
+    walkFrom(path, relative, visit, cancelled);
+}
+
+void ProjectWalker::walkFrom(const QString &directory, const QString &relativeDirectory,
+                             const std::function<void(const QFileInfo &file)> &visit,
+                             const std::atomic<bool> *cancelled) const {
+    struct PendingDir {
+        QString path;
+        QString relative;
+    };
+    QVector<PendingDir> stack;
+    stack.append({directory, relativeDirectory});
+
+    IgnoreService &ignoreService = IgnoreService::instance();
+    std::shared_ptr<const IgnoreRules> ignore = IgnoreRules::builtIn();
+    while (!stack.isEmpty()) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        const PendingDir dir = stack.takeLast();
+        if (m_rules->respectGitIgnore) {
+            // Compiled once per directory and shared with everything else
+            // that walks or watches the project
+            ignore = ignoreService.rulesFor(m_rootPath, dir.path);
+        }
+
+        QDirIterator it(dir.path, QDir::AllEntries | QDir::NoDotAndDotDot |
+                                      QDir::Hidden | QDir::System);
+        while (it.hasNext()) {
+            it.next();
+            const QFileInfo info = it.fileInfo();
+            const QString name = info.fileName();
+            const bool isDir = info.isDir();
+            const QString relative =
+                dir.relative.isEmpty() ? name : dir.relative + QLatin1Char('/') + name;
+
+            if (isDir && info.isSymLink()) {
+                continue;
+            }
+            if (m_rules->excludes->matches(relative, isDir) || ignore->matches(relative, isDir)) {
+                continue;
+            }
+
+            if (isDir) {
+                stack.append({info.filePath(), relative});
+            } else if (m_rules->includes->isEmpty() ||
+                       m_rules->includes->matches(relative, false)) {
+                visit(info);
+            }
+        }
+    }
+}
+
+bool ProjectWalker::acceptsFile(const QString &relativePath) const {
+    const std::shared_ptr<const IgnoreRules> builtIn = IgnoreRules::builtIn();
+    const QStringList parts = relativePath.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    QString prefix;
+    for (int i = 0; i < parts.size(); ++i) {
+        const bool isDir = i + 1 < parts.size();
+        prefix = prefix.isEmpty() ? parts[i] : prefix + QLatin1Char('/') + parts[i];
+        if (builtIn->matches(prefix, isDir) || m_rules->excludes->matches(prefix, isDir)) {
+            return false;
+        }
+    }
+    return m_rules->includes->isEmpty() ||
+           (!parts.isEmpty() && m_rules->includes->matches(relativePath, false));
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <QFileInfo>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Enumerates the files of a project the way project-wide search sees them.
+// Directories matching an exclude glob or an ignore rule are pruned without
+// being entered, and version control metadata and symlinked directories
+// are never entered. The globs are compiled once on construction, the
+// .gitignore and .ignore rules once per directory by the IgnoreService. A
+// walker may be built on one thread and used on another, but not by two at
+// once.
+class ProjectWalker {
+public:
+  struct Options {
+    // Comma-separated globs. Without a '/' they match file names,
+    // otherwise paths relative to the root.
+    QString includeGlobs;
+    QString excludeGlobs;
+    bool respectGitIgnore = true;
+  };
+
+  // Larger files are almost never source; they are neither searched nor
+  // indexed
+  static constexpr qint64 MaxFileSize = 64 * 1024 * 1024;
+  // False for binary contents: a NUL in the first 8000 bytes, as git decides
+  static bool isText(const char *data, qint64 size);
+
+  ProjectWalker(const QString &rootPath, const Options &options);
+
+  QString rootPath() const { return m_rootPath; }
+
+  // Calls `visit` for every file that passes the filters. Returns early
+  // once `cancelled` is set.
+  void walk(const std::function<void(const QFileInfo &file)> &visit,
+            const std::atomic<bool> *cancelled = nullptr) const;
+  // As walk(), but only below `directory`, a directory under the root.
+  // Visits nothing when it, or a directory above it, is excluded or
+  // ignored.
+  void walkDirectory(const QString &directory,
+                     const std::function<void(const QFileInfo &file)> &visit,
+                     const std::atomic<bool> *cancelled = nullptr) const;
+  // Whether a file under the root, found some other way, passes the
+  // include and exclude globs. Ignore files are not consulted.
+  bool acceptsFile(const QString &relativePath) const;
+
+private:
+  struct Rules;
+
+  void walkFrom(const QString &directory, const QString &relativeDirectory,
+                const std::function<void(const QFileInfo &file)> &visit,
+                const std::atomic<bool> *cancelled) const;
+
+  QString m_rootPath;
+  std::shared_ptr<const Rules> m_rules;
+};
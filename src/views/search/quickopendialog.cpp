@@ -0,0 +1,126 @@
+#include "quickopendialog.h"
+#include <QCoreApplication>
+#include <QHeaderView>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+namespace {
+constexpr int kMaxResults = 100;
+} // namespace
+
+QuickOpenDialog::QuickOpenDialog(PathIndex *index, QWidget *parent)
+    : QDialog(parent, Qt::Popup), m_index(index) {
+    setupUI();
+
+    connect(m_queryEdit, &QLineEdit::textChanged, this, &QuickOpenDialog::updateResults);
+    connect(m_queryEdit, &QLineEdit::returnPressed, this, &QuickOpenDialog::openCurrent);
+    connect(m_resultList, &QTreeWidget::itemActivated, this, &QuickOpenDialog::openCurrent);
+    connect(m_index, &PathIndex::pathsChanged, this, &QuickOpenDialog::handlePathsChanged);
+}
+
+void QuickOpenDialog::setupUI() {
+    resize(600, 400);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->setSpacing(4);
+
+    m_queryEdit = new QLineEdit(this);
+    m_queryEdit->setPlaceholderText(tr("Go to file"));
+    m_queryEdit->installEventFilter(this);
+    layout->addWidget(m_queryEdit);
+
+    m_resultList = new QTreeWidget(this);
+    m_resultList->setColumnCount(2);
+    m_resultList->setHeaderHidden(true);
+    m_resultList->setRootIsDecorated(false);
+    m_resultList->setUniformRowHeights(true);
+    m_resultList->setFocusPolicy(Qt::NoFocus);
+    m_resultList->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    layout->addWidget(m_resultList);
+
+    m_statusLabel = new QLabel(this);
+    layout->addWidget(m_statusLabel);
+}
+
+void QuickOpenDialog::popup() {
+    if (QWidget *window = parentWidget() ? parentWidget()->window() : nullptr) {
+        const QRect frame = window->geometry();
+        resize(qMin(600, frame.width() - 40), height());
+        move(frame.x() + (frame.width() - width()) / 2, frame.y() + 60);
+    }
+
+    if (m_ranker.paths() != m_index->paths()) {
+        m_ranker.setPaths(m_index->paths());
+    }
+    m_queryEdit->clear();
+    updateResults();
+    show();
+    raise();
+    activateWindow();
+    m_queryEdit->setFocus();
+}
+
+void QuickOpenDialog::handlePathsChanged() {
+    m_ranker.setPaths(m_index->paths());
+    if (isVisible()) {
+        updateResults();
+    }
+}
+
+void QuickOpenDialog::updateResults() {
+    m_resultList->clear();
+
+    const std::shared_ptr<const PathList> paths = m_ranker.paths();
+    if (!paths) {
+        m_statusLabel->setText(tr("Indexing files..."));
+        return;
+    }
+
+    const QVector<FuzzyRanker::Result> results = m_ranker.rank(m_queryEdit->text(), kMaxResults);
+    QList<QTreeWidgetItem *> items;
+    items.reserve(results.size());
+    for (const FuzzyRanker::Result &result : results) {
+        QTreeWidgetItem *item = new QTreeWidgetItem;
+        item->setText(0, paths->fileName(result.file).toString());
+        item->setText(1, paths->directory(result.file).toString());
+        item->setData(0, Qt::UserRole, paths->absolutePath(result.file));
+        item->setForeground(1, palette().brush(QPalette::PlaceholderText));
+        items.append(item);
+    }
+    m_resultList->addTopLevelItems(items);
+    if (!items.isEmpty()) {
+        m_resultList->setCurrentItem(items.first());
+    }
+    m_statusLabel->setText(tr("%1 of %2 files").arg(m_ranker.matchCount()).arg(paths->fileCount()));
+}
+
+void QuickOpenDialog::openCurrent() {
+    QTreeWidgetItem *item = m_resultList->currentItem();
+    if (!item) {
+        return;
+    }
+    const QString path = item->data(0, Qt::UserRole).toString();
+    hide();
+    emit fileSelected(path);
+}
+
+bool QuickOpenDialog::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == m_queryEdit && event->type() == QEvent::KeyPress) {
+        // Moving through the results keeps the focus in the query
+        switch (static_cast<QKeyEvent *>(event)->key()) {
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+        case Qt::Key_PageUp:
+        case Qt::Key_PageDown:
+            QCoreApplication::sendEvent(m_resultList, event);
+            return true;
+        default:
+            break;
+        }
+    }
+    return QDialog::eventFilter(watched, event);
+}
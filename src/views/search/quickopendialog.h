@@ -0,0 +1,42 @@
+#pragma once
+#include "views/search/fuzzyranker.h"
+#include "views/search/pathindex.h"
+#include <QDialog>
+
+class QLabel;
+class QLineEdit;
+class QTreeWidget;
+
+// The Go to File palette: a query box over the best fuzzy matches among
+// the project's files, reranked on every keystroke. Enter or a click opens
+// the selected file.
+class QuickOpenDialog : public QDialog {
+  Q_OBJECT
+
+public:
+  explicit QuickOpenDialog(PathIndex *index, QWidget *parent = nullptr);
+
+  // Shows the palette at the top of the parent window with an empty query
+  void popup();
+
+signals:
+  void fileSelected(const QString &filePath);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+  void updateResults();
+  void handlePathsChanged();
+  void openCurrent();
+
+private:
+  void setupUI();
+
+  PathIndex *m_index;
+  FuzzyRanker m_ranker;
+
+  QLineEdit *m_queryEdit;
+  QTreeWidget *m_resultList;
+  QLabel *m_statusLabel;
+};
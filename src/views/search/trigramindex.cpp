@@ -0,0 +1,686 @@
+#include "trigramindex.h"
+#include "settings/sessionsettings.h"
+#include "views/search/projectwalker.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace {
+constexpr char kMagic[8] = {'O', 'H', 'T', 'R', 'I', 'G', 'R', 'M'};
+constexpr quint32 kVersion = 2;
+// The overlay is folded into a fresh index once it holds this share of the
+// files, or at least kMinRebuildThreshold entries
+constexpr int kRebuildDivisor = 20;
+constexpr int kMinRebuildThreshold = 512;
+constexpr int kRebuildDelayMs = 2000;
+
+// File layout, native byte order since the index never leaves the machine:
+// Header, FileEntry[fileCount], TrigramEntry[trigramCount] sorted by
+// trigram, the UTF-8 relative paths, then the posting lists
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 fileCount;
+    quint32 trigramCount;
+    quint32 reserved;
+    quint64 filesOffset;
+    quint64 trigramsOffset;
+    quint64 pathsOffset;
+    quint64 pathsSize;
+    quint64 postingsOffset;
+    quint64 postingsSize;
+};
+
+struct FileEntry {
+    qint64 modified; // ms since the epoch
+    qint64 size;
+    quint32 pathOffset;
+    quint32 pathLength;
+};
+
+struct TrigramEntry {
+    quint32 trigram;
+    quint32 count;
+    quint64 offset; // Into the postings
+};
+
+inline uchar foldCase(uchar ch) {
+    return (ch >= 'A' && ch <= 'Z') ? uchar(ch + ('a' - 'A')) : ch;
+}
+
+inline quint32 trigramAt(const uchar *p) {
+    return (quint32(foldCase(p[0])) << 16) | (quint32(foldCase(p[1])) << 8) |
+           foldCase(p[2]);
+}
+
+void appendVarint(QByteArray &out, quint32 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Appends the literal strings every match of the query must contain.
+// Returns false when nothing is required, as with a top-level alternation.
+bool requiredLiterals(const SearchEngine::Query &query, QStringList *runs) {
+    if (!query.regex) {
+        runs->append(query.pattern);
+        return true;
+    }
+
+    const QString &pattern = query.pattern;
+    // Extended mode makes whitespace insignificant; not worth modelling
+    static const QRegularExpression extendedFlag(QStringLiteral("\\(\\?[a-wyzA-Z^-]*x"));
+    if (extendedFlag.match(pattern).hasMatch()) {
+        return false;
+    }
+
+    QString current;
+    int depth = 0;
+    auto endRun = [&]() {
+        if (!current.isEmpty()) {
+            runs->append(current);
+            current.clear();
+        }
+    };
+    // Only text outside groups is certain to be matched; anything inside
+    // one may be optional or an alternative
+    auto literal = [&](QChar ch) {
+        if (depth == 0) {
+            current += ch;
+        } else {
+            endRun();
+        }
+    };
+
+    for (qsizetype i = 0; i < pattern.size(); ++i) {
+        const QChar ch = pattern[i];
+        switch (ch.unicode()) {
+        case '\\': {
+            if (i + 1 == pattern.size()) {
+                endRun();
+                break;
+            }
+            const QChar next = pattern[++i];
+            if (!next.isLetterOrNumber()) {
+                literal(next);
+            } else if (QStringLiteral("xopPNkgcQEu0").contains(next)) {
+                // Escapes with arguments of their own; stop rather than
+                // misread what follows
+                endRun();
+                return true;
+            } else {
+                // Character classes, anchors and back-references
+                endRun();
+            }
+            break;
+        }
+        case '[': {
+            endRun();
+            qsizetype j = i + 1;
+            if (j < pattern.size() && pattern[j] == QLatin1Char('^')) {
+                ++j;
+            }
+            if (j < pattern.size() && pattern[j] == QLatin1Char(']')) {
+                ++j;
+            }
+            while (j < pattern.size() && pattern[j] != QLatin1Char(']')) {
+                j += pattern[j] == QLatin1Char('\\') ? 2 : 1;
+            }
+            i = j;
+            break;
+        }
+        case '(':
+            endRun();
+            ++depth;
+            break;
+        case ')':
+            endRun();
+            --depth;
+            break;
+        case '|':
+            if (depth == 0) {
+                runs->clear();
+                return false;
+            }
+            endRun();
+            break;
+        case '?':
+        case '*':
+        case '{':
+            // The quantified character may be absent
+            current.chop(1);
+            endRun();
+            if (ch == QLatin1Char('{')) {
+                qsizetype close = pattern.indexOf(QLatin1Char('}'), i);
+                i = close < 0 ? pattern.size() : close;
+            }
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            endRun();
+            break;
+        default:
+            literal(ch);
+            break;
+        }
+    }
+    endRun();
+    return true;
+}
+
+// The sorted, distinct trigrams every match of the query contains
+bool queryTrigrams(const SearchEngine::Query &query, QVector<quint32> *trigrams) {
+    QStringList runs;
+    if (!requiredLiterals(query, &runs)) {
+        return false;
+    }
+
+    // Case-insensitive matching folds more than ASCII, so only trigrams of
+    // ASCII bytes are reliable then
+    const bool asciiOnly = !query.caseSensitive || query.pattern.contains(QLatin1String("(?"));
+    for (const QString &run : runs) {
+        const QByteArray bytes = run.toUtf8();
+        const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+        for (qsizetype i = 0; i + 3 <= bytes.size(); ++i) {
+            if (asciiOnly && ((data[i] | data[i + 1] | data[i + 2]) & 0x80)) {
+                continue;
+            }
+            trigrams->append(trigramAt(data + i));
+        }
+    }
+    std::sort(trigrams->begin(), trigrams->end());
+    trigrams->erase(std::unique(trigrams->begin(), trigrams->end()), trigrams->end());
+    return !trigrams->isEmpty();
+}
+} // namespace
+
+struct TrigramIndex::Data {
+    QString rootPath;
+    QFile file;
+    uchar *base = nullptr;
+    Header header;
+    const FileEntry *files = nullptr;
+    const TrigramEntry *trigrams = nullptr;
+    const char *paths = nullptr;
+    const uchar *postings = nullptr;
+
+    ~Data() {
+        if (base) {
+            file.unmap(base);
+        }
+    }
+
+    QString relativePath(quint32 id) const {
+        const FileEntry &entry = files[id];
+        return QString::fromUtf8(paths + entry.pathOffset, entry.pathLength);
+    }
+
+    QVector<quint32> postingList(const TrigramEntry &entry) const {
+        QVector<quint32> ids;
+        ids.reserve(entry.count);
+        const uchar *p = postings + entry.offset;
+        const uchar *end = postings + header.postingsSize;
+        quint32 id = 0;
+        for (quint32 n = 0; n < entry.count && p < end; ++n) {
+            quint32 delta = 0;
+            for (int shift = 0; p < end; shift += 7) {
+                const uchar byte = *p++;
+                delta |= quint32(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+            id += delta;
+            if (id >= header.fileCount) {
+                break;
+            }
+            ids.append(id);
+        }
+        return ids;
+    }
+
+    // Maps a saved index, or returns null if it is missing or damaged
+    static std::shared_ptr<const Data> open(const QString &indexPath,
+                                            const QString &rootPath) {
+        auto data = std::make_shared<Data>();
+        data->rootPath = rootPath;
+        data->file.setFileName(indexPath);
+        if (!data->file.open(QIODevice::ReadOnly)) {
+            return nullptr;
+        }
+        const quint64 size = quint64(data->file.size());
+        if (size < sizeof(Header)) {
+            return nullptr;
+        }
+        data->base = data->file.map(0, qint64(size));
+        if (!data->base) {
+            return nullptr;
+        }
+
+        Header &header = data->header;
+        std::memcpy(&header, data->base, sizeof(Header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+            header.version != kVersion ||
+            header.filesOffset + quint64(header.fileCount) * sizeof(FileEntry) > size ||
+            header.trigramsOffset + quint64(header.trigramCount) * sizeof(TrigramEntry) > size ||
+            header.pathsOffset + header.pathsSize > size ||
+            header.postingsOffset + header.postingsSize > size ||
+            header.filesOffset % 8 != 0 || header.trigramsOffset % 8 != 0) {
+            return nullptr;
+        }
+
+        data->files = reinterpret_cast<const FileEntry *>(data->base + header.filesOffset);
+        data->trigrams = reinterpret_cast<const TrigramEntry *>(data->base + header.trigramsOffset);
+        data->paths = reinterpret_cast<const char *>(data->base + header.pathsOffset);
+        data->postings = data->base + header.postingsOffset;
+
+        for (quint32 i = 0; i < header.fileCount; ++i) {
+            const FileEntry &entry = data->files[i];
+            if (quint64(entry.pathOffset) + entry.pathLength > header.pathsSize) {
+                return nullptr;
+            }
+        }
+        for (quint32 i = 0; i < header.trigramCount; ++i) {
+            if (data->trigrams[i].offset >= header.postingsSize && data->trigrams[i].count > 0) {
+                return nullptr;
+            }
+        }
+        return data;
+    }
+
+    // Indexes every file the walker yields and writes the result to
+    // `indexPath`, replacing it atomically
+    static bool build(const QString &rootPath, const QString &indexPath,
+                      const std::atomic<bool> &cancelled) {
+        const ProjectWalker walker(rootPath, ProjectWalker::Options());
+        const QString prefix = walker.rootPath() + QLatin1Char('/');
+
+        QVector<FileEntry> files;
+        QByteArray paths;
+        QHash<quint32, QVector<quint32>> postings;
+        // One bit per possible trigram, set for those already seen in the
+        // current file
+        std::vector<quint64> seen(size_t(1) << 18, 0);
+        QVector<quint32> fileTrigrams;
+
+        // Every file the walker yields gets an entry, those that are not
+        // indexed too, with no postings, so changedFiles() knows them
+        auto record = [&](const QFileInfo &info) {
+            const QByteArray relative = info.filePath().mid(prefix.size()).toUtf8();
+            files.append(FileEntry{info.lastModified().toMSecsSinceEpoch(), info.size(),
+                                   quint32(paths.size()), quint32(relative.size())});
+            paths.append(relative);
+        };
+
+        walker.walk(
+            [&](const QFileInfo &info) {
+                if (info.size() > ProjectWalker::MaxFileSize) {
+                    record(info);
+                    return;
+                }
+                QFile file(info.filePath());
+                if (!file.open(QIODevice::ReadOnly)) {
+                    record(info);
+                    return;
+                }
+                qint64 length = file.size();
+                const uchar *contents = length > 0 ? file.map(0, length) : nullptr;
+                QByteArray fallback;
+                if (!contents && length > 0) {
+                    fallback = file.readAll();
+                    contents = reinterpret_cast<const uchar *>(fallback.constData());
+                    length = fallback.size();
+                }
+                if (length > 0 &&
+                    !ProjectWalker::isText(reinterpret_cast<const char *>(contents), length)) {
+                    record(info);
+                    return;
+                }
+
+                fileTrigrams.clear();
+                for (qint64 i = 0; i + 3 <= length; ++i) {
+                    const quint32 trigram = trigramAt(contents + i);
+                    quint64 &word = seen[trigram >> 6];
+                    const quint64 bit = quint64(1) << (trigram & 63);
+                    if (!(word & bit)) {
+                        word |= bit;
+                        fileTrigrams.append(trigram);
+                    }
+                }
+
+                const quint32 id = quint32(files.size());
+                for (quint32 trigram : fileTrigrams) {
+                    seen[trigram >> 6] &= ~(quint64(1) << (trigram & 63));
+                    postings[trigram].append(id);
+                }
+
+                record(info);
+            },
+            &cancelled);
+        if (cancelled.load()) {
+            return false;
+        }
+
+        QVector<quint32> keys = postings.keys();
+        std::sort(keys.begin(), keys.end());
+        QVector<TrigramEntry> table;
+        table.reserve(keys.size());
+        QByteArray blob;
+        for (quint32 key : keys) {
+            const QVector<quint32> &ids = *postings.constFind(key);
+            table.append(TrigramEntry{key, quint32(ids.size()), quint64(blob.size())});
+            quint32 previous = 0;
+            for (quint32 id : ids) {
+                appendVarint(blob, id - previous);
+                previous = id;
+            }
+        }
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.fileCount = quint32(files.size());
+        header.trigramCount = quint32(table.size());
+        header.filesOffset = sizeof(Header);
+        header.trigramsOffset = header.filesOffset + quint64(files.size()) * sizeof(FileEntry);
+        header.pathsOffset = header.trigramsOffset + quint64(table.size()) * sizeof(TrigramEntry);
+        header.pathsSize = quint64(paths.size());
+        header.postingsOffset = header.pathsOffset + header.pathsSize;
+        header.postingsSize = quint64(blob.size());
+
+        QSaveFile out(indexPath);
+        if (!out.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(files.constData()),
+                  qint64(files.size()) * qint64(sizeof(FileEntry)));
+        out.write(reinterpret_cast<const char *>(table.constData()),
+                  qint64(table.size()) * qint64(sizeof(TrigramEntry)));
+        out.write(paths);
+        out.write(blob);
+        return out.commit();
+    }
+
+    // Files that are new or differ in size or time from when they were
+    // indexed. Deleted files are left alone; scanning them finds nothing.
+    QStringList changedFiles(const std::atomic<bool> &cancelled) const {
+        QHash<QString, quint32> ids;
+        ids.reserve(int(header.fileCount));
+        for (quint32 i = 0; i < header.fileCount; ++i) {
+            ids.insert(relativePath(i), i);
+        }
+
+        const ProjectWalker walker(rootPath, ProjectWalker::Options());
+        const int prefixLength = walker.rootPath().size() + 1;
+        QStringList changed;
+        walker.walk(
+            [&](const QFileInfo &info) {
+                auto it = ids.constFind(info.filePath().mid(prefixLength));
+                if (it == ids.constEnd() ||
+                    files[*it].modified != info.lastModified().toMSecsSinceEpoch() ||
+                    files[*it].size != info.size()) {
+                    changed.append(info.filePath());
+                }
+            },
+            &cancelled);
+        return changed;
+    }
+};
+
+bool TrigramIndex::Lookup::candidates(const SearchEngine::Query &query,
+                                      QStringList *paths) const {
+    QVector<quint32> keys;
+    if (!d || !queryTrigrams(query, &keys)) {
+        return false;
+    }
+
+    // A trigram missing from the index rules out every indexed file
+    QVector<const TrigramEntry *> entries;
+    const TrigramEntry *begin = d->trigrams;
+    const TrigramEntry *end = d->trigrams + d->header.trigramCount;
+    for (quint32 key : keys) {
+        const TrigramEntry *entry = std::lower_bound(
+            begin, end, key,
+            [](const TrigramEntry &entry, quint32 value) { return entry.trigram < value; });
+        if (entry == end || entry->trigram != key) {
+            entries.clear();
+            break;
+        }
+        entries.append(entry);
+    }
+
+    // Intersect from the rarest trigram up, so the working set starts small
+    QVector<quint32> ids;
+    if (!entries.isEmpty()) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const TrigramEntry *a, const TrigramEntry *b) { return a->count < b->count; });
+        ids = d->postingList(*entries.first());
+        for (int i = 1; i < entries.size() && !ids.isEmpty(); ++i) {
+            const QVector<quint32> other = d->postingList(*entries[i]);
+            QVector<quint32> both;
+            std::set_intersection(ids.cbegin(), ids.cend(), other.cbegin(), other.cend(),
+                                  std::back_inserter(both));
+            ids.swap(both);
+        }
+    }
+
+    const QString prefix = d->rootPath + QLatin1Char('/');
+    paths->reserve(paths->size() + ids.size() + dirtyFiles.size());
+    for (quint32 id : ids) {
+        paths->append(prefix + d->relativePath(id));
+    }
+
+    // Whatever changed since the build is verified regardless
+    if (!dirtyFiles.isEmpty() || !dirtyDirs.isEmpty()) {
+        QSet<QString> seen(paths->cbegin(), paths->cend());
+        auto add = [&](const QString &path) {
+            if (!seen.contains(path)) {
+                seen.insert(path);
+                paths->append(path);
+            }
+        };
+        for (const QString &path : dirtyFiles) {
+            add(path);
+        }
+        // A directory may have been moved in or created with whole trees
+        // below it, so it is walked in full, ignore rules and all, as a
+        // search without the index would
+        const ProjectWalker walker(d->rootPath, ProjectWalker::Options());
+        for (const QString &dir : dirtyDirs) {
+            walker.walkDirectory(dir, [&](const QFileInfo &info) { add(info.filePath()); });
+        }
+    }
+    return true;
+}
+
+TrigramIndex::TrigramIndex(QObject *parent)
+    : QObject(parent), m_building(false), m_generation(0),
+      m_cancelled(std::make_shared<std::atomic<bool>>(false)) {
+    m_pool.setMaxThreadCount(1);
+
+    m_rebuildTimer = new QTimer(this);
+    m_rebuildTimer->setSingleShot(true);
+    m_rebuildTimer->setInterval(kRebuildDelayMs);
+    connect(m_rebuildTimer, &QTimer::timeout, this, &TrigramIndex::rebuild);
+}
+
+TrigramIndex::~TrigramIndex() {
+    cancel();
+    m_pool.waitForDone();
+}
+
+void TrigramIndex::cancel() {
+    ++m_generation;
+    *m_cancelled = true;
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_building = false;
+    m_rebuildTimer->stop();
+}
+
+void TrigramIndex::setRootPath(const QString &path) {
+    const QString root = path.isEmpty() ? QString() : QDir(path).absolutePath();
+    if (root == m_rootPath) {
+        return;
+    }
+
+    cancel();
+    const bool wasReady = isReady();
+    m_rootPath = root;
+    m_data.reset();
+    m_dirtyFiles.clear();
+    m_dirtyDirs.clear();
+    if (wasReady) {
+        emit readyChanged(false);
+    }
+    if (root.isEmpty()) {
+        return;
+    }
+
+    const QString indexDir = SessionSettings::instance().configDirectory() + "/index";
+    QDir().mkpath(indexDir);
+    const QByteArray key =
+        QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+    m_indexPath = indexDir + QLatin1Char('/') + QString::fromLatin1(key) + ".trgm";
+    load();
+}
+
+void TrigramIndex::load() {
+    const int generation = m_generation;
+    const QString root = m_rootPath;
+    const QString indexPath = m_indexPath;
+    const std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+    TrigramIndex *receiver = this;
+
+    m_pool.start([=]() {
+        std::shared_ptr<const Data> data = Data::open(indexPath, root);
+        QStringList changed;
+        if (data) {
+            changed = data->changedFiles(*cancelled);
+        } else if (Data::build(root, indexPath, *cancelled)) {
+            data = Data::open(indexPath, root);
+        }
+        if (cancelled->load()) {
+            return;
+        }
+        QMetaObject::invokeMethod(
+            receiver,
+            [=]() { receiver->receive(generation, data, changed, false); },
+            Qt::QueuedConnection);
+    });
+}
+
+void TrigramIndex::rebuild() {
+    if (m_building || m_rootPath.isEmpty()) {
+        return;
+    }
+    m_building = true;
+    m_dirtyFilesSinceBuild.clear();
+    m_dirtyDirsSinceBuild.clear();
+
+    const int generation = m_generation;
+    const QString root = m_rootPath;
+    const QString indexPath = m_indexPath;
+    const std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+    TrigramIndex *receiver = this;
+
+    m_pool.start([=]() {
+        std::shared_ptr<const Data> data;
+        if (Data::build(root, indexPath, *cancelled)) {
+            data = Data::open(indexPath, root);
+        }
+        if (cancelled->load()) {
+            return;
+        }
+        QMetaObject::invokeMethod(
+            receiver,
+            [=]() { receiver->receive(generation, data, QStringList(), true); },
+            Qt::QueuedConnection);
+    });
+}
+
+void TrigramIndex::receive(int generation, std::shared_ptr<const Data> data,
+                           QStringList changedFiles, bool rebuilt) {
+    if (generation != m_generation) {
+        return;
+    }
+
+    if (rebuilt) {
+        m_building = false;
+        if (!data) {
+            return;
+        }
+        // Only what changed after the build started can be missing from it
+        m_dirtyFiles = m_dirtyFilesSinceBuild;
+        m_dirtyDirs = m_dirtyDirsSinceBuild;
+        m_dirtyFilesSinceBuild.clear();
+        m_dirtyDirsSinceBuild.clear();
+    } else {
+        for (const QString &path : changedFiles) {
+            m_dirtyFiles.insert(path);
+        }
+    }
+
+    const bool wasReady = isReady();
+    m_data = std::move(data);
+    if (isReady() != wasReady) {
+        emit readyChanged(isReady());
+    }
+    maybeScheduleRebuild();
+}
+
+void TrigramIndex::invalidate(const QString &path) {
+    if (m_rootPath.isEmpty() ||
+        (path != m_rootPath && !path.startsWith(m_rootPath + QLatin1Char('/')))) {
+        return;
+    }
+
+    const bool isDir = QFileInfo(path).isDir();
+    (isDir ? m_dirtyDirs : m_dirtyFiles).insert(path);
+    if (m_building) {
+        (isDir ? m_dirtyDirsSinceBuild : m_dirtyFilesSinceBuild).insert(path);
+    }
+    maybeScheduleRebuild();
+}
+
+void TrigramIndex::refresh() {
+    if (m_rootPath.isEmpty()) {
+        return;
+    }
+    // The current data keeps serving until the check is done
+    cancel();
+    load();
+}
+
+void TrigramIndex::maybeScheduleRebuild() {
+    if (!m_data || m_building || m_rebuildTimer->isActive()) {
+        return;
+    }
+    const int threshold =
+        qMax(kMinRebuildThreshold, int(m_data->header.fileCount / kRebuildDivisor));
+    if (m_dirtyFiles.size() + m_dirtyDirs.size() >= threshold) {
+        m_rebuildTimer->start();
+    }
+}
+
+TrigramIndex::Lookup TrigramIndex::lookup() const {
+    Lookup lookup;
+    lookup.d = m_data;
+    lookup.dirtyFiles = m_dirtyFiles;
+    lookup.dirtyDirs = m_dirtyDirs;
+    return lookup;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "codeeditor/searchengine.h"
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+class QTimer;
+
+// An on-disk trigram index of a project, kept under .ohao-ide/index. For
+// each three-byte sequence it stores the sorted ids of the files that
+// contain it (ASCII case-folded, delta and varint encoded), so a query
+// only has to verify the files holding every trigram it requires.
+//
+// The index file is memory-mapped and never modified; a rebuild writes a
+// new file and swaps it in. Files reported changed since the build are
+// kept in an overlay and always verified, and once the overlay grows large
+// the index is rebuilt in the background. Opening a folder loads the saved
+// index, if any, and compares it against the tree on a worker thread
+// before it is used.
+class TrigramIndex : public QObject {
+  Q_OBJECT
+
+private:
+  struct Data;
+
+public:
+  // What a search needs from the index at one moment: the mapped index and
+  // the overlay. Cheap to copy and safe to use from any thread.
+  class Lookup {
+  public:
+    bool isValid() const { return d != nullptr; }
+    // Absolute paths of the files that may contain a match. Returns false
+    // when the query requires no trigram (too short, or an alternation at
+    // the top level of a regex) and every file has to be scanned.
+    bool candidates(const SearchEngine::Query &query, QStringList *paths) const;
+
+  private:
+    friend class TrigramIndex;
+
+    std::shared_ptr<const Data> d;
+    QSet<QString> dirtyFiles;
+    QSet<QString> dirtyDirs;
+  };
+
+  explicit TrigramIndex(QObject *parent = nullptr);
+  ~TrigramIndex();
+
+  // Loads or builds the index of `path`; an empty path drops it
+  void setRootPath(const QString &path);
+  // Reports a file or directory changed since the index was built
+  void invalidate(const QString &path);
+  // Checks the whole tree against the index again, as after change events
+  // were lost
+  void refresh();
+
+  bool isReady() const { return m_data != nullptr; }
+  Lookup lookup() const;
+
+signals:
+  void readyChanged(bool ready);
+
+private:
+  void cancel();
+  void load();
+  void rebuild();
+  void maybeScheduleRebuild();
+  void receive(int generation, std::shared_ptr<const Data> data,
+               QStringList changedFiles, bool rebuilt);
+
+  QString m_rootPath;
+  QString m_indexPath;
+  std::shared_ptr<const Data> m_data;
+  QSet<QString> m_dirtyFiles;
+  QSet<QString> m_dirtyDirs;
+  // Changes reported while a rebuild runs, which it may have missed
+  bool m_building;
+  QSet<QString> m_dirtyFilesSinceBuild;
+  QSet<QString> m_dirtyDirsSinceBuild;
+
+  int m_generation;
+  std::shared_ptr<std::atomic<bool>> m_cancelled;
+  QTimer *m_rebuildTimer;
+  QThreadPool m_pool;
+};
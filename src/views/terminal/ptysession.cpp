@@ -0,0 +1,264 @@
+#include "ptysession.h"
+#include <QDebug>
+#include <QFile>
+#include <QProcessEnvironment>
+#include <QSocketNotifier>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(Q_OS_MACOS)
+#include <util.h>
+#elif defined(Q_OS_FREEBSD)
+#include <libutil.h>
+#else
+#include <pty.h>
+#endif
+#endif
+
+namespace {
+// Output is read in chunks of this size...
+constexpr qsizetype kReadChunk = 64 * 1024;
+// ...and handed on in one piece of up to this much, so a flood of output
+// neither becomes thousands of small signals nor starves the event loop
+constexpr qsizetype kMaxReadPerWake = 1024 * 1024;
+} // namespace
+
+PtySession::PtySession(QObject *parent)
+    : QObject(parent), m_fd(-1), m_pid(-1), m_columns(80), m_rows(24),
+      m_readNotifier(nullptr), m_writeNotifier(nullptr) {}
+
+PtySession::~PtySession() {
+    delete m_readNotifier;
+    delete m_writeNotifier;
+#ifdef Q_OS_UNIX
+    if (m_fd >= 0) {
+        // Hangs up the terminal, which sends the shell SIGHUP
+        ::close(m_fd);
+    }
+    if (m_pid > 0) {
+        const pid_t pid = pid_t(m_pid);
+        ::kill(pid, SIGHUP);
+        for (int attempt = 0; attempt < 50; ++attempt) {
+            if (::waitpid(pid, nullptr, WNOHANG) != 0) {
+                return;
+            }
+            ::usleep(2000);
+        }
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+    }
+#endif
+}
+
+bool PtySession::start(const QString &workingDirectory, int columns, int rows) {
+    if (isRunning()) {
+        return true;
+    }
+    m_columns = qMax(1, columns);
+    m_rows = qMax(1, rows);
+
+#ifdef Q_OS_UNIX
+    QByteArray shell = qgetenv("SHELL");
+    if (shell.isEmpty() || ::access(shell.constData(), X_OK) != 0) {
+        shell = "/bin/sh";
+    }
+
+    // Only async-signal-safe calls are allowed between fork and exec in a
+    // threaded program, so the arguments and environment are built here
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("TERM", "xterm-256color");
+    environment.insert("COLORTERM", "truecolor");
+    if (!workingDirectory.isEmpty()) {
+        environment.insert("PWD", workingDirectory);
+    }
+    QList<QByteArray> variables;
+    for (const QString &variable : environment.toStringList()) {
+        variables.append(variable.toLocal8Bit());
+    }
+    std::vector<char *> envp;
+    for (QByteArray &variable : variables) {
+        envp.push_back(variable.data());
+    }
+    envp.push_back(nullptr);
+    QByteArray program = shell;
+    char *argv[] = {program.data(), nullptr};
+    const QByteArray directory = QFile::encodeName(workingDirectory);
+
+    struct winsize size {};
+    size.ws_col = static_cast<unsigned short>(m_columns);
+    size.ws_row = static_cast<unsigned short>(m_rows);
+
+    int fd = -1;
+    const pid_t pid = ::forkpty(&fd, nullptr, nullptr, &size);
+    if (pid < 0) {
+        qWarning() << "Cannot create a pseudo-terminal:" << strerror(errno);
+        return false;
+    }
+    if (pid == 0) {
+        // The child inherits the GUI's signal mask and ignored signals,
+        // which would carry over into every command the shell runs
+        sigset_t signals;
+        sigemptyset(&signals);
+        ::sigprocmask(SIG_SETMASK, &signals, nullptr);
+        for (int number : {SIGINT, SIGQUIT, SIGPIPE, SIGCHLD, SIGHUP, SIGTERM}) {
+            ::signal(number, SIG_DFL);
+        }
+        if (!directory.isEmpty()) {
+            (void)::chdir(directory.constData());
+        }
+        ::execve(argv[0], argv, envp.data());
+        ::_exit(127);
+    }
+
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    // Other children, such as language servers, must not keep it open
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    m_fd = fd;
+    m_pid = pid;
+
+    m_readNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_readNotifier, &QSocketNotifier::activated, this, [this]() { readOutput(); });
+    m_writeNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Write, this);
+    m_writeNotifier->setEnabled(false);
+    connect(m_writeNotifier, &QSocketNotifier::activated, this, [this]() { writePending(); });
+    return true;
+#else
+    Q_UNUSED(workingDirectory);
+    qWarning() << "Pseudo-terminals are not supported on this platform";
+    return false;
+#endif
+}
+
+void PtySession::write(const QByteArray &data) {
+    if (!isRunning() || data.isEmpty()) {
+        return;
+    }
+    m_pendingInput.append(data);
+    writePending();
+}
+
+void PtySession::resize(int columns, int rows) {
+    columns = qMax(1, columns);
+    rows = qMax(1, rows);
+    if (columns == m_columns && rows == m_rows) {
+        return;
+    }
+    m_columns = columns;
+    m_rows = rows;
+#ifdef Q_OS_UNIX
+    if (m_fd >= 0) {
+        struct winsize size {};
+        size.ws_col = static_cast<unsigned short>(m_columns);
+        size.ws_row = static_cast<unsigned short>(m_rows);
+        ::ioctl(m_fd, TIOCSWINSZ, &size);
+    }
+#endif
+}
+
+void PtySession::interrupt() {
+#ifdef Q_OS_UNIX
+    if (!isRunning()) {
+        return;
+    }
+    // Programs that read ^C themselves (ssh, editors, tmux) turn off ISIG;
+    // they get the character, as they would from a real terminal
+    struct termios attributes {};
+    if (::tcgetattr(m_fd, &attributes) == 0 &&
+        (!(attributes.c_lflag & ISIG) || attributes.c_cc[VINTR] != '\x03')) {
+        write("\x03");
+        return;
+    }
+    // Typed input the job has not read yet goes with it, as with ^C
+    m_pendingInput.clear();
+    m_writeNotifier->setEnabled(false);
+    const pid_t group = ::tcgetpgrp(m_fd);
+    if (group > 0) {
+        ::killpg(group, SIGINT);
+    } else {
+        ::kill(pid_t(m_pid), SIGINT);
+    }
+#endif
+}
+
+void PtySession::readOutput() {
+#ifdef Q_OS_UNIX
+    QByteArray output;
+    bool closed = false;
+    while (output.size() < kMaxReadPerWake) {
+        const qsizetype offset = output.size();
+        output.resize(offset + kReadChunk);
+        const ssize_t length = ::read(m_fd, output.data() + offset, size_t(kReadChunk));
+        output.resize(offset + qMax<qsizetype>(0, length));
+        if (length > 0) {
+            continue;
+        }
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        // EAGAIN once drained; EIO or end of file once the last process
+        // holding the terminal is gone
+        closed = length == 0 || errno != EAGAIN;
+        break;
+    }
+    if (!output.isEmpty()) {
+        emit dataReceived(output);
+    }
+    if (closed) {
+        reap();
+    }
+#endif
+}
+
+void PtySession::writePending() {
+#ifdef Q_OS_UNIX
+    while (!m_pendingInput.isEmpty()) {
+        const ssize_t written =
+            ::write(m_fd, m_pendingInput.constData(), size_t(m_pendingInput.size()));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                // The shell is gone; reading notices and reaps it
+                m_pendingInput.clear();
+            }
+            break;
+        }
+        m_pendingInput.remove(0, written);
+    }
+    m_writeNotifier->setEnabled(!m_pendingInput.isEmpty());
+#endif
+}
+
+void PtySession::reap() {
+#ifdef Q_OS_UNIX
+    // Called from the read notifier's own signal
+    m_readNotifier->setEnabled(false);
+    m_readNotifier->deleteLater();
+    m_readNotifier = nullptr;
+    m_writeNotifier->setEnabled(false);
+    m_writeNotifier->deleteLater();
+    m_writeNotifier = nullptr;
+    ::close(m_fd);
+    m_fd = -1;
+    m_pendingInput.clear();
+
+    // The shell closed the terminal on its way out, so this does not wait
+    // for long
+    int status = 0;
+    int exitCode = -1;
+    if (::waitpid(pid_t(m_pid), &status, 0) > 0) {
+        exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    m_pid = -1;
+    emit finished(exitCode);
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+class QSocketNotifier;
+
+// One interactive shell on a pseudo-terminal, alive for as long as its
+// terminal is. The shell does its own line editing, history, completion and
+// job control; this only moves bytes between it and the widget, tells it the
+// window size, and signals its foreground job.
+class PtySession : public QObject {
+  Q_OBJECT
+
+public:
+  explicit PtySession(QObject *parent = nullptr);
+  ~PtySession();
+
+  // Starts $SHELL (or /bin/sh) in `workingDirectory` with a window of the
+  // given size. False when the pseudo-terminal cannot be created, or on
+  // platforms without one.
+  bool start(const QString &workingDirectory, int columns, int rows);
+  bool isRunning() const { return m_pid > 0; }
+
+  // Queues input for the shell as if typed; what the terminal cannot take
+  // at once is written as it drains
+  void write(const QByteArray &data);
+  // Sets the window size with TIOCSWINSZ; the kernel sends SIGWINCH to the
+  // foreground job
+  void resize(int columns, int rows);
+  // ^C: sends SIGINT to the foreground process group, as the line
+  // discipline would, without going through the input queue. When the
+  // job has turned signals off (ISIG clear), or ^C is not its interrupt
+  // character, the character itself is written instead.
+  void interrupt();
+
+signals:
+  // Raw output, in the order the terminal produced it. Chunks may end in
+  // the middle of a UTF-8 character or an escape sequence.
+  void dataReceived(const QByteArray &data);
+  // The shell exited; the session can be started again
+  void finished(int exitCode);
+
+private:
+  void readOutput();
+  void writePending();
+  void reap();
+
+  int m_fd;
+  qint64 m_pid;
+  int m_columns;
+  int m_rows;
+  QByteArray m_pendingInput;
+  QSocketNotifier *m_readNotifier;
+  QSocketNotifier *m_writeNotifier;
+};
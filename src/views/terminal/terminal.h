@@ -19,7 +19,6 @@ public:
 
   // Terminal specific methods
   void createNewTerminalTab();
-  void setIntelligentIndent(bool enabled);
 
 private slots:
   void addNewTab();
@@ -31,7 +30,6 @@ private slots:
 private:
   QTabWidget *tabWidget;
   QList<QSplitter *> splitters;
-  bool m_intelligentIndent;
 
   void setupUI();
   void createToolBar();
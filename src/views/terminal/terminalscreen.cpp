@@ -0,0 +1,1076 @@
+#include "terminalscreen.h"
+#include <QChar>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+constexpr int kTabWidth = 8;
+
+struct CodepointRange {
+    char32_t first;
+    char32_t last;
+};
+
+// East Asian Wide and Fullwidth characters, which take two cells
+constexpr CodepointRange kWideRanges[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},   {0x23E9, 0x23EC},
+    {0x23F0, 0x23F0},   {0x23F3, 0x23F3},   {0x25FD, 0x25FE},   {0x2614, 0x2615},
+    {0x2648, 0x2653},   {0x267F, 0x267F},   {0x2693, 0x2693},   {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},   {0x26CE, 0x26CE},
+    {0x26D4, 0x26D4},   {0x26EA, 0x26EA},   {0x26F2, 0x26F3},   {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA},   {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},
+    {0x2728, 0x2728},   {0x274C, 0x274C},   {0x274E, 0x274E},   {0x2753, 0x2755},
+    {0x2757, 0x2757},   {0x2795, 0x2797},   {0x27B0, 0x27B0},   {0x27BF, 0x27BF},
+    {0x2B1B, 0x2B1C},   {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x2E80, 0x303E},
+    {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},   {0xA000, 0xA4CF},
+    {0xA960, 0xA97F},   {0xAC00, 0xD7A3},   {0xF900, 0xFAFF},   {0xFE10, 0xFE19},
+    {0xFE30, 0xFE6F},   {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+    {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F64F},
+    {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+// The DEC special graphics set, from '_' to '~'
+constexpr char16_t kLineDrawing[] = {
+    u' ',      u'◆', u'▒', u'␉', u'␌', u'␍', u'␊', u'°',
+    u'±', u'␤', u'␋', u'┘', u'┐', u'┌', u'└', u'┼',
+    u'⎺', u'⎻', u'─', u'⎼', u'⎽', u'├', u'┤', u'┴',
+    u'┬', u'│', u'≤', u'≥', u'π', u'≠', u'£', u'·',
+};
+
+// Cells a character takes: 0 for combining marks, which are not kept
+int characterWidth(char32_t codepoint) {
+    if (codepoint < 0x300) {
+        return 1;
+    }
+    switch (QChar::category(codepoint)) {
+    case QChar::Mark_NonSpacing:
+    case QChar::Mark_Enclosing:
+    case QChar::Other_Format:
+        return 0;
+    default:
+        break;
+    }
+    auto it = std::upper_bound(std::begin(kWideRanges), std::end(kWideRanges), codepoint,
+                               [](char32_t value, const CodepointRange &range) {
+                                   return value < range.first;
+                               });
+    return it != std::begin(kWideRanges) && codepoint <= std::prev(it)->last ? 2 : 1;
+}
+
+// Reads "38;5;n", "38;2;r;g;b" or their ':' forms starting at `index`.
+// Returns the index of the last parameter used.
+int extendedColor(const TerminalParams &params, int index, quint32 *color) {
+    if (params.isSubparameter(index + 1)) {
+        int last = index + 1;
+        while (params.isSubparameter(last + 1)) {
+            ++last;
+        }
+        const int kind = params.value(index + 1, 0);
+        if (kind == 5) {
+            *color = TerminalCell::indexedColor(params.value(index + 2, 0));
+        } else if (kind == 2) {
+            // "38:2:r:g:b", or with a colour space id as in "38:2::r:g:b"
+            const int red = last - index >= 5 ? index + 3 : index + 2;
+            *color = TerminalCell::rgbColor(params.value(red, 0), params.value(red + 1, 0),
+                                            params.value(red + 2, 0));
+        }
+        return last;
+    }
+
+    const int kind = params.value(index + 1, 0);
+    if (kind == 5) {
+        *color = TerminalCell::indexedColor(params.value(index + 2, 0));
+        return qMin(index + 2, params.count - 1);
+    }
+    if (kind == 2) {
+        *color = TerminalCell::rgbColor(params.value(index + 2, 0), params.value(index + 3, 0),
+                                        params.value(index + 4, 0));
+        return qMin(index + 4, params.count - 1);
+    }
+    return qMin(index + 1, params.count - 1);
+}
+} // namespace
+
+TerminalScreen::TerminalScreen(int rows, int columns, int scrollbackLines)
+    : m_rows(qMax(1, rows)), m_columns(qMax(1, columns)),
+      m_scrollbackLines(qMax(0, scrollbackLines)), m_alternate(false), m_scrollTop(0),
+      m_scrollBottom(m_rows - 1), m_autoWrap(true), m_insertMode(false), m_newLineMode(false),
+      m_cursorVisible(true), m_applicationCursorKeys(false), m_bracketedPaste(false),
+      m_lineDrawing(false), m_lastPrinted(U' '), m_anyDirty(false), m_bells(0) {
+    allocate(m_mainBuffer, m_rows + m_scrollbackLines);
+    allocate(m_alternateBuffer, m_rows);
+    m_dirty.assign(size_t(m_rows), 1);
+    m_anyDirty = true;
+    resetTabStops();
+}
+
+void TerminalScreen::allocate(Buffer &buffer, int capacity) {
+    buffer.cells.clear();
+    buffer.wrapped.clear();
+    buffer.capacity = capacity;
+    buffer.first = 0;
+    buffer.count = 0;
+    for (int i = 0; i < m_rows; ++i) {
+        appendLine(buffer);
+    }
+}
+
+void TerminalScreen::appendLine(Buffer &buffer) {
+    if (buffer.count < buffer.capacity) {
+        // Still filling the ring; slots are in line order
+        buffer.cells.resize(size_t(buffer.count + 1) * size_t(m_columns), blank());
+        buffer.wrapped.push_back(0);
+        ++buffer.count;
+        return;
+    }
+    // The oldest line is reused as the newest
+    buffer.first = (buffer.first + 1) % buffer.capacity;
+    ++buffer.dropped;
+    clearCells(buffer.line(buffer.count - 1, m_columns), m_columns);
+    buffer.wrappedFlag(buffer.count - 1) = 0;
+}
+
+void TerminalScreen::resize(int rows, int columns) {
+    rows = qMax(1, rows);
+    columns = qMax(1, columns);
+    if (rows == m_rows && columns == m_columns) {
+        return;
+    }
+
+    Buffer &primary = m_mainBuffer;
+    const int oldColumns = m_columns;
+    const int cursorLine = primary.count - m_rows + (m_alternate ? m_rows - 1 : m_cursor.row);
+    int count = primary.count;
+    if (rows < m_rows && !m_alternate) {
+        // Lines below the cursor go first, so the prompt does not move up
+        count -= qMin(m_rows - rows, m_rows - 1 - m_cursor.row);
+    }
+
+    const int capacity = rows + m_scrollbackLines;
+    const int keep = qMin(count, capacity);
+    const int skipped = count - keep;
+    const int copied = qMin(oldColumns, columns);
+    std::vector<TerminalCell> cells(size_t(keep) * size_t(columns));
+    std::vector<quint8> wrapped(static_cast<size_t>(keep));
+    for (int i = 0; i < keep; ++i) {
+        const TerminalCell *source = primary.line(skipped + i, oldColumns);
+        TerminalCell *target = &cells[size_t(i) * size_t(columns)];
+        std::copy_n(source, copied, target);
+        if (copied < oldColumns && (target[copied - 1].flags & TerminalCell::Wide)) {
+            target[copied - 1] = TerminalCell();
+        }
+        wrapped[size_t(i)] = primary.wrappedFlag(skipped + i);
+    }
+    primary.cells.swap(cells);
+    primary.wrapped.swap(wrapped);
+    primary.dropped += skipped;
+    primary.first = 0;
+    primary.count = keep;
+    primary.capacity = capacity;
+
+    m_rows = rows;
+    m_columns = columns;
+    while (primary.count < m_rows) {
+        appendLine(primary);
+    }
+    allocate(m_alternateBuffer, m_rows);
+
+    if (m_alternate) {
+        m_cursor.row = qMin(m_cursor.row, m_rows - 1);
+    } else {
+        m_cursor.row = qBound(0, cursorLine - skipped - (primary.count - m_rows), m_rows - 1);
+    }
+    m_cursor.column = qMin(m_cursor.column, m_columns - 1);
+    m_cursor.pendingWrap = false;
+    m_savedCursor.row = qMin(m_savedCursor.row, m_rows - 1);
+    m_savedCursor.column = qMin(m_savedCursor.column, m_columns - 1);
+    m_scrollTop = 0;
+    m_scrollBottom = m_rows - 1;
+    resetTabStops();
+    m_dirty.assign(size_t(m_rows), 1);
+    m_anyDirty = true;
+}
+
+bool TerminalScreen::isWrapped(int index) const {
+    const Buffer &lines = buffer();
+    return lines.wrapped[size_t((lines.first + index) % lines.capacity)] != 0;
+}
+
+QString TerminalScreen::lineText(int index) const {
+    const TerminalCell *cells = line(index);
+    QString text;
+    text.reserve(m_columns);
+    for (int column = 0; column < m_columns; ++column) {
+        const TerminalCell &cell = cells[column];
+        if (cell.flags & TerminalCell::WideTail) {
+            continue;
+        }
+        const char32_t codepoint = cell.codepoint;
+        if (QChar::requiresSurrogates(codepoint)) {
+            text += QChar(QChar::highSurrogate(codepoint));
+            text += QChar(QChar::lowSurrogate(codepoint));
+        } else {
+            text += QChar(char16_t(codepoint));
+        }
+    }
+    return text;
+}
+
+void TerminalScreen::clearDirty() {
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+    m_anyDirty = false;
+}
+
+QByteArray TerminalScreen::takeResponse() {
+    QByteArray response;
+    response.swap(m_response);
+    return response;
+}
+
+int TerminalScreen::takeBells() {
+    const int bells = m_bells;
+    m_bells = 0;
+    return bells;
+}
+
+TerminalCell *TerminalScreen::row(int screenRow) {
+    Buffer &lines = buffer();
+    return lines.line(lines.count - m_rows + screenRow, m_columns);
+}
+
+TerminalCell TerminalScreen::blank() const {
+    // Erased cells take the current background, as xterm's do
+    TerminalCell cell;
+    cell.background = m_cursor.background;
+    return cell;
+}
+
+void TerminalScreen::markDirty(int screenRow) {
+    m_dirty[size_t(screenRow)] = 1;
+    m_anyDirty = true;
+}
+
+void TerminalScreen::markAllDirty() {
+    std::fill(m_dirty.begin(), m_dirty.end(), 1);
+    m_anyDirty = true;
+}
+
+void TerminalScreen::clearCells(TerminalCell *cells, int count) {
+    std::fill_n(cells, count, blank());
+}
+
+void TerminalScreen::splitWideCharacters(int screenRow, int fromColumn, int toColumn) {
+    TerminalCell *cells = row(screenRow);
+    if (fromColumn > 0 && fromColumn < m_columns &&
+        (cells[fromColumn].flags & TerminalCell::WideTail)) {
+        cells[fromColumn - 1].codepoint = U' ';
+        cells[fromColumn - 1].flags &= ~TerminalCell::Wide;
+    }
+    if (toColumn > 0 && toColumn < m_columns && (cells[toColumn].flags & TerminalCell::WideTail)) {
+        cells[toColumn].codepoint = U' ';
+        cells[toColumn].flags &= ~TerminalCell::WideTail;
+    }
+}
+
+void TerminalScreen::print(char32_t codepoint) {
+    if (m_lineDrawing && codepoint >= U'_' && codepoint <= U'~') {
+        codepoint = kLineDrawing[codepoint - U'_'];
+    }
+    const int width = characterWidth(codepoint);
+    if (width == 0) {
+        return;
+    }
+    if (width > m_columns) {
+        return;
+    }
+    if (width == 2 && m_cursor.column == m_columns - 1 && m_autoWrap) {
+        // Does not fit; the line wraps early
+        m_cursor.pendingWrap = true;
+    }
+    wrapIfPending();
+    if (m_insertMode) {
+        insertCharacters(width);
+    }
+
+    const int column = qMin(m_cursor.column, m_columns - width);
+    TerminalCell *cells = row(m_cursor.row);
+    splitWideCharacters(m_cursor.row, column, column + width);
+    TerminalCell cell;
+    cell.codepoint = codepoint;
+    cell.foreground = m_cursor.foreground;
+    cell.background = m_cursor.background;
+    cell.flags = m_cursor.flags | (width == 2 ? quint32(TerminalCell::Wide) : 0u);
+    cells[column] = cell;
+    if (width == 2) {
+        cell.codepoint = 0;
+        cell.flags = m_cursor.flags | TerminalCell::WideTail;
+        cells[column + 1] = cell;
+    }
+    m_lastPrinted = codepoint;
+    markDirty(m_cursor.row);
+
+    if (column + width >= m_columns) {
+        m_cursor.column = m_columns - 1;
+        m_cursor.pendingWrap = m_autoWrap;
+    } else {
+        m_cursor.column = column + width;
+    }
+}
+
+void TerminalScreen::printAscii(const char *text, int length) {
+    if (m_lineDrawing || m_insertMode) {
+        for (int i = 0; i < length; ++i) {
+            print(char32_t(uchar(text[i])));
+        }
+        return;
+    }
+
+    TerminalCell cell;
+    cell.foreground = m_cursor.foreground;
+    cell.background = m_cursor.background;
+    cell.flags = m_cursor.flags;
+    int i = 0;
+    while (i < length) {
+        wrapIfPending();
+        // As much as fits on the cursor's line, in one go
+        const int column = m_cursor.column;
+        const int run = qMin(m_columns - column, length - i);
+        TerminalCell *cells = row(m_cursor.row);
+        splitWideCharacters(m_cursor.row, column, column + run);
+        for (int k = 0; k < run; ++k) {
+            cell.codepoint = uchar(text[i + k]);
+            cells[column + k] = cell;
+        }
+        markDirty(m_cursor.row);
+        i += run;
+        if (column + run >= m_columns) {
+            m_cursor.column = m_columns - 1;
+            m_cursor.pendingWrap = m_autoWrap;
+        } else {
+            m_cursor.column = column + run;
+        }
+    }
+    if (length > 0) {
+        m_lastPrinted = uchar(text[length - 1]);
+    }
+}
+
+void TerminalScreen::wrapIfPending() {
+    if (!m_cursor.pendingWrap) {
+        return;
+    }
+    m_cursor.pendingWrap = false;
+    Buffer &lines = buffer();
+    lines.wrappedFlag(lines.count - m_rows + m_cursor.row) = 1;
+    m_cursor.column = 0;
+    lineFeed();
+}
+
+void TerminalScreen::executeControl(char control) {
+    switch (control) {
+    case '\a':
+        ++m_bells;
+        break;
+    case '\b':
+        m_cursor.pendingWrap = false;
+        if (m_cursor.column > 0) {
+            --m_cursor.column;
+        }
+        break;
+    case '\t': {
+        int column = m_cursor.column + 1;
+        while (column < m_columns - 1 && !m_tabStops[size_t(column)]) {
+            ++column;
+        }
+        m_cursor.column = qMin(column, m_columns - 1);
+        m_cursor.pendingWrap = false;
+        break;
+    }
+    case '\n':
+    case '\v':
+    case '\f':
+        lineFeed();
+        if (m_newLineMode) {
+            m_cursor.column = 0;
+        }
+        break;
+    case '\r':
+        m_cursor.column = 0;
+        m_cursor.pendingWrap = false;
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::lineFeed() {
+    m_cursor.pendingWrap = false;
+    if (m_cursor.row == m_scrollBottom) {
+        scrollUp(m_scrollTop, m_scrollBottom, 1, true);
+    } else if (m_cursor.row < m_rows - 1) {
+        ++m_cursor.row;
+    }
+}
+
+void TerminalScreen::reverseIndex() {
+    m_cursor.pendingWrap = false;
+    if (m_cursor.row == m_scrollTop) {
+        scrollDown(m_scrollTop, m_scrollBottom, 1);
+    } else if (m_cursor.row > 0) {
+        --m_cursor.row;
+    }
+}
+
+void TerminalScreen::scrollUp(int top, int bottom, int count, bool intoScrollback) {
+    count = qBound(0, count, bottom - top + 1);
+    if (count == 0) {
+        return;
+    }
+    Buffer &lines = buffer();
+    if (intoScrollback && !m_alternate && top == 0 && bottom == m_rows - 1) {
+        // The ring turns; no cells move
+        for (int i = 0; i < count; ++i) {
+            appendLine(lines);
+        }
+        markAllDirty();
+        return;
+    }
+
+    const int base = lines.count - m_rows;
+    for (int r = top; r + count <= bottom; ++r) {
+        std::copy_n(lines.line(base + r + count, m_columns), m_columns,
+                    lines.line(base + r, m_columns));
+        lines.wrappedFlag(base + r) = lines.wrappedFlag(base + r + count);
+    }
+    for (int r = bottom - count + 1; r <= bottom; ++r) {
+        clearCells(lines.line(base + r, m_columns), m_columns);
+        lines.wrappedFlag(base + r) = 0;
+    }
+    for (int r = top; r <= bottom; ++r) {
+        markDirty(r);
+    }
+}
+
+void TerminalScreen::scrollDown(int top, int bottom, int count) {
+    count = qBound(0, count, bottom - top + 1);
+    if (count == 0) {
+        return;
+    }
+    Buffer &lines = buffer();
+    const int base = lines.count - m_rows;
+    for (int r = bottom; r - count >= top; --r) {
+        std::copy_n(lines.line(base + r - count, m_columns), m_columns,
+                    lines.line(base + r, m_columns));
+        lines.wrappedFlag(base + r) = lines.wrappedFlag(base + r - count);
+    }
+    for (int r = top; r < top + count; ++r) {
+        clearCells(lines.line(base + r, m_columns), m_columns);
+        lines.wrappedFlag(base + r) = 0;
+    }
+    for (int r = top; r <= bottom; ++r) {
+        markDirty(r);
+    }
+}
+
+void TerminalScreen::moveCursor(int row, int column) {
+    if (m_cursor.originMode) {
+        row = qBound(m_scrollTop, row + m_scrollTop, m_scrollBottom);
+    } else {
+        row = qBound(0, row, m_rows - 1);
+    }
+    m_cursor.row = row;
+    m_cursor.column = qBound(0, column, m_columns - 1);
+    m_cursor.pendingWrap = false;
+}
+
+void TerminalScreen::moveCursorRelative(int rows, int columns) {
+    // Stops at the margins when it starts between them
+    const int top = m_cursor.row >= m_scrollTop ? m_scrollTop : 0;
+    const int bottom = m_cursor.row <= m_scrollBottom ? m_scrollBottom : m_rows - 1;
+    m_cursor.row = qBound(top, m_cursor.row + rows, bottom);
+    m_cursor.column = qBound(0, m_cursor.column + columns, m_columns - 1);
+    m_cursor.pendingWrap = false;
+}
+
+void TerminalScreen::eraseCells(int screenRow, int fromColumn, int toColumn) {
+    fromColumn = qBound(0, fromColumn, m_columns);
+    toColumn = qBound(fromColumn, toColumn, m_columns);
+    if (fromColumn == toColumn) {
+        return;
+    }
+    splitWideCharacters(screenRow, fromColumn, toColumn);
+    clearCells(row(screenRow) + fromColumn, toColumn - fromColumn);
+    markDirty(screenRow);
+}
+
+void TerminalScreen::eraseInDisplay(int mode) {
+    switch (mode) {
+    case 0:
+        eraseInLine(0);
+        for (int r = m_cursor.row + 1; r < m_rows; ++r) {
+            eraseCells(r, 0, m_columns);
+        }
+        break;
+    case 1:
+        for (int r = 0; r < m_cursor.row; ++r) {
+            eraseCells(r, 0, m_columns);
+        }
+        eraseInLine(1);
+        break;
+    case 2:
+        for (int r = 0; r < m_rows; ++r) {
+            eraseCells(r, 0, m_columns);
+        }
+        break;
+    case 3:
+        clearScrollback();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::eraseInLine(int mode) {
+    switch (mode) {
+    case 0:
+        eraseCells(m_cursor.row, m_cursor.column, m_columns);
+        break;
+    case 1:
+        eraseCells(m_cursor.row, 0, m_cursor.column + 1);
+        break;
+    case 2:
+        eraseCells(m_cursor.row, 0, m_columns);
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::insertCharacters(int count) {
+    const int column = m_cursor.column;
+    count = qBound(0, count, m_columns - column);
+    if (count == 0) {
+        return;
+    }
+    TerminalCell *cells = row(m_cursor.row);
+    splitWideCharacters(m_cursor.row, column, m_columns - count);
+    std::copy_backward(cells + column, cells + m_columns - count, cells + m_columns);
+    clearCells(cells + column, count);
+    if (cells[m_columns - 1].flags & TerminalCell::Wide) {
+        // Its second half was pushed off the edge
+        cells[m_columns - 1] = blank();
+    }
+    m_cursor.pendingWrap = false;
+    markDirty(m_cursor.row);
+}
+
+void TerminalScreen::deleteCharacters(int count) {
+    const int column = m_cursor.column;
+    count = qBound(0, count, m_columns - column);
+    if (count == 0) {
+        return;
+    }
+    TerminalCell *cells = row(m_cursor.row);
+    splitWideCharacters(m_cursor.row, column, column + count);
+    std::copy(cells + column + count, cells + m_columns, cells + column);
+    clearCells(cells + m_columns - count, count);
+    m_cursor.pendingWrap = false;
+    markDirty(m_cursor.row);
+}
+
+void TerminalScreen::insertLines(int count) {
+    if (m_cursor.row < m_scrollTop || m_cursor.row > m_scrollBottom) {
+        return;
+    }
+    scrollDown(m_cursor.row, m_scrollBottom, count);
+    m_cursor.column = 0;
+    m_cursor.pendingWrap = false;
+}
+
+void TerminalScreen::deleteLines(int count) {
+    if (m_cursor.row < m_scrollTop || m_cursor.row > m_scrollBottom) {
+        return;
+    }
+    scrollUp(m_cursor.row, m_scrollBottom, count);
+    m_cursor.column = 0;
+    m_cursor.pendingWrap = false;
+}
+
+void TerminalScreen::setScrollRegion(int top, int bottom) {
+    top = qBound(0, top, m_rows - 1);
+    bottom = qBound(0, bottom, m_rows - 1);
+    if (top >= bottom) {
+        return;
+    }
+    m_scrollTop = top;
+    m_scrollBottom = bottom;
+    moveCursor(0, 0);
+}
+
+void TerminalScreen::setMode(int mode, bool privateMode, bool enabled) {
+    if (!privateMode) {
+        if (mode == 4) {
+            m_insertMode = enabled;
+        } else if (mode == 20) {
+            m_newLineMode = enabled;
+        }
+        return;
+    }
+
+    switch (mode) {
+    case 1:
+        m_applicationCursorKeys = enabled;
+        break;
+    case 6:
+        m_cursor.originMode = enabled;
+        moveCursor(0, 0);
+        break;
+    case 7:
+        m_autoWrap = enabled;
+        break;
+    case 25:
+        m_cursorVisible = enabled;
+        markDirty(m_cursor.row);
+        break;
+    case 47:
+    case 1047:
+        setAlternateScreen(enabled);
+        break;
+    case 1048:
+        if (enabled) {
+            saveCursor();
+        } else {
+            restoreCursor();
+        }
+        break;
+    case 1049:
+        if (enabled) {
+            saveCursor();
+            setAlternateScreen(true);
+        } else {
+            setAlternateScreen(false);
+            restoreCursor();
+        }
+        break;
+    case 2004:
+        m_bracketedPaste = enabled;
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::selectGraphicRendition(const TerminalParams &params) {
+    Cursor &pen = m_cursor;
+    if (params.count == 0) {
+        pen.foreground = TerminalCell::DefaultColor;
+        pen.background = TerminalCell::DefaultColor;
+        pen.flags = 0;
+        return;
+    }
+
+    for (int i = 0; i < params.count; ++i) {
+        const int code = params.value(i, 0);
+        switch (code) {
+        case 0:
+            pen.foreground = TerminalCell::DefaultColor;
+            pen.background = TerminalCell::DefaultColor;
+            pen.flags = 0;
+            break;
+        case 1:
+            pen.flags |= TerminalCell::Bold;
+            break;
+        case 2:
+            pen.flags |= TerminalCell::Faint;
+            break;
+        case 3:
+            pen.flags |= TerminalCell::Italic;
+            break;
+        case 4:
+            // "4:0" turns underlining off; other styles all draw the same
+            if (params.isSubparameter(i + 1) && params.value(i + 1, 1) == 0) {
+                pen.flags &= ~TerminalCell::Underline;
+            } else {
+                pen.flags |= TerminalCell::Underline;
+            }
+            break;
+        case 5:
+        case 6:
+            pen.flags |= TerminalCell::Blink;
+            break;
+        case 7:
+            pen.flags |= TerminalCell::Inverse;
+            break;
+        case 8:
+            pen.flags |= TerminalCell::Invisible;
+            break;
+        case 9:
+            pen.flags |= TerminalCell::Strikeout;
+            break;
+        case 21:
+            pen.flags |= TerminalCell::Underline;
+            break;
+        case 22:
+            pen.flags &= ~(TerminalCell::Bold | TerminalCell::Faint);
+            break;
+        case 23:
+            pen.flags &= ~TerminalCell::Italic;
+            break;
+        case 24:
+            pen.flags &= ~TerminalCell::Underline;
+            break;
+        case 25:
+            pen.flags &= ~TerminalCell::Blink;
+            break;
+        case 27:
+            pen.flags &= ~TerminalCell::Inverse;
+            break;
+        case 28:
+            pen.flags &= ~TerminalCell::Invisible;
+            break;
+        case 29:
+            pen.flags &= ~TerminalCell::Strikeout;
+            break;
+        case 38:
+            i = extendedColor(params, i, &pen.foreground);
+            continue;
+        case 39:
+            pen.foreground = TerminalCell::DefaultColor;
+            break;
+        case 48:
+            i = extendedColor(params, i, &pen.background);
+            continue;
+        case 49:
+            pen.background = TerminalCell::DefaultColor;
+            break;
+        case 58: {
+            // Underline colour, which is not drawn
+            quint32 ignored = 0;
+            i = extendedColor(params, i, &ignored);
+            continue;
+        }
+        default:
+            if (code >= 30 && code <= 37) {
+                pen.foreground = TerminalCell::indexedColor(code - 30);
+            } else if (code >= 40 && code <= 47) {
+                pen.background = TerminalCell::indexedColor(code - 40);
+            } else if (code >= 90 && code <= 97) {
+                pen.foreground = TerminalCell::indexedColor(code - 90 + 8);
+            } else if (code >= 100 && code <= 107) {
+                pen.background = TerminalCell::indexedColor(code - 100 + 8);
+            }
+            break;
+        }
+        while (params.isSubparameter(i + 1)) {
+            ++i;
+        }
+    }
+}
+
+void TerminalScreen::saveCursor() {
+    m_savedCursor = m_cursor;
+}
+
+void TerminalScreen::restoreCursor() {
+    m_cursor = m_savedCursor;
+    m_cursor.row = qMin(m_cursor.row, m_rows - 1);
+    m_cursor.column = qMin(m_cursor.column, m_columns - 1);
+}
+
+void TerminalScreen::setAlternateScreen(bool enabled) {
+    if (enabled == m_alternate) {
+        return;
+    }
+    m_alternate = enabled;
+    if (enabled) {
+        for (int r = 0; r < m_rows; ++r) {
+            clearCells(row(r), m_columns);
+            m_alternateBuffer.wrappedFlag(r) = 0;
+        }
+    }
+    markAllDirty();
+}
+
+void TerminalScreen::clearScrollback() {
+    Buffer &primary = m_mainBuffer;
+    const int scrollback = primary.count - m_rows;
+    if (scrollback == 0) {
+        return;
+    }
+    std::vector<TerminalCell> cells(size_t(m_rows) * size_t(m_columns));
+    std::vector<quint8> wrapped(static_cast<size_t>(m_rows));
+    for (int r = 0; r < m_rows; ++r) {
+        std::copy_n(primary.line(scrollback + r, m_columns), m_columns,
+                    &cells[size_t(r) * size_t(m_columns)]);
+        wrapped[size_t(r)] = primary.wrappedFlag(scrollback + r);
+    }
+    primary.cells.swap(cells);
+    primary.wrapped.swap(wrapped);
+    primary.first = 0;
+    primary.count = m_rows;
+    primary.dropped += scrollback;
+    markAllDirty();
+}
+
+void TerminalScreen::resetTabStops() {
+    m_tabStops.assign(size_t(m_columns), 0);
+    for (int column = kTabWidth; column < m_columns; column += kTabWidth) {
+        m_tabStops[size_t(column)] = 1;
+    }
+}
+
+void TerminalScreen::escDispatch(char intermediate, char final) {
+    if (intermediate == '(') {
+        // G0: '0' is line drawing, anything else taken as ASCII
+        m_lineDrawing = final == '0';
+        return;
+    }
+    if (intermediate == '#' && final == '8') {
+        // DECALN fills the screen with 'E'
+        for (int r = 0; r < m_rows; ++r) {
+            TerminalCell *cells = row(r);
+            for (int column = 0; column < m_columns; ++column) {
+                cells[column] = TerminalCell();
+                cells[column].codepoint = U'E';
+            }
+        }
+        markAllDirty();
+        return;
+    }
+    if (intermediate != 0) {
+        return;
+    }
+
+    switch (final) {
+    case '7':
+        saveCursor();
+        break;
+    case '8':
+        restoreCursor();
+        break;
+    case 'D':
+        lineFeed();
+        break;
+    case 'E':
+        m_cursor.column = 0;
+        lineFeed();
+        break;
+    case 'H':
+        m_tabStops[size_t(m_cursor.column)] = 1;
+        break;
+    case 'M':
+        reverseIndex();
+        break;
+    case 'c':
+        reset();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::csiDispatch(const TerminalParams &params, char privateMarker,
+                                 char intermediate, char final) {
+    // Most counts treat 0 like 1
+    const int count = qMax(1, params.value(0, 1));
+
+    if (privateMarker == '?') {
+        if (intermediate == 0 && (final == 'h' || final == 'l')) {
+            for (int i = 0; i < params.count; ++i) {
+                setMode(params.value(i, 0), true, final == 'h');
+            }
+        }
+        return;
+    }
+    if (privateMarker == '>') {
+        if (final == 'c') {
+            // Secondary device attributes: a VT220
+            m_response += "\x1b[>1;10;0c";
+        }
+        return;
+    }
+    if (privateMarker != 0) {
+        return;
+    }
+    if (intermediate == '!' && final == 'p') {
+        // DECSTR, a soft reset: modes and the pen, not the screen
+        m_cursor.foreground = TerminalCell::DefaultColor;
+        m_cursor.background = TerminalCell::DefaultColor;
+        m_cursor.flags = 0;
+        m_cursor.originMode = false;
+        m_insertMode = false;
+        m_autoWrap = true;
+        m_cursorVisible = true;
+        m_applicationCursorKeys = false;
+        m_scrollTop = 0;
+        m_scrollBottom = m_rows - 1;
+        m_savedCursor = Cursor();
+        return;
+    }
+    if (intermediate != 0) {
+        return;
+    }
+
+    switch (final) {
+    case '@':
+        insertCharacters(count);
+        break;
+    case 'A':
+        moveCursorRelative(-count, 0);
+        break;
+    case 'B':
+    case 'e':
+        moveCursorRelative(count, 0);
+        break;
+    case 'C':
+    case 'a':
+        moveCursorRelative(0, count);
+        break;
+    case 'D':
+        moveCursorRelative(0, -count);
+        break;
+    case 'E':
+        moveCursorRelative(count, 0);
+        m_cursor.column = 0;
+        break;
+    case 'F':
+        moveCursorRelative(-count, 0);
+        m_cursor.column = 0;
+        break;
+    case 'G':
+    case '`':
+        m_cursor.column = qBound(0, count - 1, m_columns - 1);
+        m_cursor.pendingWrap = false;
+        break;
+    case 'H':
+    case 'f':
+        moveCursor(params.value(0, 1) - 1, params.value(1, 1) - 1);
+        break;
+    case 'I':
+        for (int i = 0; i < count; ++i) {
+            executeControl('\t');
+        }
+        break;
+    case 'J':
+        eraseInDisplay(params.value(0, 0));
+        break;
+    case 'K':
+        eraseInLine(params.value(0, 0));
+        break;
+    case 'L':
+        insertLines(count);
+        break;
+    case 'M':
+        deleteLines(count);
+        break;
+    case 'P':
+        deleteCharacters(count);
+        break;
+    case 'S':
+        scrollUp(m_scrollTop, m_scrollBottom, count);
+        break;
+    case 'T':
+        scrollDown(m_scrollTop, m_scrollBottom, count);
+        break;
+    case 'X':
+        eraseCells(m_cursor.row, m_cursor.column, m_cursor.column + count);
+        break;
+    case 'Z':
+        for (int i = 0; i < count; ++i) {
+            int column = m_cursor.column - 1;
+            while (column > 0 && !m_tabStops[size_t(column)]) {
+                --column;
+            }
+            m_cursor.column = qMax(0, column);
+        }
+        m_cursor.pendingWrap = false;
+        break;
+    case 'b':
+        // Repeats the last character printed
+        for (int i = 0; i < qMin(count, m_rows * m_columns); ++i) {
+            print(m_lastPrinted);
+        }
+        break;
+    case 'c':
+        if (params.value(0, 0) == 0) {
+            // Primary device attributes: a VT220 with ANSI colour
+            m_response += "\x1b[?62;22c";
+        }
+        break;
+    case 'd':
+        moveCursor(count - 1, m_cursor.column);
+        break;
+    case 'g':
+        if (params.value(0, 0) == 0) {
+            m_tabStops[size_t(m_cursor.column)] = 0;
+        } else if (params.value(0, 0) == 3) {
+            std::fill(m_tabStops.begin(), m_tabStops.end(), 0);
+        }
+        break;
+    case 'h':
+    case 'l':
+        for (int i = 0; i < params.count; ++i) {
+            setMode(params.value(i, 0), false, final == 'h');
+        }
+        break;
+    case 'm':
+        selectGraphicRendition(params);
+        break;
+    case 'n':
+        if (params.value(0, 0) == 5) {
+            m_response += "\x1b[0n";
+        } else if (params.value(0, 0) == 6) {
+            const int reportedRow =
+                m_cursor.originMode ? m_cursor.row - m_scrollTop : m_cursor.row;
+            m_response += "\x1b[" + QByteArray::number(reportedRow + 1) + ';' +
+                          QByteArray::number(m_cursor.column + 1) + 'R';
+        }
+        break;
+    case 'r':
+        setScrollRegion(params.value(0, 1) - 1, params.value(1, m_rows) - 1);
+        break;
+    case 's':
+        saveCursor();
+        break;
+    case 'u':
+        restoreCursor();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::oscDispatch(const QByteArray &data) {
+    // "0;title" and "2;title" set the window title; the rest is ignored
+    const int separator = data.indexOf(';');
+    if (separator < 0) {
+        return;
+    }
+    const QByteArray command = data.left(separator);
+    if (command == "0" || command == "2") {
+        m_title = QString::fromUtf8(data.mid(separator + 1));
+    }
+}
+
+void TerminalScreen::reset() {
+    m_cursor = Cursor();
+    m_savedCursor = Cursor();
+    setAlternateScreen(false);
+    m_scrollTop = 0;
+    m_scrollBottom = m_rows - 1;
+    m_autoWrap = true;
+    m_insertMode = false;
+    m_newLineMode = false;
+    m_cursorVisible = true;
+    m_applicationCursorKeys = false;
+    m_bracketedPaste = false;
+    m_lineDrawing = false;
+    resetTabStops();
+    for (int r = 0; r < m_rows; ++r) {
+        eraseCells(r, 0, m_columns);
+        m_mainBuffer.wrappedFlag(m_mainBuffer.count - m_rows + r) = 0;
+    }
+    markAllDirty();
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <vector>
+
+// One character cell: 12 bytes. Colours are packed with their kind in the
+// top byte: the default colour, an index into the 256-colour palette, or an
+// RGB value.
+struct TerminalCell {
+  enum Flag : quint32 {
+    Bold = 1 << 0,
+    Faint = 1 << 1,
+    Italic = 1 << 2,
+    Underline = 1 << 3,
+    Blink = 1 << 4,
+    Inverse = 1 << 5,
+    Invisible = 1 << 6,
+    Strikeout = 1 << 7,
+    // The first and second halves of a double-width character; the second
+    // holds no codepoint of its own
+    Wide = 1 << 8,
+    WideTail = 1 << 9,
+  };
+
+  static constexpr quint32 DefaultColor = 0;
+  static constexpr quint32 indexedColor(int index) { return 0x01000000u | quint32(index & 0xFF); }
+  static constexpr quint32 rgbColor(int red, int green, int blue) {
+    return 0x02000000u | quint32(red & 0xFF) << 16 | quint32(green & 0xFF) << 8 |
+           quint32(blue & 0xFF);
+  }
+  static constexpr bool isIndexed(quint32 color) { return (color >> 24) == 1; }
+  static constexpr bool isRgb(quint32 color) { return (color >> 24) == 2; }
+
+  quint32 foreground = DefaultColor;
+  quint32 background = DefaultColor;
+  quint32 codepoint : 21;
+  quint32 flags : 11;
+
+  TerminalCell() : codepoint(U' '), flags(0) {}
+};
+
+// The numeric parameters of a control sequence, without allocating. A
+// parameter left out is -1; one introduced by ':' rather than ';' is a
+// subparameter of the one before it, as in "38:2::255:128:0".
+struct TerminalParams {
+  static constexpr int Max = 32;
+
+  int values[Max];
+  quint32 subparameters = 0;
+  int count = 0;
+
+  int value(int index, int fallback) const {
+    return index < count && values[index] >= 0 ? values[index] : fallback;
+  }
+  bool isSubparameter(int index) const {
+    return index < count && (subparameters & (1u << index));
+  }
+};
+
+// The state of a VT-style terminal: a grid of cells for the screen and the
+// alternate screen, the scrollback above the main screen, the cursor and
+// the modes. Escape sequences arrive already split up by VtParser,
+// through the *Dispatch calls; this only decides what they do to the grid.
+//
+// Lines live in a ring, so scrolling the whole screen into the scrollback
+// moves no cells, and once the scrollback is full the oldest line is
+// reused for the new one. Rows the renderer has to repaint are marked
+// dirty.
+class TerminalScreen {
+public:
+  explicit TerminalScreen(int rows = 24, int columns = 80, int scrollbackLines = 10000);
+
+  int rows() const { return m_rows; }
+  int columns() const { return m_columns; }
+  // Lines are cut or padded to the new width rather than reflowed, and the
+  // cursor's line stays in view
+  void resize(int rows, int columns);
+
+  // Text, the scrollback first: lineCount() - rows() is the first visible
+  // line. The alternate screen has no scrollback.
+  int lineCount() const { return buffer().count; }
+  const TerminalCell *line(int index) const { return buffer().line(index, m_columns); }
+  // The line continues on the next one because it was wrapped, not ended
+  bool isWrapped(int index) const;
+  QString lineText(int index) const;
+  // How many lines have fallen off the top of the scrollback in total,
+  // which keeps positions counted from the first line ever stable
+  qint64 droppedLines() const { return buffer().dropped; }
+
+  int cursorRow() const { return m_cursor.row; }
+  int cursorColumn() const { return m_cursor.column; }
+  bool isCursorVisible() const { return m_cursorVisible; }
+  bool isAlternateScreen() const { return m_alternate; }
+  bool applicationCursorKeys() const { return m_applicationCursorKeys; }
+  bool bracketedPaste() const { return m_bracketedPaste; }
+  QString title() const { return m_title; }
+
+  // Rows of the screen changed since clearDirty()
+  bool isDirty(int row) const { return m_dirty[size_t(row)] != 0; }
+  bool hasDirtyRows() const { return m_anyDirty; }
+  void clearDirty();
+
+  // What the terminal answers to status requests, for the shell to read
+  QByteArray takeResponse();
+  // Bells rung since the last call
+  int takeBells();
+
+  void print(char32_t codepoint);
+  // A run of printable ASCII, the bulk of most output
+  void printAscii(const char *text, int length);
+  // C0 controls: BEL, BS, HT, LF, VT, FF and CR
+  void executeControl(char control);
+  void escDispatch(char intermediate, char final);
+  void csiDispatch(const TerminalParams &params, char privateMarker, char intermediate,
+                   char final);
+  void oscDispatch(const QByteArray &data);
+  // Resets everything but the scrollback, as RIS does
+  void reset();
+
+private:
+  struct Cursor {
+    int row = 0;
+    int column = 0;
+    // The last column was written; the next character wraps first
+    bool pendingWrap = false;
+    quint32 foreground = TerminalCell::DefaultColor;
+    quint32 background = TerminalCell::DefaultColor;
+    quint32 flags = 0;
+    bool originMode = false;
+  };
+
+  struct Buffer {
+    std::vector<TerminalCell> cells;
+    std::vector<quint8> wrapped;
+    // Lines the ring holds at most, and at least `rows`
+    int capacity = 0;
+    // Ring slot of line 0
+    int first = 0;
+    int count = 0;
+    qint64 dropped = 0;
+
+    TerminalCell *line(int index, int columns) {
+      return &cells[size_t((first + index) % capacity) * size_t(columns)];
+    }
+    const TerminalCell *line(int index, int columns) const {
+      return &cells[size_t((first + index) % capacity) * size_t(columns)];
+    }
+    quint8 &wrappedFlag(int index) { return wrapped[size_t((first + index) % capacity)]; }
+  };
+
+  Buffer &buffer() { return m_alternate ? m_alternateBuffer : m_mainBuffer; }
+  const Buffer &buffer() const { return m_alternate ? m_alternateBuffer : m_mainBuffer; }
+  TerminalCell *row(int screenRow);
+  TerminalCell blank() const;
+  void markDirty(int screenRow);
+  void markAllDirty();
+  void clearCells(TerminalCell *cells, int count);
+  // A wide character half of which is overwritten loses the other half
+  void splitWideCharacters(int screenRow, int fromColumn, int toColumn);
+
+  void wrapIfPending();
+  void lineFeed();
+  void reverseIndex();
+  // Only lines scrolled off the top of the whole main screen are kept
+  void scrollUp(int top, int bottom, int count, bool intoScrollback = false);
+  void scrollDown(int top, int bottom, int count);
+  void moveCursor(int row, int column);
+  void moveCursorRelative(int rows, int columns);
+  void eraseInDisplay(int mode);
+  void eraseInLine(int mode);
+  void eraseCells(int screenRow, int fromColumn, int toColumn);
+  void insertCharacters(int count);
+  void deleteCharacters(int count);
+  void insertLines(int count);
+  void deleteLines(int count);
+  void setScrollRegion(int top, int bottom);
+  void setMode(int mode, bool privateMode, bool enabled);
+  void selectGraphicRendition(const TerminalParams &params);
+  void saveCursor();
+  void restoreCursor();
+  void setAlternateScreen(bool enabled);
+  void clearScrollback();
+  void resetTabStops();
+  void allocate(Buffer &buffer, int capacity);
+  void appendLine(Buffer &buffer);
+
+  int m_rows;
+  int m_columns;
+  int m_scrollbackLines;
+  Buffer m_mainBuffer;
+  Buffer m_alternateBuffer;
+  bool m_alternate;
+
+  Cursor m_cursor;
+  Cursor m_savedCursor;
+  int m_scrollTop;
+  int m_scrollBottom;
+  std::vector<quint8> m_tabStops;
+
+  bool m_autoWrap;
+  bool m_insertMode;
+  bool m_newLineMode;
+  bool m_cursorVisible;
+  bool m_applicationCursorKeys;
+  bool m_bracketedPaste;
+  // G0 is the DEC special graphics set, for line drawing
+  bool m_lineDrawing;
+  char32_t m_lastPrinted;
+  QString m_title;
+
+  std::vector<quint8> m_dirty;
+  bool m_anyDirty;
+  QByteArray m_response;
+  int m_bells;
+};
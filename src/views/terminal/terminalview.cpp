@@ -0,0 +1,619 @@
+#include "terminalview.h"
+#include <QFocusEvent>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScreen>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <QtMath>
+#include <algorithm>
+#include <array>
+
+namespace {
+const QRgb kDefaultForeground = qRgb(0xF8, 0xF8, 0xF2);
+const QRgb kDefaultBackground = qRgb(0x28, 0x28, 0x28);
+const QColor kSelectionColor(0x26, 0x4F, 0x78, 160);
+
+// Words laid out per font before the cache starts over
+constexpr int kMaxGlyphRuns = 4096;
+
+// The 16 ANSI colours, then xterm's 6x6x6 colour cube and grey ramp
+const std::array<QRgb, 256> &palette() {
+    static const std::array<QRgb, 256> colors = []() {
+        std::array<QRgb, 256> table{};
+        const QRgb ansi[16] = {
+            qRgb(0x00, 0x00, 0x00), qRgb(0xCC, 0x00, 0x00), qRgb(0x4E, 0x9A, 0x06),
+            qRgb(0xC4, 0xA0, 0x00), qRgb(0x34, 0x65, 0xA4), qRgb(0x75, 0x50, 0x7B),
+            qRgb(0x06, 0x98, 0x9A), qRgb(0xD3, 0xD7, 0xCF), qRgb(0x55, 0x57, 0x53),
+            qRgb(0xEF, 0x29, 0x29), qRgb(0x8A, 0xE2, 0x34), qRgb(0xFC, 0xE9, 0x4F),
+            qRgb(0x72, 0x9F, 0xCF), qRgb(0xAD, 0x7F, 0xA8), qRgb(0x34, 0xE2, 0xE2),
+            qRgb(0xEE, 0xEE, 0xEC),
+        };
+        std::copy(std::begin(ansi), std::end(ansi), table.begin());
+        const int levels[6] = {0, 95, 135, 175, 215, 255};
+        for (int i = 0; i < 216; ++i) {
+            table[size_t(16 + i)] = qRgb(levels[i / 36], levels[i / 6 % 6], levels[i % 6]);
+        }
+        for (int i = 0; i < 24; ++i) {
+            const int grey = 8 + 10 * i;
+            table[size_t(232 + i)] = qRgb(grey, grey, grey);
+        }
+        return table;
+    }();
+    return colors;
+}
+
+QRgb resolveColor(quint32 color, QRgb fallback) {
+    if (TerminalCell::isIndexed(color)) {
+        return palette()[color & 0xFF];
+    }
+    if (TerminalCell::isRgb(color)) {
+        return 0xFF000000u | (color & 0xFFFFFF);
+    }
+    return fallback;
+}
+
+// Cells drawn alike can share one run
+bool sameStyle(const TerminalCell &a, const TerminalCell &b) {
+    constexpr quint32 kLayoutFlags = TerminalCell::Wide | TerminalCell::WideTail;
+    return a.foreground == b.foreground && a.background == b.background &&
+           (a.flags & ~kLayoutFlags) == (b.flags & ~kLayoutFlags);
+}
+
+// The text of cells [from, to), and for each character the column it is in
+QString cellsText(const TerminalCell *cells, int from, int to, QVector<int> *columns = nullptr) {
+    QString text;
+    text.reserve(to - from);
+    for (int column = from; column < to; ++column) {
+        const TerminalCell &cell = cells[column];
+        if (cell.flags & TerminalCell::WideTail) {
+            continue;
+        }
+        const char32_t codepoint = cell.codepoint;
+        if (QChar::requiresSurrogates(codepoint)) {
+            text += QChar(QChar::highSurrogate(codepoint));
+            text += QChar(QChar::lowSurrogate(codepoint));
+            if (columns) {
+                columns->append(column);
+            }
+        } else {
+            text += QChar(char16_t(codepoint));
+        }
+        if (columns) {
+            columns->append(column);
+        }
+    }
+    return text;
+}
+
+bool isWordCharacter(char32_t codepoint) {
+    static const QString separators = QStringLiteral(" \t()[]{}<>'\"`|;,");
+    return codepoint > 0xFFFF || !separators.contains(QChar(char16_t(codepoint)));
+}
+} // namespace
+
+TerminalView::TerminalView(QWidget *parent)
+    : QAbstractScrollArea(parent), m_screen(nullptr), m_cellWidth(1), m_cellHeight(1),
+      m_ascent(0), m_followOutput(true), m_lastCursorRow(-1), m_lastCursorColumn(-1),
+      m_lastDropped(0), m_lastLineCount(0) {
+    setFrameStyle(QFrame::NoFrame);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    // Always shown, so the grid does not change width as output arrives
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    // Every pixel is painted, so Qt need not clear it first
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+
+    m_frameTimer.setSingleShot(true);
+    connect(&m_frameTimer, &QTimer::timeout, this, &TerminalView::flushUpdates);
+    updateMetrics();
+}
+
+void TerminalView::setScreen(TerminalScreen *screen) {
+    m_screen = screen;
+    m_followOutput = true;
+    clearSelection();
+    updateScrollBar();
+    viewport()->update();
+}
+
+int TerminalView::visibleRows() const {
+    return qMax(1, viewport()->height() / m_cellHeight);
+}
+
+int TerminalView::visibleColumns() const {
+    return qMax(1, int(viewport()->width() / m_cellWidth));
+}
+
+void TerminalView::scheduleUpdate() {
+    if (m_frameTimer.isActive()) {
+        return;
+    }
+    const qreal rate = screen() ? screen()->refreshRate() : 60.0;
+    m_frameTimer.start(qMax(1, qRound(1000.0 / qMax<qreal>(1.0, rate))));
+}
+
+void TerminalView::scrollToBottom() {
+    m_followOutput = true;
+    updateScrollBar();
+    viewport()->update();
+}
+
+void TerminalView::updateMetrics() {
+    m_fonts[0] = font();
+    m_fonts[1] = font();
+    m_fonts[1].setBold(true);
+    m_fonts[2] = font();
+    m_fonts[2].setItalic(true);
+    m_fonts[3] = m_fonts[1];
+    m_fonts[3].setItalic(true);
+    for (QHash<QString, QStaticText> &cache : m_glyphRuns) {
+        cache.clear();
+    }
+
+    const QFontMetricsF metrics(font());
+    m_cellWidth = qMax<qreal>(1.0, metrics.horizontalAdvance(QLatin1Char('M')));
+    m_cellHeight = qMax(1, qCeil(metrics.lineSpacing()));
+    m_ascent = qCeil(metrics.ascent());
+}
+
+void TerminalView::updateScrollBar() {
+    if (!m_screen) {
+        return;
+    }
+    QScrollBar *bar = verticalScrollBar();
+    const int maximum = qMax(0, m_screen->lineCount() - m_screen->rows());
+    // Lines falling off the top of the scrollback move what is shown up,
+    // unless the view stays where it was
+    int value = bar->value() - int(m_screen->droppedLines() - m_lastDropped);
+    // Set without scrollContentsBy(), which would take this for the user
+    // scrolling
+    const QSignalBlocker blocker(bar);
+    bar->setRange(0, maximum);
+    bar->setPageStep(m_screen->rows());
+    bar->setSingleStep(1);
+    bar->setValue(m_followOutput ? maximum : qBound(0, value, maximum));
+}
+
+void TerminalView::flushUpdates() {
+    if (!m_screen) {
+        return;
+    }
+    const int previousValue = verticalScrollBar()->value();
+    updateScrollBar();
+    const bool scrolled = verticalScrollBar()->value() != previousValue ||
+                          m_screen->droppedLines() != m_lastDropped ||
+                          m_screen->lineCount() != m_lastLineCount;
+    const bool cursorMoved = m_screen->cursorRow() != m_lastCursorRow ||
+                             m_screen->cursorColumn() != m_lastCursorColumn;
+
+    if (scrolled) {
+        viewport()->update();
+    } else if (m_screen->hasDirtyRows() || cursorMoved) {
+        // Only the rows that changed, and the ones the cursor left and
+        // entered
+        QRegion region;
+        const int firstScreenLine = m_screen->lineCount() - m_screen->rows();
+        const int top = firstVisibleLine();
+        for (int viewRow = 0; viewRow < visibleRows(); ++viewRow) {
+            const int screenRow = top + viewRow - firstScreenLine;
+            if (screenRow < 0 || screenRow >= m_screen->rows()) {
+                continue;
+            }
+            if (m_screen->isDirty(screenRow) ||
+                (cursorMoved &&
+                 (screenRow == m_screen->cursorRow() || screenRow == m_lastCursorRow))) {
+                region += lineRect(viewRow);
+            }
+        }
+        viewport()->update(region);
+    }
+
+    m_screen->clearDirty();
+    m_lastCursorRow = m_screen->cursorRow();
+    m_lastCursorColumn = m_screen->cursorColumn();
+    m_lastDropped = m_screen->droppedLines();
+    m_lastLineCount = m_screen->lineCount();
+}
+
+QRect TerminalView::lineRect(int viewRow) const {
+    return QRect(0, viewRow * m_cellHeight, viewport()->width(), m_cellHeight);
+}
+
+qint64 TerminalView::firstVisibleLine() const {
+    return verticalScrollBar()->value();
+}
+
+void TerminalView::paintEvent(QPaintEvent *event) {
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), QColor(kDefaultBackground));
+    if (!m_screen) {
+        return;
+    }
+
+    const int top = int(firstVisibleLine());
+    const int firstRow = event->rect().top() / m_cellHeight;
+    const int lastRow =
+        qMin(event->rect().bottom() / m_cellHeight, m_screen->lineCount() - top - 1);
+    for (int viewRow = firstRow; viewRow <= lastRow; ++viewRow) {
+        const int index = top + viewRow;
+        paintLine(painter, viewRow * m_cellHeight, m_screen->line(index),
+                  m_screen->droppedLines() + index);
+    }
+
+    if (!m_screen->isCursorVisible()) {
+        return;
+    }
+    const int cursorRow = m_screen->lineCount() - m_screen->rows() + m_screen->cursorRow() - top;
+    if (cursorRow < firstRow || cursorRow > lastRow) {
+        return;
+    }
+    const int column = m_screen->cursorColumn();
+    const TerminalCell &cell = m_screen->line(top + cursorRow)[column];
+    const int width = cell.flags & TerminalCell::Wide ? 2 : 1;
+    const QRectF rect(column * m_cellWidth, cursorRow * m_cellHeight, width * m_cellWidth,
+                      m_cellHeight);
+    if (hasFocus()) {
+        // A block, with the character under it drawn in reverse
+        painter.fillRect(rect, foregroundColor(cell));
+        if (!(cell.flags & TerminalCell::WideTail)) {
+            drawRun(painter, cellsText(&cell, 0, 1), cell.flags, rect.x(),
+                    cursorRow * m_cellHeight, backgroundColor(cell));
+        }
+    } else {
+        painter.setPen(QColor(kDefaultForeground));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(rect.adjusted(0.5, 0.5, -0.5, -0.5));
+    }
+}
+
+void TerminalView::paintLine(QPainter &painter, int y, const TerminalCell *cells, qint64 line) {
+    const int columns = m_screen->columns();
+    int column = 0;
+    while (column < columns) {
+        // A run of cells in one style
+        int end = column + 1;
+        while (end < columns && sameStyle(cells[end], cells[column])) {
+            ++end;
+        }
+        const TerminalCell &style = cells[column];
+        const QColor background = backgroundColor(style);
+        if (background.rgb() != kDefaultBackground) {
+            painter.fillRect(QRectF(column * m_cellWidth, y, (end - column) * m_cellWidth,
+                                    m_cellHeight),
+                             background);
+        }
+
+        if (!(style.flags & TerminalCell::Invisible)) {
+            const QColor foreground = foregroundColor(style);
+            // Words of ASCII are drawn whole, so the cache sees the same
+            // ones again and again; anything else goes one cell at a time,
+            // at its cell, whatever the font's advance for it
+            int start = column;
+            while (start < end) {
+                const char32_t codepoint = cells[start].codepoint;
+                if (codepoint == U' ' || (cells[start].flags & TerminalCell::WideTail)) {
+                    ++start;
+                    continue;
+                }
+                int stop = start + 1;
+                if (codepoint < 0x80) {
+                    while (stop < end && cells[stop].codepoint > U' ' &&
+                           cells[stop].codepoint < 0x80) {
+                        ++stop;
+                    }
+                }
+                drawRun(painter, cellsText(cells, start, stop), style.flags,
+                        start * m_cellWidth, y, foreground);
+                start = stop;
+            }
+
+            if (style.flags & (TerminalCell::Underline | TerminalCell::Strikeout)) {
+                painter.setPen(foreground);
+                const qreal left = column * m_cellWidth;
+                const qreal right = end * m_cellWidth - 1;
+                if (style.flags & TerminalCell::Underline) {
+                    const qreal underline = y + m_ascent + 1.5;
+                    painter.drawLine(QPointF(left, underline), QPointF(right, underline));
+                }
+                if (style.flags & TerminalCell::Strikeout) {
+                    const qreal strikeout = y + m_ascent * 0.65;
+                    painter.drawLine(QPointF(left, strikeout), QPointF(right, strikeout));
+                }
+            }
+        }
+        column = end;
+    }
+
+    if (!hasSelection()) {
+        return;
+    }
+    const Position start = qMin(m_selectionAnchor, m_selectionEnd);
+    const Position stop = qMax(m_selectionAnchor, m_selectionEnd);
+    if (line < start.line || line > stop.line) {
+        return;
+    }
+    const int from = line == start.line ? start.column : 0;
+    const int to = line == stop.line ? stop.column : columns;
+    if (to > from) {
+        painter.fillRect(QRectF(from * m_cellWidth, y, (to - from) * m_cellWidth, m_cellHeight),
+                         kSelectionColor);
+    }
+}
+
+void TerminalView::drawRun(QPainter &painter, const QString &text, quint32 flags, qreal x,
+                           int y, const QColor &color) {
+    const int style = (flags & TerminalCell::Bold ? 1 : 0) | (flags & TerminalCell::Italic ? 2 : 0);
+    QHash<QString, QStaticText> &cache = m_glyphRuns[style];
+    auto run = cache.constFind(text);
+    if (run == cache.constEnd()) {
+        if (cache.size() >= kMaxGlyphRuns) {
+            cache.clear();
+        }
+        QStaticText layout(text);
+        layout.setTextFormat(Qt::PlainText);
+        layout.setPerformanceHint(QStaticText::AggressiveCaching);
+        layout.prepare(QTransform(), m_fonts[style]);
+        run = cache.insert(text, layout);
+    }
+    painter.setFont(m_fonts[style]);
+    painter.setPen(color);
+    painter.drawStaticText(QPointF(x, y), *run);
+}
+
+QColor TerminalView::foregroundColor(const TerminalCell &cell) const {
+    QColor color = cell.flags & TerminalCell::Inverse
+                       ? QColor(resolveColor(cell.background, kDefaultBackground))
+                       : QColor(resolveColor(cell.foreground, kDefaultForeground));
+    if (cell.flags & TerminalCell::Faint) {
+        color.setAlpha(150);
+    }
+    return color;
+}
+
+QColor TerminalView::backgroundColor(const TerminalCell &cell) const {
+    return cell.flags & TerminalCell::Inverse
+               ? QColor(resolveColor(cell.foreground, kDefaultForeground))
+               : QColor(resolveColor(cell.background, kDefaultBackground));
+}
+
+void TerminalView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    emit gridSizeChanged(visibleRows(), visibleColumns());
+}
+
+void TerminalView::changeEvent(QEvent *event) {
+    QAbstractScrollArea::changeEvent(event);
+    if (event->type() == QEvent::FontChange) {
+        updateMetrics();
+        emit gridSizeChanged(visibleRows(), visibleColumns());
+        viewport()->update();
+    }
+}
+
+void TerminalView::wheelEvent(QWheelEvent *event) {
+    if (event->modifiers() & Qt::ControlModifier) {
+        // Zooming is up to the terminal widget
+        event->ignore();
+        return;
+    }
+    QAbstractScrollArea::wheelEvent(event);
+}
+
+void TerminalView::scrollContentsBy(int dx, int dy) {
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    const QScrollBar *bar = verticalScrollBar();
+    m_followOutput = bar->value() == bar->maximum();
+    viewport()->update();
+}
+
+TerminalView::Position TerminalView::positionAt(const QPoint &point) const {
+    Position position;
+    if (!m_screen) {
+        return position;
+    }
+    const int index = qBound(0, int(firstVisibleLine()) + point.y() / m_cellHeight,
+                             m_screen->lineCount() - 1);
+    position.line = m_screen->droppedLines() + index;
+    // Rounded to the nearest cell boundary, as text editors do
+    position.column = qBound(0, qRound(point.x() / m_cellWidth), m_screen->columns());
+    return position;
+}
+
+void TerminalView::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+    setFocus(Qt::MouseFocusReason);
+    const Position position = positionAt(event->position().toPoint());
+    setSelection(position, position);
+}
+
+void TerminalView::mouseMoveEvent(QMouseEvent *event) {
+    if (!(event->buttons() & Qt::LeftButton)) {
+        QAbstractScrollArea::mouseMoveEvent(event);
+        return;
+    }
+    setSelection(m_selectionAnchor, positionAt(event->position().toPoint()));
+}
+
+void TerminalView::mouseDoubleClickEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton || !m_screen) {
+        QAbstractScrollArea::mouseDoubleClickEvent(event);
+        return;
+    }
+    // The word under the pointer
+    Position position = positionAt(event->position().toPoint());
+    const int columns = m_screen->columns();
+    const TerminalCell *cells = m_screen->line(int(position.line - m_screen->droppedLines()));
+    int column = qMin(int(event->position().x() / m_cellWidth), columns - 1);
+    if (!isWordCharacter(cells[column].codepoint)) {
+        return;
+    }
+    int start = column;
+    while (start > 0 && isWordCharacter(cells[start - 1].codepoint)) {
+        --start;
+    }
+    int end = column + 1;
+    while (end < columns && isWordCharacter(cells[end].codepoint)) {
+        ++end;
+    }
+    Position anchor = position;
+    anchor.column = start;
+    position.column = end;
+    setSelection(anchor, position);
+}
+
+void TerminalView::focusInEvent(QFocusEvent *event) {
+    QAbstractScrollArea::focusInEvent(event);
+    viewport()->update();
+}
+
+void TerminalView::focusOutEvent(QFocusEvent *event) {
+    QAbstractScrollArea::focusOutEvent(event);
+    viewport()->update();
+}
+
+void TerminalView::setSelection(const Position &anchor, const Position &end) {
+    if (anchor == m_selectionAnchor && end == m_selectionEnd) {
+        return;
+    }
+    m_selectionAnchor = anchor;
+    m_selectionEnd = end;
+    viewport()->update();
+}
+
+bool TerminalView::hasSelection() const {
+    return !(m_selectionAnchor == m_selectionEnd);
+}
+
+void TerminalView::clearSelection() {
+    setSelection(Position(), Position());
+}
+
+void TerminalView::selectAll() {
+    if (!m_screen) {
+        return;
+    }
+    Position start;
+    start.line = m_screen->droppedLines();
+    Position end;
+    end.line = start.line + m_screen->lineCount() - 1;
+    end.column = m_screen->columns();
+    setSelection(start, end);
+}
+
+QString TerminalView::selectedText() const {
+    if (!m_screen || !hasSelection()) {
+        return QString();
+    }
+    const Position start = qMin(m_selectionAnchor, m_selectionEnd);
+    const Position stop = qMax(m_selectionAnchor, m_selectionEnd);
+    const qint64 dropped = m_screen->droppedLines();
+    const int columns = m_screen->columns();
+
+    QString text;
+    for (qint64 line = qMax(start.line, dropped); line <= stop.line; ++line) {
+        const int index = int(line - dropped);
+        if (index >= m_screen->lineCount()) {
+            break;
+        }
+        const int from = line == start.line ? start.column : 0;
+        const int to = line == stop.line ? stop.column : columns;
+        QString part = cellsText(m_screen->line(index), from, to);
+        // Wrapped lines join up again; the padding at the end of others goes
+        const bool wrapped = m_screen->isWrapped(index) && to == columns;
+        if (!wrapped) {
+            while (part.endsWith(QLatin1Char(' '))) {
+                part.chop(1);
+            }
+        }
+        text += part;
+        if (line != stop.line && !wrapped) {
+            text += QLatin1Char('\n');
+        }
+    }
+    return text;
+}
+
+bool TerminalView::find(const QString &text, bool backward) {
+    if (!m_screen || text.isEmpty()) {
+        return false;
+    }
+    const qint64 dropped = m_screen->droppedLines();
+    const int count = m_screen->lineCount();
+    const int columns = m_screen->columns();
+
+    // From the current match, or else from the top of what is shown when
+    // going forward and from the end when going back
+    Position origin;
+    if (hasSelection()) {
+        origin = qMin(m_selectionAnchor, m_selectionEnd);
+    } else if (backward) {
+        origin.line = dropped + count - 1;
+        origin.column = columns;
+    } else {
+        origin.line = dropped + firstVisibleLine();
+        origin.column = -1;
+    }
+
+    int index = qBound(0, int(origin.line - dropped), count - 1);
+    for (int step = 0; step <= count; ++step) {
+        QVector<int> positions;
+        const QString line = cellsText(m_screen->line(index), 0, columns, &positions);
+        qsizetype found = -1;
+        if (step == 0 && !backward) {
+            // Only after the current match
+            qsizetype from = positions.size();
+            for (qsizetype i = 0; i < positions.size(); ++i) {
+                if (positions[i] > origin.column) {
+                    from = i;
+                    break;
+                }
+            }
+            found = line.indexOf(text, from, Qt::CaseInsensitive);
+        } else if (step == 0) {
+            // Only before it
+            qsizetype from = -1;
+            for (qsizetype i = 0; i < positions.size() && positions[i] < origin.column; ++i) {
+                from = i;
+            }
+            if (from >= 0) {
+                found = line.lastIndexOf(text, from, Qt::CaseInsensitive);
+            }
+        } else if (backward) {
+            found = line.lastIndexOf(text, -1, Qt::CaseInsensitive);
+        } else {
+            found = line.indexOf(text, 0, Qt::CaseInsensitive);
+        }
+
+        if (found >= 0) {
+            Position start;
+            start.line = dropped + index;
+            start.column = positions[found];
+            Position end = start;
+            const qsizetype after = found + text.size();
+            end.column = after < positions.size() ? positions[after] : columns;
+            setSelection(start, end);
+            showLine(start.line);
+            return true;
+        }
+        index = backward ? (index + count - 1) % count : (index + 1) % count;
+    }
+    return false;
+}
+
+void TerminalView::showLine(qint64 line) {
+    if (!m_screen) {
+        return;
+    }
+    const int index = int(line - m_screen->droppedLines());
+    QScrollBar *bar = verticalScrollBar();
+    if (index < bar->value() || index >= bar->value() + visibleRows()) {
+        bar->setValue(index - visibleRows() / 2);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "views/terminal/terminalscreen.h"
+#include <QAbstractScrollArea>
+#include <QHash>
+#include <QStaticText>
+#include <QTimer>
+
+// Draws a TerminalScreen as a grid of character cells, the scrollback
+// above it. Output only schedules a repaint; at most once a display frame
+// the rows the screen marked dirty are painted, and runs of text are drawn
+// from cached, already laid-out glyphs.
+class TerminalView : public QAbstractScrollArea {
+  Q_OBJECT
+
+public:
+  explicit TerminalView(QWidget *parent = nullptr);
+
+  void setScreen(TerminalScreen *screen);
+  // The grid that fits in the viewport with the current font
+  int visibleRows() const;
+  int visibleColumns() const;
+  // Repaints what the screen changed, at the next frame
+  void scheduleUpdate();
+  // Shows the newest output again
+  void scrollToBottom();
+
+  bool hasSelection() const;
+  QString selectedText() const;
+  void selectAll();
+  void clearSelection();
+  // Selects the next match of `text`, ignoring case and wrapping around;
+  // false when there is none
+  bool find(const QString &text, bool backward);
+
+signals:
+  void gridSizeChanged(int rows, int columns);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void changeEvent(QEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+  void mouseDoubleClickEvent(QMouseEvent *event) override;
+  void focusInEvent(QFocusEvent *event) override;
+  void focusOutEvent(QFocusEvent *event) override;
+  void scrollContentsBy(int dx, int dy) override;
+
+private:
+  // A cell counted from the first line ever written, so it stays put as
+  // the scrollback turns over
+  struct Position {
+    qint64 line = 0;
+    int column = 0;
+    bool operator<(const Position &other) const {
+      return line < other.line || (line == other.line && column < other.column);
+    }
+    bool operator==(const Position &other) const {
+      return line == other.line && column == other.column;
+    }
+  };
+
+  void updateMetrics();
+  void updateScrollBar();
+  void flushUpdates();
+  void paintLine(QPainter &painter, int y, const TerminalCell *cells, qint64 line);
+  void drawRun(QPainter &painter, const QString &text, quint32 flags, qreal x, int y,
+               const QColor &color);
+  QColor foregroundColor(const TerminalCell &cell) const;
+  QColor backgroundColor(const TerminalCell &cell) const;
+  QRect lineRect(int viewRow) const;
+  Position positionAt(const QPoint &point) const;
+  qint64 firstVisibleLine() const;
+  void setSelection(const Position &anchor, const Position &end);
+  void showLine(qint64 line);
+
+  TerminalScreen *m_screen;
+  QTimer m_frameTimer;
+  qreal m_cellWidth;
+  int m_cellHeight;
+  int m_ascent;
+  // Follow the output unless the user has scrolled back
+  bool m_followOutput;
+  int m_lastCursorRow;
+  int m_lastCursorColumn;
+  qint64 m_lastDropped;
+  int m_lastLineCount;
+
+  Position m_selectionAnchor;
+  Position m_selectionEnd;
+
+  // Laid-out words, for regular, bold, italic and bold italic text
+  QFont m_fonts[4];
+  QHash<QString, QStaticText> m_glyphRuns[4];
+};
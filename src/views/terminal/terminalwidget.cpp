@@ -1,10 +1,7 @@
 #include "terminalwidget.h"
 #include <QDir>
 #include <QFontDatabase>
-#include <QHostInfo>
 #include <QKeyEvent>
-#include <QProcessEnvironment>
-#include <QRegularExpression>
 #include <QScrollBar>
 #include <QVBoxLayout>
 #include <QClipboard>
@@ -15,44 +12,44 @@
 #include <QWheelEvent>
 #include <QContextMenuEvent>
 
-// Define static color constants
-const QColor TerminalWidget::DefaultForeground = QColor("#F8F8F2");
-const QColor TerminalWidget::DefaultBackground = QColor("#282828");
-
-const QVector<QColor> TerminalWidget::AnsiColors = {
-    QColor("#000000"),  // Black
-    QColor("#CC0000"),  // Red
-    QColor("#4E9A06"),  // Green
-    QColor("#C4A000"),  // Yellow
-    QColor("#3465A4"),  // Blue
-    QColor("#75507B"),  // Magenta
-    QColor("#06989A"),  // Cyan
-    QColor("#D3D7CF")   // White
-};
-
-const QVector<QColor> TerminalWidget::AnsiBrightColors = {
-    QColor("#555753"),  // Bright Black
-    QColor("#EF2929"),  // Bright Red
-    QColor("#8AE234"),  // Bright Green
-    QColor("#FCE94F"),  // Bright Yellow
-    QColor("#729FCF"),  // Bright Blue
-    QColor("#AD7FA8"),  // Bright Magenta
-    QColor("#34E2E2"),  // Bright Cyan
-    QColor("#EEEEEC")   // Bright White
-};
+namespace {
+// What a VT220-style terminal sends for a key; empty for keys it does not
+// send anything for. Cursor keys send SS3 sequences once an application
+// asks for them.
+QByteArray functionKeySequence(int key, bool applicationCursorKeys) {
+    const QByteArray cursor = applicationCursorKeys ? "\x1bO" : "\x1b[";
+    switch (key) {
+    case Qt::Key_Up: return cursor + 'A';
+    case Qt::Key_Down: return cursor + 'B';
+    case Qt::Key_Right: return cursor + 'C';
+    case Qt::Key_Left: return cursor + 'D';
+    case Qt::Key_Home: return cursor + 'H';
+    case Qt::Key_End: return cursor + 'F';
+    case Qt::Key_Insert: return "\x1b[2~";
+    case Qt::Key_Delete: return "\x1b[3~";
+    case Qt::Key_PageUp: return "\x1b[5~";
+    case Qt::Key_PageDown: return "\x1b[6~";
+    case Qt::Key_F1: return "\x1bOP";
+    case Qt::Key_F2: return "\x1bOQ";
+    case Qt::Key_F3: return "\x1bOR";
+    case Qt::Key_F4: return "\x1bOS";
+    case Qt::Key_F5: return "\x1b[15~";
+    case Qt::Key_F6: return "\x1b[17~";
+    case Qt::Key_F7: return "\x1b[18~";
+    case Qt::Key_F8: return "\x1b[19~";
+    case Qt::Key_F9: return "\x1b[20~";
+    case Qt::Key_F10: return "\x1b[21~";
+    case Qt::Key_F11: return "\x1b[23~";
+    case Qt::Key_F12: return "\x1b[24~";
+    default: return QByteArray();
+    }
+}
+} // namespace
 
 TerminalWidget::TerminalWidget(QWidget *parent)
-    : QWidget(parent), historyIndex(-1), promptPosition(0), baseFontSize(10), 
-      ctrlPressed(false), m_intelligentIndent(true) {
-
-  username = qgetenv("USER");
-  if (username.isEmpty()) {
-    username = qgetenv("USERNAME");
-  }
-  hostname = QHostInfo::localHostName();
-
+    : QWidget(parent), parser(&terminalScreen), baseFontSize(10) {
   setupUI();
-  setupProcess();
+  setupSession();
   setupShortcuts();
   setWorkingDirectory(QDir::homePath());
 }
@@ -62,39 +59,20 @@ void TerminalWidget::setupUI() {
   layout->setContentsMargins(0, 0, 0, 0);
   layout->setSpacing(0);
 
-  terminal = new QPlainTextEdit(this);
-  terminal->setFrameStyle(QFrame::NoFrame);
-  terminal->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
-  terminal->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
-  terminal->setLineWrapMode(QPlainTextEdit::WidgetWidth);
-  terminal->installEventFilter(this);
-  terminal->setContextMenuPolicy(Qt::CustomContextMenu);
-  connect(terminal, &QWidget::customContextMenuRequested,
+  view = new TerminalView(this);
+  view->setScreen(&terminalScreen);
+  view->installEventFilter(this);
+  view->setContextMenuPolicy(Qt::CustomContextMenu);
+  connect(view, &QWidget::customContextMenuRequested,
           this, [this](const QPoint &pos) { createContextMenu(pos); });
+  connect(view, &TerminalView::gridSizeChanged, this, &TerminalWidget::resizeGrid);
 
   // Set terminal font
   QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
   font.setPointSize(baseFontSize);
-  terminal->setFont(font);
-
-  // Set modern terminal colors
-  QPalette p = terminal->palette();
-  p.setColor(QPalette::Base, DefaultBackground);
-  p.setColor(QPalette::Text, DefaultForeground);
-  terminal->setPalette(p);
-
-  // Style sheet for better appearance
-  terminal->setStyleSheet(QString(
-      "QPlainTextEdit {"
-      "   background-color: %1;"
-      "   color: %2;"
-      "   border: none;"
-      "   padding: 4px;"
-      "}"
-      "QPlainTextEdit:focus {"
-      "   border: none;"
-      "   outline: none;"
-      "}"
+  view->setFont(font);
+
+  view->setStyleSheet(
       "QScrollBar:vertical {"
       "   background-color: #2A2A2A;"
       "   width: 14px;"
@@ -111,28 +89,10 @@ void TerminalWidget::setupUI() {
       "}"
       "QScrollBar::add-line:vertical, QScrollBar::sub-line:vertical {"
       "   height: 0px;"
-      "}"
-      "QScrollBar:horizontal {"
-      "   background-color: #2A2A2A;"
-      "   height: 14px;"
-      "   margin: 0px;"
-      "}"
-      "QScrollBar::handle:horizontal {"
-      "   background-color: #424242;"
-      "   min-width: 20px;"
-      "   border-radius: 7px;"
-      "   margin: 2px;"
-      "}"
-      "QScrollBar::handle:horizontal:hover {"
-      "   background-color: #686868;"
-      "}"
-      "QScrollBar::add-line:horizontal, QScrollBar::sub-line:horizontal {"
-      "   width: 0px;"
-      "}")
-      .arg(DefaultBackground.name(), DefaultForeground.name()));
+      "}");
 
-  layout->addWidget(terminal);
-  displayPrompt();
+  layout->addWidget(view);
+  setFocusProxy(view);
 }
 
 void TerminalWidget::setupShortcuts() {
@@ -141,18 +101,15 @@ void TerminalWidget::setupShortcuts() {
     new QShortcut(QKeySequence::ZoomOut, this, this, &TerminalWidget::zoomOut);
     new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_0), this, this, &TerminalWidget::resetZoom);
     
-    // Find shortcuts
-    new QShortcut(QKeySequence::Find, this, this, &TerminalWidget::find);
+    // Find and clipboard shortcuts take Shift, as in other terminals, so
+    // that Ctrl+F, Ctrl+C and Ctrl+V reach the shell
+    new QShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F), this, this, &TerminalWidget::find);
     new QShortcut(QKeySequence::FindNext, this, this, &TerminalWidget::findNext);
     new QShortcut(QKeySequence::FindPrevious, this, this, &TerminalWidget::findPrevious);
-    
-    // Copy/Paste shortcuts
-    new QShortcut(QKeySequence::Copy, this, this, &TerminalWidget::copySelectedText);
-    new QShortcut(QKeySequence::Paste, this, this, &TerminalWidget::pasteClipboard);
-
-    // Indent/Unindent shortcuts
-    new QShortcut(QKeySequence(Qt::Key_Tab), this, [this]() { handleIndent(true); });
-    new QShortcut(QKeySequence(Qt::SHIFT | Qt::Key_Tab), this, [this]() { handleIndent(false); });
+    new QShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_C), this, this,
+                  &TerminalWidget::copySelectedText);
+    new QShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_V), this, this,
+                  &TerminalWidget::pasteClipboard);
 }
 
 void TerminalWidget::contextMenuEvent(QContextMenuEvent *event) {
@@ -171,7 +128,7 @@ void TerminalWidget::createContextMenu(const QPoint &pos) {
     menu->addSeparator();
     menu->addAction(tr("Clear Scrollback"), this, &TerminalWidget::clearScrollback);
     
-    menu->exec(terminal->mapToGlobal(pos));
+    menu->exec(view->mapToGlobal(pos));
     delete menu;
 }
 
@@ -193,11 +150,11 @@ void TerminalWidget::handleZoom(int delta) {
 }
 
 void TerminalWidget::zoomIn() {
-    setFontSize(terminal->font().pointSize() + 1);
+    setFontSize(view->font().pointSize() + 1);
 }
 
 void TerminalWidget::zoomOut() {
-    setFontSize(terminal->font().pointSize() - 1);
+    setFontSize(view->font().pointSize() - 1);
 }
 
 void TerminalWidget::resetZoom() {
@@ -207,9 +164,10 @@ void TerminalWidget::resetZoom() {
 void TerminalWidget::setFontSize(int size) {
     if (size < 6 || size > 72) return;
     
-    QFont font = terminal->font();
+    // The view reports the new grid size once the font has changed
+    QFont font = view->font();
     font.setPointSize(size);
-    terminal->setFont(font);
+    view->setFont(font);
     emit fontSizeChanged(size);
 }
 
@@ -229,22 +187,7 @@ void TerminalWidget::findNext() {
         find();
         return;
     }
-    
-    QTextDocument *doc = terminal->document();
-    QTextCursor cursor = terminal->textCursor();
-    
-    QTextDocument::FindFlags flags;
-    QTextCursor found = doc->find(searchString, cursor, flags);
-    
-    if (found.isNull()) {
-        // Wrap around
-        cursor.movePosition(QTextCursor::Start);
-        found = doc->find(searchString, cursor, flags);
-    }
-    
-    if (!found.isNull()) {
-        terminal->setTextCursor(found);
-    }
+    view->find(searchString, false);
 }
 
 void TerminalWidget::findPrevious() {
@@ -252,659 +195,180 @@ void TerminalWidget::findPrevious() {
         find();
         return;
     }
-    
-    QTextDocument *doc = terminal->document();
-    QTextCursor cursor = terminal->textCursor();
-    
-    QTextDocument::FindFlags flags = QTextDocument::FindBackward;
-    QTextCursor found = doc->find(searchString, cursor, flags);
-    
-    if (found.isNull()) {
-        // Wrap around
-        cursor.movePosition(QTextCursor::End);
-        found = doc->find(searchString, cursor, flags);
-    }
-    
-    if (!found.isNull()) {
-        terminal->setTextCursor(found);
-    }
+    view->find(searchString, true);
 }
 
 void TerminalWidget::copySelectedText() {
-    terminal->copy();
+    const QString text = view->selectedText();
+    if (!text.isEmpty()) {
+        QApplication::clipboard()->setText(text);
+    }
 }
 
 void TerminalWidget::pasteClipboard() {
     const QClipboard *clipboard = QApplication::clipboard();
     QString text = clipboard->text();
     if (!text.isEmpty()) {
-        QStringList lines = text.split('\n');
-        for (int i = 0; i < lines.size(); ++i) {
-            setCurrentCommand(lines[i]);
-            if (i < lines.size() - 1) {
-                handleCommandExecution();
-            }
+        // Lines end in carriage returns, as if typed
+        text.replace("\r\n", "\r");
+        text.replace('\n', '\r');
+        if (terminalScreen.bracketedPaste()) {
+            // Lets the shell take it as one paste rather than typed commands
+            text.remove(QStringLiteral("\x1b[201~"));
+            text = QStringLiteral("\x1b[200~") + text + QStringLiteral("\x1b[201~");
         }
+        session->write(text.toUtf8());
     }
 }
 
 void TerminalWidget::selectAll() {
-    terminal->selectAll();
+    view->selectAll();
 }
 
 void TerminalWidget::clearScrollback() {
-    terminal->clear();
-    displayPrompt();
-}
-
-QColor TerminalWidget::getAnsiColor(int colorCode, bool bright) {
-    if (colorCode < 0 || colorCode > 7) {
-        return bright ? DefaultForeground : DefaultBackground;
-    }
-    return bright ? AnsiBrightColors[colorCode] : AnsiColors[colorCode];
-}
-
-QString TerminalWidget::getAnsiColorTable() {
-    return QString(
-        "\033[0m\033[K  Default                     "
-        "\033[1m  Bold\n\033[0m"
-        "\033[30m  Black                       "
-        "\033[1;30m  Bright Black\n\033[0m"
-        "\033[31m  Red                         "
-        "\033[1;31m  Bright Red\n\033[0m"
-        "\033[32m  Green                       "
-        "\033[1;32m  Bright Green\n\033[0m"
-        "\033[33m  Yellow                      "
-        "\033[1;33m  Bright Yellow\n\033[0m"
-        "\033[34m  Blue                        "
-        "\033[1;34m  Bright Blue\n\033[0m"
-        "\033[35m  Magenta                     "
-        "\033[1;35m  Bright Magenta\n\033[0m"
-        "\033[36m  Cyan                        "
-        "\033[1;36m  Bright Cyan\n\033[0m"
-        "\033[37m  White                       "
-        "\033[1;37m  Bright White\n\033[0m");
-}
-
-void TerminalWidget::setupProcess() {
-  process = new QProcess(this);
-  process->setProcessChannelMode(QProcess::MergedChannels);
-
-  QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-  process->setProcessEnvironment(env);
-
-  connect(process, &QProcess::readyReadStandardOutput, this,
-          &TerminalWidget::onReadyReadStandardOutput);
-  connect(process, &QProcess::readyReadStandardError, this,
-          &TerminalWidget::onReadyReadStandardError);
-  connect(process, &QProcess::finished, this,
-          &TerminalWidget::onProcessFinished);
-}
-
-QString TerminalWidget::getColoredPrompt() const {
-  QString dirName = QDir(currentWorkingDirectory).dirName();
-  if (dirName.isEmpty()) {
-    dirName = "/";
+    parser.feed(QByteArrayLiteral("\x1b[3J"));
+    view->scrollToBottom();
+    // Has the shell clear the screen and draw its prompt again
+    session->write("\x0c");
+}
+
+void TerminalWidget::setupSession() {
+  session = new PtySession(this);
+  connect(session, &PtySession::dataReceived, this,
+          &TerminalWidget::onDataReceived);
+  connect(session, &PtySession::finished, this,
+          &TerminalWidget::onShellFinished);
+}
+
+void TerminalWidget::showEvent(QShowEvent *event) {
+  QWidget::showEvent(event);
+  // Started once the widget has a size, so the shell's first prompt is
+  // laid out for the real window
+  if (!session->isRunning()) {
+    startShell();
   }
-
-  return QString("<span style='color:#87FF5F'>%1@%2</span>"
-                 "<span style='color:#5F87FF'>:%3</span>"
-                 "<span style='color:#FF5F5F'>$</span> ")
-      .arg(username, hostname, dirName);
 }
 
-void TerminalWidget::displayPrompt() {
-  QTextCursor cursor = terminal->textCursor();
-  cursor.movePosition(QTextCursor::End);
-  cursor.insertHtml(getColoredPrompt());
-  promptPosition = cursor.position();
-  terminal->setTextCursor(cursor);
-  terminal->ensureCursorVisible();
+void TerminalWidget::startShell() {
+  terminalScreen.resize(view->visibleRows(), view->visibleColumns());
+  if (!session->start(currentWorkingDirectory, terminalScreen.columns(),
+                      terminalScreen.rows())) {
+    parser.feed("\x1b[91m" + tr("Cannot start a shell on a pseudo-terminal").toUtf8() +
+                "\x1b[0m\r\n");
+    view->scheduleUpdate();
+  }
 }
 
-void TerminalWidget::handleCommandExecution() {
-  QString command = getCurrentCommand();
-  terminal->appendPlainText(""); // New line
-
-  if (!command.isEmpty()) {
-    commandHistory.append(command);
-    historyIndex = commandHistory.size();
-    executeCommand(command);
-  } else {
-    displayPrompt();
-  }
+void TerminalWidget::resizeGrid(int rows, int columns) {
+  terminalScreen.resize(rows, columns);
+  session->resize(columns, rows);
+  view->scheduleUpdate();
 }
 
-void TerminalWidget::handleHistoryNavigation(bool up) {
-  if (commandHistory.isEmpty())
+void TerminalWidget::setWorkingDirectory(const QString &path) {
+  if (path.isEmpty() || !QDir(path).exists()) {
     return;
-
-  if (up) {
-    if (historyIndex > 0) {
-      historyIndex--;
-      setCurrentCommand(commandHistory[historyIndex]);
-    }
-  } else {
-    if (historyIndex < commandHistory.size() - 1) {
-      historyIndex++;
-      setCurrentCommand(commandHistory[historyIndex]);
-    } else {
-      historyIndex = commandHistory.size();
-      setCurrentCommand("");
-    }
   }
+  currentWorkingDirectory = QDir(path).absolutePath();
 }
 
-QString TerminalWidget::getCurrentCommand() const {
-  QTextCursor cursor = terminal->textCursor();
-  cursor.movePosition(QTextCursor::End);
-  cursor.setPosition(promptPosition, QTextCursor::KeepAnchor);
-  return cursor.selectedText();
-}
-
-void TerminalWidget::setCurrentCommand(const QString &command) {
-  QTextCursor cursor = terminal->textCursor();
-  cursor.movePosition(QTextCursor::End);
-  cursor.setPosition(promptPosition, QTextCursor::KeepAnchor);
-  cursor.insertText(command);
-}
-
-void TerminalWidget::appendOutput(const QString &text, const QColor &color) {
-  if (color.isValid()) {
-    QTextCursor cursor = terminal->textCursor();
-    cursor.movePosition(QTextCursor::End);
-    QTextCharFormat format;
-    format.setForeground(color);
-    cursor.insertText(text, format);
-    terminal->setTextCursor(cursor);
-    terminal->ensureCursorVisible();
-  } else {
-    appendFormattedOutput(text);
+void TerminalWidget::onDataReceived(const QByteArray &data) {
+  parser.feed(data);
+  // Answers to status requests, such as the cursor position
+  const QByteArray response = terminalScreen.takeResponse();
+  if (!response.isEmpty()) {
+    session->write(response);
   }
+  if (terminalScreen.takeBells() > 0) {
+    QApplication::beep();
+  }
+  view->scheduleUpdate();
 }
 
-void TerminalWidget::onReadyReadStandardOutput() {
-  QByteArray output = process->readAllStandardOutput();
-  appendFormattedOutput(QString::fromLocal8Bit(output));
-}
-
-void TerminalWidget::onReadyReadStandardError() {
-  QByteArray error = process->readAllStandardError();
-  appendFormattedOutput(QString::fromLocal8Bit(error));
-}
-
-void TerminalWidget::onProcessFinished(int exitCode,
-                                       QProcess::ExitStatus exitStatus) {
+void TerminalWidget::onShellFinished(int exitCode) {
   Q_UNUSED(exitCode);
-  Q_UNUSED(exitStatus);
-  displayPrompt();
+  // The shell was left with exit or Ctrl+D
+  emit closeRequested();
 }
 
-void TerminalWidget::executeCommand(const QString &command) {
-  // Handle built-in commands first
-  if (command == "clear" || command == "cls") {
-    terminal->clear();
-    displayPrompt();
-    return;
-  }
-
-  if (command.startsWith("cd ") || command == "cd") {
-    handleCdCommand(command);
-    return;
-  }
-
-#ifdef Q_OS_WIN
-  process->start("cmd.exe", QStringList() << "/c" << command);
-#else
-  process->start("/bin/bash", QStringList() << "-c" << command);
-#endif
-}
-
-void TerminalWidget::handleCdCommand(const QString &command) {
-  QString newPath;
-  QString arg = command.mid(3).trimmed();
-
-  if (arg.isEmpty() || arg == "~") {
-    newPath = QDir::homePath();
-  } else if (arg == "-") {
-    // cd - to go to previous directory
-    newPath = previousWorkingDirectory;
-  } else {
-    QDir dir(currentWorkingDirectory);
-    if (dir.cd(arg)) {
-      newPath = dir.absolutePath();
-    } else {
-      appendOutput("cd: " + arg + ": No such directory\n", QColor("#FF5F5F"));
-      displayPrompt();
-      return;
+bool TerminalWidget::eventFilter(QObject *obj, QEvent *event) {
+    if (obj != view) {
+        return QWidget::eventFilter(obj, event);
     }
-  }
-
-  if (!newPath.isEmpty() && QDir(newPath).exists()) {
-    previousWorkingDirectory = currentWorkingDirectory;
-    setWorkingDirectory(newPath);
-    displayPrompt();
-  }
-}
 
-bool TerminalWidget::eventFilter(QObject *obj, QEvent *event) {
-    if (obj == terminal && event->type() == QEvent::KeyPress) {
+    if (event->type() == QEvent::ShortcutOverride) {
+        // Control keys belong to the shell, not to the application's menus
         QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
-
-        // Handle control key combinations
-        if (keyEvent->modifiers() & Qt::ControlModifier) {
-            switch (keyEvent->key()) {
-            case Qt::Key_C:
-                handleCtrlC();
-                return true;
-
-            case Qt::Key_L:
-                handleCtrlL();
-                return true;
-
-            case Qt::Key_D:
-                handleCtrlD();
-                return true;
-            }
-        }
-
-        // Handle Tab and Shift+Tab for indentation
-        if (keyEvent->key() == Qt::Key_Tab) {
-            if (keyEvent->modifiers() & Qt::ShiftModifier) {
-                handleIndent(false);
-            } else {
-                handleIndent(true);
-            }
+        if (keyEvent->modifiers() == Qt::ControlModifier &&
+            keyEvent->key() >= Qt::Key_A && keyEvent->key() <= Qt::Key_Z) {
+            event->accept();
             return true;
         }
-
-        switch (keyEvent->key()) {
-        case Qt::Key_Return:
-        case Qt::Key_Enter:
-            if (m_intelligentIndent) {
-                // Get the current line's indent level before executing
-                QString currentLine = getCurrentCommand();
-                int indentLevel = getIndentLevel(currentLine);
-                
-                // Execute the command
-                handleCommandExecution();
-                
-                // Apply the same indentation to the new line
-                QString indent = getIndentString().repeated(indentLevel);
-                setCurrentCommand(indent);
-                return true;
-            }
-            handleCommandExecution();
+    } else if (event->type() == QEvent::KeyPress) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        if (keyEvent->modifiers() == Qt::ControlModifier && keyEvent->key() == Qt::Key_C) {
+            // Straight to the foreground job, however much input is queued,
+            // unless the job reads ^C itself
+            session->interrupt();
             return true;
-
-        case Qt::Key_Up:
-        case Qt::Key_Down:
-            handleHistoryNavigation(keyEvent->key() == Qt::Key_Up);
+        }
+        if (keyEvent->modifiers() == Qt::ShiftModifier &&
+            (keyEvent->key() == Qt::Key_PageUp || keyEvent->key() == Qt::Key_PageDown)) {
+            // Scrolls back through the output instead of going to the shell
+            view->verticalScrollBar()->triggerAction(keyEvent->key() == Qt::Key_PageUp
+                                                         ? QAbstractSlider::SliderPageStepSub
+                                                         : QAbstractSlider::SliderPageStepAdd);
             return true;
-
-        case Qt::Key_Backspace:
-            if (terminal->textCursor().position() <= promptPosition) {
-                return true;
-            }
-            // Handle backspace with intelligent indent
-            if (m_intelligentIndent) {
-                QTextCursor cursor = terminal->textCursor();
-                cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor);
-                QString deletedChar = cursor.selectedText();
-                
-                // If deleting a space and cursor is at the start of an indent level
-                if (deletedChar == " " && (cursor.position() - promptPosition) % 4 == 0) {
-                    cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, 3);
-                    cursor.removeSelectedText();
-                    return true;
-                }
-            }
-            break;
         }
-
-        if (terminal->textCursor().position() < promptPosition) {
-            terminal->moveCursor(QTextCursor::End);
+        const QByteArray sequence =
+            keySequence(keyEvent, terminalScreen.applicationCursorKeys());
+        if (!sequence.isEmpty()) {
+            session->write(sequence);
+            view->scrollToBottom();
         }
+        return true;
     }
     return QWidget::eventFilter(obj, event);
 }
 
-void TerminalWidget::handleTabCompletion() {
-  QString currentText = getCurrentCommand();
-  QString wordUnderCursor = currentText.section(' ', -1);
-
-  if (wordUnderCursor.isEmpty()) {
-    return;
-  }
-
-  QStringList completions = getCompletions(wordUnderCursor);
-
-  if (completions.isEmpty()) {
-    return;
-  } else if (completions.size() == 1) {
-    // Single completion - replace the word
-    QString newText =
-        currentText.left(currentText.length() - wordUnderCursor.length()) +
-        completions.first();
-    setCurrentCommand(newText);
-  } else {
-    // Multiple completions - show them
-    showCompletions(completions);
-  }
-}
-void TerminalWidget::showCompletions(const QStringList &completions) {
-  if (completions.isEmpty())
-    return;
-
-  // Store the current command before showing completions
-  QString currentCommand = getCurrentCommand();
-
-  // Calculate column width based on longest item
-  int maxWidth = 0;
-  for (const QString &item : completions) {
-    maxWidth = qMax(maxWidth, item.length());
-  }
-  maxWidth += 2; // Add minimum spacing between columns
-
-  // Get terminal width in characters
-  QFontMetrics fm(terminal->font());
-  int terminalWidth = terminal->viewport()->width() / fm.horizontalAdvance(' ');
-  int numColumns = qMax(1, terminalWidth / maxWidth);
-
-  // Sort completions
-  QStringList sortedCompletions = completions;
-  std::sort(sortedCompletions.begin(), sortedCompletions.end());
-
-  // Calculate rows needed
-  int numItems = sortedCompletions.size();
-  int numRows = (numItems + numColumns - 1) / numColumns;
-
-  // Display completions
-  appendOutput("\n");
-
-  for (int row = 0; row < numRows; ++row) {
-    for (int col = 0; col < numColumns; ++col) {
-      int index = col * numRows + row;
-      if (index < sortedCompletions.size()) {
-        QString item = sortedCompletions[index];
-        QString paddedItem = item.leftJustified(maxWidth, ' ');
-
-        // Determine color based on type
-        QColor color;
-        if (item.endsWith('/')) {
-          color = QColor("#5F87FF"); // Blue for directories
-        } else if (item.endsWith('*')) {
-          color = QColor("#87FF5F"); // Green for executables
-        } else {
-          color = QColor("#F8F8F2"); // Default color for files
-        }
-
-        appendOutput(paddedItem, color);
-      }
+QByteArray TerminalWidget::keySequence(const QKeyEvent *event, bool applicationCursorKeys) {
+    const Qt::KeyboardModifiers modifiers = event->modifiers();
+    switch (event->key()) {
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        return "\r";
+    case Qt::Key_Backspace:
+        return "\x7f";
+    case Qt::Key_Tab:
+        return "\t";
+    case Qt::Key_Backtab:
+        return "\x1b[Z";
+    case Qt::Key_Escape:
+        return "\x1b";
     }
-    appendOutput("\n");
-  }
-
-  // Restore prompt with the original command
-  appendOutput("\n");
-  displayPrompt();
-  setCurrentCommand(currentCommand); // Restore the original command
-}
-
-QStringList TerminalWidget::getCompletions(const QString &prefix) const {
-  QStringList completions;
-  QString command = getCurrentCommand();
-  QStringList parts = command.split(' ', Qt::SkipEmptyParts);
-
-  if (parts.isEmpty()) {
-    return completions;
-  }
-
-  // Command-specific completions
-  if (parts[0] == "ls" && prefix == "-") {
-    // Common ls options
-    completions << "-l" << "-a" << "-h" << "-t" << "-r" << "-R" << "--help";
-  } else if (parts[0] == "cd") {
-    // Only show directories for cd
-    QDir dir(currentWorkingDirectory);
-    for (const QFileInfo &info :
-         dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
-      QString name = info.fileName();
-      if (name.startsWith(prefix, Qt::CaseInsensitive)) {
-        completions << name + "/";
-      }
-    }
-  } else if (parts.size() == 1) {
-    // Completing command name
-    QDir dir(currentWorkingDirectory);
-
-    // Add executables from current directory
-    for (const QFileInfo &info :
-         dir.entryInfoList(QDir::Files | QDir::Executable)) {
-      QString name = info.fileName();
-      if (name.startsWith(prefix, Qt::CaseInsensitive)) {
-        completions << name + "*";
-      }
-    }
-
-    // Add commands from PATH
-    QString pathEnv = qgetenv("PATH");
-    QStringList paths = pathEnv.split(QDir::listSeparator());
-    for (const QString &path : paths) {
-      QDir pathDir(path);
-      for (const QFileInfo &info :
-           pathDir.entryInfoList(QDir::Files | QDir::Executable)) {
-        QString name = info.fileName();
-        if (name.startsWith(prefix, Qt::CaseInsensitive)) {
-          completions << name;
-        }
-      }
+    const QByteArray function = functionKeySequence(event->key(), applicationCursorKeys);
+    if (!function.isEmpty()) {
+        return function;
     }
-  } else {
-    // File completion for arguments
-    QDir dir(currentWorkingDirectory);
-    for (const QFileInfo &info :
-         dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot)) {
-      QString name = info.fileName();
-      if (name.startsWith(prefix, Qt::CaseInsensitive)) {
-        if (info.isDir()) {
-          completions << name + "/";
-        } else if (info.isExecutable()) {
-          completions << name + "*";
-        } else {
-          completions << name;
-        }
-      }
-    }
-  }
-
-  completions.removeDuplicates();
-  completions.sort(Qt::CaseInsensitive);
-  return completions;
-}
-
-void TerminalWidget::handleCtrlC() {
-  if (process->state() == QProcess::Running) {
-    process->kill();
-    appendOutput("^C\n");
-    displayPrompt();
-  } else {
-    appendOutput("^C\n");
-    displayPrompt();
-  }
-}
-
-void TerminalWidget::handleCtrlL() {
-  terminal->clear();
-  displayPrompt();
-}
-
-void TerminalWidget::handleCtrlD() {
-  // Only exit if no process is running and the current line is empty
-  if (process->state() != QProcess::Running && getCurrentCommand().isEmpty()) {
-    // Emit a signal to close this terminal instance
-    emit closeRequested();
-  }
-}
-
-void TerminalWidget::setWorkingDirectory(const QString &path) {
-  if (path.isEmpty() || !QDir(path).exists()) {
-    return;
-  }
-
-  QDir dir(path);
-  currentWorkingDirectory = dir.absolutePath();
-  process->setWorkingDirectory(currentWorkingDirectory);
 
-  // Set the PWD environment variable
-  QProcessEnvironment env = process->processEnvironment();
-  env.insert("PWD", currentWorkingDirectory);
-  process->setProcessEnvironment(env);
-}
-
-void TerminalWidget::appendFormattedOutput(const QString &text) {
-    QTextCursor cursor = terminal->textCursor();
-    cursor.movePosition(QTextCursor::End);
-
-    QRegularExpression regex("\x1B\\[([0-9;]*)([A-Za-z])");
-    QRegularExpressionMatchIterator it = regex.globalMatch(text);
-
-    int lastPos = 0;
-    QTextCharFormat currentFormat;
-    currentFormat.setForeground(DefaultForeground);
-    currentFormat.setBackground(DefaultBackground);
-
-    while (it.hasNext()) {
-        QRegularExpressionMatch match = it.next();
-        QString before = text.mid(lastPos, match.capturedStart() - lastPos);
-        cursor.insertText(before, currentFormat);
-
-        QString codes = match.captured(1);
-        QString command = match.captured(2);
-
-        if (command == "m") {
-            QStringList codeList = codes.split(';');
-            for (const QString &code : codeList) {
-                int codeInt = code.toInt();
-                
-                if (codeInt == 0) {
-                    currentFormat = QTextCharFormat();
-                    currentFormat.setForeground(DefaultForeground);
-                    currentFormat.setBackground(DefaultBackground);
-                }
-                else if (codeInt == 1) {
-                    QFont font = currentFormat.font();
-                    font.setBold(true);
-                    currentFormat.setFont(font);
-                }
-                else if (codeInt == 2) {
-                    QFont font = currentFormat.font();
-                    font.setBold(false);
-                    currentFormat.setFont(font);
-                }
-                else if (codeInt == 3) {
-                    QFont font = currentFormat.font();
-                    font.setItalic(true);
-                    currentFormat.setFont(font);
-                }
-                else if (codeInt == 4) {
-                    QFont font = currentFormat.font();
-                    font.setUnderline(true);
-                    currentFormat.setFont(font);
-                }
-                else if (codeInt >= 30 && codeInt <= 37) {
-                    currentFormat.setForeground(getAnsiColor(codeInt - 30, false));
-                }
-                else if (codeInt >= 90 && codeInt <= 97) {
-                    currentFormat.setForeground(getAnsiColor(codeInt - 90, true));
-                }
-                else if (codeInt >= 40 && codeInt <= 47) {
-                    currentFormat.setBackground(getAnsiColor(codeInt - 40, false));
-                }
-                else if (codeInt >= 100 && codeInt <= 107) {
-                    currentFormat.setBackground(getAnsiColor(codeInt - 100, true));
-                }
-            }
+    QByteArray text;
+    if (modifiers & Qt::ControlModifier) {
+        const int key = event->key();
+        if (key >= Qt::Key_A && key <= Qt::Key_Z) {
+            text = QByteArray(1, char(key - Qt::Key_A + 1));
+        } else if (key == Qt::Key_Space || key == Qt::Key_At) {
+            text = QByteArray(1, '\0');
+        } else if (key >= Qt::Key_BracketLeft && key <= Qt::Key_Underscore) {
+            // Ctrl+[ \ ] ^ _ are ESC, FS, GS, RS and US
+            text = QByteArray(1, char(key - Qt::Key_BracketLeft + 0x1b));
         }
-
-        lastPos = match.capturedEnd();
     }
-
-    QString remaining = text.mid(lastPos);
-    cursor.insertText(remaining, currentFormat);
-
-    terminal->setTextCursor(cursor);
-    terminal->ensureCursorVisible();
-}
-
-void TerminalWidget::setIntelligentIndent(bool enabled) {
-    m_intelligentIndent = enabled;
-}
-
-QString TerminalWidget::getIndentString() const {
-    return "    "; // 4 spaces for indentation
-}
-
-int TerminalWidget::getIndentLevel(const QString &text) const {
-    int spaces = 0;
-    for (QChar c : text) {
-        if (c == ' ') spaces++;
-        else if (c == '\t') spaces += 4;
-        else break;
+    if (text.isEmpty()) {
+        text = event->text().toUtf8();
     }
-    return spaces / 4;
-}
-
-void TerminalWidget::handleIndent(bool indent) {
-    if (!m_intelligentIndent) return;
-
-    QTextCursor cursor = terminal->textCursor();
-    
-    // Get the selected text or current line
-    QString selectedText = cursor.selectedText();
-    bool hasSelection = !selectedText.isEmpty();
-    
-    if (!hasSelection) {
-        // If no selection, select the current line
-        cursor.movePosition(QTextCursor::StartOfLine);
-        cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-        selectedText = cursor.selectedText();
-    }
-    
-    // Split into lines
-    QStringList lines = selectedText.split(QChar::ParagraphSeparator);
-    
-    // Process each line
-    for (int i = 0; i < lines.size(); ++i) {
-        QString &line = lines[i];
-        if (indent) {
-            // Add indentation
-            line.prepend(getIndentString());
-        } else {
-            // Remove indentation if exists
-            if (line.startsWith(getIndentString())) {
-                line.remove(0, getIndentString().length());
-            } else if (line.startsWith("\t")) {
-                line.remove(0, 1);
-            }
-        }
-    }
-    
-    // Join lines back together
-    QString newText = lines.join("\n");
-    
-    // Replace the text
-    cursor.beginEditBlock();
-    cursor.removeSelectedText();
-    cursor.insertText(newText);
-    cursor.endEditBlock();
-    
-    // Maintain selection if there was one
-    if (hasSelection) {
-        int start = cursor.position() - newText.length();
-        int end = cursor.position();
-        cursor.setPosition(start);
-        cursor.setPosition(end, QTextCursor::KeepAnchor);
-        terminal->setTextCursor(cursor);
+    // Alt sends the key prefixed with ESC, as readline expects of Meta
+    if (!text.isEmpty() && (modifiers & Qt::AltModifier)) {
+        text.prepend('\x1b');
     }
+    return text;
 }
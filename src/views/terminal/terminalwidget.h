@@ -1,14 +1,19 @@
 #pragma once
-#include <QPlainTextEdit>
-#include <QProcess>
-#include <QTextCharFormat>
+#include "views/terminal/ptysession.h"
+#include "views/terminal/terminalscreen.h"
+#include "views/terminal/terminalview.h"
+#include "views/terminal/vtparser.h"
 #include <QWidget>
 
+// A terminal tab or split: one long-lived shell on a pseudo-terminal. Keys
+// go to the shell as a terminal would send them; its output is played onto
+// a TerminalScreen and drawn by a TerminalView.
 class TerminalWidget : public QWidget {
   Q_OBJECT
 
 public:
   explicit TerminalWidget(QWidget *parent = nullptr);
+  // Where the shell starts; it has no effect once the shell is running
   void setWorkingDirectory(const QString &path);
   void setFontSize(int size);
   void zoomIn();
@@ -17,8 +22,6 @@ public:
   void find();
   void findNext();
   void findPrevious();
-  void setIntelligentIndent(bool enabled);
-  bool intelligentIndentEnabled() const { return m_intelligentIndent; }
 
 signals:
   void closeRequested();
@@ -27,68 +30,32 @@ signals:
 protected:
   void contextMenuEvent(QContextMenuEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
+  void showEvent(QShowEvent *event) override;
 
 private:
-  QProcess *process;
-  QPlainTextEdit *terminal;
+  PtySession *session;
+  TerminalScreen terminalScreen;
+  VtParser parser;
+  TerminalView *view;
   QString currentWorkingDirectory;
-  QString username;
-  QString hostname;
-  QStringList commandHistory;
-  int historyIndex;
-  int promptPosition;
-  QString previousWorkingDirectory;
   QString searchString;
   int baseFontSize;
-  bool ctrlPressed;
-  bool m_intelligentIndent;
 
   void setupUI();
-  void setupProcess();
-  void executeCommand(const QString &command);
-  void appendOutput(const QString &text,
-                    const QColor &color = QColor("#D4D4D4"));
-  QString getColoredPrompt() const;
-  void displayPrompt();
-  void handleInput(QKeyEvent *event);
-  void handleCommandExecution();
-  void handleHistoryNavigation(bool up);
-  QString getCurrentCommand() const;
-  void setCurrentCommand(const QString &command);
-  bool isInPromptArea() const;
-  void handleCtrlC();
-  void handleCtrlL();
-  void handleCtrlD();
-  void handleCdCommand(const QString &command);
-  void handleTabCompletion();
-  void handleIndent(bool indent);
-  QString getIndentString() const;
-  int getIndentLevel(const QString &text) const;
-  QStringList getCompletions(const QString &prefix) const;
-  void showCompletions(const QStringList &completions);
-  void appendFormattedOutput(const QString &text);
+  void setupSession();
+  void startShell();
+  void resizeGrid(int rows, int columns);
   void createContextMenu(const QPoint &pos);
-  void searchHistory(const QString &searchTerm);
   void copySelectedText();
   void pasteClipboard();
   void selectAll();
   void clearScrollback();
   void handleZoom(int delta);
-  void updateFont();
-  void highlightSearchText();
   void setupShortcuts();
-  static QColor getAnsiColor(int colorCode, bool bright = false);
-  static QString getAnsiColorTable();
-  
-  // Constants for ANSI colors
-  static const QColor DefaultForeground;
-  static const QColor DefaultBackground;
-  static const QVector<QColor> AnsiColors;
-  static const QVector<QColor> AnsiBrightColors;
+  static QByteArray keySequence(const QKeyEvent *event, bool applicationCursorKeys);
 
 private slots:
-  void onReadyReadStandardOutput();
-  void onReadyReadStandardError();
-  void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+  void onDataReceived(const QByteArray &data);
+  void onShellFinished(int exitCode);
   bool eventFilter(QObject *obj, QEvent *event) override;
 };
@@ -0,0 +1,303 @@
+#include "vtparser.h"
+
+namespace {
+constexpr char32_t kReplacementCharacter = 0xFFFD;
+
+enum State : quint8 {
+    Ground,
+    Escape,
+    EscapeIntermediate,
+    CsiEntry,
+    CsiParam,
+    CsiIntermediate,
+    CsiIgnore,
+    DcsEntry,
+    DcsParam,
+    DcsIntermediate,
+    DcsPassthrough,
+    DcsIgnore,
+    OscString,
+    // SOS, PM and APC strings
+    StringIgnore,
+    StateCount
+};
+
+enum Action : quint8 {
+    NoAction,
+    Print,
+    Execute,
+    Collect,
+    Param,
+    EscDispatch,
+    CsiDispatch,
+    OscPut,
+};
+
+// For each state and 7-bit byte, the action in the low four bits and the
+// next state in the high four
+struct TransitionTable {
+    quint8 entries[StateCount][128] = {};
+
+    constexpr void set(int state, int first, int last, Action action, int next) {
+        for (int byte = first; byte <= last; ++byte) {
+            entries[state][byte] = quint8(action | next << 4);
+        }
+    }
+    constexpr void stay(int state, int first, int last, Action action) {
+        set(state, first, last, action, state);
+    }
+
+    constexpr TransitionTable() {
+        for (int state = 0; state < StateCount; ++state) {
+            stay(state, 0x00, 0x7F, NoAction);
+        }
+
+        stay(Ground, 0x00, 0x1F, Execute);
+        stay(Ground, 0x20, 0x7E, Print);
+
+        stay(Escape, 0x00, 0x1F, Execute);
+        set(Escape, 0x20, 0x2F, Collect, EscapeIntermediate);
+        set(Escape, 0x30, 0x7E, EscDispatch, Ground);
+        set(Escape, 'P', 'P', NoAction, DcsEntry);
+        set(Escape, '[', '[', NoAction, CsiEntry);
+        set(Escape, ']', ']', NoAction, OscString);
+        set(Escape, 'X', 'X', NoAction, StringIgnore);
+        set(Escape, '^', '_', NoAction, StringIgnore);
+
+        stay(EscapeIntermediate, 0x00, 0x1F, Execute);
+        stay(EscapeIntermediate, 0x20, 0x2F, Collect);
+        set(EscapeIntermediate, 0x30, 0x7E, EscDispatch, Ground);
+
+        // ':' is taken as a parameter separator, for SGR subparameters
+        stay(CsiEntry, 0x00, 0x1F, Execute);
+        set(CsiEntry, 0x20, 0x2F, Collect, CsiIntermediate);
+        set(CsiEntry, 0x30, 0x3B, Param, CsiParam);
+        set(CsiEntry, 0x3C, 0x3F, Collect, CsiParam);
+        set(CsiEntry, 0x40, 0x7E, CsiDispatch, Ground);
+
+        stay(CsiParam, 0x00, 0x1F, Execute);
+        stay(CsiParam, 0x30, 0x3B, Param);
+        set(CsiParam, 0x3C, 0x3F, NoAction, CsiIgnore);
+        set(CsiParam, 0x20, 0x2F, Collect, CsiIntermediate);
+        set(CsiParam, 0x40, 0x7E, CsiDispatch, Ground);
+
+        stay(CsiIntermediate, 0x00, 0x1F, Execute);
+        stay(CsiIntermediate, 0x20, 0x2F, Collect);
+        set(CsiIntermediate, 0x30, 0x3F, NoAction, CsiIgnore);
+        set(CsiIntermediate, 0x40, 0x7E, CsiDispatch, Ground);
+
+        stay(CsiIgnore, 0x00, 0x1F, Execute);
+        set(CsiIgnore, 0x40, 0x7E, NoAction, Ground);
+
+        set(DcsEntry, 0x20, 0x2F, Collect, DcsIntermediate);
+        set(DcsEntry, 0x30, 0x3B, Param, DcsParam);
+        set(DcsEntry, 0x3C, 0x3F, Collect, DcsParam);
+        set(DcsEntry, 0x40, 0x7E, NoAction, DcsPassthrough);
+
+        stay(DcsParam, 0x30, 0x3B, Param);
+        set(DcsParam, 0x3C, 0x3F, NoAction, DcsIgnore);
+        set(DcsParam, 0x20, 0x2F, Collect, DcsIntermediate);
+        set(DcsParam, 0x40, 0x7E, NoAction, DcsPassthrough);
+
+        stay(DcsIntermediate, 0x20, 0x2F, Collect);
+        set(DcsIntermediate, 0x30, 0x3F, NoAction, DcsIgnore);
+        set(DcsIntermediate, 0x40, 0x7E, NoAction, DcsPassthrough);
+
+        // Ended by ST, or by BEL as xterm allows
+        stay(OscString, 0x20, 0x7F, OscPut);
+        set(OscString, 0x07, 0x07, NoAction, Ground);
+
+        // From anywhere: CAN and SUB cancel the sequence, ESC starts another
+        for (int state = 0; state < StateCount; ++state) {
+            set(state, 0x18, 0x18, Execute, Ground);
+            set(state, 0x1A, 0x1A, Execute, Ground);
+            set(state, 0x1B, 0x1B, NoAction, Escape);
+        }
+    }
+};
+
+constexpr TransitionTable kTransitions;
+} // namespace
+
+VtParser::VtParser(TerminalScreen *screen) : m_screen(screen) {
+    reset();
+}
+
+void VtParser::reset() {
+    m_state = Ground;
+    clear();
+    m_oscLength = 0;
+    m_codepoint = 0;
+    m_utf8Remaining = 0;
+    m_utf8Lower = 0x80;
+    m_utf8Upper = 0xBF;
+}
+
+void VtParser::clear() {
+    m_params.count = 0;
+    m_params.subparameters = 0;
+    m_parameter = -1;
+    m_subparameter = false;
+    m_hasParameters = false;
+    m_privateMarker = 0;
+    m_intermediate = 0;
+    m_ignoreSequence = false;
+}
+
+void VtParser::feed(const char *data, qsizetype size) {
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    qsizetype i = 0;
+    while (i < size) {
+        const uchar byte = bytes[i];
+        if (m_state == Ground && m_utf8Remaining == 0 && byte >= 0x20 && byte < 0x7F) {
+            // Printable ASCII, the bulk of most output, goes in runs
+            qsizetype end = i + 1;
+            while (end < size && bytes[end] >= 0x20 && bytes[end] < 0x7F) {
+                ++end;
+            }
+            m_screen->printAscii(data + i, int(end - i));
+            i = end;
+            continue;
+        }
+        ++i;
+
+        if (byte >= 0x80) {
+            if (m_state == Ground) {
+                decodeUtf8(byte);
+            } else if (m_state == OscString) {
+                // Titles are UTF-8 too, decoded when the string ends
+                perform(OscPut, byte);
+            }
+            continue;
+        }
+        if (m_utf8Remaining > 0) {
+            // A character cut short
+            m_utf8Remaining = 0;
+            m_screen->print(kReplacementCharacter);
+        }
+
+        const quint8 entry = kTransitions.entries[m_state][byte];
+        const quint8 next = entry >> 4;
+        if (next == m_state) {
+            perform(entry & 0x0F, byte);
+            continue;
+        }
+        // Exit action, then the transition's, then the entry action
+        if (m_state == OscString) {
+            m_screen->oscDispatch(QByteArray::fromRawData(m_osc, m_oscLength));
+        }
+        perform(entry & 0x0F, byte);
+        m_state = next;
+        if (next == Escape || next == CsiEntry || next == DcsEntry) {
+            clear();
+        } else if (next == OscString) {
+            m_oscLength = 0;
+        }
+    }
+}
+
+void VtParser::perform(quint8 action, uchar byte) {
+    switch (action) {
+    case Print:
+        m_screen->print(byte);
+        break;
+    case Execute:
+        m_screen->executeControl(char(byte));
+        break;
+    case Collect:
+        if (byte >= 0x3C && byte <= 0x3F) {
+            m_privateMarker = char(byte);
+        } else {
+            m_ignoreSequence = m_ignoreSequence || m_intermediate != 0;
+            m_intermediate = char(byte);
+        }
+        break;
+    case Param:
+        m_hasParameters = true;
+        if (byte == ';' || byte == ':') {
+            finishParameter();
+            m_subparameter = byte == ':';
+        } else {
+            const int digit = byte - '0';
+            m_parameter = qMin((m_parameter < 0 ? 0 : m_parameter) * 10 + digit, 0xFFFF);
+        }
+        break;
+    case EscDispatch:
+        if (!m_ignoreSequence) {
+            m_screen->escDispatch(m_intermediate, char(byte));
+        }
+        break;
+    case CsiDispatch:
+        if (m_hasParameters) {
+            finishParameter();
+        }
+        if (!m_ignoreSequence) {
+            m_screen->csiDispatch(m_params, m_privateMarker, m_intermediate, char(byte));
+        }
+        break;
+    case OscPut:
+        if (m_oscLength < MaxOscLength) {
+            m_osc[m_oscLength++] = char(byte);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void VtParser::finishParameter() {
+    // Parameters past the last one kept are dropped, as xterm does
+    if (m_params.count < TerminalParams::Max) {
+        m_params.values[m_params.count] = m_parameter;
+        if (m_subparameter) {
+            m_params.subparameters |= 1u << m_params.count;
+        }
+        ++m_params.count;
+    }
+    m_parameter = -1;
+    m_subparameter = false;
+}
+
+void VtParser::decodeUtf8(uchar byte) {
+    if (m_utf8Remaining > 0) {
+        if (byte >= m_utf8Lower && byte <= m_utf8Upper) {
+            m_codepoint = m_codepoint << 6 | (byte & 0x3F);
+            m_utf8Lower = 0x80;
+            m_utf8Upper = 0xBF;
+            if (--m_utf8Remaining == 0) {
+                m_screen->print(m_codepoint);
+            }
+            return;
+        }
+        // What came before was malformed; this byte starts afresh
+        m_utf8Remaining = 0;
+        m_screen->print(kReplacementCharacter);
+    }
+
+    // The second byte's range rules out overlong forms, surrogates and
+    // anything past U+10FFFF
+    m_utf8Lower = 0x80;
+    m_utf8Upper = 0xBF;
+    if (byte >= 0xC2 && byte <= 0xDF) {
+        m_codepoint = byte & 0x1F;
+        m_utf8Remaining = 1;
+    } else if (byte >= 0xE0 && byte <= 0xEF) {
+        m_codepoint = byte & 0x0F;
+        m_utf8Remaining = 2;
+        if (byte == 0xE0) {
+            m_utf8Lower = 0xA0;
+        } else if (byte == 0xED) {
+            m_utf8Upper = 0x9F;
+        }
+    } else if (byte >= 0xF0 && byte <= 0xF4) {
+        m_codepoint = byte & 0x07;
+        m_utf8Remaining = 3;
+        if (byte == 0xF0) {
+            m_utf8Lower = 0x90;
+        } else if (byte == 0xF4) {
+            m_utf8Upper = 0x8F;
+        }
+    } else {
+        m_screen->print(kReplacementCharacter);
+    }
+}
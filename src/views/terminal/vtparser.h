@@ -0,0 +1,52 @@
+#pragma once
+#include "views/terminal/terminalscreen.h"
+#include <QByteArray>
+
+// Turns the bytes a terminal receives into calls on a TerminalScreen: a
+// table-driven state machine for the VT500 series, after Paul Williams'
+// DEC ANSI parser, with UTF-8 decoded as it arrives. All it keeps between
+// calls is fixed-size, so a character or escape sequence may be split
+// across reads anywhere, and nothing is allocated per byte.
+//
+// Bytes from 0x80 up are UTF-8, as in xterm's UTF-8 mode; the 8-bit C1
+// controls are not recognised. DCS strings are read through and dropped,
+// as are SOS, PM and APC ones.
+class VtParser {
+public:
+  explicit VtParser(TerminalScreen *screen);
+
+  void feed(const char *data, qsizetype size);
+  void feed(const QByteArray &data) { feed(data.constData(), data.size()); }
+  void reset();
+
+private:
+  static constexpr int MaxOscLength = 4096;
+
+  void perform(quint8 action, uchar byte);
+  void decodeUtf8(uchar byte);
+  void clear();
+  void finishParameter();
+
+  TerminalScreen *m_screen;
+  quint8 m_state;
+
+  // The control sequence being read
+  TerminalParams m_params;
+  int m_parameter;
+  bool m_subparameter;
+  bool m_hasParameters;
+  char m_privateMarker;
+  char m_intermediate;
+  // More intermediates than any sequence this knows has
+  bool m_ignoreSequence;
+
+  // The OSC string being read; anything past MaxOscLength is dropped
+  char m_osc[MaxOscLength];
+  int m_oscLength;
+
+  // The UTF-8 character being read
+  char32_t m_codepoint;
+  int m_utf8Remaining;
+  uchar m_utf8Lower;
+  uchar m_utf8Upper;
+};
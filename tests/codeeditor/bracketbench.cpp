@@ -0,0 +1,383 @@
+// Compares BracketMatcher's per-block index, the packed sorted bracket
+// arrays in each block's BlockData, with the whole-document AVL tree it
+// replaced. The document is a C++ source repeated to kTargetLines lines.
+// For both structures it reports the time and the number of heap
+// allocations to index the document, to take in a keystroke, and to look up
+// the pair of every bracket.
+//
+//   bracketbench <C++ source>
+//
+// The old tree is rebuilt from the whole text on every keystroke, as the
+// editor used to do; the index rescans only the edited block.
+#include "codeeditor/blockdata.h"
+#include "codeeditor/bracketmatching.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QRandomGenerator>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<qint64> g_allocations{0};
+}
+
+// Every allocation is counted. Qt's containers allocate with malloc() rather
+// than operator new, so on glibc malloc() itself is counted, which covers
+// both; elsewhere only operator new is.
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+void *realloc(void *pointer, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+constexpr bool kCountInNew = false;
+#else
+constexpr bool kCountInNew = true;
+#endif
+
+void *operator new(std::size_t size) {
+    if (kCountInNew) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void *pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+// About the size of a large source file
+constexpr int kTargetLines = 20000;
+// Keystrokes timed for each structure; the old tree is much slower per
+// keystroke, so it gets fewer
+constexpr int kKeystrokes = 2000;
+constexpr int kTreeKeystrokes = 20;
+
+// The matcher as it was before the per-block index: a pointer-based AVL
+// tree of every pair in the document, rebuilt from the whole text with one
+// node allocated per pair. Kept here only as the baseline.
+class AvlBracketTree {
+public:
+    AvlBracketTree() {
+        m_pairs['{'] = '}';
+        m_pairs['['] = ']';
+        m_pairs['('] = ')';
+        m_pairs['<'] = '>';
+        m_pairs['"'] = '"';
+        m_pairs['\''] = '\'';
+        m_pairs['`'] = '`';
+    }
+    ~AvlBracketTree() { clear(m_root); }
+    AvlBracketTree(const AvlBracketTree &) = delete;
+    AvlBracketTree &operator=(const AvlBracketTree &) = delete;
+
+    void update(const QString &text);
+    const BracketPair *find(int position) const;
+
+private:
+    struct Node {
+        BracketPair pair;
+        Node *left = nullptr;
+        Node *right = nullptr;
+        int height = 1;
+        explicit Node(const BracketPair &p) : pair(p) {}
+    };
+
+    bool isOpen(QChar ch) const { return QStringLiteral("([{<\"'`").contains(ch); }
+    bool isClose(QChar ch) const { return QStringLiteral(")]}>\"'`").contains(ch); }
+    QChar matching(QChar ch) const { return m_pairs.value(ch, ch); }
+    static int height(Node *node) { return node ? node->height : 0; }
+    static void updateHeight(Node *node) {
+        node->height = 1 + qMax(height(node->left), height(node->right));
+    }
+    static Node *rotateLeft(Node *x);
+    static Node *rotateRight(Node *y);
+    static Node *insert(Node *node, const BracketPair &pair);
+    static void clear(Node *node);
+
+    Node *m_root = nullptr;
+    QMap<QChar, QChar> m_pairs;
+};
+
+void AvlBracketTree::update(const QString &text) {
+    clear(m_root);
+    m_root = nullptr;
+
+    QVector<BracketPair> openBrackets;
+    int level = 0;
+    bool inString = false;
+    bool inComment = false;
+    QChar stringChar;
+
+    for (int i = 0; i < text.length(); i++) {
+        QChar ch = text[i];
+        if (ch == '/' && i + 1 < text.length() && text[i + 1] == '/') {
+            inComment = true;
+            continue;
+        }
+        if (ch == '\n') {
+            inComment = false;
+            continue;
+        }
+        if (inComment) {
+            continue;
+        }
+        if ((ch == '"' || ch == '\'' || ch == '`') && (i == 0 || text[i - 1] != '\\')) {
+            if (!inString) {
+                inString = true;
+                stringChar = ch;
+            } else if (ch == stringChar) {
+                inString = false;
+            }
+            continue;
+        }
+        if (inString) {
+            continue;
+        }
+
+        if (isOpen(ch)) {
+            openBrackets.push_back(BracketPair(i, -1, level++, ch, matching(ch)));
+        } else if (isClose(ch) && !openBrackets.isEmpty()) {
+            for (int j = openBrackets.size() - 1; j >= 0; j--) {
+                if (openBrackets[j].closePos == -1 && openBrackets[j].closeChar == ch) {
+                    openBrackets[j].closePos = i;
+                    m_root = insert(m_root, openBrackets[j]);
+                    level = j;
+                    openBrackets.resize(j);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const BracketPair &pair : openBrackets) {
+        BracketPair invalid = pair;
+        invalid.isInvalid = true;
+        m_root = insert(m_root, invalid);
+    }
+}
+
+const BracketPair *AvlBracketTree::find(int position) const {
+    const Node *current = m_root;
+    while (current) {
+        if (position == current->pair.openPos || position == current->pair.closePos) {
+            return &current->pair;
+        }
+        current = position < current->pair.openPos ? current->left : current->right;
+    }
+    return nullptr;
+}
+
+AvlBracketTree::Node *AvlBracketTree::rotateLeft(Node *x) {
+    Node *y = x->right;
+    x->right = y->left;
+    y->left = x;
+    updateHeight(x);
+    updateHeight(y);
+    return y;
+}
+
+AvlBracketTree::Node *AvlBracketTree::rotateRight(Node *y) {
+    Node *x = y->left;
+    y->left = x->right;
+    x->right = y;
+    updateHeight(y);
+    updateHeight(x);
+    return x;
+}
+
+AvlBracketTree::Node *AvlBracketTree::insert(Node *node, const BracketPair &pair) {
+    if (!node) {
+        return new Node(pair);
+    }
+    if (pair.openPos < node->pair.openPos) {
+        node->left = insert(node->left, pair);
+    } else if (pair.openPos > node->pair.openPos) {
+        node->right = insert(node->right, pair);
+    } else {
+        return node;
+    }
+
+    updateHeight(node);
+    const int balance = height(node->left) - height(node->right);
+    if (balance > 1 && pair.openPos < node->left->pair.openPos) {
+        return rotateRight(node);
+    }
+    if (balance < -1 && pair.openPos > node->right->pair.openPos) {
+        return rotateLeft(node);
+    }
+    if (balance > 1 && pair.openPos > node->left->pair.openPos) {
+        node->left = rotateLeft(node->left);
+        return rotateRight(node);
+    }
+    if (balance < -1 && pair.openPos < node->right->pair.openPos) {
+        node->right = rotateRight(node->right);
+        return rotateLeft(node);
+    }
+    return node;
+}
+
+void AvlBracketTree::clear(Node *node) {
+    if (node) {
+        clear(node->left);
+        clear(node->right);
+        delete node;
+    }
+}
+
+// Time and allocations of one measured step
+struct Cost {
+    qint64 nanoseconds = 0;
+    qint64 allocations = 0;
+};
+
+template <typename Function>
+Cost measure(Function function) {
+    QElapsedTimer timer;
+    const qint64 allocations = g_allocations.load(std::memory_order_relaxed);
+    timer.start();
+    function();
+    Cost cost;
+    cost.nanoseconds = timer.nsecsElapsed();
+    cost.allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+    return cost;
+}
+
+void printRow(const char *label, const Cost &tree, int treeCount, const Cost &index,
+              int indexCount) {
+    std::printf("%-24s %12.1f us %10.1f   %12.1f us %10.1f\n", label,
+                tree.nanoseconds / 1e3 / treeCount, double(tree.allocations) / treeCount,
+                index.nanoseconds / 1e3 / indexCount, double(index.allocations) / indexCount);
+}
+
+void printLookupRow(const Cost &tree, const Cost &index, int count) {
+    std::printf("%-24s %12.1f ns %10.3f   %12.1f ns %10.3f\n", "lookup (per bracket)",
+                double(tree.nanoseconds) / count, double(tree.allocations) / count,
+                double(index.nanoseconds) / count, double(index.allocations) / count);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    // Only QTextDocument is needed, which wants a GUI application for its
+    // fonts; no window is ever shown
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <C++ source>\n", argv[0]);
+        return 2;
+    }
+
+    QFile file(QString::fromLocal8Bit(argv[1]));
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::fprintf(stderr, "%s: %s\n", argv[1], qPrintable(file.errorString()));
+        return 1;
+    }
+    const QString source = QString::fromUtf8(file.readAll());
+    const int sourceLines = qMax(1, int(source.count(QLatin1Char('\n'))));
+    const QString text = source.repeated(qMax(1, kTargetLines / sourceLines));
+
+    QTextDocument document;
+    document.setPlainText(text);
+
+    BracketMatcher matcher;
+    AvlBracketTree tree;
+    const Cost indexBuild = measure([&] { matcher.setDocument(&document); });
+    const Cost treeBuild = measure([&] { tree.update(text); });
+
+    // Every bracket the index knows, in a fixed random order so neither
+    // structure is helped by walking the document in order
+    QVector<int> positions;
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        if (const BlockData *data = BlockData::get(block)) {
+            for (quint32 bracket : data->brackets) {
+                positions.append(block.position() + BlockData::bracketPosition(bracket));
+            }
+        }
+    }
+    QRandomGenerator random(9);
+    std::shuffle(positions.begin(), positions.end(), random);
+
+    qint64 checksum = 0;
+    const Cost treeLookup = measure([&] {
+        for (int position : std::as_const(positions)) {
+            if (const BracketPair *pair = tree.find(position)) {
+                checksum += pair->closePos;
+            }
+        }
+    });
+    const Cost indexLookup = measure([&] {
+        BracketPair pair;
+        for (int position : std::as_const(positions)) {
+            if (matcher.findMatchingBracket(position, &pair)) {
+                checksum += pair.closePos;
+            }
+        }
+    });
+
+    // The old editor rebuilt the tree from the text on every keystroke,
+    // whatever was typed
+    const Cost treeKeystroke = measure([&] {
+        for (int i = 0; i < kTreeKeystrokes; ++i) {
+            tree.update(text);
+        }
+    });
+
+    // Keystrokes spread over the document: a letter typed into a line, and
+    // a line break, which splices a block into the index. Only the index
+    // update is measured, not the document's own edit.
+    Cost indexTyping;
+    Cost indexNewLine;
+    QTextCursor cursor(&document);
+    for (int i = 0; i < kKeystrokes; ++i) {
+        const bool newLine = i % 2 == 1;
+        const int line = int(random.bounded(document.blockCount()));
+        const QTextBlock block = document.findBlockByNumber(line);
+        const int position = block.position() + block.length() / 2;
+        cursor.setPosition(position);
+        cursor.insertText(newLine ? QStringLiteral("\n") : QStringLiteral("x"));
+        const Cost cost = measure([&] { matcher.updateBlocks(position, 0, 1); });
+        Cost &total = newLine ? indexNewLine : indexTyping;
+        total.nanoseconds += cost.nanoseconds;
+        total.allocations += cost.allocations;
+    }
+
+    std::printf("%s repeated to %d lines, %lld characters, %lld brackets\n\n",
+                qPrintable(QFileInfo(file).fileName()), int(text.count(QLatin1Char('\n'))),
+                static_cast<long long>(text.size()), static_cast<long long>(positions.size()));
+    std::printf("%-24s %15s %10s   %15s %10s\n", "", "AVL tree", "allocs", "block index",
+                "allocs");
+    printRow("index the document", treeBuild, 1, indexBuild, 1);
+    printRow("type a letter", treeKeystroke, kTreeKeystrokes, indexTyping, kKeystrokes / 2);
+    printRow("type a line break", treeKeystroke, kTreeKeystrokes, indexNewLine, kKeystrokes / 2);
+    printLookupRow(treeLookup, indexLookup, qMax(1, int(positions.size())));
+    std::printf("\nchecksum %lld\n", static_cast<long long>(checksum));
+    return 0;
+}
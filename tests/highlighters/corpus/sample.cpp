@@ -0,0 +1,360 @@
+// A fixed C++ source for lexbench. It is not built; it only has to look like
+// the code the highlighter sees: long and short lines, every token kind, and
+// the constructs that carry state from one line to the next.
+#include "sample.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define SAMPLE_VERSION 0x010203
+#define SAMPLE_STRINGIFY(x) #x
+#define SAMPLE_CHECK(condition)                                                \
+  do {                                                                         \
+    if (!(condition))                                                          \
+      reportFailure(__FILE__, __LINE__, SAMPLE_STRINGIFY(condition));          \
+  } while (false)
+
+#if defined(_WIN32) && !defined(SAMPLE_NO_WINDOWS)
+#  define SAMPLE_EXPORT __declspec(dllexport)
+#elif __GNUC__ >= 4
+#  define SAMPLE_EXPORT __attribute__((visibility("default")))
+#else
+#  define SAMPLE_EXPORT
+#endif
+
+/*
+ * A block comment that runs over several lines, as licence headers and
+ * documentation blocks do. The lexer has to carry the open comment from
+ * one line to the next and find the end on a later one.
+ */
+
+namespace sample {
+namespace detail {
+
+constexpr std::uint32_t kMagic = 0xDEADBEEFu;
+constexpr double kPi = 3.14159265358979323846;
+constexpr float kEpsilon = 1.0e-6f;
+constexpr long long kBig = 9'223'372'036'854'775'807LL;
+constexpr unsigned kMask = 0b1010'1010u;
+constexpr auto kOctal = 0755;
+constexpr char kNewline = '\n';
+constexpr char16_t kSnowman = u'☃';
+constexpr char32_t kGrin = U'\U0001F600';
+constexpr wchar_t kWide = L'w';
+
+inline int clampIndex(int index, int size) noexcept {
+  return index < 0 ? 0 : (index >= size ? size - 1 : index);
+}
+
+template <typename T, typename Compare = std::less<T>>
+const T &clamp(const T &value, const T &low, const T &high,
+               Compare compare = Compare()) {
+  return compare(value, low) ? low : (compare(high, value) ? high : value);
+}
+
+} // namespace detail
+
+enum class Colour : std::uint8_t { Red = 1, Green = 2, Blue = 4 };
+
+struct Point {
+  int x = 0;
+  int y = 0;
+
+  constexpr Point operator+(const Point &other) const {
+    return {x + other.x, y + other.y};
+  }
+  constexpr bool operator==(const Point &other) const {
+    return x == other.x && y == other.y;
+  }
+  constexpr bool operator!=(const Point &other) const { return !(*this == other); }
+};
+
+class SAMPLE_EXPORT Shape {
+public:
+  explicit Shape(std::string name) : m_name(std::move(name)) {}
+  virtual ~Shape() = default;
+  Shape(const Shape &) = delete;
+  Shape &operator=(const Shape &) = delete;
+
+  virtual double area() const = 0;
+  virtual double perimeter() const = 0;
+  const std::string &name() const { return m_name; }
+
+protected:
+  static double square(double value) { return value * value; }
+
+private:
+  std::string m_name;
+};
+
+class Circle final : public Shape {
+public:
+  explicit Circle(double radius) : Shape("circle"), m_radius(radius) {}
+
+  double area() const override { return detail::kPi * square(m_radius); }
+  double perimeter() const override { return 2.0 * detail::kPi * m_radius; }
+
+private:
+  double m_radius;
+};
+
+class Rectangle : public Shape {
+public:
+  Rectangle(double width, double height)
+      : Shape("rectangle"), m_width(width), m_height(height) {}
+
+  double area() const override { return m_width * m_height; }
+  double perimeter() const override { return 2.0 * (m_width + m_height); }
+
+private:
+  double m_width;
+  double m_height;
+};
+
+// Strings with escapes, prefixes and quotes inside them
+const char *const kMessages[] = {
+    "plain text",
+    "escaped \"quotes\" and a backslash \\ at the end\\",
+    "tabs\tand\nnewlines\r\n",
+    u8"UTF-8: café, 世界",
+    "a // comment marker inside a string",
+    "a /* block comment marker */ inside a string",
+    "hex \x41\x42\x43 and octal \101\102\103",
+};
+
+const wchar_t *const kWideMessage = L"wide string";
+const char16_t *const kUtf16Message = u"UTF-16 string";
+const char32_t *const kUtf32Message = U"UTF-32 string";
+
+// Raw strings, one on a line and one spanning several
+const char *const kPattern = R"re(^\s*(\w+)\s*=\s*"([^"]*)"\s*$)re";
+const char *const kShader = R"glsl(
+#version 330 core
+layout(location = 0) in vec3 position;
+uniform mat4 transform;
+void main() {
+  // not a C++ comment: ")" alone does not end the string
+  gl_Position = transform * vec4(position, 1.0);
+}
+)glsl";
+
+template <typename Key, typename Value>
+class LruCache {
+public:
+  explicit LruCache(std::size_t capacity) : m_capacity(capacity) {}
+
+  std::optional<Value> get(const Key &key) {
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return std::nullopt;
+    touch(it->second);
+    return it->second->second;
+  }
+
+  void put(const Key &key, Value value) {
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      it->second->second = std::move(value);
+      touch(it->second);
+      return;
+    }
+    if (m_entries.size() >= m_capacity && !m_entries.empty()) {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+    }
+    m_entries.emplace_front(key, std::move(value));
+    m_index[key] = m_entries.begin();
+  }
+
+  std::size_t size() const noexcept { return m_entries.size(); }
+
+private:
+  using Entry = std::pair<Key, Value>;
+  using List = std::list<Entry>;
+
+  void touch(typename List::iterator it) {
+    m_entries.splice(m_entries.begin(), m_entries, it);
+  }
+
+  std::size_t m_capacity;
+  List m_entries;
+  std::unordered_map<Key, typename List::iterator> m_index;
+};
+
+template <typename Range, typename Predicate>
+auto countIf(const Range &range, Predicate predicate)
+    -> decltype(std::distance(std::begin(range), std::end(range))) {
+  return std::count_if(std::begin(range), std::end(range), predicate);
+}
+
+template <typename T>
+concept Numeric = std::is_arithmetic_v<T>;
+
+template <Numeric T>
+constexpr T lerp(T from, T to, double amount) requires(sizeof(T) <= 8) {
+  return static_cast<T>(from + (to - from) * amount);
+}
+
+std::vector<std::unique_ptr<Shape>> makeShapes(int count) {
+  std::vector<std::unique_ptr<Shape>> shapes;
+  shapes.reserve(static_cast<std::size_t>(count));
+  for (int i = 0; i < count; ++i) {
+    if (i % 3 == 0)
+      shapes.push_back(std::make_unique<Circle>(0.5 * i + 1.0));
+    else
+      shapes.push_back(std::make_unique<Rectangle>(i + 1.0, 2.0 * i + 0.25));
+  }
+  return shapes;
+}
+
+double totalArea(const std::vector<std::unique_ptr<Shape>> &shapes) {
+  double total = 0.0;
+  for (const auto &shape : shapes) {
+    total += shape->area(); // Accumulated in order; the sum is not sorted
+  }
+  return total;
+}
+
+std::map<std::string, int> countWords(std::string_view text) {
+  std::map<std::string, int> counts;
+  std::size_t start = 0;
+  while (start < text.size()) {
+    while (start < text.size() && (text[start] == ' ' || text[start] == '\t'))
+      ++start;
+    std::size_t end = start;
+    while (end < text.size() && text[end] != ' ' && text[end] != '\t')
+      ++end;
+    if (end > start)
+      ++counts[std::string(text.substr(start, end - start))];
+    start = end;
+  }
+  return counts;
+}
+
+int parseInteger(std::string_view text, int fallback = -1) {
+  if (text.empty())
+    return fallback;
+  bool negative = text.front() == '-';
+  std::size_t i = negative || text.front() == '+' ? 1 : 0;
+  long long value = 0;
+  for (; i < text.size(); ++i) {
+    const char c = text[i];
+    if (c < '0' || c > '9')
+      return fallback;
+    value = value * 10 + (c - '0');
+    if (value > 0x7fffffffLL)
+      return fallback;
+  }
+  return static_cast<int>(negative ? -value : value);
+}
+
+std::uint32_t hash(std::string_view text) {
+  std::uint32_t h = 2166136261u;
+  for (unsigned char c : text) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15) ^ detail::kMagic;
+}
+
+class EventQueue {
+public:
+  using Handler = std::function<void(int)>;
+
+  void subscribe(int type, Handler handler) {
+    m_handlers[type].push_back(std::move(handler));
+  }
+
+  void post(int type, int payload) { m_pending.emplace_back(type, payload); }
+
+  int dispatch() {
+    int delivered = 0;
+    std::vector<std::pair<int, int>> pending;
+    pending.swap(m_pending);
+    for (const auto &[type, payload] : pending) {
+      auto it = m_handlers.find(type);
+      if (it == m_handlers.end())
+        continue;
+      for (const Handler &handler : it->second) {
+        handler(payload);
+        ++delivered;
+      }
+    }
+    return delivered;
+  }
+
+private:
+  std::unordered_map<int, std::vector<Handler>> m_handlers;
+  std::vector<std::pair<int, int>> m_pending;
+};
+
+Colour mix(Colour a, Colour b) {
+  return static_cast<Colour>(static_cast<std::uint8_t>(a) |
+                             static_cast<std::uint8_t>(b));
+}
+
+const char *colourName(Colour colour) {
+  switch (colour) {
+  case Colour::Red:
+    return "red";
+  case Colour::Green:
+    return "green";
+  case Colour::Blue:
+    return "blue";
+  default:
+    return "mixed";
+  }
+}
+
+void reportFailure(const char *file, int line, const char *condition) {
+  static thread_local int failures = 0;
+  ++failures;
+  (void)file;
+  (void)line;
+  (void)condition;
+}
+
+int selfTest() {
+  SAMPLE_CHECK(detail::clampIndex(-5, 10) == 0);
+  SAMPLE_CHECK(detail::clampIndex(50, 10) == 9);
+  SAMPLE_CHECK(parseInteger("-1234") == -1234);
+  SAMPLE_CHECK(parseInteger("12a") == -1);
+  SAMPLE_CHECK(lerp(0, 100, 0.25) == 25);
+  SAMPLE_CHECK(mix(Colour::Red, Colour::Blue) != Colour::Green);
+
+  LruCache<std::string, int> cache(2);
+  cache.put("one", 1);
+  cache.put("two", 2);
+  cache.put("three", 3);
+  SAMPLE_CHECK(!cache.get("one").has_value());
+  SAMPLE_CHECK(cache.get("three").value_or(0) == 3);
+
+  EventQueue queue;
+  int sum = 0;
+  queue.subscribe(1, [&sum](int value) { sum += value; });
+  queue.subscribe(1, [&sum](int value) { sum -= value / 2; });
+  queue.post(1, 10);
+  queue.post(2, 99);
+  SAMPLE_CHECK(queue.dispatch() == 2 && sum == 5);
+
+  auto shapes = makeShapes(12);
+  SAMPLE_CHECK(totalArea(shapes) > 0.0);
+  SAMPLE_CHECK(countIf(shapes, [](const auto &shape) {
+                 return shape->name() == "circle";
+               }) == 4);
+
+  const auto counts = countWords("the quick brown fox jumps over the lazy dog");
+  SAMPLE_CHECK(counts.at("the") == 2);
+  return hash(kMessages[0]) == 0 ? 1 : 0; /* never zero in practice */
+}
+
+} // namespace sample
@@ -0,0 +1,111 @@
+// Times CppLexer::tokenize over C/C++ sources. Each file is tokenized line by
+// line with the block state carried from one line to the next, as
+// CppHighlighter does, into one reused token vector, and the throughput is
+// reported in MB/s of UTF-8 source.
+//
+//   lexbench <directory or source file>...
+//
+// Exits non-zero if a file ends inside a block comment or raw string, which
+// would mean a multi-line construct was never closed.
+#include "highlighters/cpplexer.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QVector>
+#include <cstdio>
+
+namespace {
+// Each file is tokenized for at least this long when timing
+constexpr qint64 kTimingMs = 250;
+
+// Runs the lexer over every line once; returns the state after the last
+int tokenizeLines(const QVector<QStringView> &lines, QVector<CppLexer::Token> *tokens,
+                  qint64 *tokenCount) {
+    int state = CppLexer::Normal;
+    for (QStringView line : lines) {
+        tokens->clear();
+        state = CppLexer::tokenize(line, state, tokens);
+        *tokenCount += tokens->size();
+    }
+    return state;
+}
+
+bool bench(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::fprintf(stderr, "%s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    const QString text = QString::fromUtf8(data);
+    const QString name = QFileInfo(path).fileName();
+
+    // Lines as the document's blocks hold them, without the line break
+    QVector<QStringView> lines;
+    qsizetype start = 0;
+    while (start <= text.size()) {
+        qsizetype end = text.indexOf(QLatin1Char('\n'), start);
+        if (end < 0) {
+            end = text.size();
+        }
+        qsizetype length = end - start;
+        if (length > 0 && text[end - 1] == QLatin1Char('\r')) {
+            --length;
+        }
+        lines.append(QStringView(text).mid(start, length));
+        start = end + 1;
+    }
+
+    QVector<CppLexer::Token> tokens;
+    qint64 tokensPerPass = 0;
+    const int finalState = tokenizeLines(lines, &tokens, &tokensPerPass);
+    if (finalState != CppLexer::Normal) {
+        std::printf("%-20s %8lld bytes  FAILED: ends in state %d\n", qPrintable(name),
+                    static_cast<long long>(data.size()), finalState);
+        return false;
+    }
+
+    qint64 bytes = 0;
+    qint64 tokenCount = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        tokenizeLines(lines, &tokens, &tokenCount);
+        bytes += data.size();
+    } while (timer.elapsed() < kTimingMs);
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    std::printf("%-20s %8lld bytes %6lld lines %7lld tokens  %8.1f MB/s\n", qPrintable(name),
+                static_cast<long long>(data.size()), static_cast<long long>(lines.size()),
+                static_cast<long long>(tokensPerPass), bytes / seconds / 1e6);
+    return true;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    const QStringList filters = {"*.c", "*.cc", "*.cpp", "*.cxx", "*.h", "*.hh", "*.hpp"};
+    QStringList paths;
+    for (int i = 1; i < argc; ++i) {
+        const QString argument = QString::fromLocal8Bit(argv[i]);
+        if (QFileInfo(argument).isDir()) {
+            const QDir dir(argument);
+            for (const QString &entry : dir.entryList(filters, QDir::Files, QDir::Name)) {
+                paths.append(dir.filePath(entry));
+            }
+        } else {
+            paths.append(argument);
+        }
+    }
+    if (paths.isEmpty()) {
+        std::fprintf(stderr, "usage: %s <directory or source file>...\n", argv[0]);
+        return 2;
+    }
+
+    bool passed = true;
+    for (const QString &path : paths) {
+        passed = bench(path) && passed;
+    }
+    return passed ? 0 : 1;
+}
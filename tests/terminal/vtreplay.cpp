@@ -0,0 +1,153 @@
+// Replays recorded terminal output through VtParser. Each recording is fed
+// once in one piece and once a byte at a time, which splits every escape
+// sequence and UTF-8 character at every possible point, and the two screens
+// must come out the same. Then the parser is timed over the recording.
+//
+//   vtreplay <directory or .vt file>...
+//
+// Exits non-zero if any recording leaves different screens.
+#include "views/terminal/terminalscreen.h"
+#include "views/terminal/vtparser.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <cstdio>
+
+namespace {
+// The size the recordings were made at
+constexpr int kRows = 24;
+constexpr int kColumns = 80;
+// Each recording is replayed for at least this long when timing
+constexpr qint64 kTimingMs = 250;
+
+QString describeCell(const TerminalCell &cell) {
+    return QString("U+%1 flags %2 fg %3 bg %4")
+        .arg(uint(cell.codepoint), 4, 16, QChar('0'))
+        .arg(uint(cell.flags), 0, 16)
+        .arg(cell.foreground, 0, 16)
+        .arg(cell.background, 0, 16);
+}
+
+// The first difference between the two screens, or an empty string
+QString compareScreens(TerminalScreen &whole, TerminalScreen &split) {
+    if (whole.lineCount() != split.lineCount()) {
+        return QString("%1 lines against %2").arg(whole.lineCount()).arg(split.lineCount());
+    }
+    if (whole.droppedLines() != split.droppedLines()) {
+        return QString("%1 dropped lines against %2")
+            .arg(whole.droppedLines())
+            .arg(split.droppedLines());
+    }
+    if (whole.cursorRow() != split.cursorRow() || whole.cursorColumn() != split.cursorColumn()) {
+        return QString("cursor at %1,%2 against %3,%4")
+            .arg(whole.cursorRow())
+            .arg(whole.cursorColumn())
+            .arg(split.cursorRow())
+            .arg(split.cursorColumn());
+    }
+    if (whole.isCursorVisible() != split.isCursorVisible() ||
+        whole.isAlternateScreen() != split.isAlternateScreen() ||
+        whole.applicationCursorKeys() != split.applicationCursorKeys() ||
+        whole.bracketedPaste() != split.bracketedPaste()) {
+        return QString("modes differ");
+    }
+    if (whole.title() != split.title()) {
+        return QString("title \"%1\" against \"%2\"").arg(whole.title(), split.title());
+    }
+    if (whole.takeResponse() != split.takeResponse()) {
+        return QString("responses differ");
+    }
+
+    for (int line = 0; line < whole.lineCount(); ++line) {
+        if (whole.isWrapped(line) != split.isWrapped(line)) {
+            return QString("line %1 wrapped differently").arg(line);
+        }
+        const TerminalCell *a = whole.line(line);
+        const TerminalCell *b = split.line(line);
+        for (int column = 0; column < whole.columns(); ++column) {
+            if (a[column].codepoint != b[column].codepoint || a[column].flags != b[column].flags ||
+                a[column].foreground != b[column].foreground ||
+                a[column].background != b[column].background) {
+                return QString("line %1 column %2: %3 against %4")
+                    .arg(line)
+                    .arg(column)
+                    .arg(describeCell(a[column]), describeCell(b[column]));
+            }
+        }
+    }
+    return QString();
+}
+
+bool replay(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::fprintf(stderr, "%s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    const QString name = QFileInfo(path).fileName();
+
+    TerminalScreen whole(kRows, kColumns);
+    VtParser wholeParser(&whole);
+    wholeParser.feed(data);
+
+    TerminalScreen split(kRows, kColumns);
+    VtParser splitParser(&split);
+    for (qsizetype i = 0; i < data.size(); ++i) {
+        splitParser.feed(data.constData() + i, 1);
+    }
+
+    const QString difference = compareScreens(whole, split);
+    if (!difference.isEmpty()) {
+        std::printf("%-20s %8lld bytes  FAILED: %s\n", qPrintable(name),
+                    static_cast<long long>(data.size()), qPrintable(difference));
+        return false;
+    }
+
+    // One screen throughout, reset between passes, so the timing is of the
+    // parser and the grid rather than of allocating the scrollback
+    TerminalScreen screen(kRows, kColumns);
+    VtParser parser(&screen);
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        screen.reset();
+        parser.reset();
+        parser.feed(data);
+        bytes += data.size();
+    } while (timer.elapsed() < kTimingMs);
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    std::printf("%-20s %8lld bytes  identical  %8.1f MB/s\n", qPrintable(name),
+                static_cast<long long>(data.size()), bytes / seconds / 1e6);
+    return true;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QStringList paths;
+    for (int i = 1; i < argc; ++i) {
+        const QString argument = QString::fromLocal8Bit(argv[i]);
+        if (QFileInfo(argument).isDir()) {
+            const QDir dir(argument);
+            for (const QString &entry : dir.entryList({"*.vt"}, QDir::Files, QDir::Name)) {
+                paths.append(dir.filePath(entry));
+            }
+        } else {
+            paths.append(argument);
+        }
+    }
+    if (paths.isEmpty()) {
+        std::fprintf(stderr, "usage: %s <directory or .vt file>...\n", argv[0]);
+        return 2;
+    }
+
+    bool passed = true;
+    for (const QString &path : paths) {
+        passed = replay(path) && passed;
+    }
+    return passed ? 0 : 1;
+}